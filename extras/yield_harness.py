@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+#SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Run dumphfdl over a directory of I/Q recordings, report decoding yield
+# together with CPU and memory usage, and compare the results against
+# a stored baseline.
+#
+# Each recording must have a file with the same base name and .args
+# extension, containing the remaining dumphfdl command line arguments
+# (sampling rate, center frequency, channel frequencies), eg.:
+#
+#   recording_8900.cs16:
+#   recording_8900.args:    --sample-rate 250000 --centerfreq 8900 8885 8912 8927 8936 8942 8948 8957 8977
+#
+# The sample format is taken from the file extension (.cu8, .cs16 or .cf32).
+#
+import argparse
+import json
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+
+SAMPLE_FORMATS = { '.cu8': 'CU8', '.cs16': 'CS16', '.cf32': 'CF32' }
+COUNTERS = [ 'input_samples', 'frames_good', 'frames_bad_fcs', 'lpdus_good', 'lpdus_bad_fcs' ]
+STAGES = [ 'input', 'fft', 'channel', 'pdu', 'output' ]
+
+def find_recordings(corpus_dir):
+    result = []
+    for name in sorted(os.listdir(corpus_dir)):
+        base, ext = os.path.splitext(name)
+        if ext.lower() not in SAMPLE_FORMATS:
+            continue
+        args_file = os.path.join(corpus_dir, base + '.args')
+        if not os.path.isfile(args_file):
+            print(f"{name}: {base}.args not found, skipping", file=sys.stderr)
+            continue
+        with open(args_file) as f:
+            args = shlex.split(f.read(), comments=True)
+        result.append({
+            'name': name,
+            'path': os.path.join(corpus_dir, name),
+            'format': SAMPLE_FORMATS[ext.lower()],
+            'args': args
+        })
+    return result
+
+
+def run_recording(dumphfdl, rec, threaded):
+    with tempfile.NamedTemporaryFile(prefix='dumphfdl-runstats-', suffix='.json') as stats_file:
+        cmd = [ dumphfdl,
+                '--iq-file', rec['path'],
+                '--sample-format', rec['format'],
+                '--output', 'decoded:text:file:path=/dev/null',
+                '--run-stats-file', stats_file.name ]
+        if not threaded:
+            cmd.append('--deterministic')
+        cmd.extend(rec['args'])
+        print(f"{rec['name']}: {' '.join(shlex.quote(c) for c in cmd)}", file=sys.stderr)
+        proc = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+        if proc.returncode != 0:
+            print(proc.stderr, file=sys.stderr)
+            raise RuntimeError(f"{rec['name']}: dumphfdl exited with code {proc.returncode}")
+        with open(stats_file.name) as f:
+            return json.load(f)
+
+
+def ratio(a, b):
+    return a / b if b > 0 else 0.0
+
+
+# Sums the results of all recordings. Peak RSS is the maximum, not the sum.
+def compute_totals(results):
+    total = { c: 0 for c in COUNTERS }
+    total.update({ 'input_sec': 0.0, 'cpu_sec': 0.0, 'peak_rss_kb': 0 })
+    total['stage_cpu_sec'] = { s: 0.0 for s in STAGES }
+    for r in results.values():
+        for c in COUNTERS:
+            total[c] += r[c]
+        total['input_sec'] += r['input_sec']
+        total['cpu_sec'] += r['cpu_sec']
+        total['peak_rss_kb'] = max(total['peak_rss_kb'], r['peak_rss_kb'])
+        for s in STAGES:
+            total['stage_cpu_sec'][s] += r['stage_cpu_sec'].get(s, 0.0)
+    total['cpu_sec_per_input_sec'] = ratio(total['cpu_sec'], total['input_sec'])
+    total['lpdus_per_cpu_sec'] = ratio(total['lpdus_good'], total['cpu_sec'])
+    return total
+
+
+def print_report(report):
+    fmt = "{:<32} {:>8} {:>8} {:>8} {:>10} {:>10} {:>10}"
+    print(fmt.format('recording', 'frames', 'lpdus', 'bad_fcs', 'cpu/in_s', 'lpdu/cpu_s', 'rss_kB'))
+    rows = list(report['recordings'].items()) + [ ('TOTAL', report['total']) ]
+    for name, r in rows:
+        print(fmt.format(name[:32], r['frames_good'], r['lpdus_good'], r['frames_bad_fcs'],
+            f"{r['cpu_sec_per_input_sec']:.4f}", f"{r['lpdus_per_cpu_sec']:.2f}", r['peak_rss_kb']))
+    stages = report['total']['stage_cpu_sec']
+    print("Stage CPU time (s): " + ', '.join(f"{s}: {stages[s]:.2f}" for s in STAGES))
+
+
+# Returns a list of regressions. Yield may not drop by more than
+# yield_tol percent, yield per CPU-second by more than efficiency_tol
+# percent and peak RSS may not grow by more than rss_tol percent.
+def compare(report, baseline, yield_tol, efficiency_tol, rss_tol):
+    failures = []
+    cur = report['total']
+    base = baseline['total']
+    missing = set(baseline['recordings']) - set(report['recordings'])
+    if missing:
+        failures.append(f"recordings missing from this run: {', '.join(sorted(missing))}")
+    def check_drop(key, tol):
+        if cur[key] < base[key] * (1.0 - tol / 100.0):
+            failures.append(f"{key}: {cur[key]:.2f} < baseline {base[key]:.2f} - {tol}%")
+    check_drop('frames_good', yield_tol)
+    check_drop('lpdus_good', yield_tol)
+    check_drop('lpdus_per_cpu_sec', efficiency_tol)
+    if cur['peak_rss_kb'] > base['peak_rss_kb'] * (1.0 + rss_tol / 100.0):
+        failures.append(f"peak_rss_kb: {cur['peak_rss_kb']} > baseline {base['peak_rss_kb']} + {rss_tol}%")
+    for name, r in report['recordings'].items():
+        b = baseline['recordings'].get(name)
+        if b is not None and r['lpdus_good'] < b['lpdus_good'] * (1.0 - yield_tol / 100.0):
+            failures.append(f"{name}: lpdus_good: {r['lpdus_good']} < baseline {b['lpdus_good']} - {yield_tol}%")
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decoding yield vs CPU usage regression harness for dumphfdl')
+    parser.add_argument('--dumphfdl', default='dumphfdl', help='dumphfdl binary to test (default: dumphfdl)')
+    parser.add_argument('--corpus', required=True, help='directory with I/Q recordings and their .args files')
+    parser.add_argument('--threaded', action='store_true',
+            help='run in the normal multithreaded mode instead of --deterministic')
+    parser.add_argument('--report', help='write the report (JSON) to this file')
+    parser.add_argument('--baseline', help='compare the results against this report')
+    parser.add_argument('--yield-tolerance', type=float, default=0.5,
+            help='allowed drop in frames and LPDUs decoded, in percent (default: 0.5)')
+    parser.add_argument('--efficiency-tolerance', type=float, default=3.0,
+            help='allowed drop in LPDUs decoded per CPU-second, in percent (default: 3)')
+    parser.add_argument('--rss-tolerance', type=float, default=10.0,
+            help='allowed growth of peak RSS, in percent (default: 10)')
+    args = parser.parse_args()
+
+    recordings = find_recordings(args.corpus)
+    if not recordings:
+        print(f"No recordings found in {args.corpus}", file=sys.stderr)
+        return 2
+    results = {}
+    try:
+        for rec in recordings:
+            results[rec['name']] = run_recording(args.dumphfdl, rec, args.threaded)
+    except (RuntimeError, OSError) as e:
+        print(e, file=sys.stderr)
+        return 2
+    report = {
+        'mode': 'threaded' if args.threaded else 'deterministic',
+        'recordings': results,
+        'total': compute_totals(results)
+    }
+    print_report(report)
+    if args.report is not None:
+        with open(args.report, 'w') as f:
+            json.dump(report, f, indent=2)
+    if args.baseline is not None:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get('mode') != report['mode']:
+            print(f"Warning: baseline was made in {baseline.get('mode')} mode, this run is {report['mode']}",
+                    file=sys.stderr)
+        failures = compare(report, baseline, args.yield_tolerance, args.efficiency_tolerance, args.rss_tolerance)
+        if failures:
+            print("REGRESSION:\n  " + "\n  ".join(failures))
+            return 1
+        print("OK: no regression against the baseline")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
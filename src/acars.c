@@ -1,14 +1,15 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include <math.h>                   // trunc
+#include <string.h>                 // memcmp, strncpy
 #include <libacars/libacars.h>      // la_type_descriptor, la_proto_node, LA_MSG_DIR_*
-#include <libacars/reassembly.h>    // la_reasm_ctx
 #include <libacars/acars.h>         // la_acars_parse
 #include <libacars/adsc.h>          // la_adsc_*
 #include <libacars/dict.h>          // la_dict
 #include <libacars/list.h>          // la_list
+#include "reasm.h"                  // reasm_mgr, reasm_mgr_acars_parse
 #include "config.h"                 // WITH_STATSD
-#include "pdu.h"                    // enum hfdl_pdu_direction
-#include "position.h"               // position_info
+#include "pdu.h"                    // enum hfdl_pdu_direction, enum hfdl_pdu_decode_level
+#include "summary.h"                // struct msg_summary
 #include "statsd.h"                 // statsd_*
 #include "util.h"                   // ASSERT
 
@@ -19,19 +20,19 @@
 #ifdef WITH_STATSD
 static void update_statsd_acars_metrics(la_msg_dir msg_dir, la_proto_node *root);
 #endif
-static struct position_info *adsc_position_info_extract(la_proto_node *tree);
+static void adsc_summarize(la_adsc_msg_t const *msg, struct msg_summary *summary);
 
 /******************************
  * Public methods
  ******************************/
 
 la_proto_node *acars_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction direction,
-		la_reasm_ctx *reasm_ctx, struct timeval rx_timestamp) {
+		reasm_mgr reasm, struct timeval rx_timestamp) {
 	ASSERT(buf);
 	la_proto_node *node = NULL;
 	if(len > 0 && buf[0] == 1) {        // ACARS SOH byte
 		la_msg_dir msg_dir = (direction == UPLINK_PDU ? LA_MSG_DIR_GND2AIR : LA_MSG_DIR_AIR2GND);
-		node = la_acars_parse_and_reassemble(buf + 1, len - 1, msg_dir, reasm_ctx, rx_timestamp);
+		node = reasm_mgr_acars_parse(reasm, buf + 1, len - 1, msg_dir, rx_timestamp);
 #ifdef WITH_STATSD
 		update_statsd_acars_metrics(msg_dir, node);
 #endif
@@ -39,13 +40,41 @@ la_proto_node *acars_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction d
 	return node;
 }
 
-struct position_info *acars_position_info_extract(la_proto_node *tree) {
-	ASSERT(tree);
+// Checks whether an ACARS message is worth decoding at the given decode level.
+// Positions are extracted only from ADS-C reports, which are carried
+// in messages with the following labels, either directly or wrapped
+// in MIAM (label MA).
+bool acars_decode_wanted(uint8_t *buf, uint32_t len, enum hfdl_pdu_decode_level decode_level) {
+	static char const adsc_labels[][2] = { "A6", "B6", "H1", "MA" };
+	if(decode_level == PDU_DECODE_FULL) {
+		return true;
+	} else if(decode_level == PDU_DECODE_HEADERS) {
+		return false;
+	}
+	// SOH + mode + registration (7 chars) + ack + label (2 chars)
+	if(len < 12 || buf[0] != 1) {
+		return false;
+	}
+	for(size_t i = 0; i < sizeof(adsc_labels) / sizeof(adsc_labels[0]); i++) {
+		if(memcmp(buf + 10, adsc_labels[i], 2) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	struct position_info *pos_info = NULL;
-	pos_info = adsc_position_info_extract(tree);
+void acars_summarize(la_proto_node *node, struct msg_summary *summary) {
+	ASSERT(node);
+	ASSERT(summary);
 
-	return pos_info;
+	if(node->td == &la_DEF_acars_message) {
+		la_acars_msg const *amsg = node->data;
+		summary->acars_present = true;
+		summary->acars_crc_ok = amsg->crc_ok;
+		memcpy(summary->acars_label, amsg->label, sizeof(summary->acars_label));
+	} else if(node->td == &la_DEF_adsc_message) {
+		adsc_summarize(node->data, summary);
+	}
 }
 
 /****************************************
@@ -83,18 +112,10 @@ static void update_statsd_acars_metrics(la_msg_dir msg_dir, la_proto_node *root)
 }
 #endif
 
-static struct position_info *adsc_position_info_extract(la_proto_node *tree) {
-	ASSERT(tree);
-
-	struct position_info *pos_info = NULL;
-	la_proto_node *adsc_node = la_proto_tree_find_adsc(tree);
-	if(adsc_node == NULL) {
-		return NULL;
-	}
-	la_adsc_msg_t *msg = adsc_node->data;
+static void adsc_summarize(la_adsc_msg_t const *msg, struct msg_summary *summary) {
 	ASSERT(msg != NULL);
 	if(msg->err == true || msg->tag_list == NULL) {
-		return NULL;
+		return;
 	}
 	bool position_present = false;
 	bool icao_address_present = false;
@@ -144,30 +165,30 @@ static struct position_info *adsc_position_info_extract(la_proto_node *tree) {
 
 	if(position_present == false) {
 		debug_print(D_MISC, "No position found\n");
-		return NULL;
+		return;
 	}
-	pos_info = position_info_create();
-	pos_info->position.location.lat = lat;
-	pos_info->position.location.lon = lon;
-	pos_info->position.timestamp.tm.tm_min = trunc(timestamp / 60.0);
-	pos_info->position.timestamp.tm.tm_sec = trunc(timestamp - 60.0 * trunc(timestamp / 60.0));
-	pos_info->position.timestamp.tm_min_present = true;
-	pos_info->position.timestamp.tm_sec_present = true;
+	struct position *pos = &summary->position;
+	pos->location.lat = lat;
+	pos->location.lon = lon;
+	pos->timestamp.tm.tm_min = trunc(timestamp / 60.0);
+	pos->timestamp.tm.tm_sec = trunc(timestamp - 60.0 * trunc(timestamp / 60.0));
+	pos->timestamp.tm_min_present = true;
+	pos->timestamp.tm_sec_present = true;
+	summary->position_present = true;
 	if(icao_address_present) {
-		pos_info->aircraft.icao_address = icao_address;
-		pos_info->aircraft.icao_address_present = true;
+		summary->icao_address = icao_address;
+		summary->icao_address_present = true;
 	}
 	if(flight_id_present) {
-		pos_info->aircraft.flight_id = flight_id;
-		pos_info->aircraft.flight_id_present = true;
+		strncpy(summary->flight_id, flight_id, SUMMARY_FLIGHT_ID_LEN);
+		summary->flight_id_present = true;
 	}
 	debug_print(D_MISC, "lat: %f lon: %f t: %02d:%02d icao_addr: %06X flight_id: %s\n",
-			pos_info->position.location.lat,
-			pos_info->position.location.lon,
-			pos_info->position.timestamp.tm.tm_min,
-			pos_info->position.timestamp.tm.tm_sec,
-			icao_address_present ? pos_info->aircraft.icao_address : 0,
-			flight_id_present ? pos_info->aircraft.flight_id : ""
+			pos->location.lat,
+			pos->location.lon,
+			pos->timestamp.tm.tm_min,
+			pos->timestamp.tm.tm_sec,
+			icao_address_present ? icao_address : 0,
+			flight_id_present ? flight_id : ""
 			);
-	return pos_info;
 }
@@ -2,11 +2,13 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <libacars/libacars.h>      // la_proto_node
-#include <libacars/reassembly.h>    // la_reasm_ctx
-#include "pdu.h"                    // enum hfdl_pdu_direction
-#include "position.h"               // struct position_info
+#include "reasm.h"                  // reasm_mgr
+#include "pdu.h"                    // enum hfdl_pdu_direction, enum hfdl_pdu_decode_level
+#include "summary.h"                // struct msg_summary
 
 la_proto_node *acars_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction direction,
-		la_reasm_ctx *reasm_ctx, struct timeval rx_timestamp);
-struct position_info *acars_position_info_extract(la_proto_node *tree);
+		reasm_mgr reasm, struct timeval rx_timestamp);
+bool acars_decode_wanted(uint8_t *buf, uint32_t len, enum hfdl_pdu_decode_level decode_level);
+void acars_summarize(la_proto_node *node, struct msg_summary *summary);
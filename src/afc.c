@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                  // fopen, fscanf, fprintf, snprintf, rename, remove
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>                 // strerror, strlen
+#include <errno.h>                  // errno
+#include "afc.h"
+#include "util.h"                   // NEW, XCALLOC, XREALLOC, XFREE, debug_print
+
+struct afc_entry {
+	int32_t freq;
+	float offset_hz;
+};
+
+struct afc_store {
+	struct afc_entry *entries;
+	size_t cnt;
+};
+
+static struct afc_entry *afc_store_find(afc_store const *store, int32_t freq) {
+	for(size_t i = 0; i < store->cnt; i++) {
+		if(store->entries[i].freq == freq) {
+			return &store->entries[i];
+		}
+	}
+	return NULL;
+}
+
+// Returns an empty store if the file does not exist or can't be read.
+afc_store *afc_store_load(char const *file) {
+	NEW(afc_store, store);
+	if(file == NULL) {
+		return store;
+	}
+	FILE *f = fopen(file, "r");
+	if(f == NULL) {
+		if(errno != ENOENT) {
+			fprintf(stderr, "Could not read frequency offsets from %s: %s\n", file, strerror(errno));
+		}
+		return store;
+	}
+	int32_t freq;
+	float offset_hz;
+	while(fscanf(f, "%d %f", &freq, &offset_hz) == 2) {
+		afc_store_set(store, freq, offset_hz);
+		debug_print(D_DSP, "%d: loaded frequency offset: %.1f Hz\n", freq, offset_hz);
+	}
+	fclose(f);
+	return store;
+}
+
+float afc_store_get(afc_store const *store, int32_t freq) {
+	ASSERT(store != NULL);
+	struct afc_entry const *e = afc_store_find(store, freq);
+	return e != NULL ? e->offset_hz : 0.0f;
+}
+
+void afc_store_set(afc_store *store, int32_t freq, float offset_hz) {
+	ASSERT(store != NULL);
+	struct afc_entry *e = afc_store_find(store, freq);
+	if(e == NULL) {
+		store->entries = XREALLOC(store->entries, (store->cnt + 1) * sizeof(struct afc_entry));
+		e = &store->entries[store->cnt++];
+		e->freq = freq;
+	}
+	e->offset_hz = offset_hz;
+}
+
+bool afc_store_save(afc_store const *store, char const *file) {
+	ASSERT(store != NULL);
+	ASSERT(file != NULL);
+	// Write to a temporary file first and rename it afterwards, so that
+	// a crash during shutdown never leaves a truncated file behind
+	size_t len = strlen(file) + sizeof(".tmp");
+	char *tmp_path = XCALLOC(len, sizeof(char));
+	snprintf(tmp_path, len, "%s.tmp", file);
+	bool result = false;
+	FILE *f = fopen(tmp_path, "w");
+	if(f == NULL) {
+		fprintf(stderr, "Could not save frequency offsets to %s: %s\n", tmp_path, strerror(errno));
+		goto end;
+	}
+	for(size_t i = 0; i < store->cnt; i++) {
+		fprintf(f, "%d %.2f\n", store->entries[i].freq, store->entries[i].offset_hz);
+	}
+	if(fclose(f) != 0) {
+		fprintf(stderr, "Could not save frequency offsets to %s: %s\n", tmp_path, strerror(errno));
+		remove(tmp_path);
+		goto end;
+	}
+	if(rename(tmp_path, file) != 0) {
+		fprintf(stderr, "Could not rename %s to %s: %s\n", tmp_path, file, strerror(errno));
+		remove(tmp_path);
+		goto end;
+	}
+	result = true;
+end:
+	XFREE(tmp_path);
+	return result;
+}
+
+void afc_store_destroy(afc_store *store) {
+	if(store != NULL) {
+		XFREE(store->entries);
+		XFREE(store);
+	}
+}
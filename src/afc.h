@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Persistent storage of automatic frequency control offsets, keyed by
+// channel frequency. The file is a plain text file with one
+// "<frequency_hz> <offset_hz>" pair per line.
+
+typedef struct afc_store afc_store;
+
+afc_store *afc_store_load(char const *file);
+float afc_store_get(afc_store const *store, int32_t freq);
+void afc_store_set(afc_store *store, int32_t freq, float offset_hz);
+bool afc_store_save(afc_store const *store, char const *file);
+void afc_store_destroy(afc_store *store);
@@ -0,0 +1,662 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                  // fprintf, snprintf
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>               // PRIu64
+#include <string.h>                 // memcpy, memset, strerror, strdup, strrchr, strlen
+#include <math.h>                   // isfinite
+#include <errno.h>                  // errno
+#include <unistd.h>                 // read, write, close, usleep
+#include <poll.h>                   // poll
+#include <pthread.h>                // pthread_*
+#include <sys/types.h>              // socket
+#include <sys/socket.h>             // socket, bind, listen, accept, connect, setsockopt
+#include <netinet/in.h>             // IPPROTO_TCP
+#include <netinet/tcp.h>            // TCP_NODELAY
+#include <netdb.h>                  // getaddrinfo, getnameinfo
+#include <glib.h>                   // GAsyncQueue, g_async_queue_*
+#include "baseband.h"
+#include "pdu.h"                    // hfdl_pdu_metadata, pdu_decoder_queue_push
+#include "globals.h"                // do_exit
+#include "util.h"                   // NEW, XCALLOC, XFREE, ASSERT, debug_print, start_thread
+
+// Maximum number of channels a single worker may subscribe to
+#define BB_FREQ_MAX 64
+// Maximum number of messages waiting to be sent to a worker or to be
+// demodulated by a worker channel. Excess blocks are dropped.
+#define BB_QUEUE_LEN_MAX 256
+#define BB_PAYLOAD_LEN_MAX (1024 * 1024)
+// How often threads check for new data to send and for the exit flag
+#define BB_POLL_INTERVAL_US 10000
+#define BB_ACCEPT_POLL_INTERVAL_MS 500
+#define BB_SERVER_DEFAULT_HOST "127.0.0.1"
+
+struct bb_msg {
+	struct bb_msg_hdr hdr;
+	uint8_t payload[];
+};
+
+struct bb_conn {
+	struct bb_server *server;
+	char *peer;
+	int32_t fd;
+	GAsyncQueue *outq;          // struct bb_msg * to be sent to the worker
+	int32_t freqs[BB_FREQ_MAX]; // subscribed channels (protected by server mutex)
+	int32_t freq_cnt;
+	uint64_t dropped_cnt;
+	uint64_t rejected_cnt;      // invalid frames or frames from unsubscribed channels
+	bool done;                  // thread has exited (protected by server mutex)
+};
+
+struct bb_server {
+	pthread_mutex_t mutex;
+	struct bb_conn **conns;
+	int32_t conn_cnt;
+	int32_t listen_fd;
+	int32_t threads_running;
+};
+
+struct bb_feed {
+	struct bb_client *client;
+	int32_t freq;
+	GAsyncQueue *q;             // struct bb_block *
+	uint64_t dropped_cnt;
+};
+
+struct bb_client {
+	char *address;
+	int32_t fd;
+	pthread_mutex_t send_mutex;
+	struct bb_feed *feeds[BB_FREQ_MAX];
+	int32_t feed_cnt;
+	bool running;
+};
+
+/******************************
+ * Helper routines
+ ******************************/
+
+static bool read_full(int32_t fd, void *buf, size_t len) {
+	uint8_t *ptr = buf;
+	while(len > 0) {
+		ssize_t ret = read(fd, ptr, len);
+		if(ret < 0 && errno == EINTR) {
+			continue;
+		} else if(ret <= 0) {
+			return false;
+		}
+		ptr += ret;
+		len -= (size_t)ret;
+	}
+	return true;
+}
+
+static bool write_full(int32_t fd, void const *buf, size_t len) {
+	uint8_t const *ptr = buf;
+	while(len > 0) {
+		ssize_t ret = send(fd, ptr, len, MSG_NOSIGNAL);
+		if(ret < 0 && errno == EINTR) {
+			continue;
+		} else if(ret <= 0) {
+			return false;
+		}
+		ptr += ret;
+		len -= (size_t)ret;
+	}
+	return true;
+}
+
+// Allocates a message with room for len bytes of payload. If payload is
+// NULL, the payload is left zeroed for the caller to fill in.
+static struct bb_msg *bb_msg_create(enum bb_msg_type type, int32_t freq, uint64_t sample_cnt,
+		void const *payload, size_t len) {
+	struct bb_msg *msg = XCALLOC(1, sizeof(struct bb_msg) + len);
+	msg->hdr.magic = BB_MSG_MAGIC;
+	msg->hdr.type = type;
+	msg->hdr.freq = freq;
+	msg->hdr.len = (uint32_t)len;
+	msg->hdr.sample_cnt = sample_cnt;
+	if(payload != NULL && len > 0) {
+		memcpy(msg->payload, payload, len);
+	}
+	return msg;
+}
+
+// Reads a complete message. Returns NULL on error or when the peer
+// has closed the connection.
+static struct bb_msg *bb_msg_read(int32_t fd, char const *peer) {
+	struct bb_msg_hdr hdr;
+	if(read_full(fd, &hdr, sizeof(hdr)) == false) {
+		return NULL;
+	}
+	if(hdr.magic != BB_MSG_MAGIC) {
+		fprintf(stderr, "%s: invalid message received (incompatible peer?)\n", peer);
+		return NULL;
+	}
+	if(hdr.len > BB_PAYLOAD_LEN_MAX) {
+		fprintf(stderr, "%s: message too long (%u bytes)\n", peer, hdr.len);
+		return NULL;
+	}
+	struct bb_msg *msg = XCALLOC(1, sizeof(struct bb_msg) + hdr.len);
+	msg->hdr = hdr;
+	if(read_full(fd, msg->payload, hdr.len) == false) {
+		XFREE(msg);
+		return NULL;
+	}
+	return msg;
+}
+
+static int32_t bb_socket_options_set(int32_t fd) {
+	int32_t one = 1;
+	return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/******************************
+ * Front-end
+ ******************************/
+
+static bool bb_conn_is_subscribed(struct bb_conn const *conn, int32_t freq) {
+	for(int32_t i = 0; i < conn->freq_cnt; i++) {
+		if(conn->freqs[i] == freq) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void bb_conn_destroy(struct bb_conn *conn) {
+	if(conn == NULL) {
+		return;
+	}
+	struct bb_msg *msg;
+	while((msg = g_async_queue_try_pop(conn->outq)) != NULL) {
+		XFREE(msg);
+	}
+	g_async_queue_unref(conn->outq);
+	XFREE(conn->peer);
+	XFREE(conn);
+}
+
+// Checks frame metadata received from a worker. The protocol is not
+// authenticated, so anything coming from the peer is sanity checked
+// before it's passed to the decoder and outputs.
+static bool bb_frame_info_is_valid(struct bb_frame_info const *info) {
+	return info->version == 1 &&
+		(info->slot == 'S' || info->slot == 'D') &&
+		(info->bit_rate == 300 || info->bit_rate == 600 ||
+		 info->bit_rate == 1200 || info->bit_rate == 1800) &&
+		info->tv_sec >= 0 && info->tv_usec >= 0 && info->tv_usec < 1000000 &&
+		isfinite(info->freq_err_hz) && isfinite(info->rssi) && isfinite(info->noise_floor);
+}
+
+static void bb_frame_dispatch(struct bb_conn *conn, struct bb_msg *msg) {
+	struct bb_server *s = conn->server;
+	pthread_mutex_lock(&s->mutex);
+	bool subscribed = bb_conn_is_subscribed(conn, msg->hdr.freq);
+	pthread_mutex_unlock(&s->mutex);
+	if(subscribed == false) {
+		debug_print(D_MISC, "%s: frame from unsubscribed channel %d dropped\n", conn->peer, msg->hdr.freq);
+		conn->rejected_cnt++;
+		return;
+	}
+	if(msg->hdr.len < sizeof(struct bb_frame_info)) {
+		fprintf(stderr, "%s: truncated frame message\n", conn->peer);
+		conn->rejected_cnt++;
+		return;
+	}
+	struct bb_frame_info info;
+	memcpy(&info, msg->payload, sizeof(info));
+	size_t len = msg->hdr.len - sizeof(info);
+	if(bb_frame_info_is_valid(&info) == false || len == 0) {
+		debug_print(D_MISC, "%s: invalid frame metadata, frame dropped\n", conn->peer);
+		conn->rejected_cnt++;
+		return;
+	}
+
+	struct metadata *m = hfdl_pdu_metadata_create();
+	struct hfdl_pdu_metadata *hm = container_of(m, struct hfdl_pdu_metadata, metadata);
+	hm->version = info.version;
+	hm->freq = msg->hdr.freq;
+	hm->freq_err_hz = info.freq_err_hz;
+	hm->rssi = info.rssi;
+	hm->noise_floor = info.noise_floor;
+	hm->bit_rate = info.bit_rate;
+	hm->slot = info.slot;
+	m->rx_timestamp.tv_sec = (time_t)info.tv_sec;
+	m->rx_timestamp.tv_usec = (suseconds_t)info.tv_usec;
+	uint8_t *copy = XCALLOC(len, sizeof(uint8_t));
+	memcpy(copy, msg->payload + sizeof(info), len);
+	pdu_decoder_queue_push(m, octet_string_new(copy, len), 0);
+}
+
+static void bb_conn_handle_msg(struct bb_conn *conn, struct bb_msg *msg) {
+	struct bb_server *s = conn->server;
+	switch(msg->hdr.type) {
+		case BB_MSG_SUBSCRIBE:
+			pthread_mutex_lock(&s->mutex);
+			if(bb_conn_is_subscribed(conn, msg->hdr.freq) == false && conn->freq_cnt < BB_FREQ_MAX) {
+				conn->freqs[conn->freq_cnt++] = msg->hdr.freq;
+			}
+			pthread_mutex_unlock(&s->mutex);
+			fprintf(stderr, "%s: worker subscribed to channel %.3f kHz\n",
+					conn->peer, HZ_TO_KHZ(msg->hdr.freq));
+			break;
+		case BB_MSG_FRAME:
+			bb_frame_dispatch(conn, msg);
+			break;
+		default:
+			debug_print(D_MISC, "%s: unexpected message type %u\n", conn->peer, msg->hdr.type);
+			break;
+	}
+}
+
+static void *bb_conn_thread(void *ctx) {
+	struct bb_conn *conn = ctx;
+	struct bb_server *s = conn->server;
+	while(do_exit == 0) {
+		// Send queued sample blocks, waiting for a while if there are none
+		struct bb_msg *msg = g_async_queue_timeout_pop(conn->outq, BB_POLL_INTERVAL_US);
+		if(msg != NULL) {
+			bool ok = write_full(conn->fd, msg, sizeof(struct bb_msg_hdr) + msg->hdr.len);
+			XFREE(msg);
+			if(!ok) {
+				fprintf(stderr, "%s: send failed: %s\n", conn->peer, strerror(errno));
+				break;
+			}
+		}
+		// Handle messages from the worker
+		struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+		if(poll(&pfd, 1, 0) > 0) {
+			if((msg = bb_msg_read(conn->fd, conn->peer)) == NULL) {
+				break;
+			}
+			bb_conn_handle_msg(conn, msg);
+			XFREE(msg);
+		}
+	}
+	fprintf(stderr, "%s: worker disconnected (%" PRIu64 " sample blocks dropped, "
+			"%" PRIu64 " frames rejected)\n", conn->peer, conn->dropped_cnt, conn->rejected_cnt);
+	close(conn->fd);
+	pthread_mutex_lock(&s->mutex);
+	conn->done = true;
+	s->threads_running--;
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+static void *bb_accept_thread(void *ctx) {
+	struct bb_server *s = ctx;
+	while(do_exit == 0) {
+		struct pollfd pfd = { .fd = s->listen_fd, .events = POLLIN };
+		if(poll(&pfd, 1, BB_ACCEPT_POLL_INTERVAL_MS) <= 0) {
+			continue;
+		}
+		struct sockaddr_storage addr;
+		socklen_t addr_len = sizeof(addr);
+		int32_t fd = accept(s->listen_fd, (struct sockaddr *)&addr, &addr_len);
+		if(fd < 0) {
+			fprintf(stderr, "baseband server: accept failed: %s\n", strerror(errno));
+			continue;
+		}
+		char host[NI_MAXHOST], port[NI_MAXSERV], peer[NI_MAXHOST + NI_MAXSERV + 2];
+		if(getnameinfo((struct sockaddr *)&addr, addr_len, host, sizeof(host), port, sizeof(port),
+					NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+			snprintf(host, sizeof(host), "unknown");
+			snprintf(port, sizeof(port), "0");
+		}
+		snprintf(peer, sizeof(peer), "%s:%s", host, port);
+		bb_socket_options_set(fd);
+
+		NEW(struct bb_conn, conn);
+		conn->server = s;
+		conn->peer = strdup(peer);
+		conn->fd = fd;
+		conn->outq = g_async_queue_new();
+		fprintf(stderr, "%s: worker connected\n", conn->peer);
+
+		pthread_mutex_lock(&s->mutex);
+		s->conns = XREALLOC(s->conns, (s->conn_cnt + 1) * sizeof(struct bb_conn *));
+		s->conns[s->conn_cnt++] = conn;
+		s->threads_running++;
+		pthread_mutex_unlock(&s->mutex);
+		pthread_t th;
+		if(start_thread(&th, bb_conn_thread, conn) != 0) {
+			close(fd);
+			pthread_mutex_lock(&s->mutex);
+			conn->done = true;
+			s->threads_running--;
+			pthread_mutex_unlock(&s->mutex);
+		}
+	}
+	close(s->listen_fd);
+	pthread_mutex_lock(&s->mutex);
+	s->threads_running--;
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+// address is either <port>, which listens on 127.0.0.1 only,
+// or <host>:<port>. IPv6 addresses need to be enclosed in square brackets.
+bb_server bb_server_create(char const *address) {
+	ASSERT(address != NULL);
+	char *host = strdup(address);
+	char *port = strrchr(host, ':');
+	char *node = BB_SERVER_DEFAULT_HOST;
+	if(port != NULL) {
+		*port++ = '\0';
+		node = host;
+		size_t node_len = strlen(node);
+		if(node_len >= 2 && node[0] == '[' && node[node_len - 1] == ']') {
+			node[node_len - 1] = '\0';
+			node++;
+		}
+	} else {
+		port = host;
+	}
+	if(port[0] == '\0' || node[0] == '\0') {
+		fprintf(stderr, "Invalid baseband server address %s (must be [<host>:]<port>)\n", address);
+		XFREE(host);
+		return NULL;
+	}
+	struct addrinfo hints, *result = NULL, *rptr;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	int32_t ret = getaddrinfo(node, port, &hints, &result);
+	if(ret != 0) {
+		fprintf(stderr, "baseband server: invalid address %s: %s\n", address, gai_strerror(ret));
+		XFREE(host);
+		return NULL;
+	}
+	int32_t fd = -1;
+	for(rptr = result; rptr != NULL; rptr = rptr->ai_next) {
+		if((fd = socket(rptr->ai_family, rptr->ai_socktype, rptr->ai_protocol)) < 0) {
+			continue;
+		}
+		int32_t one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if(bind(fd, rptr->ai_addr, rptr->ai_addrlen) == 0 && listen(fd, 8) == 0) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(result);
+	XFREE(host);
+	if(fd < 0) {
+		fprintf(stderr, "baseband server: could not listen on %s: %s\n", address, strerror(errno));
+		return NULL;
+	}
+
+	NEW(struct bb_server, s);
+	pthread_mutex_init(&s->mutex, NULL);
+	s->listen_fd = fd;
+	s->threads_running = 1;
+	pthread_t th;
+	if(start_thread(&th, bb_accept_thread, s) != 0) {
+		close(fd);
+		pthread_mutex_destroy(&s->mutex);
+		XFREE(s);
+		return NULL;
+	}
+	fprintf(stderr, "Listening for worker connections on %s\n", address);
+	return s;
+}
+
+// Queues a block of channel baseband for all workers subscribed to the channel.
+// Returns false if there are none (the caller should then decode the
+// channel itself). Never blocks - if a worker is not keeping up, blocks
+// are dropped.
+bool bb_server_send(bb_server s, int32_t freq, uint64_t sample_cnt,
+		float complex const *samples, size_t len) {
+	ASSERT(s != NULL);
+	bool subscribed = false;
+	pthread_mutex_lock(&s->mutex);
+	for(int32_t i = 0; i < s->conn_cnt; i++) {
+		struct bb_conn *conn = s->conns[i];
+		if(conn->done) {
+			// Remove connections which have been closed
+			bb_conn_destroy(conn);
+			s->conns[i--] = s->conns[--s->conn_cnt];
+			continue;
+		}
+		if(bb_conn_is_subscribed(conn, freq) == false) {
+			continue;
+		}
+		subscribed = true;
+		if(g_async_queue_length(conn->outq) >= BB_QUEUE_LEN_MAX) {
+			if(conn->dropped_cnt++ % BB_QUEUE_LEN_MAX == 0) {
+				fprintf(stderr, "%s: worker is not keeping up, sample blocks dropped\n", conn->peer);
+			}
+			continue;
+		}
+		g_async_queue_push(conn->outq, bb_msg_create(BB_MSG_SAMPLES, freq, sample_cnt,
+					samples, len * sizeof(float complex)));
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return subscribed;
+}
+
+// Must be called after do_exit has been set
+void bb_server_destroy(bb_server s) {
+	if(s == NULL) {
+		return;
+	}
+	while(true) {
+		pthread_mutex_lock(&s->mutex);
+		int32_t running = s->threads_running;
+		pthread_mutex_unlock(&s->mutex);
+		if(running == 0) {
+			break;
+		}
+		usleep(BB_POLL_INTERVAL_US);
+	}
+	for(int32_t i = 0; i < s->conn_cnt; i++) {
+		bb_conn_destroy(s->conns[i]);
+	}
+	XFREE(s->conns);
+	pthread_mutex_destroy(&s->mutex);
+	XFREE(s);
+}
+
+/******************************
+ * Worker
+ ******************************/
+
+// address is <host>:<port>
+bb_client bb_client_connect(char const *address) {
+	ASSERT(address != NULL);
+	char *host = strdup(address);
+	char *port = strrchr(host, ':');
+	bb_client result = NULL;
+	if(port == NULL || port == host || port[1] == '\0') {
+		fprintf(stderr, "Invalid baseband source address %s (must be <host>:<port>)\n", address);
+		goto end;
+	}
+	*port++ = '\0';
+	struct addrinfo hints, *ai = NULL, *rptr;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	int32_t ret = getaddrinfo(host, port, &hints, &ai);
+	if(ret != 0) {
+		fprintf(stderr, "Could not resolve address %s: %s\n", address, gai_strerror(ret));
+		goto end;
+	}
+	int32_t fd = -1;
+	for(rptr = ai; rptr != NULL; rptr = rptr->ai_next) {
+		if((fd = socket(rptr->ai_family, rptr->ai_socktype, rptr->ai_protocol)) < 0) {
+			continue;
+		}
+		if(connect(fd, rptr->ai_addr, rptr->ai_addrlen) == 0) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(ai);
+	if(fd < 0) {
+		fprintf(stderr, "Could not connect to %s: %s\n", address, strerror(errno));
+		goto end;
+	}
+	bb_socket_options_set(fd);
+	fprintf(stderr, "Connected to front-end node %s\n", address);
+
+	NEW(struct bb_client, c);
+	c->address = strdup(address);
+	c->fd = fd;
+	pthread_mutex_init(&c->send_mutex, NULL);
+	result = c;
+end:
+	XFREE(host);
+	return result;
+}
+
+static bool bb_client_send(bb_client c, struct bb_msg *msg) {
+	pthread_mutex_lock(&c->send_mutex);
+	bool ok = write_full(c->fd, msg, sizeof(struct bb_msg_hdr) + msg->hdr.len);
+	pthread_mutex_unlock(&c->send_mutex);
+	if(!ok) {
+		fprintf(stderr, "%s: send failed: %s\n", c->address, strerror(errno));
+	}
+	XFREE(msg);
+	return ok;
+}
+
+// Must be called before bb_client_start()
+bb_feed bb_client_subscribe(bb_client c, int32_t freq) {
+	ASSERT(c != NULL);
+	ASSERT(c->running == false);
+	if(c->feed_cnt == BB_FREQ_MAX) {
+		fprintf(stderr, "Too many channels (max %d)\n", BB_FREQ_MAX);
+		return NULL;
+	}
+	if(bb_client_send(c, bb_msg_create(BB_MSG_SUBSCRIBE, freq, 0, NULL, 0)) == false) {
+		return NULL;
+	}
+	NEW(struct bb_feed, f);
+	f->client = c;
+	f->freq = freq;
+	f->q = g_async_queue_new();
+	c->feeds[c->feed_cnt++] = f;
+	return f;
+}
+
+static struct bb_feed *bb_client_feed_find(bb_client c, int32_t freq) {
+	for(int32_t i = 0; i < c->feed_cnt; i++) {
+		if(c->feeds[i]->freq == freq) {
+			return c->feeds[i];
+		}
+	}
+	return NULL;
+}
+
+static void *bb_client_thread(void *ctx) {
+	bb_client c = ctx;
+	while(do_exit == 0) {
+		struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+		if(poll(&pfd, 1, BB_ACCEPT_POLL_INTERVAL_MS) <= 0) {
+			continue;
+		}
+		struct bb_msg *msg = bb_msg_read(c->fd, c->address);
+		if(msg == NULL) {
+			fprintf(stderr, "%s: connection to front-end node lost\n", c->address);
+			do_exit = 1;
+			break;
+		}
+		struct bb_feed *f;
+		if(msg->hdr.type == BB_MSG_SAMPLES && (f = bb_client_feed_find(c, msg->hdr.freq)) != NULL) {
+			if(g_async_queue_length(f->q) >= BB_QUEUE_LEN_MAX) {
+				if(f->dropped_cnt++ % BB_QUEUE_LEN_MAX == 0) {
+					fprintf(stderr, "%d: demodulator is not keeping up, sample blocks dropped\n", f->freq);
+				}
+			} else {
+				uint32_t len = msg->hdr.len / sizeof(float complex);
+				struct bb_block *b = XCALLOC(1, sizeof(struct bb_block) + len * sizeof(float complex));
+				b->sample_cnt = msg->hdr.sample_cnt;
+				b->len = len;
+				memcpy(b->samples, msg->payload, len * sizeof(float complex));
+				g_async_queue_push(f->q, b);
+			}
+		}
+		XFREE(msg);
+	}
+	// Wake up all channels
+	for(int32_t i = 0; i < c->feed_cnt; i++) {
+		NEW(struct bb_block, b);
+		b->eos = true;
+		g_async_queue_push(c->feeds[i]->q, b);
+	}
+	c->running = false;
+	return NULL;
+}
+
+int32_t bb_client_start(bb_client c) {
+	ASSERT(c != NULL);
+	pthread_t th;
+	c->running = true;
+	if(start_thread(&th, bb_client_thread, c) != 0) {
+		c->running = false;
+		return -1;
+	}
+	return 0;
+}
+
+bool bb_client_is_running(bb_client c) {
+	return c != NULL && c->running;
+}
+
+// Must be called after the client thread and all channels have finished
+void bb_client_destroy(bb_client c) {
+	if(c == NULL) {
+		return;
+	}
+	for(int32_t i = 0; i < c->feed_cnt; i++) {
+		struct bb_block *b;
+		while((b = g_async_queue_try_pop(c->feeds[i]->q)) != NULL) {
+			XFREE(b);
+		}
+		g_async_queue_unref(c->feeds[i]->q);
+		XFREE(c->feeds[i]);
+	}
+	close(c->fd);
+	pthread_mutex_destroy(&c->send_mutex);
+	XFREE(c->address);
+	XFREE(c);
+}
+
+// Returns the next block of channel baseband or NULL when the front-end
+// has gone away. The caller becomes the owner of the block.
+struct bb_block *bb_feed_pop(bb_feed f) {
+	ASSERT(f != NULL);
+	struct bb_block *b = g_async_queue_pop(f->q);
+	if(b->eos) {
+		XFREE(b);
+		return NULL;
+	}
+	return b;
+}
+
+// Sends a decoded frame to the front-end. Takes ownership of m and pdu.
+void bb_feed_send_pdu(bb_feed f, struct metadata *m, struct octet_string *pdu) {
+	ASSERT(f != NULL);
+	ASSERT(m != NULL);
+	ASSERT(pdu != NULL);
+	struct hfdl_pdu_metadata *hm = container_of(m, struct hfdl_pdu_metadata, metadata);
+	struct bb_frame_info info = {
+		.tv_sec = m->rx_timestamp.tv_sec,
+		.tv_usec = m->rx_timestamp.tv_usec,
+		.freq_err_hz = hm->freq_err_hz,
+		.rssi = hm->rssi,
+		.noise_floor = hm->noise_floor,
+		.bit_rate = hm->bit_rate,
+		.version = hm->version,
+		.slot = hm->slot
+	};
+	struct bb_msg *msg = bb_msg_create(BB_MSG_FRAME, hm->freq, 0, NULL, sizeof(info) + pdu->len);
+	memcpy(msg->payload, &info, sizeof(info));
+	memcpy(msg->payload + sizeof(info), pdu->buf, pdu->len);
+	bb_client_send(f->client, msg);
+	metadata_destroy(m);
+	octet_string_destroy(pdu);
+}
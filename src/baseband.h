@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>                 // size_t
+#include <complex.h>
+#include "metadata.h"               // struct metadata
+#include "util.h"                   // struct octet_string
+
+// Distributed channel decoding over TCP.
+//
+// A front-end node runs the input, the FFT and the channelizers and streams
+// channelized, resampled baseband (HFDL_SYMBOL_RATE * SPS samples per second)
+// of each channel to worker nodes which have subscribed to it. Workers run
+// the demodulator and FEC decoder and send decoded frames back to
+// the front-end, which passes them to its PDU decoder and outputs.
+// Channels which no worker has subscribed to are decoded by the front-end.
+//
+// All messages start with struct bb_msg_hdr. Fields are in host byte order,
+// so both ends must have the same endianness and float format
+// (which is checked with the magic value).
+//
+// The protocol has no authentication nor encryption. The front-end listens
+// on the loopback interface unless told otherwise, and accepts frames only
+// for channels which the sending worker has subscribed to.
+
+#define BB_MSG_MAGIC 0x42484644u        // "DFHB"
+
+enum bb_msg_type {
+	BB_MSG_SUBSCRIBE = 1,       // worker -> front-end: start sending channel baseband
+	BB_MSG_SAMPLES = 2,         // front-end -> worker: block of channel baseband samples
+	BB_MSG_FRAME = 3            // worker -> front-end: decoded frame (struct bb_frame_info + data)
+};
+
+struct bb_msg_hdr {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t reserved;
+	int32_t freq;               // channel frequency (Hz)
+	uint32_t len;               // payload length (bytes)
+	uint64_t sample_cnt;        // BB_MSG_SAMPLES: channel sample clock of the first sample
+};
+
+// Frame metadata sent along with BB_MSG_FRAME
+struct bb_frame_info {
+	int64_t tv_sec;
+	int64_t tv_usec;
+	float freq_err_hz;
+	float rssi;
+	float noise_floor;
+	int32_t bit_rate;
+	int32_t version;
+	char slot;
+	uint8_t reserved[3];
+};
+
+// Block of baseband samples received by a worker
+struct bb_block {
+	uint64_t sample_cnt;
+	uint32_t len;               // number of samples
+	bool eos;                   // end of stream - the front-end is gone
+	float complex samples[];
+};
+
+typedef struct bb_server *bb_server;
+typedef struct bb_client *bb_client;
+typedef struct bb_feed *bb_feed;
+
+// front-end
+bb_server bb_server_create(char const *address);
+bool bb_server_send(bb_server s, int32_t freq, uint64_t sample_cnt,
+		float complex const *samples, size_t len);
+void bb_server_destroy(bb_server s);
+
+// worker
+bb_client bb_client_connect(char const *address);
+bb_feed bb_client_subscribe(bb_client c, int32_t freq);
+int32_t bb_client_start(bb_client c);
+bool bb_client_is_running(bb_client c);
+void bb_client_destroy(bb_client c);
+struct bb_block *bb_feed_pop(bb_feed f);
+void bb_feed_send_pdu(bb_feed f, struct metadata *m, struct octet_string *pdu);
@@ -3,21 +3,29 @@
 #include <stdbool.h>
 #include <complex.h>
 #include <stdlib.h>
+#include <string.h>             // memcpy
 #include <pthread.h>            // pthread_*
-#include <liquid/liquid.h>      // cbuffercf_*
+#include <stdatomic.h>          // atomic_*
+#include <time.h>               // clock_gettime
 #include "config.h"
 #ifndef HAVE_PTHREAD_BARRIERS
 #include "pthread_barrier.h"
 #endif
 #include "block.h"
 #include "util.h"               // XCALLOC, pthread_*_initialize, debug_print
+#include "dspbuf.h"             // DSPBUF_ALLOC, DSPBUF_FREE
 
 #define BUF_SIZE_PROD_MTU_MULTIPLIER 8
 #define BUF_SIZE_CONS_MRU_MULTIPLIER 2
 
-static int32_t block_circ_buffer_init(struct circ_buffer *buffer, size_t buf_size) {
+static int32_t block_circ_buffer_init(struct circ_buffer *buffer, size_t buf_size, struct sample_type sample_type) {
 	ASSERT(buffer);
-	buffer->buf = cbuffercf_create(buf_size);
+	ASSERT(sample_type.size > 0);
+	ASSERT(sample_type.convert != NULL);
+	buffer->sample_type = sample_type;
+	buffer->size = buf_size;
+	buffer->head = buffer->len = 0;
+	buffer->buf = DSPBUF_ALLOC(buf_size, sample_type.size);
 	buffer->cond = XCALLOC(1, sizeof(pthread_cond_t));
 	buffer->mutex= XCALLOC(1, sizeof(pthread_mutex_t));
 	return pthread_cond_initialize(buffer->cond) || pthread_mutex_initialize(buffer->mutex);
@@ -25,7 +33,7 @@ static int32_t block_circ_buffer_init(struct circ_buffer *buffer, size_t buf_siz
 
 static void block_circ_buffer_destroy(struct circ_buffer *buffer) {
 	if(buffer != NULL) {
-		cbuffercf_destroy(buffer->buf);
+		DSPBUF_FREE(buffer->buf);
 		XFREE(buffer->cond);
 		XFREE(buffer->mutex);
 		// No XFREE(buffer) as this is a member of a struct allocated by the caller
@@ -35,7 +43,7 @@ static void block_circ_buffer_destroy(struct circ_buffer *buffer) {
 static int32_t block_shared_buffer_init(struct shared_buffer *buffer, size_t buf_size, size_t thread_cnt) {
 	ASSERT(buffer);
 	ASSERT(thread_cnt > 0);
-	buffer->buf = XCALLOC(buf_size, sizeof(float complex));
+	buffer->buf = DSPBUF_ALLOC(buf_size, sizeof(float complex));
 	buffer->data_ready = XCALLOC(1, sizeof(pthread_barrier_t));
 	buffer->consumers_ready = XCALLOC(1, sizeof(pthread_barrier_t));
 	return pthread_barrier_create(buffer->data_ready, thread_cnt) ||
@@ -44,7 +52,7 @@ static int32_t block_shared_buffer_init(struct shared_buffer *buffer, size_t buf
 
 static void block_shared_buffer_destroy(struct shared_buffer *buffer) {
 	if(buffer != NULL) {
-		XFREE(buffer->buf);
+		DSPBUF_FREE(buffer->buf);
 		XFREE(buffer->data_ready);
 		XFREE(buffer->consumers_ready);
 		// No XFREE(buffer) as this is a member of a struct allocated by the caller
@@ -59,14 +67,18 @@ int32_t block_connect_one2one(struct block *source, struct block *sink) {
 	ASSERT(sink->consumer.type == CONSUMER_SINGLE);
 	ASSERT(source->producer.max_tu != 0);
 
+	struct sample_type sample_type = source->producer.sample_type;
 	size_t buf_size_by_producer_mtu = BUF_SIZE_PROD_MTU_MULTIPLIER * source->producer.max_tu;
 	size_t buf_size_by_consumer_mru = BUF_SIZE_CONS_MRU_MULTIPLIER * sink->consumer.min_ru;
 	size_t buf_size = max(buf_size_by_producer_mtu, buf_size_by_consumer_mru);
-	debug_print(D_MISC, "producer MTU: %zu consumer MRU: %zu buf_size: %zu\n",
-			source->producer.max_tu, sink->consumer.min_ru, buf_size);
+	// Narrower sample types get proportionally more samples within
+	// the same memory footprint as a complex float buffer
+	buf_size = buf_size * sizeof(float complex) / sample_type.size;
+	debug_print(D_MISC, "producer MTU: %zu consumer MRU: %zu sample size: %zu buf_size: %zu\n",
+			source->producer.max_tu, sink->consumer.min_ru, sample_type.size, buf_size);
 	NEW(struct block_connection, connection);
 	int32_t ret = 0;
-	if(block_circ_buffer_init(&connection->circ_buffer, buf_size) != 0) {
+	if(block_circ_buffer_init(&connection->circ_buffer, buf_size, sample_type) != 0) {
 		goto end;
 	}
 	source->producer.out = sink->consumer.in = connection;
@@ -176,6 +188,48 @@ int32_t block_set_start(size_t block_cnt, struct block *block[block_cnt]) {
 	return ret;
 }
 
+bool block_step(struct block *block) {
+	ASSERT(block);
+	ASSERT(block->step);
+	return block->step(block);
+}
+
+static int64_t monotonic_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec;
+}
+
+// Heartbeat of a consumer, which has just received a buffer of data
+void block_heartbeat_busy(struct block *block) {
+	ASSERT(block);
+	atomic_store(&block->busy_since, monotonic_time());
+	atomic_store(&block->hb_state, BLOCK_BUSY);
+}
+
+// Heartbeat of a consumer, which is done with the current buffer.
+// Returns false if the block has been detached by the watchdog in the
+// meantime. Its place in the connection has then been taken over by
+// another block, so it must exit without touching the connection.
+bool block_heartbeat_idle(struct block *block) {
+	ASSERT(block);
+	int32_t expected = BLOCK_BUSY;
+	return atomic_compare_exchange_strong(&block->hb_state, &expected, BLOCK_IDLE) ||
+		expected != BLOCK_DETACHED;
+}
+
+// Marks the block as detached if it has been processing the same buffer
+// for more than timeout seconds. Returns true if it did so.
+bool block_detach_if_stalled(struct block *block, int32_t timeout) {
+	ASSERT(block);
+	if(atomic_load(&block->hb_state) != BLOCK_BUSY ||
+			monotonic_time() - atomic_load(&block->busy_since) <= timeout) {
+		return false;
+	}
+	int32_t expected = BLOCK_BUSY;
+	return atomic_compare_exchange_strong(&block->hb_state, &expected, BLOCK_DETACHED);
+}
+
 bool block_is_running(struct block *block) {
 	ASSERT(block);
 	return block->running;
@@ -191,3 +245,47 @@ bool block_set_is_any_running(size_t block_cnt, struct block *blocks[block_cnt])
 	return false;
 }
 
+
+// Circular buffer routines. The caller must hold buffer->mutex, except for
+// circ_buffer_read() which may be called without holding the mutex by the
+// (single) consumer, since the producer never modifies stored samples.
+
+size_t circ_buffer_size(struct circ_buffer *buffer) {
+	ASSERT(buffer);
+	return buffer->len;
+}
+
+size_t circ_buffer_space_available(struct circ_buffer *buffer) {
+	ASSERT(buffer);
+	return buffer->size - buffer->len;
+}
+
+// Returns the number of samples written
+size_t circ_buffer_write(struct circ_buffer *buffer, void const *samples, size_t sample_cnt) {
+	ASSERT(buffer);
+	sample_cnt = min(sample_cnt, circ_buffer_space_available(buffer));
+	size_t const sample_size = buffer->sample_type.size;
+	size_t tail = (buffer->head + buffer->len) % buffer->size;
+	size_t first = min(sample_cnt, buffer->size - tail);
+	memcpy(buffer->buf + tail * sample_size, samples, first * sample_size);
+	memcpy(buffer->buf, (uint8_t const *)samples + first * sample_size, (sample_cnt - first) * sample_size);
+	buffer->len += sample_cnt;
+	return sample_cnt;
+}
+
+// Converts sample_cnt samples from the head of the buffer to complex float
+// and stores them in out. Samples are not removed from the buffer.
+void circ_buffer_read(struct circ_buffer *buffer, size_t sample_cnt, float complex *out) {
+	ASSERT(buffer);
+	struct sample_type const *st = &buffer->sample_type;
+	size_t first = min(sample_cnt, buffer->size - buffer->head);
+	st->convert(buffer->buf + buffer->head * st->size, first, st->full_scale, out);
+	st->convert(buffer->buf, sample_cnt - first, st->full_scale, out + first);
+}
+
+void circ_buffer_release(struct circ_buffer *buffer, size_t sample_cnt) {
+	ASSERT(buffer);
+	ASSERT(sample_cnt <= buffer->len);
+	buffer->head = (buffer->head + sample_cnt) % buffer->size;
+	buffer->len -= sample_cnt;
+}
@@ -3,8 +3,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <complex.h>
+#include <stddef.h>                 // size_t
 #include <pthread.h>
-#include <liquid/liquid.h>
+#include <stdatomic.h>              // _Atomic
 #include "config.h"
 #ifndef HAVE_PTHREAD_BARRIERS
 #include "pthread_barrier.h"
@@ -24,8 +25,24 @@ enum consumer_type {
 	CONSUMER_MAX
 };
 
+// Converts sample_cnt samples from a native format to complex float
+typedef void (*sample_convert_fun)(void const *inbuf, size_t sample_cnt, float full_scale, float complex *outbuf);
+
+// Format of samples passed through a circular buffer connection.
+// Samples are stored in the native format of the producer and converted
+// to complex float by the consumer while reading.
+struct sample_type {
+	size_t size;                        // octets per sample
+	float full_scale;                   // max raw sample value
+	sample_convert_fun convert;
+};
+
 struct circ_buffer {
-	cbuffercf buf;
+	uint8_t *buf;
+	size_t size;                        // capacity (samples)
+	size_t head;                        // read position (samples)
+	size_t len;                         // number of samples stored
+	struct sample_type sample_type;
 	pthread_cond_t *cond;
 	pthread_mutex_t *mutex;
 };
@@ -50,6 +67,7 @@ struct block_connection {
 struct producer {
 	struct block_connection *out;
 	size_t max_tu;                      // maximum transmission unit (samples)
+	struct sample_type sample_type;     // PRODUCER_SINGLE only
 	enum producer_type type;
 };
 
@@ -59,11 +77,23 @@ struct consumer {
 	enum consumer_type type;
 };
 
+// States reported by consumers of one2many connections to the watchdog
+enum block_heartbeat_state {
+	BLOCK_IDLE = 0,                     // waiting for data
+	BLOCK_BUSY,                         // processing data
+	BLOCK_DETACHED                      // stalled and replaced by a new instance
+};
+
 struct block {
 	struct consumer consumer;
 	struct producer producer;
 	pthread_t thread;
 	void *(*thread_routine)(void *);
+	// Deterministic mode: does one unit of work in the calling thread
+	// instead of the thread routine. Returns false if there was nothing to do.
+	bool (*step)(struct block *);
+	_Atomic int32_t hb_state;           // enum block_heartbeat_state
+	_Atomic int64_t busy_since;         // CLOCK_MONOTONIC, seconds
 	bool running;
 };
 
@@ -74,8 +104,17 @@ void block_disconnect_one2one(struct block *source, struct block *sink);
 void block_disconnect_one2many(struct block *source, size_t sink_count, struct block *sinks[sink_count]);
 int32_t block_start(struct block *block);
 int32_t block_set_start(size_t block_cnt, struct block *block[block_cnt]);
+bool block_step(struct block *block);
+void block_heartbeat_busy(struct block *block);
+bool block_heartbeat_idle(struct block *block);
+bool block_detach_if_stalled(struct block *block, int32_t timeout);
 void block_connection_one2one_shutdown(struct block_connection *connection);
 void block_connection_one2many_shutdown(struct block_connection *connection);
 bool block_connection_is_shutdown_signaled(struct block_connection *connection);
 bool block_is_running(struct block *block);
 bool block_set_is_any_running(size_t block_cnt, struct block *blocks[block_cnt]);
+size_t circ_buffer_size(struct circ_buffer *buffer);
+size_t circ_buffer_space_available(struct circ_buffer *buffer);
+size_t circ_buffer_write(struct circ_buffer *buffer, void const *samples, size_t sample_cnt);
+void circ_buffer_read(struct circ_buffer *buffer, size_t sample_cnt, float complex *out);
+void circ_buffer_release(struct circ_buffer *buffer, size_t sample_cnt);
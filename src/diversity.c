@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>               // PRIu64, PRId64
+#include <stdlib.h>                 // llabs
+#include <string.h>                 // memmove
+#include <math.h>                   // lrintf, llround
+#include <pthread.h>                // pthread_mutex_*
+#include "diversity.h"
+#include "util.h"                   // NEW, XCALLOC, XFREE, ASSERT, debug_print
+
+// Maximum number of frames waiting for a match from the other branch
+#define PENDING_MAX 4
+#define READY_MAX (DIVERSITY_BRANCH_CNT * PENDING_MAX + 2)
+// Minimum fraction of hard decisions which must agree between two frames
+// to consider them copies of the same transmission. Data bits are scrambled,
+// so unrelated frames agree in about 50% of positions.
+#define MIN_AGREEMENT 0.56f
+// Weight of a new measurement in the branch clock offset average
+#define OFFSET_AVG_WEIGHT 0.2
+
+struct diversity {
+	pthread_mutex_t mutex;
+	struct diversity_frame *pending[DIVERSITY_BRANCH_CNT][PENDING_MAX];
+	int32_t pending_cnt[DIVERSITY_BRANCH_CNT];
+	struct diversity_frame *ready[READY_MAX];
+	int32_t ready_cnt;
+	bool done[DIVERSITY_BRANCH_CNT];
+	double offset;              // branch 1 clock minus branch 0 clock (samples)
+	bool offset_locked;
+	uint32_t acq_window, track_window;
+	int32_t freq;
+	int32_t refcnt;
+	uint64_t combined_cnt, single_cnt[DIVERSITY_BRANCH_CNT];
+};
+
+// acq_window and track_window are maximum time differences (in samples)
+// between copies of the same frame before and after the branch clock offset
+// is known.
+diversity diversity_create(int32_t freq, uint32_t acq_window, uint32_t track_window) {
+	NEW(struct diversity, d);
+	pthread_mutex_init(&d->mutex, NULL);
+	d->freq = freq;
+	d->acq_window = acq_window;
+	d->track_window = track_window;
+	d->refcnt = 1;
+	return d;
+}
+
+diversity diversity_ref(diversity d) {
+	ASSERT(d != NULL);
+	pthread_mutex_lock(&d->mutex);
+	d->refcnt++;
+	pthread_mutex_unlock(&d->mutex);
+	return d;
+}
+
+void diversity_frame_destroy(struct diversity_frame *frame) {
+	if(frame != NULL) {
+		XFREE(frame->soft_bits);
+		XFREE(frame);
+	}
+}
+
+void diversity_unref(diversity d) {
+	if(d == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&d->mutex);
+	bool last = --d->refcnt == 0;
+	pthread_mutex_unlock(&d->mutex);
+	if(!last) {
+		return;
+	}
+	debug_print(D_DSP, "%d: frames combined: %" PRIu64 " branch 0 only: %" PRIu64 " branch 1 only: %" PRIu64 "\n",
+			d->freq, d->combined_cnt, d->single_cnt[0], d->single_cnt[1]);
+	for(int32_t b = 0; b < DIVERSITY_BRANCH_CNT; b++) {
+		for(int32_t i = 0; i < d->pending_cnt[b]; i++) {
+			diversity_frame_destroy(d->pending[b][i]);
+		}
+	}
+	for(int32_t i = 0; i < d->ready_cnt; i++) {
+		diversity_frame_destroy(d->ready[i]);
+	}
+	pthread_mutex_destroy(&d->mutex);
+	XFREE(d);
+}
+
+// Converts a frame position to the sample clock of the given branch
+static int64_t frame_time(diversity d, struct diversity_frame const *f, int32_t branch) {
+	int64_t t = (int64_t)f->end_sample;
+	if(f->branch == branch) {
+		return t;
+	}
+	int64_t offset = d->offset_locked ? llround(d->offset) : 0;
+	return branch == 1 ? t + offset : t - offset;
+}
+
+static uint32_t match_window(diversity d) {
+	return d->offset_locked ? d->track_window : d->acq_window;
+}
+
+static void ready_push(diversity d, struct diversity_frame *f) {
+	ASSERT(d->ready_cnt < READY_MAX);
+	if(f->branch_cnt == 1) {
+		d->single_cnt[f->branch]++;
+	} else {
+		d->combined_cnt++;
+	}
+	d->ready[d->ready_cnt++] = f;
+}
+
+static struct diversity_frame *pending_remove(diversity d, int32_t branch, int32_t idx) {
+	ASSERT(idx < d->pending_cnt[branch]);
+	struct diversity_frame *f = d->pending[branch][idx];
+	d->pending_cnt[branch]--;
+	memmove(&d->pending[branch][idx], &d->pending[branch][idx + 1],
+			(d->pending_cnt[branch] - idx) * sizeof(struct diversity_frame *));
+	return f;
+}
+
+static void pending_flush(diversity d, int32_t branch) {
+	while(d->pending_cnt[branch] > 0) {
+		ready_push(d, pending_remove(d, branch, 0));
+	}
+}
+
+static float hard_decision_agreement(struct diversity_frame const *a, struct diversity_frame const *b) {
+	ASSERT(a->len == b->len);
+	uint32_t agree = 0;
+	for(uint32_t i = 0; i < a->len; i++) {
+		agree += (a->soft_bits[i] >> 7) == (b->soft_bits[i] >> 7);
+	}
+	return (float)agree / (float)a->len;
+}
+
+// Combines soft bits of b into a, weighting each branch by its SNR.
+// The result is scaled back to the range of a single branch, which
+// does not change Viterbi decoder decisions.
+static void frames_combine(struct diversity_frame *a, struct diversity_frame const *b) {
+	float wa = a->snr, wb = b->snr;
+	float wsum = wa + wb;
+	if(wsum <= 0.0f) {
+		wa = wb = wsum = 1.0f;
+	}
+	for(uint32_t i = 0; i < a->len; i++) {
+		float llr = (wa * ((float)a->soft_bits[i] - 127.5f) + wb * ((float)b->soft_bits[i] - 127.5f)) / wsum;
+		long v = lrintf(llr + 127.5f);
+		a->soft_bits[i] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+	}
+	// Report metadata of the stronger branch
+	if(b->snr > a->snr) {
+		a->timestamp = b->timestamp;
+		a->freq_err_hz = b->freq_err_hz;
+		a->signal_level = b->signal_level;
+		a->noise_floor = b->noise_floor;
+	}
+	a->snr += b->snr;
+	a->branch_cnt += b->branch_cnt;
+}
+
+// Takes ownership of the frame. The frame becomes available for decoding
+// through diversity_next() either right away (when it matches a frame
+// from the other branch) or when it becomes clear that there will be no match.
+void diversity_submit(diversity d, struct diversity_frame *frame) {
+	ASSERT(d != NULL);
+	ASSERT(frame != NULL);
+	int32_t b = frame->branch;
+	ASSERT(b >= 0 && b < DIVERSITY_BRANCH_CNT);
+	int32_t other = 1 - b;
+	frame->branch_cnt = 1;
+
+	pthread_mutex_lock(&d->mutex);
+	if(d->done[other]) {
+		ready_push(d, frame);
+		goto end;
+	}
+	int64_t t = (int64_t)frame->end_sample;
+	uint32_t window = match_window(d);
+	for(int32_t i = 0; i < d->pending_cnt[other]; i++) {
+		struct diversity_frame *f = d->pending[other][i];
+		int64_t diff = t - frame_time(d, f, b);
+		if(f->M1 != frame->M1 || f->len != frame->len || llabs(diff) > window) {
+			continue;
+		}
+		float agreement = hard_decision_agreement(frame, f);
+		debug_print(D_DSP, "%d: frame time diff: %" PRId64 " samples, agreement: %.3f\n",
+				d->freq, diff, agreement);
+		if(agreement < MIN_AGREEMENT) {
+			continue;
+		}
+		pending_remove(d, other, i);
+		// Measured clock offset: branch 1 clock minus branch 0 clock
+		double measured = b == 1 ?
+			(double)t - (double)f->end_sample : (double)f->end_sample - (double)t;
+		if(d->offset_locked) {
+			d->offset = (1.0 - OFFSET_AVG_WEIGHT) * d->offset + OFFSET_AVG_WEIGHT * measured;
+		} else {
+			d->offset = measured;
+			d->offset_locked = true;
+			debug_print(D_DSP, "%d: branch clock offset locked at %.0f samples\n", d->freq, d->offset);
+		}
+		frames_combine(frame, f);
+		diversity_frame_destroy(f);
+		ready_push(d, frame);
+		goto end;
+	}
+	if(d->pending_cnt[b] == PENDING_MAX) {
+		ready_push(d, pending_remove(d, b, 0));
+	}
+	d->pending[b][d->pending_cnt[b]++] = frame;
+end:
+	pthread_mutex_unlock(&d->mutex);
+}
+
+// Returns the next frame to be decoded by the given branch or NULL if there
+// is none. now is the current position of the branch sample clock.
+// Frames from the other branch which have not been matched by the time
+// this branch has gone past them are returned for decoding without combining.
+// The caller becomes the owner of the returned frame.
+struct diversity_frame *diversity_next(diversity d, int32_t branch, uint64_t now) {
+	ASSERT(d != NULL);
+	ASSERT(branch >= 0 && branch < DIVERSITY_BRANCH_CNT);
+	int32_t other = 1 - branch;
+	struct diversity_frame *f = NULL;
+
+	pthread_mutex_lock(&d->mutex);
+	uint32_t window = match_window(d);
+	while(d->pending_cnt[other] > 0 &&
+			frame_time(d, d->pending[other][0], branch) + window < (int64_t)now) {
+		ready_push(d, pending_remove(d, other, 0));
+	}
+	if(d->done[other]) {
+		pending_flush(d, branch);
+	}
+	if(d->ready_cnt > 0) {
+		f = d->ready[0];
+		d->ready_cnt--;
+		memmove(&d->ready[0], &d->ready[1], d->ready_cnt * sizeof(struct diversity_frame *));
+	}
+	pthread_mutex_unlock(&d->mutex);
+	return f;
+}
+
+// Marks the branch as finished. Pending frames of both branches will
+// no longer be waited for and are returned by subsequent diversity_next() calls.
+void diversity_branch_done(diversity d, int32_t branch) {
+	ASSERT(d != NULL);
+	ASSERT(branch >= 0 && branch < DIVERSITY_BRANCH_CNT);
+	pthread_mutex_lock(&d->mutex);
+	d->done[branch] = true;
+	pending_flush(d, 0);
+	pending_flush(d, 1);
+	pthread_mutex_unlock(&d->mutex);
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>               // struct timeval
+
+// Soft-decision diversity combiner for two receive branches of the same
+// HFDL channel (eg. two antennas with separate receivers).
+//
+// Each branch demodulates frames independently and submits deinterleaved
+// soft bits of each frame to the combiner. Frames received on both branches
+// are paired up and their soft bits are combined with weights proportional
+// to the per-branch SNR (maximum ratio combining) before being passed to the
+// Viterbi decoder. Frames received on one branch only are decoded as-is.
+
+#define DIVERSITY_BRANCH_CNT 2
+
+struct diversity_frame {
+	uint8_t *soft_bits;         // Viterbi decoder input (offset binary, 128 = erasure)
+	uint32_t len;
+	int32_t M1;
+	uint64_t start_sample;      // start of frame position in the branch sample clock
+	uint64_t end_sample;        // end of frame position in the branch sample clock
+	float snr;                  // linear SNR (power ratio)
+	int32_t branch;             // branch which delivered the frame
+	int32_t branch_cnt;         // number of branches combined into this frame
+	// PDU metadata
+	struct timeval timestamp;
+	float freq_err_hz;
+	float signal_level;
+	float noise_floor;
+};
+
+typedef struct diversity *diversity;
+
+diversity diversity_create(int32_t freq, uint32_t acq_window, uint32_t track_window);
+diversity diversity_ref(diversity d);
+void diversity_unref(diversity d);
+void diversity_submit(diversity d, struct diversity_frame *frame);
+struct diversity_frame *diversity_next(diversity d, int32_t branch, uint64_t now);
+void diversity_branch_done(diversity d, int32_t branch);
+void diversity_frame_destroy(struct diversity_frame *frame);
@@ -0,0 +1,303 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                  // fprintf, fopen, fgets, sscanf
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>               // PRIu64
+#include <stdlib.h>                 // posix_memalign, free, _exit
+#include <string.h>                 // memset, strerror
+#include <errno.h>                  // errno
+#include <unistd.h>                 // _exit, syscall, ftruncate, close, sysconf
+#include <pthread.h>                // pthread_mutex_*, pthread_once
+#include <sys/mman.h>               // mmap, munmap, madvise
+#include <sys/syscall.h>            // SYS_memfd_create
+#include "dspbuf.h"
+#include "util.h"                   // debug_print, ASSERT
+
+// Buffers for FFTs and sample ring buffers are allocated through this module
+// rather than with XCALLOC, for two reasons:
+// - SIMD code paths (FFTW in particular) work best with buffers aligned
+//   to at least 32-64 bytes. calloc() only guarantees 16-byte alignment.
+// - FFT sizes used with wideband inputs reach several megabytes. Backing
+//   these with huge pages reduces TLB misses significantly.
+//
+// Each buffer is preceded by a header (padded to DSPBUF_ALIGNMENT bytes),
+// which records how the memory was obtained, so that it can be released
+// correctly by dspbuf_free().
+
+#define DEFAULT_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+enum dspbuf_method {
+	DSPBUF_REGULAR = 0,     // posix_memalign
+	DSPBUF_THP,             // posix_memalign aligned to huge page size + madvise(MADV_HUGEPAGE)
+	DSPBUF_HUGETLB,         // mmap(MAP_HUGETLB)
+	DSPBUF_MIRRORED,        // memfd mapped twice (dspbuf_alloc_mirrored)
+	DSPBUF_METHOD_CNT
+};
+
+static char const *dspbuf_method_names[DSPBUF_METHOD_CNT] = {
+	[DSPBUF_REGULAR] = "regular",
+	[DSPBUF_THP] = "transparent huge pages",
+	[DSPBUF_HUGETLB] = "hugetlbfs",
+	[DSPBUF_MIRRORED] = "mirrored"
+};
+
+struct dspbuf_hdr {
+	void *base;                 // start of the underlying allocation
+	size_t alloc_len;           // length of the underlying allocation
+	size_t len;                 // requested length
+	enum dspbuf_method method;
+};
+
+_Static_assert(sizeof(struct dspbuf_hdr) <= DSPBUF_ALIGNMENT, "struct dspbuf_hdr too large");
+
+static struct {
+	uint64_t cnt[DSPBUF_METHOD_CNT];
+	uint64_t bytes[DSPBUF_METHOD_CNT];
+	uint64_t hugepage_fallback_cnt;
+} Stats;
+static pthread_mutex_t Stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t Hugepage_size = DEFAULT_HUGEPAGE_SIZE;
+static pthread_once_t Hugepage_size_once = PTHREAD_ONCE_INIT;
+
+static void hugepage_size_read(void) {
+	FILE *f = fopen("/proc/meminfo", "r");
+	if(f == NULL) {
+		return;
+	}
+	char line[128];
+	unsigned long kbytes = 0;
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if(sscanf(line, "Hugepagesize: %lu kB", &kbytes) == 1) {
+			if(kbytes > 0) {
+				Hugepage_size = kbytes * 1024;
+			}
+			break;
+		}
+	}
+	fclose(f);
+	debug_print(D_DSP, "huge page size: %zu bytes\n", Hugepage_size);
+}
+
+static size_t round_up(size_t len, size_t multiple) {
+	return (len + multiple - 1) / multiple * multiple;
+}
+
+static void *alloc_hugetlb(size_t len, size_t *alloc_len) {
+#ifdef MAP_HUGETLB
+	// munmap() on hugetlbfs mappings requires the length to be
+	// a multiple of the huge page size
+	*alloc_len = round_up(len, Hugepage_size);
+	void *ptr = mmap(NULL, *alloc_len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if(ptr == MAP_FAILED) {
+		debug_print(D_DSP, "mmap(MAP_HUGETLB, %zu) failed: %s\n", *alloc_len, strerror(errno));
+		return NULL;
+	}
+	return ptr;     // mmap returns zeroed memory
+#else
+	UNUSED(len);
+	UNUSED(alloc_len);
+	return NULL;
+#endif
+}
+
+static void *alloc_thp(size_t len, size_t *alloc_len) {
+#ifdef MADV_HUGEPAGE
+	void *ptr = NULL;
+	*alloc_len = round_up(len, Hugepage_size);
+	if(posix_memalign(&ptr, Hugepage_size, *alloc_len) != 0) {
+		return NULL;
+	}
+	if(madvise(ptr, *alloc_len, MADV_HUGEPAGE) != 0) {
+		debug_print(D_DSP, "madvise(MADV_HUGEPAGE, %zu) failed: %s\n", *alloc_len, strerror(errno));
+		free(ptr);
+		return NULL;
+	}
+	memset(ptr, 0, *alloc_len);
+	return ptr;
+#else
+	UNUSED(len);
+	UNUSED(alloc_len);
+	return NULL;
+#endif
+}
+
+static void *alloc_regular(size_t len, size_t *alloc_len) {
+	void *ptr = NULL;
+	*alloc_len = len;
+	if(posix_memalign(&ptr, DSPBUF_ALIGNMENT, len) != 0) {
+		return NULL;
+	}
+	memset(ptr, 0, len);
+	return ptr;
+}
+
+void *dspbuf_alloc(size_t nmemb, size_t size, char const *file, int line, char const *func) {
+	pthread_once(&Hugepage_size_once, hugepage_size_read);
+
+	size_t len = nmemb * size;
+	size_t total_len = len + DSPBUF_ALIGNMENT;     // room for the header
+	size_t alloc_len = 0;
+	void *base = NULL;
+	enum dspbuf_method method = DSPBUF_REGULAR;
+	bool hugepage_wanted = len >= DSPBUF_HUGEPAGE_THRESHOLD;
+
+	if(hugepage_wanted) {
+		if((base = alloc_hugetlb(total_len, &alloc_len)) != NULL) {
+			method = DSPBUF_HUGETLB;
+		} else if((base = alloc_thp(total_len, &alloc_len)) != NULL) {
+			method = DSPBUF_THP;
+		}
+	}
+	if(base == NULL) {
+		if((base = alloc_regular(total_len, &alloc_len)) == NULL) {
+			fprintf(stderr, "%s:%d: %s(): dspbuf_alloc(%zu, %zu) failed: %s\n",
+					file, line, func, nmemb, size, strerror(errno));
+			_exit(1);
+		}
+		method = DSPBUF_REGULAR;
+	}
+
+	struct dspbuf_hdr *hdr = base;
+	hdr->base = base;
+	hdr->alloc_len = alloc_len;
+	hdr->len = len;
+	hdr->method = method;
+
+	pthread_mutex_lock(&Stats_lock);
+	Stats.cnt[method]++;
+	Stats.bytes[method] += alloc_len;
+	if(hugepage_wanted && method == DSPBUF_REGULAR) {
+		Stats.hugepage_fallback_cnt++;
+	}
+	pthread_mutex_unlock(&Stats_lock);
+
+#ifndef DEBUG
+	UNUSED(file);
+	UNUSED(line);
+	UNUSED(func);
+	UNUSED(dspbuf_method_names);
+#endif
+	debug_print(D_DSP, "%s:%d: %s(): %zu bytes, method: %s, allocated: %zu bytes\n",
+			file, line, func, len, dspbuf_method_names[method], alloc_len);
+	return (uint8_t *)base + DSPBUF_ALIGNMENT;
+}
+
+void dspbuf_free(void *ptr) {
+	if(ptr == NULL) {
+		return;
+	}
+	struct dspbuf_hdr *hdr = (struct dspbuf_hdr *)((uint8_t *)ptr - DSPBUF_ALIGNMENT);
+	ASSERT(hdr->base == hdr);
+	enum dspbuf_method method = hdr->method;
+	size_t alloc_len = hdr->alloc_len;
+	if(method == DSPBUF_HUGETLB) {
+		if(munmap(hdr->base, alloc_len) != 0) {
+			fprintf(stderr, "dspbuf_free: munmap failed: %s\n", strerror(errno));
+		}
+	} else {
+		free(hdr->base);
+	}
+	pthread_mutex_lock(&Stats_lock);
+	Stats.cnt[method]--;
+	Stats.bytes[method] -= alloc_len;
+	pthread_mutex_unlock(&Stats_lock);
+}
+
+static int memfd_open(char const *name) {
+#ifdef SYS_memfd_create
+	// Called through syscall(), since the glibc wrapper is not available
+	// in older versions and requires _GNU_SOURCE. 1 = MFD_CLOEXEC
+	return (int)syscall(SYS_memfd_create, name, 1U);
+#else
+	UNUSED(name);
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+// Allocates a ring buffer of at least nmemb elements of the given size.
+// The underlying memory is mapped twice, back to back, so that a block of up
+// to *capacity elements starting anywhere in the buffer can be accessed
+// contiguously - element i + *capacity is the same memory as element i.
+// *capacity is nmemb rounded up to a multiple of the page size.
+// Returns NULL when the system does not allow such mapping; the caller
+// should then fall back to a regular buffer.
+void *dspbuf_alloc_mirrored(size_t nmemb, size_t size, size_t *capacity) {
+	ASSERT(capacity != NULL);
+	long page_size = sysconf(_SC_PAGESIZE);
+	if(page_size <= 0 || (size_t)page_size % size != 0) {
+		return NULL;
+	}
+	size_t len = round_up(nmemb * size, (size_t)page_size);
+	int fd = memfd_open("dumphfdl-ring");
+	if(fd < 0) {
+		debug_print(D_DSP, "memfd_create failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	uint8_t *base = MAP_FAILED;
+	if(ftruncate(fd, (off_t)len) != 0) {
+		debug_print(D_DSP, "ftruncate(%zu) failed: %s\n", len, strerror(errno));
+		goto fail;
+	}
+	// Reserve address space for both copies, then map the file over it
+	base = mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED) {
+		debug_print(D_DSP, "mmap(%zu) failed: %s\n", 2 * len, strerror(errno));
+		goto fail;
+	}
+	for(int32_t i = 0; i < 2; i++) {
+		if(mmap(base + i * len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+					fd, 0) == MAP_FAILED) {
+			debug_print(D_DSP, "mmap(MAP_FIXED, %zu) failed: %s\n", len, strerror(errno));
+			goto fail;
+		}
+	}
+	close(fd);      // the mappings keep the memory alive
+
+	pthread_mutex_lock(&Stats_lock);
+	Stats.cnt[DSPBUF_MIRRORED]++;
+	Stats.bytes[DSPBUF_MIRRORED] += len;
+	pthread_mutex_unlock(&Stats_lock);
+	debug_print(D_DSP, "%zu bytes, method: %s, allocated: %zu bytes\n",
+			nmemb * size, dspbuf_method_names[DSPBUF_MIRRORED], len);
+	*capacity = len / size;
+	return base;    // memfd pages are zeroed
+fail:
+	if(base != MAP_FAILED) {
+		munmap(base, 2 * len);
+	}
+	close(fd);
+	return NULL;
+}
+
+// capacity and size must be the same as returned from and passed to
+// dspbuf_alloc_mirrored(), respectively.
+void dspbuf_free_mirrored(void *ptr, size_t capacity, size_t size) {
+	if(ptr == NULL) {
+		return;
+	}
+	size_t len = capacity * size;
+	if(munmap(ptr, 2 * len) != 0) {
+		fprintf(stderr, "dspbuf_free_mirrored: munmap failed: %s\n", strerror(errno));
+	}
+	pthread_mutex_lock(&Stats_lock);
+	Stats.cnt[DSPBUF_MIRRORED]--;
+	Stats.bytes[DSPBUF_MIRRORED] -= len;
+	pthread_mutex_unlock(&Stats_lock);
+}
+
+void dspbuf_print_stats(void) {
+	pthread_mutex_lock(&Stats_lock);
+	for(int32_t i = 0; i < DSPBUF_METHOD_CNT; i++) {
+		debug_print(D_DSP, "%s: %" PRIu64 " buffers, %" PRIu64 " bytes\n",
+				dspbuf_method_names[i], Stats.cnt[i], Stats.bytes[i]);
+	}
+	if(Stats.hugepage_fallback_cnt > 0) {
+		fprintf(stderr, "Warning: %" PRIu64 " large DSP buffer(s) could not be placed on huge pages; "
+				"enable transparent huge pages or reserve hugetlbfs pages (vm.nr_hugepages) "
+				"for better performance\n", Stats.hugepage_fallback_cnt);
+	}
+	pthread_mutex_unlock(&Stats_lock);
+}
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stddef.h>             // size_t
+
+// Alignment of all buffers returned by dspbuf_alloc().
+// 64 bytes is a cache line and is sufficient for any SIMD instruction set
+// which FFTW may use (SSE, AVX, AVX-512).
+#define DSPBUF_ALIGNMENT 64
+
+// Allocations of at least this size are backed with huge pages, if possible.
+#define DSPBUF_HUGEPAGE_THRESHOLD (1024 * 1024)
+
+// Allocates a zeroed, DSPBUF_ALIGNMENT-aligned buffer of nmemb * size bytes.
+// Large buffers are placed on huge pages when the system allows it.
+// Never returns NULL (aborts the program on allocation failure, like XCALLOC).
+#define DSPBUF_ALLOC(nmemb, size) dspbuf_alloc((nmemb), (size), __FILE__, __LINE__, __func__)
+#define DSPBUF_FREE(ptr) do { dspbuf_free(ptr); ptr = NULL; } while(0)
+
+void *dspbuf_alloc(size_t nmemb, size_t size, char const *file, int line, char const *func);
+void dspbuf_free(void *ptr);
+void *dspbuf_alloc_mirrored(size_t nmemb, size_t size, size_t *capacity);
+void dspbuf_free_mirrored(void *ptr, size_t capacity, size_t size);
+void dspbuf_print_stats(void);
@@ -31,12 +31,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <string.h>             // memset
 #include <complex.h>
+#include <pthread.h>            // pthread_mutex_*
 #include "config.h"             // FASTDDC_DEBUG
 #include "fastddc.h"
 #include "fft.h"
 #include "libcsdr.h"
 #include "libcsdr_gpl.h"
+#include "nco.h"                // nco_set_frequency
 #include "util.h"               // debug_print, XCALLOC, NEW, XFREE
+#include "dspbuf.h"             // DSPBUF_ALLOC, DSPBUF_FREE
 
 //DDC implementation based on:
 //http://www.3db-labs.com/01598092_MultibandFilterbank.pdf
@@ -195,12 +198,35 @@ decimating_shift_addition_status_t fastddc_inv_cc(float complex *input, float co
 
 	//Overlap is scrapped, not added
 	//Shift correction
-	shift_stat = decimating_shift_addition_cc(inv_output+ddc->scrap, output, ddc->post_input_size, ddc->dsadata, ddc->post_decimation, shift_stat);
+	shift_stat = decimating_shift_addition_cc(inv_output+ddc->scrap, output, ddc->post_input_size, &ddc->dsadata, ddc->post_decimation, shift_stat);
 	//shift_stat.output_size = ddc->post_input_size; //bypass shift correction
 	//memcpy(output, inv_output+ddc->scrap, sizeof(float complex)*ddc->post_input_size);
 	return shift_stat;
 }
 
+// All channels of an input have the same FFT size, so the forward FFT of
+// the filter taps is planned once and executed on each channel's buffers.
+// Channels may be created concurrently.
+static FFT_PLAN_T *Taps_plan = NULL;
+static pthread_mutex_t Taps_plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void filter_taps_fft(float complex *taps, float complex *taps_fft, int32_t fft_size) {
+	pthread_mutex_lock(&Taps_plan_lock);
+	if(Taps_plan == NULL) {
+		Taps_plan = csdr_make_fft_c2c(fft_size, taps, taps_fft, 1, 0);
+	}
+	FFT_PLAN_T *plan = Taps_plan;
+	pthread_mutex_unlock(&Taps_plan_lock);
+	if(plan->size == fft_size) {
+		// Buffers from DSPBUF_ALLOC always have the same alignment
+		csdr_fft_execute_dft(plan, taps, taps_fft);
+	} else {
+		plan = csdr_make_fft_c2c(fft_size, taps, taps_fft, 1, 0);
+		csdr_fft_execute(plan);
+		csdr_destroy_fft_c2c(plan);
+	}
+}
+
 fft_channelizer fft_channelizer_create(int32_t decimation, float transition_bw, float freq_shift) {
 	window_t window = WINDOW_HAMMING;
 
@@ -213,23 +239,21 @@ fft_channelizer fft_channelizer_create(int32_t decimation, float transition_bw,
 	fastddc_print(c->ddc,"fastddc_inv_cc");
 
 	//prepare making the filter and doing FFT on it
-	float complex *taps = XCALLOC(c->ddc->fft_size, sizeof(float complex));
-	c->filtertaps_fft = XCALLOC(c->ddc->fft_size, sizeof(float complex));
-	FFT_PLAN_T *filter_taps_plan = csdr_make_fft_c2c(c->ddc->fft_size, taps, c->filtertaps_fft, 1, 0);
+	float complex *taps = DSPBUF_ALLOC(c->ddc->fft_size, sizeof(float complex));
+	c->filtertaps_fft = DSPBUF_ALLOC(c->ddc->fft_size, sizeof(float complex));
 
 	//make the filter
 	float filter_half_bw = 0.5f / decimation;
 	debug_print(D_DSP, "preparing a bandpass filter of [%g, %g] cutoff rates. Real transition bandwidth is: %g\n",
 			(-freq_shift) - filter_half_bw, (-freq_shift) + filter_half_bw, 4.0 / c->ddc->taps_length);
 	firdes_bandpass_c(taps, c->ddc->taps_length, (-freq_shift) - filter_half_bw, (-freq_shift) + filter_half_bw, window);
-	csdr_fft_execute(filter_taps_plan);
+	filter_taps_fft(taps, c->filtertaps_fft, c->ddc->fft_size);
 	fft_swap_sides(c->filtertaps_fft, c->ddc->fft_size);
-	csdr_destroy_fft_c2c(filter_taps_plan);
-	XFREE(taps);
+	DSPBUF_FREE(taps);
 
 	//make FFT plan
-	c->inv_input = XCALLOC(c->ddc->fft_size, sizeof(float complex));
-	c->inv_output = XCALLOC(c->ddc->fft_size, sizeof(float complex));
+	c->inv_input = DSPBUF_ALLOC(c->ddc->fft_size, sizeof(float complex));
+	c->inv_output = DSPBUF_ALLOC(c->ddc->fft_size, sizeof(float complex));
 	c->inv_plan = csdr_make_fft_c2c(c->ddc->fft_inv_size, c->inv_input, c->inv_output, 0, 0);
 
 	return c;
@@ -238,14 +262,29 @@ fail:
 	return NULL;
 }
 
+// Shifts the output of the channelizer by the given offset, relative to
+// the frequency shift given at creation time (in cycles per output sample).
+void fft_channelizer_set_freq_offset(fft_channelizer c, float offset) {
+	ASSERT(c != NULL);
+	shift_addition_data_t *d = &c->ddc->dsadata;
+	nco_set_frequency(&d->nco, d->rate / 2.0f + offset);
+}
+
 void fft_channelizer_destroy(fft_channelizer c) {
 	if(c == NULL) {
 		return;
 	}
 	csdr_destroy_fft_c2c(c->inv_plan);
-	XFREE(c->inv_output);
-	XFREE(c->inv_input);
-	XFREE(c->filtertaps_fft);
+	DSPBUF_FREE(c->inv_output);
+	DSPBUF_FREE(c->inv_input);
+	DSPBUF_FREE(c->filtertaps_fft);
 	XFREE(c->ddc);
 	XFREE(c);
 }
+
+void fft_channelizer_cleanup(void) {
+	pthread_mutex_lock(&Taps_plan_lock);
+	csdr_destroy_fft_c2c(Taps_plan);
+	Taps_plan = NULL;
+	pthread_mutex_unlock(&Taps_plan_lock);
+}
@@ -1,9 +1,8 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 
 #include <stdint.h>
-#include <string.h>         // memcpy, memmove
+#include <string.h>         // memmove
 #include <pthread.h>        // pthread_*
-#include <liquid/liquid.h>  // cbuffercf_*
 #include "config.h"
 #ifndef HAVE_PTHREAD_BARRIERS
 #include "pthread_barrier.h"
@@ -12,33 +11,88 @@
 #include "fastddc.h"        // fastddc_t
 #include "fft.h"
 #include "util.h"           // XCALLOC, NEW
+#include "dspbuf.h"         // DSPBUF_ALLOC, DSPBUF_FREE, dspbuf_*_mirrored
+#include "runstats.h"       // runstats_stage_thread_done
 
+// Number of distinct buffer alignments (relative to the SIMD alignment
+// used by FFTW) which a FFT frame in the input ring may start at
+#define PLAN_SLOT_CNT (DSPBUF_ALIGNMENT / sizeof(float complex))
+
+// FFT input samples are stored in a mirrored ring buffer (see
+// dspbuf_alloc_mirrored). Each FFT frame (overlap + new samples) is then
+// a contiguous region of the ring, so the FFT reads it in place and
+// the overlap does not have to be copied on every frame.
+// If the ring can't be allocated, a regular buffer is used instead
+// and the overlap is moved to its beginning before each FFT.
 struct fft {
 	struct block block;
 	fastddc_t *ddc;
-	float complex *input;
+	float complex *input;       // used when ring == NULL
+	float complex *ring;
+	size_t ring_len;            // ring capacity (samples)
+	size_t write_pos;           // ring position where new samples go
+	// Plans can't be created in fft_create because the output buffer
+	// is created by block_connect_one2many() which is called after fft_create().
+	FFT_PLAN_T *fwd_plans[PLAN_SLOT_CNT];
 };
 
+// Returns a forward FFT plan suitable for the given input frame.
+// FFTW plans may only be executed on arrays with the same alignment
+// as the one they have been created with, so a separate plan is created
+// for each alignment a frame happens to start at.
+static FFT_PLAN_T *fwd_plan_get(FFT_PLAN_T **plans, int32_t fft_size,
+		float complex *input, float complex *output) {
+	size_t slot = (size_t)csdr_fft_alignment_of(input) / sizeof(float complex);
+	ASSERT(slot < PLAN_SLOT_CNT);
+	if(plans[slot] == NULL) {
+		// FFTW_ESTIMATE planning does not overwrite the input
+		plans[slot] = csdr_make_fft_c2c(fft_size, input, output, 1, 0);
+		debug_print(D_DSP, "created forward FFT plan for alignment slot %zu\n", slot);
+	}
+	return plans[slot];
+}
+
+// Takes ddc->input_size samples from the input buffer and puts
+// the FFT of the next frame in the output buffer
+static void fft_process(struct fft *fft, struct circ_buffer *circ_buffer, float complex *output) {
+	fastddc_t *ddc = fft->ddc;
+	float complex *frame;
+	// Conversion from the native sample format is done without holding
+	// the lock. The producer does not touch samples which have not
+	// been released yet.
+	if(fft->ring != NULL) {
+		// Samples written past the end of the ring wrap around to its beginning
+		circ_buffer_read(circ_buffer, ddc->input_size, fft->ring + fft->write_pos);
+		frame = fft->ring + (fft->write_pos + fft->ring_len - ddc->overlap_length) % fft->ring_len;
+		fft->write_pos = (fft->write_pos + ddc->input_size) % fft->ring_len;
+	} else {
+		memmove(fft->input, fft->input + ddc->input_size, ddc->overlap_length * sizeof(float complex));
+		circ_buffer_read(circ_buffer, ddc->input_size, fft->input + ddc->overlap_length);
+		frame = fft->input;
+	}
+	pthread_mutex_lock(circ_buffer->mutex);
+	circ_buffer_release(circ_buffer, ddc->input_size);
+	pthread_mutex_unlock(circ_buffer->mutex);
+
+	FFT_PLAN_T *fwd_plan = fwd_plan_get(fft->fwd_plans, ddc->fft_size, frame, output);
+	csdr_fft_execute_dft(fwd_plan, frame, output);
+	// FIXME: rework fastddc_inv_cc, so that this step is not needed
+	fft_swap_sides(output, ddc->fft_size);
+}
+
 static void *fft_thread(void *ctx) {
 	struct block *block = ctx;
 	struct fft *fft = container_of(block, struct fft, block);
 	struct circ_buffer *circ_buffer = &block->consumer.in->circ_buffer;
 	struct shared_buffer *output = &block->producer.out->shared_buffer;
 	fastddc_t *ddc = fft->ddc;
-	float complex *cbuf_read_ptr;
-	uint32_t samples_read;
-	float complex *fft_input = fft->input;
-
-	// The plan can't be created in fft_create because the output buffer
-	// is created by block_connect_one2many() which is called after fft_create().
-	FFT_PLAN_T *fwd_plan = csdr_make_fft_c2c(ddc->fft_size, fft_input, output->buf, 1, 0);
 
 	pthread_barrier_wait(output->consumers_ready);         // Wait for all consumers to initialize
 	while(true) {
 		pthread_mutex_lock(circ_buffer->mutex);
 		// Check for shutdown signal only when there is no data (or not enough data) in the buffer.
 		// This causes all the data to be processed and flushed to consumers before shutdown is done.
-		while(cbuffercf_size(circ_buffer->buf) < (uint32_t)ddc->input_size) {
+		while(circ_buffer_size(circ_buffer) < (size_t)ddc->input_size) {
 			if(block_connection_is_shutdown_signaled(block->consumer.in)) {
 				debug_print(D_MISC, "Exiting (ordered shutdown)\n");
 				pthread_mutex_unlock(circ_buffer->mutex);
@@ -46,27 +100,33 @@ static void *fft_thread(void *ctx) {
 			}
 			pthread_cond_wait(circ_buffer->cond, circ_buffer->mutex);
 		}
-		memmove(fft_input, fft_input + ddc->input_size, ddc->overlap_length * sizeof(float complex));
-		cbuffercf_read(circ_buffer->buf, ddc->input_size, &cbuf_read_ptr, &samples_read);
-		ASSERT(samples_read == (uint32_t)ddc->input_size);
-		memcpy(fft_input + ddc->overlap_length, cbuf_read_ptr,
-				ddc->input_size * sizeof(float complex));
-		cbuffercf_release(circ_buffer->buf, ddc->input_size);
 		pthread_mutex_unlock(circ_buffer->mutex);
-
-		csdr_fft_execute(fwd_plan);
-		// FIXME: rework fastddc_inv_cc, so that this step is not needed
-		fft_swap_sides(output->buf, ddc->fft_size);
+		fft_process(fft, circ_buffer, output->buf);
 		pthread_barrier_wait(output->data_ready);
 		pthread_barrier_wait(output->consumers_ready);
 	}
 shutdown:
 	block_connection_one2many_shutdown(block->producer.out);
-	csdr_destroy_fft_c2c(fwd_plan);
+	runstats_stage_thread_done(RUNSTATS_STAGE_FFT);
 	block->running = false;
 	return NULL;
 }
 
+// Deterministic mode: computes one FFT frame, if there are enough
+// samples in the input buffer. Consumers are stepped by the caller
+// before the next frame overwrites the output buffer.
+static bool fft_step(struct block *block) {
+	struct fft *fft = container_of(block, struct fft, block);
+	struct circ_buffer *circ_buffer = &block->consumer.in->circ_buffer;
+	pthread_mutex_lock(circ_buffer->mutex);
+	bool ready = circ_buffer_size(circ_buffer) >= (size_t)fft->ddc->input_size;
+	pthread_mutex_unlock(circ_buffer->mutex);
+	if(ready) {
+		fft_process(fft, circ_buffer, block->producer.out->shared_buffer.buf);
+	}
+	return ready;
+}
+
 struct block *fft_create(int32_t decimation, float transition_bw) {
 	NEW(struct fft, fft);
 	NEW(fastddc_t, ddc);
@@ -76,19 +136,28 @@ struct block *fft_create(int32_t decimation, float transition_bw) {
 	}
 	fastddc_print(ddc,"fastddc_fwd_cc");
 	fft->ddc = ddc;
-	fft->input = XCALLOC(ddc->fft_size, sizeof(float complex));
+	fft->ring = dspbuf_alloc_mirrored(ddc->fft_size, sizeof(float complex), &fft->ring_len);
+	if(fft->ring == NULL) {
+		debug_print(D_DSP, "mirrored ring not available, using a regular FFT input buffer\n");
+		fft->input = DSPBUF_ALLOC(ddc->fft_size, sizeof(float complex));
+	}
 	struct producer producer = { .type = PRODUCER_MULTI, .max_tu = ddc->fft_size };
 	struct consumer consumer = { .type = CONSUMER_SINGLE, .min_ru = ddc->fft_size };
 	fft->block.producer = producer;
 	fft->block.consumer = consumer;
 	fft->block.thread_routine = fft_thread;
+	fft->block.step = fft_step;
 	return &fft->block;
 }
 
 void fft_destroy(struct block *fft_block) {
 	if(fft_block != NULL) {
 		struct fft *fft = container_of(fft_block, struct fft, block);
-		XFREE(fft->input);
+		for(size_t i = 0; i < PLAN_SLOT_CNT; i++) {
+			csdr_destroy_fft_c2c(fft->fwd_plans[i]);
+		}
+		dspbuf_free_mirrored(fft->ring, fft->ring_len, sizeof(float complex));
+		DSPBUF_FREE(fft->input);
 		XFREE(fft->ddc);
 		XFREE(fft);
 	}
@@ -24,6 +24,8 @@ FFT_PLAN_T* csdr_make_fft_c2c(int32_t size, float complex *input,
 		float complex *output, int32_t forward, int32_t benchmark);
 void csdr_destroy_fft_c2c(FFT_PLAN_T *plan);
 void csdr_fft_execute(FFT_PLAN_T* plan);
+void csdr_fft_execute_dft(FFT_PLAN_T *plan, float complex *input, float complex *output);
+int32_t csdr_fft_alignment_of(float complex *ptr);
 
 // fft.c
 struct block *fft_create(int32_t decimation, float transition_bw);
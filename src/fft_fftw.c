@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include <complex.h>
+#include <pthread.h>        // pthread_mutex_*
 #include <fftw3.h>
 #include "fft.h"
 #include "util.h"           // NEW
@@ -7,6 +8,10 @@
 
 #define FFT_THREAD_CNT 4
 
+// FFTW planner is not thread-safe, while plans may be created
+// by several fft threads at the same time
+static pthread_mutex_t Planner_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void csdr_fft_init() {
 #ifdef WITH_FFTW3F_THREADS
 	fftwf_init_threads();
@@ -22,8 +27,10 @@ void csdr_fft_destroy() {
 
 FFT_PLAN_T* csdr_make_fft_c2c(int32_t size, float complex* input, float complex* output, int32_t forward, int32_t benchmark) {
 	NEW(FFT_PLAN_T, plan);
+	pthread_mutex_lock(&Planner_lock);
 	// fftwf_complex is binary compatible with float complex
 	plan->plan = fftwf_plan_dft_1d(size, (fftwf_complex *)input, (fftwf_complex *)output, forward ? FFTW_FORWARD : FFTW_BACKWARD, benchmark ? FFTW_MEASURE : FFTW_ESTIMATE);
+	pthread_mutex_unlock(&Planner_lock);
 	plan->size = size;
 	plan->input = input;
 	plan->output = output;
@@ -32,7 +39,9 @@ FFT_PLAN_T* csdr_make_fft_c2c(int32_t size, float complex* input, float complex*
 
 void csdr_destroy_fft_c2c(FFT_PLAN_T *plan) {
 	if(plan) {
+		pthread_mutex_lock(&Planner_lock);
 		fftwf_destroy_plan(plan->plan);
+		pthread_mutex_unlock(&Planner_lock);
 		XFREE(plan);
 	}
 }
@@ -40,3 +49,14 @@ void csdr_destroy_fft_c2c(FFT_PLAN_T *plan) {
 void csdr_fft_execute(FFT_PLAN_T* plan) {
 	fftwf_execute(plan->plan);
 }
+
+// Executes the plan on different arrays than the ones it has been created for.
+// The arrays must have the same alignment (see csdr_fft_alignment_of)
+// as the original ones.
+void csdr_fft_execute_dft(FFT_PLAN_T *plan, float complex *input, float complex *output) {
+	fftwf_execute_dft(plan->plan, (fftwf_complex *)input, (fftwf_complex *)output);
+}
+
+int32_t csdr_fft_alignment_of(float complex *ptr) {
+	return fftwf_alignment_of((float *)ptr);
+}
@@ -3,7 +3,7 @@
 #include <time.h>                       // struct tm, strftime
 #include "globals.h"                    // AC_cache, Config
 #include "output-common.h"              // fmtr_descriptor_t
-#include "position.h"                   // position_info_*
+#include "summary.h"                    // struct msg_summary
 #include "util.h"                       // ASSERT, XCALLOC, XFREE, struct octet_string
 #include "pdu.h"                        // struct hfdl_pdu_metadata
 
@@ -13,7 +13,7 @@ static bool fmtr_basestation_supports_data_type(fmtr_input_type_t type) {
 	return(type == FMTR_INTYPE_DECODED_FRAME);
 }
 
-static char *format_timestamp(struct tm *tm) {
+static char *format_timestamp(struct tm const *tm) {
 	ASSERT(tm);
 
 	size_t bufsize = 30;
@@ -23,30 +23,29 @@ static char *format_timestamp(struct tm *tm) {
 }
 
 static struct octet_string *fmtr_basestation_format_decoded_msg(struct metadata *metadata,
-		la_proto_node *root) {
-	UNUSED(metadata);
-	ASSERT(root != NULL);
+		la_proto_node *root, struct msg_summary const *summary) {
+	UNUSED(root);
+	ASSERT(summary != NULL);
 
-	struct position_info *pos_info = position_info_extract(root);
-	if(pos_info == NULL) {
+	if(summary->position_present == false) {
 	    return NULL;
 	}
 
-	struct octet_string *result = NULL;
+	struct position const *pos = &summary->position;
 	time_t now = time(NULL);
-	if(pos_info->position.timestamp.t > now) {
-		debug_print(D_MISC, "pos_info rejected: timestamp %ld is in the future\n",
-				pos_info->position.timestamp.t);
-		goto cleanup;
-	} else if(pos_info->position.timestamp.t + POSITION_MAX_AGE < now) {
-		debug_print(D_MISC, "pos_info (%f, %f) rejected: timestamp %ld too old\n",
-				pos_info->position.location.lat,
-				pos_info->position.location.lon,
-				pos_info->position.timestamp.t);
-		goto cleanup;
+	if(pos->timestamp.t > now) {
+		debug_print(D_MISC, "position rejected: timestamp %ld is in the future\n",
+				pos->timestamp.t);
+		return NULL;
+	} else if(pos->timestamp.t + POSITION_MAX_AGE < now) {
+		debug_print(D_MISC, "position (%f, %f) rejected: timestamp %ld too old\n",
+				pos->location.lat,
+				pos->location.lon,
+				pos->timestamp.t);
+		return NULL;
 	}
 
-	char *timestamp = format_timestamp(&pos_info->position.timestamp.tm);
+	char *timestamp = format_timestamp(&pos->timestamp.tm);
 	la_vstring *vstr = la_vstring_new();
 
 	int32_t frequency = 0;
@@ -56,21 +55,19 @@ static struct octet_string *fmtr_basestation_format_decoded_msg(struct metadata
 		frequency = hm->freq / 1000;
 	}
 	la_vstring_append_sprintf(vstr, "MSG,3,1,1,%06X,1,%s,%s,%s,,,,%f,%f,,%d,,,,0\n",
-			pos_info->aircraft.icao_address,
+			summary->icao_address,
 			timestamp,
 			timestamp,
-			pos_info->aircraft.flight_id != NULL ? pos_info->aircraft.flight_id : "",
-			pos_info->position.location.lat,
-			pos_info->position.location.lon,
+			summary->flight_id,
+			pos->location.lat,
+			pos->location.lon,
 			frequency
 			);
 
 	XFREE(timestamp);
 
-	result = octet_string_new(vstr->str, vstr->len);
+	struct octet_string *result = octet_string_new(vstr->str, vstr->len);
 	la_vstring_destroy(vstr, false);
-cleanup:
-	position_info_destroy(pos_info);
 	return result;
 }
 
@@ -81,4 +78,5 @@ fmtr_descriptor_t fmtr_DEF_basestation = {
 	.format_raw_msg = NULL,
 	.supports_data_type = fmtr_basestation_supports_data_type,
 	.output_format = OFMT_TEXT,
+	.decode_level = PDU_DECODE_POSITIONS,
 };
@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>                     // memset, strcmp, strncpy
+#include <inttypes.h>                   // PRIu64, PRId64
+#include <time.h>                       // time_t, struct tm, gmtime_r, strftime
+#include <libacars/libacars.h>          // la_proto_node
+#include <libacars/vstring.h>           // la_vstring
+#include "fmtr-perfstats.h"
+#include "output-common.h"              // fmtr_descriptor_t
+#include "summary.h"                    // struct msg_summary
+#include "globals.h"                    // Systable, Systable_lock, Systable_unlock
+#include "systable.h"                   // systable_get_station_*
+#include "util.h"                       // ASSERT, UNUSED, XCALLOC, XFREE, EOL, container_of, struct octet_string
+#include "pdu.h"                        // struct hfdl_pdu_metadata
+
+// Link statistics aggregated in-process.
+//
+// Instead of passing every Performance Data HFNPDU downstream, the formatter
+// sums up the counters reported by aircraft per ground station, frequency
+// and hour, together with message counts per receiver channel. Hourly buckets
+// are kept in a ring covering the last day. A report covering the current hour
+// and the whole ring is emitted periodically and when the hour changes.
+// Time is taken from message timestamps, so that reports are consistent
+// when processing recorded files.
+//
+// Frequency search counts reported by aircraft are cumulative over the
+// flight leg, so only the increase since the previous report from the same
+// aircraft is accounted. The first report heard from an aircraft only sets
+// the baseline.
+
+#define PERFSTATS_HOURS 24
+#define PERFSTATS_GS_FREQ_MAX 128           // GS/frequency pairs per hour
+#define PERFSTATS_CHANNELS_MAX 64           // receiver channels per hour
+#define PERFSTATS_REPORT_INTERVAL 600       // seconds
+#define PERFSTATS_AIRCRAFT_MAX 1024         // aircraft tracked for frequency search counts
+#define HOUR 3600
+
+struct gs_freq_stats {
+	uint64_t mpdus_rx;
+	uint64_t mpdus_rx_errs;
+	uint64_t mpdus_tx;
+	uint64_t mpdus_delivered;
+	uint64_t spdus_rx;
+	uint64_t spdus_rx_errs;
+	uint64_t freq_search_cnt;
+	uint32_t report_cnt;
+	uint8_t gs_id;
+	uint8_t freq_id;
+};
+
+struct channel_stats {
+	uint64_t msg_cnt;
+	uint64_t crc_err_cnt;
+	int32_t freq;
+};
+
+// Last frequency search count reported by an aircraft
+struct aircraft_stats {
+	time_t last_seen;
+	uint32_t icao_address;
+	uint16_t freq_search_cnt;
+	uint8_t flight_leg;
+	char flight_id[SUMMARY_FLIGHT_ID_LEN + 1];
+	bool in_use;
+};
+
+struct perfstats_bucket {
+	time_t hour;                            // start of the hour
+	bool in_use;
+	int32_t gs_freq_cnt;
+	int32_t channel_cnt;
+	struct gs_freq_stats gs_freqs[PERFSTATS_GS_FREQ_MAX];
+	struct channel_stats channels[PERFSTATS_CHANNELS_MAX];
+};
+
+// Formatters are run by the PDU decoder thread only, so no locking is necessary
+static struct perfstats_bucket Buckets[PERFSTATS_HOURS];
+static struct aircraft_stats Aircraft[PERFSTATS_AIRCRAFT_MAX];
+static time_t Last_report_time;
+static bool Last_report_time_set;
+static int64_t Overflow_cnt;
+
+static bool fmtr_perfstats_supports_data_type(fmtr_input_type_t type) {
+	return(type == FMTR_INTYPE_DECODED_FRAME);
+}
+
+static struct perfstats_bucket *bucket_get(time_t hour) {
+	struct perfstats_bucket *b = &Buckets[(hour / HOUR) % PERFSTATS_HOURS];
+	if(b->in_use == false || b->hour != hour) {
+		memset(b, 0, sizeof(*b));
+		b->hour = hour;
+		b->in_use = true;
+	}
+	return b;
+}
+
+static struct gs_freq_stats *gs_freq_stats_get(struct perfstats_bucket *b, uint8_t gs_id, uint8_t freq_id) {
+	for(int32_t i = 0; i < b->gs_freq_cnt; i++) {
+		if(b->gs_freqs[i].gs_id == gs_id && b->gs_freqs[i].freq_id == freq_id) {
+			return &b->gs_freqs[i];
+		}
+	}
+	if(b->gs_freq_cnt == PERFSTATS_GS_FREQ_MAX) {
+		return NULL;
+	}
+	struct gs_freq_stats *s = &b->gs_freqs[b->gs_freq_cnt++];
+	s->gs_id = gs_id;
+	s->freq_id = freq_id;
+	return s;
+}
+
+static struct channel_stats *channel_stats_get(struct perfstats_bucket *b, int32_t freq) {
+	for(int32_t i = 0; i < b->channel_cnt; i++) {
+		if(b->channels[i].freq == freq) {
+			return &b->channels[i];
+		}
+	}
+	if(b->channel_cnt == PERFSTATS_CHANNELS_MAX) {
+		return NULL;
+	}
+	struct channel_stats *s = &b->channels[b->channel_cnt++];
+	s->freq = freq;
+	return s;
+}
+
+// Returns the number of frequency searches made by the aircraft since its
+// previous report. Aircraft are identified by the flight ID or, if it's
+// not available, by the ICAO address. When the table is full, the entry
+// which has not been heard from for the longest time is reused.
+static uint16_t freq_search_cnt_delta(time_t now, struct msg_summary const *summary) {
+	struct msg_perf_data const *pd = &summary->perf_data;
+	char const *flight_id = summary->flight_id_present ? summary->flight_id : "";
+	uint32_t icao_address = 0;
+	if(flight_id[0] == '\0') {
+		if(summary->icao_address_present == false) {
+			return 0;
+		}
+		icao_address = summary->icao_address;
+	}
+	struct aircraft_stats *a = NULL, *oldest = &Aircraft[0];
+	for(int32_t i = 0; i < PERFSTATS_AIRCRAFT_MAX; i++) {
+		struct aircraft_stats *e = &Aircraft[i];
+		if(e->in_use == false) {
+			if(oldest->in_use) {
+				oldest = e;
+			}
+			continue;
+		}
+		if(e->icao_address == icao_address && strcmp(e->flight_id, flight_id) == 0) {
+			a = e;
+			break;
+		}
+		if(oldest->in_use && e->last_seen < oldest->last_seen) {
+			oldest = e;
+		}
+	}
+	uint16_t delta = 0;
+	if(a == NULL) {
+		a = oldest;
+		memset(a, 0, sizeof(*a));
+		a->in_use = true;
+		a->icao_address = icao_address;
+		strncpy(a->flight_id, flight_id, SUMMARY_FLIGHT_ID_LEN);
+	} else if(a->flight_leg != pd->flight_leg || pd->freq_search_cnt < a->freq_search_cnt) {
+		// New flight leg - the counter has started over
+		delta = pd->freq_search_cnt;
+	} else {
+		delta = pd->freq_search_cnt - a->freq_search_cnt;
+	}
+	a->flight_leg = pd->flight_leg;
+	a->freq_search_cnt = pd->freq_search_cnt;
+	a->last_seen = now;
+	return delta;
+}
+
+static void gs_freq_stats_add(struct gs_freq_stats *dst, struct gs_freq_stats const *src) {
+	dst->mpdus_rx += src->mpdus_rx;
+	dst->mpdus_rx_errs += src->mpdus_rx_errs;
+	dst->mpdus_tx += src->mpdus_tx;
+	dst->mpdus_delivered += src->mpdus_delivered;
+	dst->spdus_rx += src->spdus_rx;
+	dst->spdus_rx_errs += src->spdus_rx_errs;
+	dst->freq_search_cnt += src->freq_search_cnt;
+	dst->report_cnt += src->report_cnt;
+}
+
+static void perfstats_update(struct perfstats_bucket *b, time_t now, int32_t freq,
+		struct msg_summary const *summary) {
+	struct channel_stats *cs = channel_stats_get(b, freq);
+	if(cs != NULL) {
+		cs->msg_cnt++;
+		if(summary->lpdu_type >= 0 && summary->lpdu_crc_ok == false) {
+			cs->crc_err_cnt++;
+		}
+	} else {
+		Overflow_cnt++;
+	}
+	if(summary->perf_data_present == false) {
+		return;
+	}
+	struct msg_perf_data const *pd = &summary->perf_data;
+	uint16_t freq_search_cnt = freq_search_cnt_delta(now, summary);
+	struct gs_freq_stats *gs = gs_freq_stats_get(b, pd->gs_id, pd->freq_id);
+	if(gs == NULL) {
+		Overflow_cnt++;
+		return;
+	}
+	gs_freq_stats_add(gs, &(struct gs_freq_stats){
+		.mpdus_rx = pd->mpdus_rx,
+		.mpdus_rx_errs = pd->mpdus_rx_errs,
+		.mpdus_tx = pd->mpdus_tx,
+		.mpdus_delivered = pd->mpdus_delivered,
+		.spdus_rx = pd->spdus_rx,
+		.spdus_rx_errs = pd->spdus_rx_errs,
+		.freq_search_cnt = freq_search_cnt,
+		.report_cnt = 1
+	});
+}
+
+static double percentage(uint64_t part, uint64_t total) {
+	return total > 0 ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+static void gs_freq_stats_format_text(la_vstring *vstr, struct gs_freq_stats const *s) {
+	la_vstring_append_sprintf(vstr,
+			"reports: %u, MPDUs rx: %" PRIu64 " rx_errs: %" PRIu64 " tx: %" PRIu64
+			" delivered: %" PRIu64 " (%.1f%%), SPDUs rx: %" PRIu64 " missed: %" PRIu64 " (%.1f%%)"
+			", freq searches: %" PRIu64,
+			s->report_cnt, s->mpdus_rx, s->mpdus_rx_errs, s->mpdus_tx,
+			s->mpdus_delivered, percentage(s->mpdus_delivered, s->mpdus_tx),
+			s->spdus_rx, s->spdus_rx_errs, percentage(s->spdus_rx_errs, s->spdus_rx + s->spdus_rx_errs),
+			s->freq_search_cnt);
+}
+
+// Formats the statistics of the given hour followed by the totals
+// for all hours in the ring
+static struct octet_string *perfstats_report(time_t now, time_t hour) {
+	struct perfstats_bucket const *cur = &Buckets[(hour / HOUR) % PERFSTATS_HOURS];
+	// The bucket might have been reused already if message timestamps went backwards
+	bool cur_valid = cur->in_use && cur->hour == hour;
+	int32_t cur_gs_freq_cnt = cur_valid ? cur->gs_freq_cnt : 0;
+	int32_t cur_channel_cnt = cur_valid ? cur->channel_cnt : 0;
+	struct perfstats_bucket *total = XCALLOC(1, sizeof(struct perfstats_bucket));
+	for(int32_t i = 0; i < PERFSTATS_HOURS; i++) {
+		struct perfstats_bucket const *b = &Buckets[i];
+		if(b->in_use == false || b->hour > hour || b->hour + PERFSTATS_HOURS * HOUR <= hour) {
+			continue;
+		}
+		for(int32_t j = 0; j < b->gs_freq_cnt; j++) {
+			struct gs_freq_stats *s = gs_freq_stats_get(total, b->gs_freqs[j].gs_id, b->gs_freqs[j].freq_id);
+			if(s != NULL) {
+				gs_freq_stats_add(s, &b->gs_freqs[j]);
+			}
+		}
+		for(int32_t j = 0; j < b->channel_cnt; j++) {
+			struct channel_stats *s = channel_stats_get(total, b->channels[j].freq);
+			if(s != NULL) {
+				s->msg_cnt += b->channels[j].msg_cnt;
+				s->crc_err_cnt += b->channels[j].crc_err_cnt;
+			}
+		}
+	}
+
+	char tbuf[30], hbuf[30];
+	struct tm tm;
+	gmtime_r(&now, &tm);
+	strftime(tbuf, sizeof(tbuf), "%F %T", &tm);
+	gmtime_r(&hour, &tm);
+	strftime(hbuf, sizeof(hbuf), "%F %H:%M", &tm);
+
+	la_vstring *vstr = la_vstring_new();
+	la_vstring_append_sprintf(vstr, "[%s UTC] Link statistics for the hour starting at %s UTC "
+			"(totals for the last %d hours in brackets)\n", tbuf, hbuf, PERFSTATS_HOURS);
+	Systable_lock();
+	for(int32_t i = 0; i < total->gs_freq_cnt; i++) {
+		struct gs_freq_stats const *t = &total->gs_freqs[i];
+		char const *gs_name = systable_get_station_name(Systable, t->gs_id);
+		double freq = systable_get_station_frequency(Systable, t->gs_id, t->freq_id);
+		la_vstring_append_sprintf(vstr, " GS %hhu (%s) ", t->gs_id, gs_name != NULL ? gs_name : "unknown");
+		if(freq > 0.0) {
+			la_vstring_append_sprintf(vstr, "%.1f kHz\n", freq);
+		} else {
+			la_vstring_append_sprintf(vstr, "freq %hhu\n", t->freq_id);
+		}
+		for(int32_t j = 0; j < cur_gs_freq_cnt; j++) {
+			if(cur->gs_freqs[j].gs_id == t->gs_id && cur->gs_freqs[j].freq_id == t->freq_id) {
+				la_vstring_append_sprintf(vstr, "  This hour: ");
+				gs_freq_stats_format_text(vstr, &cur->gs_freqs[j]);
+				EOL(vstr);
+				break;
+			}
+		}
+		la_vstring_append_sprintf(vstr, "  [");
+		gs_freq_stats_format_text(vstr, t);
+		la_vstring_append_sprintf(vstr, "]\n");
+	}
+	Systable_unlock();
+	for(int32_t i = 0; i < total->channel_cnt; i++) {
+		struct channel_stats const *t = &total->channels[i];
+		struct channel_stats const *c = NULL;
+		for(int32_t j = 0; j < cur_channel_cnt; j++) {
+			if(cur->channels[j].freq == t->freq) {
+				c = &cur->channels[j];
+				break;
+			}
+		}
+		la_vstring_append_sprintf(vstr, " Channel %.1f kHz: messages: %" PRIu64 " CRC errors: %.1f%% "
+				"[messages: %" PRIu64 " CRC errors: %.1f%%]\n",
+				(float)t->freq / 1000.f,
+				c != NULL ? c->msg_cnt : 0,
+				c != NULL ? percentage(c->crc_err_cnt, c->msg_cnt) : 0.0,
+				t->msg_cnt, percentage(t->crc_err_cnt, t->msg_cnt));
+	}
+	if(Overflow_cnt > 0) {
+		la_vstring_append_sprintf(vstr, " Messages not accounted due to table overflow: %" PRId64 "\n",
+				Overflow_cnt);
+	}
+	XFREE(total);
+
+	struct octet_string *result = octet_string_new(vstr->str, vstr->len);
+	la_vstring_destroy(vstr, false);
+	return result;
+}
+
+static struct octet_string *fmtr_perfstats_format_decoded_msg(struct metadata *metadata,
+		la_proto_node *root, struct msg_summary const *summary) {
+	UNUSED(root);
+	ASSERT(metadata != NULL);
+	ASSERT(summary != NULL);
+
+	struct hfdl_pdu_metadata *hm = container_of(metadata, struct hfdl_pdu_metadata, metadata);
+	time_t now = metadata->rx_timestamp.tv_sec;
+	time_t hour = now - now % HOUR;
+	struct octet_string *result = NULL;
+
+	// Before opening a new bucket, report the final statistics of the previous hour
+	if(Last_report_time_set && Last_report_time - Last_report_time % HOUR < hour) {
+		time_t prev_hour = Last_report_time - Last_report_time % HOUR;
+		result = perfstats_report(now, prev_hour);
+		Last_report_time = now;
+	}
+	perfstats_update(bucket_get(hour), now, hm->freq, summary);
+	if(Last_report_time_set == false) {
+		Last_report_time = now;
+		Last_report_time_set = true;
+	} else if(result == NULL && now >= Last_report_time + PERFSTATS_REPORT_INTERVAL) {
+		result = perfstats_report(now, hour);
+		Last_report_time = now;
+	}
+	return result;
+}
+
+fmtr_descriptor_t fmtr_DEF_perfstats = {
+	.name = "perfstats",
+	.description = "Hourly link statistics from aircraft performance reports and own decoding results",
+	.format_decoded_msg = fmtr_perfstats_format_decoded_msg,
+	.format_raw_msg = NULL,
+	.supports_data_type = fmtr_perfstats_supports_data_type,
+	.output_format = OFMT_TEXT,
+	.decode_level = PDU_DECODE_HEADERS,
+};
@@ -38,7 +38,9 @@ static la_vstring *format_timestamp(struct timeval tv) {
 	return vstr;
 }
 
-static struct octet_string *fmtr_text_format_decoded_msg(struct metadata *metadata, la_proto_node *root) {
+static struct octet_string *fmtr_text_format_decoded_msg(struct metadata *metadata, la_proto_node *root,
+		struct msg_summary const *summary) {
+	UNUSED(summary);
 	ASSERT(metadata != NULL);
 	ASSERT(root != NULL);
 
@@ -75,4 +77,5 @@ fmtr_descriptor_t fmtr_DEF_text = {
 	.format_raw_msg = NULL,
 	.supports_data_type = fmtr_text_supports_data_type,
 	.output_format = OFMT_TEXT,
+	.decode_level = PDU_DECODE_FULL,
 };
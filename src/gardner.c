@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>                 // memcpy, memmove
+#include <complex.h>
+#include <math.h>                   // fminf, fmaxf, ceilf
+#include "gardner.h"
+#include "util.h"                   // NEW, XCALLOC, XREALLOC, XFREE, ASSERT
+
+// Number of past input samples needed by the interpolator
+// (x[n-1] plus two samples following x[n] which are not yet known when
+// the interpolation point falls at the end of the current input block).
+#define HIST_LEN 3
+#define LOOP_DAMPING 0.70710678f
+// Maximum timing correction applied in a single symbol period (in symbols)
+#define MAX_ADJ 0.1f
+
+struct gardner {
+	float sps;                  // input samples per symbol
+	float step;                 // nominal input samples per output sample
+	float acq_alpha, acq_beta;
+	float track_alpha, track_beta;
+	float alpha, beta;          // currently active loop gains
+	float integ;                // loop filter integrator
+	float err;                  // last timing error
+	float pos;                  // position of the next output sample in the work buffer
+	uint32_t out_idx;
+	float complex mid, prev_sym;
+	float complex *work;        // history + current input block
+	uint32_t work_len;
+};
+
+// Proportional-integral loop filter gains for a 2nd order loop
+// with noise bandwidth bw (normalized to the symbol rate).
+static void loop_gains_compute(float bw, float *alpha, float *beta) {
+	float zeta = LOOP_DAMPING;
+	float theta = bw / (zeta + 0.25f / zeta);
+	float d = 1.0f + 2.0f * zeta * theta + theta * theta;
+	*alpha = 4.0f * zeta * theta / d;
+	*beta = 4.0f * theta * theta / d;
+}
+
+// Cubic Lagrange interpolation between x[0] and x[1] in Farrow form.
+// x points at the sample preceding the interpolation interval.
+static inline float complex farrow_cubic(float complex const *x, float mu) {
+	float complex xm1 = x[-1], x0 = x[0], x1 = x[1], x2 = x[2];
+	float complex c3 = (x2 - xm1) * (1.0f / 6.0f) + (x0 - x1) * 0.5f;
+	float complex c2 = (xm1 + x1) * 0.5f - x0;
+	float complex c1 = x1 - x0 * 0.5f - xm1 * (1.0f / 3.0f) - x2 * (1.0f / 6.0f);
+	return ((c3 * mu + c2) * mu + c1) * mu + x0;
+}
+
+gardner gardner_create(float sps, float acq_bw, float track_bw) {
+	ASSERT(sps >= 2.0f);
+	NEW(struct gardner, g);
+	g->sps = sps;
+	g->step = sps / 2.0f;
+	loop_gains_compute(acq_bw, &g->acq_alpha, &g->acq_beta);
+	loop_gains_compute(track_bw, &g->track_alpha, &g->track_beta);
+	debug_print(D_DSP, "sps: %f acq_bw: %f (alpha: %f beta: %f) track_bw: %f (alpha: %f beta: %f)\n",
+			sps, acq_bw, g->acq_alpha, g->acq_beta, track_bw, g->track_alpha, g->track_beta);
+	g->work = XCALLOC(HIST_LEN, sizeof(float complex));
+	g->work_len = HIST_LEN;
+	g->pos = 1.0f;
+	gardner_reset(g);
+	return g;
+}
+
+void gardner_destroy(gardner g) {
+	if(g != NULL) {
+		XFREE(g->work);
+		XFREE(g);
+	}
+}
+
+uint32_t gardner_max_output_len(gardner g, uint32_t in_len) {
+	ASSERT(g != NULL);
+	// Allow for the maximum timing correction in the slower direction
+	return (uint32_t)ceilf((float)(in_len + HIST_LEN) / (g->step * (1.0f - 2.0f * MAX_ADJ))) + 1;
+}
+
+// Processes in_len input samples and writes the resulting 2 sps signal to out.
+// If out_pos is not NULL, it receives the index of the input sample which
+// each output sample has been interpolated from.
+// out must have room for gardner_max_output_len(in_len) samples.
+void gardner_execute(gardner g, float complex const *in, uint32_t in_len,
+		float complex *out, uint32_t *out_pos, uint32_t *out_len) {
+	ASSERT(g != NULL);
+	ASSERT(out_len != NULL);
+	uint32_t total_len = in_len + HIST_LEN;
+	if(total_len > g->work_len) {
+		// History is stored at the beginning of the buffer - preserve it
+		g->work = XREALLOC(g->work, total_len * sizeof(float complex));
+		g->work_len = total_len;
+	}
+	float complex *work = g->work;
+	memcpy(work + HIST_LEN, in, in_len * sizeof(float complex));
+
+	uint32_t n = 0;
+	float pos = g->pos;
+	int32_t i;
+	while((i = (int32_t)pos) + 2 < (int32_t)total_len) {
+		float complex y = farrow_cubic(work + i, pos - (float)i);
+		out[n] = y;
+		if(out_pos != NULL) {
+			out_pos[n] = i >= HIST_LEN ? (uint32_t)(i - HIST_LEN) : 0;
+		}
+		n++;
+		if(g->out_idx++ & 1) {
+			// Symbol strobe
+			float e = crealf((g->prev_sym - y) * conjf(g->mid));
+			e = fmaxf(-1.0f, fminf(1.0f, e));
+			g->integ += g->beta * e;
+			float adj = fmaxf(-MAX_ADJ, fminf(MAX_ADJ, g->alpha * e + g->integ));
+			pos += g->sps * adj;
+			g->err = e;
+			g->prev_sym = y;
+		} else {
+			g->mid = y;
+		}
+		pos += g->step;
+	}
+	// Keep the last HIST_LEN samples for the next round
+	memmove(work, work + in_len, HIST_LEN * sizeof(float complex));
+	g->pos = pos - (float)in_len;
+	*out_len = n;
+}
+
+void gardner_set_tracking(gardner g, bool tracking) {
+	ASSERT(g != NULL);
+	if(tracking) {
+		g->alpha = g->track_alpha;
+		g->beta = g->track_beta;
+	} else {
+		g->alpha = g->acq_alpha;
+		g->beta = g->acq_beta;
+	}
+}
+
+// Resets the timing loop to its initial state (acquisition mode).
+// Sample history, interpolator position and output sample parity are preserved,
+// so that the output stream stays continuous.
+void gardner_reset(gardner g) {
+	ASSERT(g != NULL);
+	g->integ = 0.0f;
+	g->err = 0.0f;
+	gardner_set_tracking(g, false);
+}
+
+float gardner_get_timing_error(gardner g) {
+	ASSERT(g != NULL);
+	return g->err;
+}
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <complex.h>
+
+// Symbol timing recovery with a Gardner timing error detector
+// and a cubic (Lagrange) Farrow interpolator.
+// Takes samples at an arbitrary, fractional oversampling ratio and produces
+// 2 samples per symbol. Output samples with odd indices (counting from 0
+// since the creation of the object) are symbol strobes, those with even
+// indices are taken halfway between symbols.
+
+typedef struct gardner *gardner;
+
+gardner gardner_create(float sps, float acq_bw, float track_bw);
+void gardner_destroy(gardner g);
+void gardner_execute(gardner g, float complex const *in, uint32_t in_len,
+		float complex *out, uint32_t *out_pos, uint32_t *out_len);
+uint32_t gardner_max_output_len(gardner g, uint32_t in_len);
+void gardner_set_tracking(gardner g, bool tracking);
+void gardner_reset(gardner g);
+float gardner_get_timing_error(gardner g);
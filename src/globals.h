@@ -21,6 +21,8 @@ struct dumphfdl_config {
 #endif
 	char *station_id;
 	int32_t output_queue_hwm;
+	int32_t reasm_max_size;         // kB
+	int32_t reasm_timeout;          // seconds
 	enum ac_data_details ac_data_details;
 	bool utc;
 	bool milliseconds;
@@ -29,6 +31,7 @@ struct dumphfdl_config {
 	bool output_corrupted_pdus;
 	bool freq_as_squawk;
 	bool ac_data_available;
+	bool deterministic;
 #ifdef DATADUMPS
 	bool datadumps;
 #endif
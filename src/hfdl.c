@@ -1,15 +1,15 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include <stdio.h>
+#include <stdlib.h>                 // posix_memalign
 #include <stdbool.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <unistd.h>
 #include <complex.h>
 #include <math.h>
-#ifdef DEBUG
 #include <pthread.h>                // pthread_mutex_*
-#endif
-#include <string.h>                 // memcpy
+#include <string.h>                 // memcpy, memset
+#include <stdatomic.h>              // atomic_*
 #include <sys/time.h>               // struct timeval
 #include <liquid/liquid.h>
 #include "config.h"                 // *_DEBUG
@@ -20,11 +20,18 @@
 #include "dumpfile.h"               // dumpfile_*
 #include "util.h"                   // NEW, XCALLOC, octet_string_new
 #include "fastddc.h"                // fft_channelizer_create, fastddc_inv_cc
+#include "gardner.h"                // gardner_*
+#include "diversity.h"              // diversity_*
+#include "slot_clock.h"             // slot_clock_*
+#include "spdu.h"                   // spdu_frame_timing_get
+#include "nco.h"                    // nco_phasor, nco_rad_to_phase
+#include "baseband.h"               // bb_*
 #include "libfec/fec.h"             // viterbi27
 #include "hfdl.h"                   // HFDL_SYMBOL_RATE, SPS
 #include "metadata.h"               // struct metadata
 #include "pdu.h"                    // pdu_decoder_queue_push, hfdl_pdu_metadata_create
 #include "statsd.h"                 // statsd_*
+#include "runstats.h"               // runstats_stage_thread_done
 
 #define PREKEY_LEN 448
 #define A_LEN 127
@@ -40,10 +47,23 @@
 #define PREAMBLE_LEN (2 * A_LEN + M1_LEN + M2_LEN + 9 * T_LEN)
 #define SINGLE_SLOT_FRAME_LEN (PREKEY_LEN + PREAMBLE_LEN + DATA_FRAME_CNT_SINGLE_SLOT * (DATA_FRAME_LEN + T_LEN))
 #define CORR_THRESHOLD_A1 0.36f
+#define CORR_THRESHOLD_A1_SLOT 0.3f     // used when a frame is expected at the current slot boundary
 #define CORR_THRESHOLD_A2 0.3f
 #define CORR_THRESHOLD_M1 0.3f
 #define MAX_SEARCH_RETRIES 3
 #define HFDL_SSB_CARRIER_OFFSET_HZ 1440
+// Automatic frequency control parameters
+#define AFC_MEASUREMENT_WEIGHT 0.3f     // weight of a new frequency error measurement in the average
+#define AFC_LOOP_GAIN 0.5f              // fraction of the averaged error moved to the channelizer per frame
+#define AFC_MAX_OFFSET_HZ 50.0f
+#define AFC_MAX_TRAIN_BER 0.05f         // frames with more training bit errors are not used for AFC
+// Maximum time difference between copies of a frame received on different
+// diversity branches, before and after the branch clock offset is known
+#define DIVERSITY_ACQ_WINDOW (2 * HFDL_SYMBOL_RATE * SPS)
+#define DIVERSITY_TRACK_WINDOW (HFDL_SYMBOL_RATE * SPS / 10)
+// When the TDMA slot clock is locked, preamble search is only done
+// for frames starting within this distance from a slot boundary (in samples)
+#define SLOT_SEARCH_WINDOW (HFDL_SYMBOL_RATE * SPS / 5)
 
 typedef enum {
 	SAMPLER_EMIT_BITS = 1,
@@ -78,67 +98,35 @@ struct hfdl_params {
 	int32_t deinterleaver_push_column_shift;
 };
 
-static struct hfdl_params const hfdl_frame_params[M_SHIFT_CNT] = {
-	// 300 bps, single slot
-	[0] = {
-		.scheme = M_BPSK,
-		.data_segment_cnt = DATA_FRAME_CNT_SINGLE_SLOT,
-		.code_rate = 4,
-		.deinterleaver_push_column_shift = 17
-	},
-	// 600 bps, single slot
-	[1] = {
-		.scheme = M_BPSK,
-		.data_segment_cnt = DATA_FRAME_CNT_SINGLE_SLOT,
-		.code_rate = 2,
-		.deinterleaver_push_column_shift = 17
-	},
-	// 1200 bps, single slot
-	[2] = {
-		.scheme = M_PSK4,
-		.data_segment_cnt = DATA_FRAME_CNT_SINGLE_SLOT,
-		.code_rate = 2,
-		.deinterleaver_push_column_shift = 17
-	},
-	// 1800 bps, single slot
-	[3] = {
-		.scheme = M_PSK8,
-		.data_segment_cnt = DATA_FRAME_CNT_SINGLE_SLOT,
-		.code_rate = 2,
-		.deinterleaver_push_column_shift = 17
-	},
-	// 300 bps, double slot
-	[4] = {
-		.scheme = M_BPSK,
-		.data_segment_cnt = DATA_FRAME_CNT_DOUBLE_SLOT,
-		.code_rate = 4,
-		.deinterleaver_push_column_shift = 23
-	},
-	// 600 bps, double slot
-	[5] = {
-		.scheme = M_BPSK,
-		.data_segment_cnt = DATA_FRAME_CNT_DOUBLE_SLOT,
-		.code_rate = 2,
-		.deinterleaver_push_column_shift = 23
+// Frame types (M1): modulation, number of data segments, code rate
+// and deinterleaver push column shift.
+// Everything which depends on the frame type is generated from this list,
+// so that the user data decoder can be specialized for each of them
+// with all frame parameters known at compile time.
+#define HFDL_FRAME_TYPES(X) \
+	X(0, M_BPSK, DATA_FRAME_CNT_SINGLE_SLOT, 4, 17)    /* 300 bps, single slot */ \
+	X(1, M_BPSK, DATA_FRAME_CNT_SINGLE_SLOT, 2, 17)    /* 600 bps, single slot */ \
+	X(2, M_PSK4, DATA_FRAME_CNT_SINGLE_SLOT, 2, 17)    /* 1200 bps, single slot */ \
+	X(3, M_PSK8, DATA_FRAME_CNT_SINGLE_SLOT, 2, 17)    /* 1800 bps, single slot */ \
+	X(4, M_BPSK, DATA_FRAME_CNT_DOUBLE_SLOT, 4, 23)    /* 300 bps, double slot */ \
+	X(5, M_BPSK, DATA_FRAME_CNT_DOUBLE_SLOT, 2, 23)    /* 600 bps, double slot */ \
+	X(6, M_PSK4, DATA_FRAME_CNT_DOUBLE_SLOT, 2, 23)    /* 1200 bps, double slot */ \
+	X(7, M_PSK8, DATA_FRAME_CNT_DOUBLE_SLOT, 2, 23)    /* 1800 bps, double slot */
+
+#define HFDL_FRAME_PARAMS(m1, scheme_, data_segment_cnt_, code_rate_, column_shift) \
+	[m1] = { \
+		.scheme = scheme_, \
+		.data_segment_cnt = data_segment_cnt_, \
+		.code_rate = code_rate_, \
+		.deinterleaver_push_column_shift = column_shift \
 	},
-	// 1200 bps, double slot
-	[6] = {
-		.scheme = M_PSK4,
-		.data_segment_cnt = DATA_FRAME_CNT_DOUBLE_SLOT,
-		.code_rate = 2,
-		.deinterleaver_push_column_shift = 23
-	},
-	// 1800 bps, double slot
-	[7] = {
-		.scheme = M_PSK8,
-		.data_segment_cnt = DATA_FRAME_CNT_DOUBLE_SLOT,
-		.code_rate = 2,
-		.deinterleaver_push_column_shift = 23
-	}
+
+static struct hfdl_params const hfdl_frame_params[M_SHIFT_CNT] = {
+	HFDL_FRAME_TYPES(HFDL_FRAME_PARAMS)
 };
 
-#define SYMSYNC_PFB_CNT 16          // number of filter in symsync polyphase filterbank
-#define HFDL_MF_SYMBOL_DELAY 3      // delay introduced by matched filter (measured in symbols)
+#define SYMSYNC_ACQ_BW 0.01f        // timing loop bandwidth during preamble search
+#define SYMSYNC_TRACK_BW 0.002f     // timing loop bandwidth after A1 has been found
 #define HFDL_MF_TAPS_CNT 19         // SPS * 3 symbols of delay * 2 + 1
 static float hfdl_matched_filter[HFDL_MF_TAPS_CNT] = {
 	-0.0170974647427123, 0.01148231492068473, 0.03138375667422348, 0.009454398851680437,
@@ -147,31 +135,47 @@ static float hfdl_matched_filter[HFDL_MF_TAPS_CNT] = {
 	-0.005495792933327306, -0.06451564801420356, -0.04161644170893816, 0.009454398851680437,
 	0.03138375667422348, 0.01148231492068473, -0.0170974647427123
 };
-static float hfdl_matched_filter_interp[HFDL_MF_TAPS_CNT];
 
 static float complex T_seq[2][T_LEN] = {
 	[0] = { 1.f, 1.f, 1.f, -1.f, 1.f, 1.f, -1.f, -1.f, 1.f, -1.f, 1.f, -1.f, -1.f, -1.f, -1.f },
 	[1] = { -1.f, -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, -1.f, 1.f, -1.f, 1.f, 1.f, 1.f, 1.f }
 };
 
-#ifdef DEBUG
-static struct {
-	int32_t A1_found, A2_found, M1_found;
-	int32_t train_bits_total, train_bits_bad;
-	float A1_corr_total, A2_corr_total, M1_corr_total;
-} S;
-
-static pthread_mutex_t S_lock = PTHREAD_MUTEX_INITIALIZER;
-
-#define STATS_UPDATE(what) \
-do { \
-	pthread_mutex_lock(&S_lock); \
-	what; \
-	pthread_mutex_unlock(&S_lock); \
-} while(0);
-#else
-#define STATS_UPDATE(what) nop()
-#endif // DEBUG
+// Preamble acquisition statistics.
+// Every channel has its own set of counters, which is written only by
+// the channel thread, so updates are plain relaxed loads and stores
+// without any locking. Each set occupies separate cache lines, so that
+// channels running on different CPUs do not invalidate each other's
+// counters. Readers sum the counters of all channels on demand.
+#define CACHE_LINE_SIZE 64
+// Correlation values are accumulated as fixed point numbers
+#define DEMOD_STATS_CORR_SCALE 1000
+
+struct demod_counters {
+	uint64_t A1_found, A2_found, M1_found;
+	uint64_t A1_corr_total, A2_corr_total, M1_corr_total;
+	uint64_t train_bits_total, train_bits_bad;
+};
+
+struct demod_stats {
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t A1_found, A2_found, M1_found;
+	_Atomic uint64_t A1_corr_total, A2_corr_total, M1_corr_total;
+	_Atomic uint64_t train_bits_total, train_bits_bad;
+	int32_t freq;
+	struct demod_stats *next;
+};
+
+#define STATS_ADD(st, counter, value) \
+	atomic_store_explicit(&(st)->counter, \
+		atomic_load_explicit(&(st)->counter, memory_order_relaxed) + (value), memory_order_relaxed)
+#define STATS_ADD_CORR(st, counter, corr) \
+	STATS_ADD(st, counter, (uint64_t)(fabsf(corr) * DEMOD_STATS_CORR_SCALE))
+
+// Counters of all channels created so far, including ones which have been
+// destroyed after a stall, so that the totals do not go backwards.
+// The lock protects the list only, not the counters.
+static struct demod_stats *Demod_stats;
+static pthread_mutex_t Demod_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static uint32_t T = 0x9AF;      // training sequence
 
@@ -185,14 +189,23 @@ typedef struct costas *costas;
 typedef struct deinterleaver *deinterleaver;
 typedef struct descrambler *descrambler;
 struct hfdl_channel;
+struct demod_state;
 
 static void *hfdl_decoder_thread(void *ctx);
+static bool hfdl_channel_step(struct block *block);
 static int32_t match_sequence(bsequence *templates, size_t template_cnt, bsequence bits, float *result_corr);
 static void compute_train_bit_error_cnt(struct hfdl_channel *c);
 static void decode_user_data(struct hfdl_channel *c);
-static void dispatch_pdu(struct hfdl_channel *c, uint8_t *buf, size_t len);
+static uint64_t frame_start_estimate(struct hfdl_channel *c, uint32_t symbols_since_prekey);
+static struct demod_state *demod_state_create(struct hfdl_channel *c);
+static void demod_state_destroy(struct demod_state *st);
+static size_t demod_state_size(struct demod_state const *st);
+static void dispatch_pdu(struct hfdl_channel *c, struct diversity_frame const *f, uint8_t *buf, size_t len);
 static void sampler_reset(struct hfdl_channel *c);
 static void framer_reset(struct hfdl_channel *c);
+static void afc_update(struct hfdl_channel *c);
+static void decode_frame(struct hfdl_channel *c, struct diversity_frame const *f);
+static void decode_diversity_frames(struct hfdl_channel *c);
 
 struct hfdl_channel {
 	struct block block;
@@ -203,15 +216,12 @@ struct hfdl_channel {
 	firfilt_crcf mf;
 	eqlms_cccf eq;
 	modem m[MODULATION_CNT];
-	symsync_crcf ss;
+	gardner ss;
 	bsequence bits;
-	bsequence user_data;
 	cbuffercf training_symbols;
 	cbuffercf data_symbols;
 	cbuffercf current_buffer;
 	descrambler descrambler;
-	deinterleaver deinterleaver[M_SHIFT_CNT];
-	void *viterbi_ctx[M_SHIFT_CNT];
 	uint64_t symbol_cnt, sample_cnt;
 	float resamp_rate;
 	sampler_state s_state;
@@ -219,6 +229,7 @@ struct hfdl_channel {
 	mod_arity data_mod_arity;
 	mod_arity current_mod_arity;
 	int32_t chan_freq;
+	float chan_sample_rate;
 	int32_t resampler_delay;
 	int32_t symbols_wanted;
 	int32_t search_retries;
@@ -230,6 +241,29 @@ struct hfdl_channel {
 	int32_t M1;
 	uint32_t bitmask;
 	uint32_t symsync_out_idx;
+	// AFC state
+	float afc_offset_hz;        // correction currently applied in the channelizer
+	float afc_residual_hz;      // averaged residual error, left for the Costas loop
+	float costas_freq_err_hz;   // residual error measured in the current frame
+	// Diversity combining
+	diversity diversity;
+	int32_t diversity_branch;
+	// Creation parameters, for hfdl_channel_respawn()
+	int32_t input_sample_rate;
+	int32_t pre_decimation_rate;
+	int32_t centerfreq;
+	float transition_bw;
+	// Distributed decoding
+	bb_server bb_server;        // front-end node: ships channel baseband to workers
+	bb_feed bb_feed;            // worker node: channel baseband comes from the front-end
+	// Standalone channels: decoded frames are passed to this callback
+	hfdl_frame_cb *frame_cb;
+	void *frame_cb_ctx;
+	struct demod_state *demod;
+	struct demod_stats *stats;
+	// TDMA timing
+	struct slot_clock slot_clock;
+	uint64_t frame_start_sample;
 	// PDU metadata
 	struct timeval pdu_timestamp;
 	float freq_err_hz;
@@ -242,11 +276,12 @@ struct hfdl_channel {
  **********************************/
 
 struct costas {
-	float alpha, beta, phi, dphi, err;
+	float alpha, beta, phi, dphi, dphi_init, err;
 };
 
 static costas costas_cccf_create() {
 	NEW(struct costas, c);
+	nco_tables_init();
 	c->alpha = 0.1f;
 	c->beta = 0.047f * c->alpha * c->alpha;
 	return c;
@@ -257,7 +292,7 @@ static void costas_cccf_destroy(costas c) {
 }
 
 static void costas_cccf_execute(costas c, float complex in, float complex *out) {
-	*out = in * cexpf(-I * c->phi);
+	*out = in * nco_phasor(nco_rad_to_phase(-c->phi));
 }
 
 static inline float branchless_limit(float x, float limit) {
@@ -284,7 +319,8 @@ static void costas_cccf_step(costas c) {
 }
 
 static void costas_cccf_reset(costas c) {
-	c->dphi = c->phi = 0.f;
+	c->phi = 0.f;
+	c->dphi = c->dphi_init;
 }
 
 /**********************************
@@ -317,6 +353,12 @@ static void descrambler_destroy(descrambler d) {
 	}
 }
 
+static void descrambler_reset(descrambler d) {
+	ASSERT(d);
+	msequence_reset(d->ms);
+	d->pos = 0;
+}
+
 static uint32_t descrambler_advance(descrambler d) {
 	ASSERT(d);
 	if(d->pos == d->len) {
@@ -342,7 +384,7 @@ struct deinterleaver {
 #define DEINTERLEAVER_POP_ROW_SHIFT 9
 
 static deinterleaver deinterleaver_create(int32_t M1) {
-	deinterleaver d = XCALLOC(DEINTERLEAVER_ROW_CNT, sizeof(struct deinterleaver));
+	NEW(struct deinterleaver, d);
 	d->column_cnt = hfdl_frame_params[M1].data_segment_cnt * DATA_FRAME_LEN
 		* hfdl_frame_params[M1].scheme / DEINTERLEAVER_ROW_CNT;
 	d->table = XCALLOC(DEINTERLEAVER_ROW_CNT, sizeof(uint8_t *));
@@ -365,7 +407,10 @@ static void deinterleaver_destroy(deinterleaver d) {
 	}
 }
 
-static void deinterleaver_push(deinterleaver d, uint8_t val) {
+// column_cnt and column_shift are passed by the frame type specific
+// decoders as constants, so that the index arithmetic can be folded
+static inline void deinterleaver_push(deinterleaver d, uint8_t val,
+		int32_t const column_cnt, int32_t const column_shift) {
 	debug_print(D_FRAME_DETAIL, "push:%d:%d:%hhu\n", d->row, d->col, val);
 	d->table[d->row][d->col] = val;
 	d->row++;
@@ -373,13 +418,13 @@ static void deinterleaver_push(deinterleaver d, uint8_t val) {
 		d->row = 0;
 		d->col++;
 	}
-	d->col -= d->push_column_shift;
+	d->col -= column_shift;
 	if(d->col < 0) {
-		d->col += d->column_cnt;
+		d->col += column_cnt;
 	}
 }
 
-static uint8_t deinterleaver_pop(deinterleaver d) {
+static inline uint8_t deinterleaver_pop(deinterleaver d) {
 	uint8_t ret = d->table[d->row][d->col];
 	debug_print(D_FRAME_DETAIL, "pop:%d:%d:%hhu\n", d->row, d->col, ret);
 	d->row = (d->row + DEINTERLEAVER_POP_ROW_SHIFT) % DEINTERLEAVER_ROW_CNT;
@@ -393,6 +438,70 @@ static void deinterleaver_reset(deinterleaver d) {
 	d->row = d->col = 0;
 }
 
+/**********************************
+ * Frame decoder pool
+ **********************************/
+
+// Deinterleavers and Viterbi decoders are sized for the frame type (M1)
+// and are only needed while a frame is being decoded. Instead of giving
+// every channel a full set of them, they are allocated on first use and
+// shared by all channels. A channel borrows one for the duration of
+// a single decoding step, so the pool only grows to the number of frames
+// being decoded concurrently.
+
+struct fec_ctx {
+	struct fec_ctx *next;
+	deinterleaver deinterleaver;
+	void *viterbi;
+};
+
+static struct {
+	struct fec_ctx *free[M_SHIFT_CNT];
+	int32_t cnt[M_SHIFT_CNT];
+} Fec_pool;
+static pthread_mutex_t Fec_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int32_t user_data_bits_cnt(int32_t M1) {
+	struct hfdl_params const p = hfdl_frame_params[M1];
+	return p.data_segment_cnt * DATA_FRAME_LEN * p.scheme / p.code_rate;
+}
+
+static size_t fec_ctx_size(int32_t M1) {
+	int32_t column_cnt = hfdl_frame_params[M1].data_segment_cnt * DATA_FRAME_LEN
+		* hfdl_frame_params[M1].scheme / DEINTERLEAVER_ROW_CNT;
+	return sizeof(struct fec_ctx) + sizeof(struct deinterleaver) +
+		DEINTERLEAVER_ROW_CNT * (sizeof(uint8_t *) + column_cnt) +
+		viterbi27_size(user_data_bits_cnt(M1));
+}
+
+static struct fec_ctx *fec_ctx_borrow(int32_t M1) {
+	ASSERT(M1 >= 0);
+	ASSERT(M1 < M_SHIFT_CNT);
+	pthread_mutex_lock(&Fec_pool_lock);
+	struct fec_ctx *ctx = Fec_pool.free[M1];
+	if(ctx != NULL) {
+		Fec_pool.free[M1] = ctx->next;
+	} else {
+		// create_viterbi27 initializes libfec globals on first call,
+		// so it must not run concurrently
+		ctx = XCALLOC(1, sizeof(struct fec_ctx));
+		ctx->deinterleaver = deinterleaver_create(M1);
+		ctx->viterbi = create_viterbi27(user_data_bits_cnt(M1));
+		Fec_pool.cnt[M1]++;
+		debug_print(D_DSP, "M1: %d: %d decoder(s) allocated\n", M1, Fec_pool.cnt[M1]);
+	}
+	pthread_mutex_unlock(&Fec_pool_lock);
+	ctx->next = NULL;
+	return ctx;
+}
+
+static void fec_ctx_return(int32_t M1, struct fec_ctx *ctx) {
+	pthread_mutex_lock(&Fec_pool_lock);
+	ctx->next = Fec_pool.free[M1];
+	Fec_pool.free[M1] = ctx;
+	pthread_mutex_unlock(&Fec_pool_lock);
+}
+
 /**********************************
  * HFDL public routines
  **********************************/
@@ -438,31 +547,40 @@ void hfdl_init_globals(void) {
 			bsequence_push(M2[shift], M1_bits[(M_shifts[shift]+j) % M1_LEN]);
 		}
 	}
-	// symsync uses interpolator internally, so it needs MF filter taps
-	// multipled by SPS
-	// XXX: doesn't work correctly for a PFB with 16 filters - gain still 2x too low
-	for(int32_t i = 0; i < HFDL_MF_TAPS_CNT; i++) {
-		hfdl_matched_filter_interp[i] = hfdl_matched_filter[i] * SPS;
-	}
 }
 
-struct block *hfdl_channel_create(int32_t sample_rate, int32_t pre_decimation_rate,
-		float transition_bw, int32_t centerfreq, int32_t frequency) {
-	NEW(struct hfdl_channel, c);
-	c->resamp_rate = (float)(HFDL_SYMBOL_RATE * SPS) / ((float)sample_rate / (float)pre_decimation_rate);
-	c->resampler = msresamp_crcf_create(c->resamp_rate, 60.0f);
-	c->resampler_delay = (int32_t)ceilf(msresamp_crcf_get_delay(c->resampler));
-
-	c->chan_freq = frequency;
-	float freq_shift = (float)(centerfreq - (frequency + HFDL_SSB_CARRIER_OFFSET_HZ)) / (float)sample_rate;
-	debug_print(D_DSP, "create: centerfreq=%d frequency=%d freq_shift=%f\n",
-			centerfreq, frequency, freq_shift);
-
-	c->channelizer = fft_channelizer_create(pre_decimation_rate, transition_bw, freq_shift);
-	if(c->channelizer == NULL) {
-		goto fail;
+static struct demod_stats *demod_stats_create(int32_t freq) {
+	void *mem = NULL;
+	if(posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(struct demod_stats)) != 0) {
+		fprintf(stderr, "posix_memalign failed\n");
+		_exit(1);
 	}
+	memset(mem, 0, sizeof(struct demod_stats));
+	struct demod_stats *st = mem;
+	st->freq = freq;
+	pthread_mutex_lock(&Demod_stats_lock);
+	st->next = Demod_stats;
+	Demod_stats = st;
+	pthread_mutex_unlock(&Demod_stats_lock);
+	return st;
+}
+
+static void demod_stats_add(struct demod_counters *total, struct demod_stats *st) {
+#define STATS_SUM(counter) total->counter += atomic_load_explicit(&st->counter, memory_order_relaxed)
+	STATS_SUM(A1_found);
+	STATS_SUM(A2_found);
+	STATS_SUM(M1_found);
+	STATS_SUM(A1_corr_total);
+	STATS_SUM(A2_corr_total);
+	STATS_SUM(M1_corr_total);
+	STATS_SUM(train_bits_total);
+	STATS_SUM(train_bits_bad);
+#undef STATS_SUM
+}
 
+// Creates the part of the channel which follows the channelizer and the resampler
+static void demodulator_create(struct hfdl_channel *c) {
+	c->stats = demod_stats_create(c->chan_freq);
 	c->agc = agc_crcf_create();
 	agc_crcf_set_bandwidth(c->agc, 0.005f);
 	agc_crcf_set_bandwidth(c->agc, 0.01f);
@@ -480,32 +598,54 @@ struct block *hfdl_channel_create(int32_t sample_rate, int32_t pre_decimation_ra
 	c->m[M_PSK4] = modem_create(LIQUID_MODEM_PSK4);
 	c->m[M_PSK8] = modem_create(LIQUID_MODEM_PSK8);
 
-	//c->ss = symsync_crcf_create(SPS, SYMSYNC_PFB_CNT, hfdl_matched_filter_interp, HFDL_MF_TAPS_CNT);
-	c->ss = symsync_crcf_create_kaiser(SPS, HFDL_MF_SYMBOL_DELAY, 0.9f, SYMSYNC_PFB_CNT);
-	symsync_crcf_set_lf_bw(c->ss, 0.001f);
-	symsync_crcf_set_output_rate(c->ss, 2);
+	c->ss = gardner_create(SPS, SYMSYNC_ACQ_BW, SYMSYNC_TRACK_BW);
 
 	c->bits = bsequence_create(M1_LEN);
 	c->training_symbols = cbuffercf_create(T_LEN);
 	c->data_symbols = cbuffercf_create(DATA_SYMBOLS_CNT_MAX);
 	c->descrambler = descrambler_create(LFSR_LEN, LFSR_GENPOLY, LFSR_INIT, DESCRAMBLER_LEN);
-	for(int32_t i = 0; i < M_SHIFT_CNT; i++) {
-		c->deinterleaver[i] = deinterleaver_create(i);
-		struct hfdl_params const p = hfdl_frame_params[i];
-		int32_t user_data_bits_cnt = p.data_segment_cnt * DATA_FRAME_LEN * p.scheme / p.code_rate;
-		debug_print(D_DSP, "user_data_bits_cnt[%d]: %d\n", i, user_data_bits_cnt);
-		c->viterbi_ctx[i] = create_viterbi27(user_data_bits_cnt);
-	}
-
-	c->user_data = bsequence_create(DATA_SYMBOLS_CNT_MAX * MOD_ARITY_MAX);
 
 	framer_reset(c);
+	// Allocated upfront, so that memory usage can be reported before starting
+	c->demod = demod_state_create(c);
+}
+
+struct block *hfdl_channel_create(int32_t sample_rate, int32_t pre_decimation_rate,
+		float transition_bw, int32_t centerfreq, int32_t frequency, float afc_offset_hz) {
+	NEW(struct hfdl_channel, c);
+	c->resamp_rate = (float)(HFDL_SYMBOL_RATE * SPS) / ((float)sample_rate / (float)pre_decimation_rate);
+	c->resampler = msresamp_crcf_create(c->resamp_rate, 60.0f);
+	c->resampler_delay = (int32_t)ceilf(msresamp_crcf_get_delay(c->resampler));
+
+	c->chan_freq = frequency;
+	c->input_sample_rate = sample_rate;
+	c->pre_decimation_rate = pre_decimation_rate;
+	c->centerfreq = centerfreq;
+	c->transition_bw = transition_bw;
+	slot_clock_init(&c->slot_clock, frequency, HFDL_SYMBOL_RATE * SPS);
+	float freq_shift = (float)(centerfreq - (frequency + HFDL_SSB_CARRIER_OFFSET_HZ)) / (float)sample_rate;
+	debug_print(D_DSP, "create: centerfreq=%d frequency=%d freq_shift=%f\n",
+			centerfreq, frequency, freq_shift);
+
+	c->channelizer = fft_channelizer_create(pre_decimation_rate, transition_bw, freq_shift);
+	if(c->channelizer == NULL) {
+		goto fail;
+	}
+	c->chan_sample_rate = (float)sample_rate / (float)pre_decimation_rate;
+	c->afc_offset_hz = fmaxf(-AFC_MAX_OFFSET_HZ, fminf(AFC_MAX_OFFSET_HZ, afc_offset_hz));
+	if(c->afc_offset_hz != 0.0f) {
+		debug_print(D_DSP, "%d: initial AFC offset: %.2f Hz\n", frequency, c->afc_offset_hz);
+		fft_channelizer_set_freq_offset(c->channelizer, -c->afc_offset_hz / c->chan_sample_rate);
+	}
+
+	demodulator_create(c);
 
 	struct producer producer = { .type = PRODUCER_NONE };
 	struct consumer consumer = { .type = CONSUMER_MULTI, .min_ru = 0 };
 	c->block.producer = producer;
 	c->block.consumer = consumer;
 	c->block.thread_routine = hfdl_decoder_thread;
+	c->block.step = hfdl_channel_step;
 
 	return &c->block;
 fail:
@@ -514,12 +654,40 @@ fail:
 
 }
 
+// Creates a channel without a channelizer, which demodulates baseband
+// sampled at HFDL_SYMBOL_RATE * SPS coming from elsewhere
+static struct hfdl_channel *unchannelized_channel_create(int32_t frequency) {
+	NEW(struct hfdl_channel, c);
+	c->chan_freq = frequency;
+	c->chan_sample_rate = HFDL_SYMBOL_RATE * SPS;
+	slot_clock_init(&c->slot_clock, frequency, HFDL_SYMBOL_RATE * SPS);
+	demodulator_create(c);
+	return c;
+}
+
+// Creates a channel on a worker node. Channel baseband is received
+// from the front-end node through the given feed.
+struct block *hfdl_channel_create_remote(int32_t frequency, bb_feed feed) {
+	ASSERT(feed != NULL);
+	struct hfdl_channel *c = unchannelized_channel_create(frequency);
+	c->bb_feed = feed;
+
+	struct producer producer = { .type = PRODUCER_NONE };
+	struct consumer consumer = { .type = CONSUMER_NONE };
+	c->block.producer = producer;
+	c->block.consumer = consumer;
+	c->block.thread_routine = hfdl_decoder_thread;
+	return &c->block;
+}
+
 void hfdl_channel_destroy(struct block *channel_block) {
 	if(channel_block == NULL) {
 		return;
 	}
 	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
-	msresamp_crcf_destroy(c->resampler);
+	if(c->resampler != NULL) {
+		msresamp_crcf_destroy(c->resampler);
+	}
 	fft_channelizer_destroy(c->channelizer);
 	agc_crcf_destroy(c->agc);
 	costas_cccf_destroy(c->loop);
@@ -528,29 +696,202 @@ void hfdl_channel_destroy(struct block *channel_block) {
 	modem_destroy(c->m[M_BPSK]);
 	modem_destroy(c->m[M_PSK4]);
 	modem_destroy(c->m[M_PSK8]);
-	symsync_crcf_destroy(c->ss);
+	gardner_destroy(c->ss);
 	bsequence_destroy(c->bits);
 	cbuffercf_destroy(c->training_symbols);
 	cbuffercf_destroy(c->data_symbols);
 	descrambler_destroy(c->descrambler);
-	for(int32_t i = 0; i < M_SHIFT_CNT; i++) {
-		deinterleaver_destroy(c->deinterleaver[i]);
-		delete_viterbi27(c->viterbi_ctx[i]);
-	}
-	bsequence_destroy(c->user_data);
+	diversity_unref(c->diversity);
+	demod_state_destroy(c->demod);
 	XFREE(c);
 }
 
+// Configures two channels receiving the same frequency from different
+// antennas to combine their frames before decoding.
+void hfdl_channel_set_diversity_pair(struct block *branch0, struct block *branch1) {
+	ASSERT(branch0 != NULL);
+	ASSERT(branch1 != NULL);
+	struct hfdl_channel *c0 = container_of(branch0, struct hfdl_channel, block);
+	struct hfdl_channel *c1 = container_of(branch1, struct hfdl_channel, block);
+	ASSERT(c0->chan_freq == c1->chan_freq);
+	ASSERT(c0->diversity == NULL && c1->diversity == NULL);
+	c0->diversity = diversity_create(c0->chan_freq, DIVERSITY_ACQ_WINDOW, DIVERSITY_TRACK_WINDOW);
+	c0->diversity_branch = 0;
+	c1->diversity = diversity_ref(c0->diversity);
+	c1->diversity_branch = 1;
+}
+
+// Makes the channel pass its baseband to worker nodes instead of
+// demodulating it, whenever any worker has subscribed to it.
+void hfdl_channel_set_baseband_server(struct block *channel_block, bb_server server) {
+	ASSERT(channel_block != NULL);
+	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
+	c->bb_server = server;
+}
+
+// Creates a fresh instance of a channel which has stalled, to take over
+// its place in the FFT fan-out. The stalled instance keeps its own state
+// and must not be destroyed until its thread has exited.
+struct block *hfdl_channel_respawn(struct block *stalled) {
+	ASSERT(stalled != NULL);
+	struct hfdl_channel *old = container_of(stalled, struct hfdl_channel, block);
+	ASSERT(old->channelizer != NULL);
+	struct block *block = hfdl_channel_create(old->input_sample_rate, old->pre_decimation_rate,
+			old->transition_bw, old->centerfreq, old->chan_freq, old->afc_offset_hz);
+	if(block == NULL) {
+		return NULL;
+	}
+	struct hfdl_channel *c = container_of(block, struct hfdl_channel, block);
+	block->consumer.in = stalled->consumer.in;
+	c->bb_server = old->bb_server;
+	// Frames received since the stall are lost, so the sample clock
+	// continues from where the old instance has stopped
+	c->sample_cnt = old->sample_cnt;
+	if(old->diversity != NULL) {
+		c->diversity = diversity_ref(old->diversity);
+		c->diversity_branch = old->diversity_branch;
+	}
+	statsd_increment_per_channel(c->chan_freq, "demod.stalls");
+	fprintf(stderr, "Channel %.1f kHz has stalled, restarted it\n", HZ_TO_KHZ(c->chan_freq));
+	return block;
+}
+
+float hfdl_channel_get_afc_offset(struct block *channel_block) {
+	ASSERT(channel_block != NULL);
+	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
+	return c->afc_offset_hz;
+}
+
+static float corr_avg(uint64_t corr_total, uint64_t cnt) {
+	return cnt > 0 ? (float)corr_total / (float)DEMOD_STATS_CORR_SCALE / (float)cnt : 0.f;
+}
+
+static void demod_counters_print(struct demod_counters const *t) {
+	fprintf(stderr, "A1_found:\t\t%" PRIu64 "\nA2_found:\t\t%" PRIu64 "\nM1_found:\t\t%" PRIu64 "\n",
+			t->A1_found, t->A2_found, t->M1_found);
+	fprintf(stderr, "A1_corr_avg:\t\t%4.3f\n", corr_avg(t->A1_corr_total, t->A1_found));
+	fprintf(stderr, "A2_corr_avg:\t\t%4.3f\n", corr_avg(t->A2_corr_total, t->A2_found));
+	fprintf(stderr, "M1_corr_avg:\t\t%4.3f\n", corr_avg(t->M1_corr_total, t->M1_found));
+	fprintf(stderr, "train_bits_bad/total:\t%" PRIu64 "/%" PRIu64 " (%f%%)\n", t->train_bits_bad, t->train_bits_total,
+			t->train_bits_total > 0 ? (float)t->train_bits_bad / (float)t->train_bits_total * 100.f : 0.f);
+}
+
+// Prints acquisition statistics summed over all channels.
+// May be called while channels are running.
 void hfdl_print_summary(void) {
-#ifdef DEBUG
-	fprintf(stderr, "A1_found:\t\t%d\nA2_found:\t\t%d\nM1_found:\t\t%d\n",
-			S.A1_found, S.A2_found, S.M1_found);
-	fprintf(stderr, "A1_corr_avg:\t\t%4.3f\n", S.A1_found > 0 ? S.A1_corr_total / (float)S.A1_found : 0);
-	fprintf(stderr, "A2_corr_avg:\t\t%4.3f\n", S.A2_found > 0 ? S.A2_corr_total / (float)S.A2_found : 0);
-	fprintf(stderr, "M1_corr_avg:\t\t%4.3f\n", S.M1_found > 0 ? S.M1_corr_total / (float)S.M1_found : 0);
-	fprintf(stderr, "train_bits_bad/total:\t%d/%d (%f%%)\n", S.train_bits_bad, S.train_bits_total,
-			(float)S.train_bits_bad / (float)S.train_bits_total * 100.f);
+	struct demod_counters total = {0};
+	pthread_mutex_lock(&Demod_stats_lock);
+	for(struct demod_stats *st = Demod_stats; st != NULL; st = st->next) {
+		demod_stats_add(&total, st);
+	}
+	pthread_mutex_unlock(&Demod_stats_lock);
+	demod_counters_print(&total);
+}
+
+#ifdef WITH_STATSD
+// Sends acquisition statistics of each channel frequency as gauges.
+// Counters of diversity branches and of restarted instances of the same
+// channel are summed together.
+void hfdl_stats_export(void) {
+	pthread_mutex_lock(&Demod_stats_lock);
+	for(struct demod_stats *st = Demod_stats; st != NULL; st = st->next) {
+		bool seen = false;
+		for(struct demod_stats *prev = Demod_stats; prev != st; prev = prev->next) {
+			if(prev->freq == st->freq) {
+				seen = true;
+				break;
+			}
+		}
+		if(seen) {
+			continue;
+		}
+		struct demod_counters t = {0};
+		for(struct demod_stats *s = st; s != NULL; s = s->next) {
+			if(s->freq == st->freq) {
+				demod_stats_add(&t, s);
+			}
+		}
+		statsd_set_per_channel(st->freq, "demod.acq.A1_found", t.A1_found);
+		statsd_set_per_channel(st->freq, "demod.acq.A2_found", t.A2_found);
+		statsd_set_per_channel(st->freq, "demod.acq.M1_found", t.M1_found);
+		// Gauges are integers, so correlation averages are sent in thousandths
+		statsd_set_per_channel(st->freq, "demod.acq.A1_corr_avg_milli",
+				t.A1_found > 0 ? t.A1_corr_total / t.A1_found : 0);
+		statsd_set_per_channel(st->freq, "demod.acq.A2_corr_avg_milli",
+				t.A2_found > 0 ? t.A2_corr_total / t.A2_found : 0);
+		statsd_set_per_channel(st->freq, "demod.acq.M1_corr_avg_milli",
+				t.M1_found > 0 ? t.M1_corr_total / t.M1_found : 0);
+		statsd_set_per_channel(st->freq, "demod.acq.train_bits_total", t.train_bits_total);
+		statsd_set_per_channel(st->freq, "demod.acq.train_bits_bad", t.train_bits_bad);
+	}
+	pthread_mutex_unlock(&Demod_stats_lock);
+}
 #endif
+
+// Frees acquisition statistics of all channels.
+// Must be called after all channels have been destroyed.
+void hfdl_stats_destroy(void) {
+	pthread_mutex_lock(&Demod_stats_lock);
+	struct demod_stats *st = Demod_stats;
+	while(st != NULL) {
+		struct demod_stats *next = st->next;
+		free(st);
+		st = next;
+	}
+	Demod_stats = NULL;
+	pthread_mutex_unlock(&Demod_stats_lock);
+}
+
+// Frees frame decoders which are not in use.
+// Must be called after all channels have been stopped.
+void hfdl_decoder_pool_destroy(void) {
+	pthread_mutex_lock(&Fec_pool_lock);
+	for(int32_t M1 = 0; M1 < M_SHIFT_CNT; M1++) {
+		struct fec_ctx *ctx = Fec_pool.free[M1];
+		while(ctx != NULL) {
+			struct fec_ctx *next = ctx->next;
+			deinterleaver_destroy(ctx->deinterleaver);
+			delete_viterbi27(ctx->viterbi);
+			XFREE(ctx);
+			ctx = next;
+		}
+		Fec_pool.free[M1] = NULL;
+		Fec_pool.cnt[M1] = 0;
+	}
+	pthread_mutex_unlock(&Fec_pool_lock);
+}
+
+// liquid-dsp objects are opaque, so their size is estimated from the
+// lengths of their coefficient and delay line buffers. The resampler
+// is designed at runtime and is not included.
+#define LIQUID_OBJECTS_SIZE_ESTIMATE ( \
+	HFDL_MF_TAPS_CNT * (sizeof(float) + 2 * sizeof(float complex)) + \
+	EQ_LEN * 5 * sizeof(float complex))
+
+// Prints the amount of memory allocated for each channel's demodulator
+// and the size of the shared frame decoders, which are allocated later,
+// when the first frame of the particular type is decoded. Channelizer
+// buffers are reported separately by dspbuf_print_stats().
+void hfdl_print_memory_usage(int32_t channel_cnt, struct block **channels) {
+	size_t total = 0, max = 0;
+	for(int32_t i = 0; i < channel_cnt; i++) {
+		struct hfdl_channel *c = container_of(channels[i], struct hfdl_channel, block);
+		size_t size = sizeof(struct hfdl_channel) + demod_state_size(c->demod) +
+			(DATA_SYMBOLS_CNT_MAX + T_LEN) * sizeof(float complex) +
+			LIQUID_OBJECTS_SIZE_ESTIMATE;
+		debug_print(D_DSP, "%d: %zu bytes\n", c->chan_freq / 1000, size);
+		total += size;
+		max = size > max ? size : max;
+	}
+	size_t fec_max = 0;
+	for(int32_t M1 = 0; M1 < M_SHIFT_CNT; M1++) {
+		size_t size = fec_ctx_size(M1);
+		debug_print(D_DSP, "frame decoder M1=%d: %zu bytes\n", M1, size);
+		fec_max = size > fec_max ? size : fec_max;
+	}
+	fprintf(stderr, "Demodulator memory: %zu kB total, up to %zu kB per channel; "
+			"shared frame decoders: up to %zu kB each\n",
+			total / 1024, max / 1024, fec_max / 1024);
 }
 
 /**********************************
@@ -562,350 +903,545 @@ void hfdl_print_summary(void) {
 }
 #define LEVEL_TO_DB(level) (20.0f * log10f(level))
 
-static void *hfdl_decoder_thread(void *ctx) {
-	ASSERT(ctx != NULL);
-	struct block *block = ctx;
-	struct hfdl_channel *c = container_of(block, struct hfdl_channel, block);
-
-	// FIXME: post_input_size / post_decimation_rate ?
-	float complex *channelizer_output = XCALLOC(c->channelizer->ddc->post_input_size, sizeof(float complex));
-	size_t resampled_size = (c->channelizer->ddc->post_input_size + c->resampler_delay + 10) * c->resamp_rate;
-	float complex *resampled = XCALLOC(resampled_size, sizeof(float complex));
-	uint32_t resampled_cnt = 0;
-	uint32_t noise_floor_sampling_clk = 0;
-	float complex r, s;
-	float frame_symbol_cnt = 0.0f;      // float because it's used only in float calculations
-	float complex symbols[3];
-	uint32_t symbols_produced = 0;
-	uint32_t bits = 0;
-	int32_t M1_match = -1;
-	float corr_A1 = 0.f;
-	float corr_A2 = 0.f;
-	float corr_M1 = 0.f;
-	static size_t const max_symbols_without_frame = 13 * SINGLE_SLOT_FRAME_LEN;
-	c->s_state = SAMPLER_EMIT_BITS;
-	c->fr_state = FRAMER_A1_SEARCH;
+// Working buffers and state of the demodulator which persist between
+// consecutive sample blocks of a channel
+struct demod_state {
+	float complex *channelizer_output;
+	size_t channelizer_output_size;
+	float complex *resampled;
+	float *signal_level;                // AGC signal level estimate at each resampled sample
+	size_t resampled_size;
+	float complex *symbols;
+	uint32_t *symbol_pos;
+	size_t symbols_size;
+	uint32_t noise_floor_sampling_clk;
+	float frame_symbol_cnt;             // float because it's used only in float calculations
 #ifdef COSTAS_DEBUG
-	dumpfile_rf32 f_costas_dphi = dumpfile_rf32_open("f_costas_dphi.rf32", NAN);
-	dumpfile_rf32 f_costas_err = dumpfile_rf32_open("f_costas_err.rf32", NAN);
-	dumpfile_cf32 f_costas_out = dumpfile_cf32_open("f_costas_out.cf32", NAN);
+	dumpfile_rf32 f_costas_dphi;
+	dumpfile_rf32 f_costas_err;
+	dumpfile_cf32 f_costas_out;
 #endif
 #ifdef SYMSYNC_DEBUG
-	dumpfile_cf32 f_symsync_out = dumpfile_cf32_open("f_symsync_out.cf32", NAN);
+	dumpfile_cf32 f_symsync_out;
 #endif
 #ifdef CHAN_DEBUG
-	dumpfile_cf32 f_chan_out = dumpfile_cf32_open("f_chan_out.cf32", NAN);
+	dumpfile_cf32 f_chan_out;
 #endif
 #ifdef MF_DEBUG
-	dumpfile_cf32 f_mf_out = dumpfile_cf32_open("f_mf_out.cf32", NAN);
+	dumpfile_cf32 f_mf_out;
 #endif
 #ifdef AGC_DEBUG
-	dumpfile_cf32 f_agc_out = dumpfile_cf32_open("f_agc_out.cf32", NAN);
-	dumpfile_rf32 f_agc_gain = dumpfile_rf32_open("f_agc_gain.rf32", NAN);
-	dumpfile_rf32 f_agc_rssi = dumpfile_rf32_open("f_agc_rssi.rf32", NAN);
-	dumpfile_rf32 f_noise_floor = dumpfile_rf32_open("f_noise_floor.rf32", NAN);
-	dumpfile_rf32 f_sig_level = dumpfile_rf32_open("f_sig_level.rf32", NAN);
-	float gain, rssi;
+	dumpfile_cf32 f_agc_out;
+	dumpfile_rf32 f_agc_gain;
+	dumpfile_rf32 f_agc_rssi;
+	dumpfile_rf32 f_noise_floor;
+	dumpfile_rf32 f_sig_level;
 #endif
 #ifdef EQ_DEBUG
-	dumpfile_cf32 f_eq_out = dumpfile_cf32_open("f_eq_out.cf32", NAN);
+	dumpfile_cf32 f_eq_out;
 #endif
 #ifdef CORR_DEBUG
-	dumpfile_rf32 f_corr_A1 = dumpfile_rf32_open("f_corr_A1.rf32", 0.f);
-	dumpfile_rf32 f_corr_A2 = dumpfile_rf32_open("f_corr_A2.rf32", 0.f);
+	dumpfile_rf32 f_corr_A1;
+	dumpfile_rf32 f_corr_A2;
 #endif
 #ifdef DUMP_CONST
 	uint64_t frame_id;
 	FILE *consts;
+#endif
+};
+
+static void demod_state_resize(struct hfdl_channel *c, struct demod_state *st, size_t resampled_size) {
+	st->resampled_size = resampled_size;
+	st->resampled = XREALLOC(st->resampled, resampled_size * sizeof(float complex));
+	st->signal_level = XREALLOC(st->signal_level, resampled_size * sizeof(float));
+	st->symbols_size = gardner_max_output_len(c->ss, resampled_size);
+	st->symbols = XREALLOC(st->symbols, st->symbols_size * sizeof(float complex));
+	st->symbol_pos = XREALLOC(st->symbol_pos, st->symbols_size * sizeof(uint32_t));
+}
+
+static size_t demod_state_size(struct demod_state const *st) {
+	if(st == NULL) {
+		return 0;
+	}
+	size_t size = sizeof(struct demod_state) +
+		(st->resampled_size + st->symbols_size) * sizeof(float complex) +
+		st->resampled_size * sizeof(float) +
+		st->symbols_size * sizeof(uint32_t);
+	if(st->channelizer_output != NULL) {
+		size += st->channelizer_output_size * sizeof(float complex);
+	}
+	return size;
+}
+
+static struct demod_state *demod_state_create(struct hfdl_channel *c) {
+	NEW(struct demod_state, st);
+	// Worker nodes grow the buffer as needed
+	size_t resampled_size = HFDL_SYMBOL_RATE * SPS / 10;
+	if(c->channelizer != NULL) {
+		// FIXME: post_input_size / post_decimation_rate ?
+		st->channelizer_output_size = c->channelizer->ddc->post_input_size;
+		st->channelizer_output = XCALLOC(st->channelizer_output_size, sizeof(float complex));
+		resampled_size = (c->channelizer->ddc->post_input_size + c->resampler_delay + 10) * c->resamp_rate;
+	}
+	demod_state_resize(c, st, resampled_size);
+#ifdef COSTAS_DEBUG
+	st->f_costas_dphi = dumpfile_rf32_open("f_costas_dphi.rf32", NAN);
+	st->f_costas_err = dumpfile_rf32_open("f_costas_err.rf32", NAN);
+	st->f_costas_out = dumpfile_cf32_open("f_costas_out.cf32", NAN);
+#endif
+#ifdef SYMSYNC_DEBUG
+	st->f_symsync_out = dumpfile_cf32_open("f_symsync_out.cf32", NAN);
+#endif
+#ifdef CHAN_DEBUG
+	st->f_chan_out = dumpfile_cf32_open("f_chan_out.cf32", NAN);
+#endif
+#ifdef MF_DEBUG
+	st->f_mf_out = dumpfile_cf32_open("f_mf_out.cf32", NAN);
+#endif
+#ifdef AGC_DEBUG
+	st->f_agc_out = dumpfile_cf32_open("f_agc_out.cf32", NAN);
+	st->f_agc_gain = dumpfile_rf32_open("f_agc_gain.rf32", NAN);
+	st->f_agc_rssi = dumpfile_rf32_open("f_agc_rssi.rf32", NAN);
+	st->f_noise_floor = dumpfile_rf32_open("f_noise_floor.rf32", NAN);
+	st->f_sig_level = dumpfile_rf32_open("f_sig_level.rf32", NAN);
+#endif
+#ifdef EQ_DEBUG
+	st->f_eq_out = dumpfile_cf32_open("f_eq_out.cf32", NAN);
+#endif
+#ifdef CORR_DEBUG
+	st->f_corr_A1 = dumpfile_rf32_open("f_corr_A1.rf32", 0.f);
+	st->f_corr_A2 = dumpfile_rf32_open("f_corr_A2.rf32", 0.f);
+#endif
+#ifdef DUMP_CONST
 	if(Config.datadumps == true) {
-		consts = fopen("const.m", "w");
-		ASSERT(consts);
+		st->consts = fopen("const.m", "w");
+		ASSERT(st->consts);
 	}
 #endif
-#ifdef DUMP_FFT
-	dumpfile_cf32 f_fft_out = dumpfile_cf32_open("f_fft_out.cf32");
+	return st;
+}
+
+static void demod_state_destroy(struct demod_state *st) {
+	if(st == NULL) {
+		return;
+	}
+#ifdef COSTAS_DEBUG
+	dumpfile_rf32_destroy(st->f_costas_dphi);
+	dumpfile_rf32_destroy(st->f_costas_err);
+	dumpfile_cf32_destroy(st->f_costas_out);
+#endif
+#ifdef SYMSYNC_DEBUG
+	dumpfile_cf32_destroy(st->f_symsync_out);
+#endif
+#ifdef CHAN_DEBUG
+	dumpfile_cf32_destroy(st->f_chan_out);
+#endif
+#ifdef MF_DEBUG
+	dumpfile_cf32_destroy(st->f_mf_out);
+#endif
+#ifdef AGC_DEBUG
+	dumpfile_cf32_destroy(st->f_agc_out);
+	dumpfile_rf32_destroy(st->f_agc_gain);
+	dumpfile_rf32_destroy(st->f_agc_rssi);
+	dumpfile_rf32_destroy(st->f_sig_level);
+	dumpfile_rf32_destroy(st->f_noise_floor);
+#endif
+#ifdef EQ_DEBUG
+	dumpfile_cf32_destroy(st->f_eq_out);
+#endif
+#ifdef CORR_DEBUG
+	dumpfile_rf32_destroy(st->f_corr_A1);
+	dumpfile_rf32_destroy(st->f_corr_A2);
+#endif
+#ifdef DUMP_CONST
+	if(Config.datadumps == true) {
+		fclose(st->consts);
+	}
+#endif
+	XFREE(st->channelizer_output);
+	XFREE(st->resampled);
+	XFREE(st->signal_level);
+	XFREE(st->symbols);
+	XFREE(st->symbol_pos);
+	XFREE(st);
+}
+
+// Extracts the channel from a FFT frame and resamples it to the symbol rate
+// multiplied by SPS. Returns the number of samples placed in st->resampled.
+static uint32_t channelize(struct hfdl_channel *c, struct demod_state *st, float complex *fft_output) {
+	uint32_t resampled_cnt = 0;
+	// FIXME: pass c->channelizer pointer to this function
+	c->channelizer->shift_status = fastddc_inv_cc(fft_output, st->channelizer_output, c->channelizer->ddc,
+			c->channelizer->inv_plan, c->channelizer->filtertaps_fft, c->channelizer->shift_status);
+	msresamp_crcf_execute(c->resampler, st->channelizer_output, c->channelizer->shift_status.output_size,
+			st->resampled, &resampled_cnt);
+	if(resampled_cnt < 1) {
+		debug_print(D_DSP, "ERROR: resampled_cnt is 0\n");
+	}
+	return resampled_cnt;
+}
+
+// Runs the demodulator and the framer over resampled_cnt samples
+// stored in st->resampled
+static void demodulate(struct hfdl_channel *c, struct demod_state *st, uint32_t resampled_cnt) {
+	float complex r, s;
+	uint64_t block_start_sample = 0;
+	uint32_t symbols_produced = 0;
+	uint32_t bits = 0;
+	int32_t M1_match = -1;
+	float corr_A1 = 0.f;
+	float corr_A1_threshold = CORR_THRESHOLD_A1;
+	float corr_A2 = 0.f;
+	float corr_M1 = 0.f;
+#ifdef AGC_DEBUG
+	float gain, rssi;
 #endif
-	struct shared_buffer *input = &block->consumer.in->shared_buffer;
+	static size_t const max_symbols_without_frame = 13 * SINGLE_SLOT_FRAME_LEN;
 	static struct timeval ts_correction = {
 		.tv_sec = 0,
 		.tv_usec = (PREKEY_LEN + 2 * A_LEN) * 1000000UL / HFDL_SYMBOL_RATE
 	};
 
-	while(true) {
-		pthread_barrier_wait(input->consumers_ready);
-		pthread_barrier_wait(input->data_ready);
-		if(block_connection_is_shutdown_signaled(block->consumer.in)) {
-			debug_print(D_MISC, "channel %d: Exiting (ordered shutdown)\n", c->chan_freq);
-			break;
-		}
-#ifdef DUMP_FFT
-		// XXX: Does not work now due to missing sample clock
-		//dumpfile_cf32_write_block(f_fft_out, input->buf, c->channelizer->ddc->fft_size);
-#endif
-		// FIXME: pass c->channelizer pointer to this function
-		c->channelizer->shift_status = fastddc_inv_cc(input->buf, channelizer_output, c->channelizer->ddc,
-				c->channelizer->inv_plan, c->channelizer->filtertaps_fft, c->channelizer->shift_status);
-		msresamp_crcf_execute(c->resampler, channelizer_output, c->channelizer->shift_status.output_size,
-				resampled, &resampled_cnt);
-		if(resampled_cnt < 1) {
-			debug_print(D_DSP, "ERROR: resampled_cnt is 0\n");
-			continue;
-		}
 #ifdef CHAN_DEBUG
-		dumpfile_cf32_write_block(f_chan_out, c->sample_cnt, resampled, resampled_cnt);
+	dumpfile_cf32_write_block(st->f_chan_out, c->sample_cnt, st->resampled, resampled_cnt);
 #endif
-		for(size_t k = 0; k < resampled_cnt; k++, c->sample_cnt++) {
-			agc_crcf_execute(c->agc, resampled[k], &r);
+	block_start_sample = c->sample_cnt;
+	for(size_t k = 0; k < resampled_cnt; k++, c->sample_cnt++) {
+		agc_crcf_execute(c->agc, st->resampled[k], &r);
+		// Stored for the symbol loop below, which runs after the whole block
+		// has passed through the AGC
+		st->signal_level[k] = agc_crcf_get_signal_level(c->agc);
 #ifdef AGC_DEBUG
-			gain = agc_crcf_get_gain(c->agc);
-			rssi = agc_crcf_get_rssi(c->agc);
-			dumpfile_rf32_write_value(f_agc_gain, c->sample_cnt, gain);
-			dumpfile_rf32_write_value(f_agc_rssi, c->sample_cnt, rssi);
-			dumpfile_cf32_write_value(f_agc_out, c->sample_cnt, r);
+		gain = agc_crcf_get_gain(c->agc);
+		rssi = agc_crcf_get_rssi(c->agc);
+		dumpfile_rf32_write_value(st->f_agc_gain, c->sample_cnt, gain);
+		dumpfile_rf32_write_value(st->f_agc_rssi, c->sample_cnt, rssi);
+		dumpfile_cf32_write_value(st->f_agc_out, c->sample_cnt, r);
 #endif
-			firfilt_crcf_push(c->mf, r);
-			firfilt_crcf_execute(c->mf, &s);
+		firfilt_crcf_push(c->mf, r);
+		firfilt_crcf_execute(c->mf, &s);
 #ifdef MF_DEBUG
-			dumpfile_cf32_write_value(f_mf_out, c->sample_cnt, s);
+		dumpfile_cf32_write_value(st->f_mf_out, c->sample_cnt, s);
 #endif
-			// update noise floor estimate - every 255 samples, only when we aren't inside a frame
-			if(c->fr_state == FRAMER_A1_SEARCH && (++noise_floor_sampling_clk & 0xFFu) == 0xFFu) {
-				c->noise_floor = 0.65f * c->noise_floor +
-					0.35f * fminf(c->noise_floor, agc_crcf_get_signal_level(c->agc)) + 1e-6f;
+		// update noise floor estimate - every 255 samples, only when we aren't inside a frame
+		if(c->fr_state == FRAMER_A1_SEARCH && (++st->noise_floor_sampling_clk & 0xFFu) == 0xFFu) {
+			c->noise_floor = 0.65f * c->noise_floor +
+				0.35f * fminf(c->noise_floor, st->signal_level[k]) + 1e-6f;
 #ifdef AGC_DEBUG
-				dumpfile_rf32_write_value(f_noise_floor, c->sample_cnt, c->noise_floor);
+			dumpfile_rf32_write_value(st->f_noise_floor, c->sample_cnt, c->noise_floor);
 #endif
-			}
-			symsync_crcf_execute(c->ss, &s, 1, symbols, &symbols_produced);
-			for(size_t i = 0; i < symbols_produced; i++, c->symsync_out_idx++) {
-				costas_cccf_step(c->loop);
-				costas_cccf_execute(c->loop, symbols[i], &r);
-				if(UNLIKELY(fabsf(c->loop->dphi) > 0.25f && c->fr_state == FRAMER_A1_SEARCH)) {
-					chan_debug("costas_dphi: %f, resetting control loops\n", c->loop->dphi);
-					costas_cccf_reset(c->loop);
-					symsync_crcf_reset(c->ss);
-				}
+		}
+		// Matched filter output replaces the input in place and is then
+		// passed to the symbol synchronizer in one go.
+		st->resampled[k] = s;
+	}
+	gardner_execute(c->ss, st->resampled, resampled_cnt, st->symbols, st->symbol_pos, &symbols_produced);
+	ASSERT(symbols_produced <= st->symbols_size);
+	for(size_t i = 0; i < symbols_produced; i++, c->symsync_out_idx++) {
+		c->sample_cnt = block_start_sample + st->symbol_pos[i];
+		float signal_level = st->signal_level[st->symbol_pos[i]];
+		costas_cccf_step(c->loop);
+		costas_cccf_execute(c->loop, st->symbols[i], &r);
+		if(UNLIKELY(fabsf(c->loop->dphi) > 0.25f && c->fr_state == FRAMER_A1_SEARCH)) {
+			chan_debug("costas_dphi: %f, resetting control loops\n", c->loop->dphi);
+			costas_cccf_reset(c->loop);
+			gardner_reset(c->ss);
+		}
 
-				eqlms_cccf_push(c->eq, r);
-				if(!(c->symsync_out_idx & 1)) {
-					continue;
-				}
+		eqlms_cccf_push(c->eq, r);
+		if(!(c->symsync_out_idx & 1)) {
+			continue;
+		}
 #ifdef SYMSYNC_DEBUG
-				dumpfile_cf32_write_value(f_symsync_out, c->sample_cnt, symbols[i]);
+		dumpfile_cf32_write_value(st->f_symsync_out, c->sample_cnt, st->symbols[i]);
 #endif
 #ifdef COSTAS_DEBUG
-				dumpfile_rf32_write_value(f_costas_dphi, c->sample_cnt, c->loop->dphi);
-				dumpfile_rf32_write_value(f_costas_err, c->sample_cnt, c->loop->err);
-				dumpfile_cf32_write_value(f_costas_out, c->sample_cnt, r);
+		dumpfile_rf32_write_value(st->f_costas_dphi, c->sample_cnt, c->loop->dphi);
+		dumpfile_rf32_write_value(st->f_costas_err, c->sample_cnt, c->loop->err);
+		dumpfile_cf32_write_value(st->f_costas_out, c->sample_cnt, r);
 #endif
-				eqlms_cccf_execute(c->eq, &s);
-				if(c->fr_state == FRAMER_EQ_TRAIN) {
-					eqlms_cccf_step(c->eq, T_seq[c->bitmask & 1][c->T_idx], s);
-					c->T_idx++;
-				}
+		eqlms_cccf_execute(c->eq, &s);
+		if(c->fr_state == FRAMER_EQ_TRAIN) {
+			eqlms_cccf_step(c->eq, T_seq[c->bitmask & 1][c->T_idx], s);
+			c->T_idx++;
+		}
 #ifdef EQ_DEBUG
-				dumpfile_cf32_write_value(f_eq_out, c->sample_cnt, s);
+		dumpfile_cf32_write_value(st->f_eq_out, c->sample_cnt, s);
 #endif
-				modem_demodulate(c->m[c->current_mod_arity], s, &bits);
-				costas_cccf_adjust(c->loop, modem_get_demodulator_phase_error(c->m[c->current_mod_arity]));
+		modem_demodulate(c->m[c->current_mod_arity], s, &bits);
+		costas_cccf_adjust(c->loop, modem_get_demodulator_phase_error(c->m[c->current_mod_arity]));
 #ifdef DUMP_CONST
-				if(c->fr_state >= FRAMER_EQ_TRAIN && Config.datadumps == true) {
-					fprintf(consts, "frame%lu(end+1,1)=%f+%f*i;\n", frame_id,
-							crealf(s), cimagf(s));
-				}
+		if(c->fr_state >= FRAMER_EQ_TRAIN && Config.datadumps == true) {
+			fprintf(st->consts, "frame%lu(end+1,1)=%f+%f*i;\n", st->frame_id,
+					crealf(s), cimagf(s));
+		}
 #endif
-				c->symbol_cnt++;
-				if(UNLIKELY(c->symbol_cnt >= max_symbols_without_frame && c->fr_state == FRAMER_A1_SEARCH)) {
-					chan_debug("Too long without a good frame (%" PRIu64 " symbols), resetting control loops\n",
-							c->symbol_cnt);
-					c->symbol_cnt = 0;
-					costas_cccf_reset(c->loop);
-					symsync_crcf_reset(c->ss);
-				}
+		c->symbol_cnt++;
+		if(UNLIKELY(c->symbol_cnt >= max_symbols_without_frame && c->fr_state == FRAMER_A1_SEARCH)) {
+			chan_debug("Too long without a good frame (%" PRIu64 " symbols), resetting control loops\n",
+					c->symbol_cnt);
+			c->symbol_cnt = 0;
+			costas_cccf_reset(c->loop);
+			gardner_reset(c->ss);
+		}
 
-				if(c->s_state == SAMPLER_EMIT_BITS) {
-					bits ^= c->bitmask;
-					for(uint32_t b = 0; b < c->current_mod_arity; b++, bits >>= 1) {
-						bsequence_push(c->bits, bits);
-					}
-				} else if(c->s_state == SAMPLER_EMIT_SYMBOLS) {
-					ASSERT(cbuffercf_space_available(c->current_buffer) != 0);
-					cbuffercf_push(c->current_buffer, s);
-				} else {    // SKIP
-							// NOOP
-				}
-				// Update signal level estimate - only when inside a frame
-				if(c->fr_state > FRAMER_A1_SEARCH) {
-					// Approximate averaging
-					c->signal_level = (c->signal_level * frame_symbol_cnt + agc_crcf_get_signal_level(c->agc)) / (frame_symbol_cnt + 1.0f);
-					frame_symbol_cnt += 1.0f;
+		if(c->s_state == SAMPLER_EMIT_BITS) {
+			bits ^= c->bitmask;
+			for(uint32_t b = 0; b < c->current_mod_arity; b++, bits >>= 1) {
+				bsequence_push(c->bits, bits);
+			}
+		} else if(c->s_state == SAMPLER_EMIT_SYMBOLS) {
+			ASSERT(cbuffercf_space_available(c->current_buffer) != 0);
+			cbuffercf_push(c->current_buffer, s);
+		} else {    // SKIP
+					// NOOP
+		}
+		// Update signal level estimate - only when inside a frame
+		if(c->fr_state > FRAMER_A1_SEARCH) {
+			// Approximate averaging
+			c->signal_level = (c->signal_level * st->frame_symbol_cnt + signal_level) / (st->frame_symbol_cnt + 1.0f);
+			st->frame_symbol_cnt += 1.0f;
 #ifdef AGC_DEBUG
-					dumpfile_rf32_write_value(f_sig_level, c->sample_cnt, c->signal_level);
+			dumpfile_rf32_write_value(st->f_sig_level, c->sample_cnt, c->signal_level);
 #endif
-				}
-				if(c->symbols_wanted > 1) {
-					c->symbols_wanted--;
-					continue;
-				}
+		}
+		if(c->symbols_wanted > 1) {
+			c->symbols_wanted--;
+			continue;
+		}
 
-				switch(c->fr_state) {
-				case FRAMER_A1_SEARCH:
-					corr_A1 = 2.0f * (float)bsequence_correlate(A_bs, c->bits) / (float)A_LEN - 1.0f;
+		switch(c->fr_state) {
+		case FRAMER_A1_SEARCH:
+			corr_A1_threshold = CORR_THRESHOLD_A1;
+			if(slot_clock_is_locked(&c->slot_clock, c->sample_cnt)) {
+				// Skip the search if a frame ending its A1 sequence
+				// now could not have started at a slot boundary
+				if(!slot_clock_in_window(&c->slot_clock, frame_start_estimate(c, A_LEN), SLOT_SEARCH_WINDOW)) {
+					break;
+				}
+				corr_A1_threshold = CORR_THRESHOLD_A1_SLOT;
+			}
+			corr_A1 = 2.0f * (float)bsequence_correlate(A_bs, c->bits) / (float)A_LEN - 1.0f;
 #ifdef CORR_DEBUG
-					dumpfile_rf32_write_value(f_corr_A1, c->sample_cnt, corr_A1);
+			dumpfile_rf32_write_value(st->f_corr_A1, c->sample_cnt, corr_A1);
 #endif
-					if(fabsf(corr_A1) > CORR_THRESHOLD_A1) {
-						STATS_UPDATE(S.A1_found++);
-						STATS_UPDATE(S.A1_corr_total += fabsf(corr_A1));
-						c->bitmask = corr_A1 > 0.f ? 0 : ~0;
-						c->signal_level = agc_crcf_get_signal_level(c->agc);
-						frame_symbol_cnt = 1.0f;
-						c->symbols_wanted = A_LEN;
-						c->search_retries = 0;
-						c->fr_state++;
+			if(fabsf(corr_A1) > corr_A1_threshold) {
+				STATS_ADD(c->stats, A1_found, 1);
+				STATS_ADD_CORR(c->stats, A1_corr_total, corr_A1);
+				c->bitmask = corr_A1 > 0.f ? 0 : ~0;
+				gardner_set_tracking(c->ss, true);
+				c->signal_level = signal_level;
+				st->frame_symbol_cnt = 1.0f;
+				c->symbols_wanted = A_LEN;
+				c->search_retries = 0;
+				c->fr_state++;
 #ifdef DUMP_CONST
-						frame_id = c->sample_cnt;
+				st->frame_id = c->sample_cnt;
 #endif
-					}
-					break;
-				case FRAMER_A2_SEARCH:
-					corr_A2 = 2.0f * (float)bsequence_correlate(A_bs, c->bits) / (float)A_LEN - 1.0f;
+			}
+			break;
+		case FRAMER_A2_SEARCH:
+			corr_A2 = 2.0f * (float)bsequence_correlate(A_bs, c->bits) / (float)A_LEN - 1.0f;
 #ifdef CORR_DEBUG
-					dumpfile_rf32_write_value(f_corr_A2, c->sample_cnt, corr_A2);
+			dumpfile_rf32_write_value(st->f_corr_A2, c->sample_cnt, corr_A2);
 #endif
-					if(fabsf(corr_A2) > CORR_THRESHOLD_A2) {
-						// Save the current timestamp and go back by the length
-						// of the prekey and two A sequences, so that the timestamp
-						// points at the start of the frame.
-						gettimeofday(&c->pdu_timestamp, NULL);
-						timersub(&c->pdu_timestamp, &ts_correction, &c->pdu_timestamp);
-						chan_debug("A2 sequence found at sample %" PRIu64 " (corr=%f retry=%d costas_dphi=%f)\n",
-								c->sample_cnt, corr_A2, c->search_retries, c->loop->dphi);
-						c->freq_err_hz = c->loop->dphi * HFDL_SYMBOL_RATE / (2.0 * M_PI);
-						STATS_UPDATE(S.A2_found++);
-						STATS_UPDATE(S.A2_corr_total += fabsf(corr_A2));
-						c->symbols_wanted = M1_LEN;
-						c->search_retries = 0;
-						c->fr_state = FRAMER_M1_SEARCH;
-						statsd_increment_per_channel(c->chan_freq, "demod.preamble.A2_found");
-					} else if(++c->search_retries >= MAX_SEARCH_RETRIES) {
-						framer_reset(c);
-					}
-					break;
-				case FRAMER_M1_SEARCH:
-					M1_match = match_sequence(M1, M_SHIFT_CNT, c->bits, &corr_M1);
-					if(fabsf(corr_M1) > CORR_THRESHOLD_M1) {
-						chan_debug("M1 match at sample %" PRIu64 ": %d (corr=%f, costas_dphi=%f)\n",
-								c->sample_cnt, M1_match, corr_M1, c->loop->dphi);
-						statsd_increment_per_channel(c->chan_freq, "demod.preamble.M1_found");
-						STATS_UPDATE(S.M1_found++);
-						STATS_UPDATE(S.M1_corr_total += fabsf(corr_M1));
-						c->data_segment_cnt = hfdl_frame_params[M1_match].data_segment_cnt;
-						c->data_mod_arity = hfdl_frame_params[M1_match].scheme;
-						c->M1 = M1_match;
-						c->symbols_wanted = M2_LEN;
-						c->search_retries = 0;
-						c->fr_state = FRAMER_M2_SKIP;
-						c->s_state = SAMPLER_SKIP;
-					} else {
-						chan_debug("M1 sequence unreliable (val=%d corr=%f)\n", M1_match, corr_M1);
-						statsd_increment_per_channel(c->chan_freq, "demod.preamble.errors.M1_not_found");
-						framer_reset(c);
-					}
-					break;
-				case FRAMER_M2_SKIP:
-					cbuffercf_reset(c->training_symbols);
-					c->symbols_wanted = T_LEN;
-					c->eq_train_seq_cnt = 9;
-					c->fr_state = FRAMER_EQ_TRAIN;
-					c->s_state = SAMPLER_EMIT_SYMBOLS;
+			if(fabsf(corr_A2) > CORR_THRESHOLD_A2) {
+				// Save the current timestamp and go back by the length
+				// of the prekey and two A sequences, so that the timestamp
+				// points at the start of the frame.
+				c->frame_start_sample = frame_start_estimate(c, 2 * A_LEN);
+				if(Config.deterministic) {
+					// Use the sample clock, so that the output does not depend
+					// on the time of the run
+					c->pdu_timestamp.tv_sec = c->frame_start_sample / (HFDL_SYMBOL_RATE * SPS);
+					c->pdu_timestamp.tv_usec = c->frame_start_sample % (HFDL_SYMBOL_RATE * SPS) *
+						1000000UL / (HFDL_SYMBOL_RATE * SPS);
+				} else {
+					gettimeofday(&c->pdu_timestamp, NULL);
+					timersub(&c->pdu_timestamp, &ts_correction, &c->pdu_timestamp);
+				}
+				chan_debug("A2 sequence found at sample %" PRIu64 " (corr=%f retry=%d costas_dphi=%f)\n",
+						c->sample_cnt, corr_A2, c->search_retries, c->loop->dphi);
+				c->costas_freq_err_hz = c->loop->dphi * HFDL_SYMBOL_RATE / (2.0 * M_PI);
+				c->freq_err_hz = c->afc_offset_hz + c->costas_freq_err_hz;
+				STATS_ADD(c->stats, A2_found, 1);
+				STATS_ADD_CORR(c->stats, A2_corr_total, corr_A2);
+				c->symbols_wanted = M1_LEN;
+				c->search_retries = 0;
+				c->fr_state = FRAMER_M1_SEARCH;
+				statsd_increment_per_channel(c->chan_freq, "demod.preamble.A2_found");
+			} else if(++c->search_retries >= MAX_SEARCH_RETRIES) {
+				framer_reset(c);
+			}
+			break;
+		case FRAMER_M1_SEARCH:
+			M1_match = match_sequence(M1, M_SHIFT_CNT, c->bits, &corr_M1);
+			if(fabsf(corr_M1) > CORR_THRESHOLD_M1) {
+				chan_debug("M1 match at sample %" PRIu64 ": %d (corr=%f, costas_dphi=%f)\n",
+						c->sample_cnt, M1_match, corr_M1, c->loop->dphi);
+				statsd_increment_per_channel(c->chan_freq, "demod.preamble.M1_found");
+				STATS_ADD(c->stats, M1_found, 1);
+				STATS_ADD_CORR(c->stats, M1_corr_total, corr_M1);
+				c->data_segment_cnt = hfdl_frame_params[M1_match].data_segment_cnt;
+				c->data_mod_arity = hfdl_frame_params[M1_match].scheme;
+				c->M1 = M1_match;
+				c->symbols_wanted = M2_LEN;
+				c->search_retries = 0;
+				c->fr_state = FRAMER_M2_SKIP;
+				c->s_state = SAMPLER_SKIP;
+			} else {
+				chan_debug("M1 sequence unreliable (val=%d corr=%f)\n", M1_match, corr_M1);
+				statsd_increment_per_channel(c->chan_freq, "demod.preamble.errors.M1_not_found");
+				framer_reset(c);
+			}
+			break;
+		case FRAMER_M2_SKIP:
+			cbuffercf_reset(c->training_symbols);
+			c->symbols_wanted = T_LEN;
+			c->eq_train_seq_cnt = 9;
+			c->fr_state = FRAMER_EQ_TRAIN;
+			c->s_state = SAMPLER_EMIT_SYMBOLS;
 #ifdef DUMP_CONST
-					if(Config.datadumps == true) {
-						fprintf(consts, "frame%lu = [];\n", frame_id);
-					}
+			if(Config.datadumps == true) {
+				fprintf(st->consts, "frame%lu = [];\n", st->frame_id);
+			}
 #endif
-					break;
-				case FRAMER_EQ_TRAIN:
-					ASSERT(cbuffercf_size(c->training_symbols) == T_LEN);
-					compute_train_bit_error_cnt(c);
-					cbuffercf_reset(c->training_symbols);
-					if(c->eq_train_seq_cnt > 1) {               // next frame is training sequence
-						c->eq_train_seq_cnt--;
-						c->symbols_wanted = T_LEN;
-						c->T_idx = 0;
-					} else if(c->data_segment_cnt > 0) {        // next frame is data frame
-						c->symbols_wanted = DATA_FRAME_LEN / 2;
-						c->fr_state = FRAMER_DATA_1;
-						c->current_mod_arity = c->data_mod_arity;
-						c->current_buffer = c->data_symbols;
-					} else {                                    // end of frame
-						chan_debug("train_bits_bad: %d/%d (%f%%)\n",
-								c->train_bits_bad, c->train_bits_total,
-								(float)c->train_bits_bad / (float)c->train_bits_total * 100.f);
-						decode_user_data(c);
-						framer_reset(c);
-						c->symbol_cnt = 0;
-					}
-					break;
-				case FRAMER_DATA_1:
-					c->symbols_wanted = DATA_FRAME_LEN / 2;
-					c->fr_state = FRAMER_DATA_2;
-					break;
-				case FRAMER_DATA_2:
-					c->data_segment_cnt--;
-					c->current_mod_arity = M_BPSK;
-					c->current_buffer = c->training_symbols;
-					c->fr_state = FRAMER_EQ_TRAIN;
-					c->eq_train_seq_cnt = 1;
-					c->symbols_wanted = T_LEN;
-					c->T_idx = 0;
-					break;
-				}
+			break;
+		case FRAMER_EQ_TRAIN:
+			ASSERT(cbuffercf_size(c->training_symbols) == T_LEN);
+			compute_train_bit_error_cnt(c);
+			cbuffercf_reset(c->training_symbols);
+			if(c->eq_train_seq_cnt > 1) {               // next frame is training sequence
+				c->eq_train_seq_cnt--;
+				c->symbols_wanted = T_LEN;
+				c->T_idx = 0;
+			} else if(c->data_segment_cnt > 0) {        // next frame is data frame
+				c->symbols_wanted = DATA_FRAME_LEN / 2;
+				c->fr_state = FRAMER_DATA_1;
+				c->current_mod_arity = c->data_mod_arity;
+				c->current_buffer = c->data_symbols;
+			} else {                                    // end of frame
+				chan_debug("train_bits_bad: %d/%d (%f%%)\n",
+						c->train_bits_bad, c->train_bits_total,
+						(float)c->train_bits_bad / (float)c->train_bits_total * 100.f);
+				afc_update(c);
+				decode_user_data(c);
+				framer_reset(c);
+				c->symbol_cnt = 0;
 			}
+			break;
+		case FRAMER_DATA_1:
+			c->symbols_wanted = DATA_FRAME_LEN / 2;
+			c->fr_state = FRAMER_DATA_2;
+			break;
+		case FRAMER_DATA_2:
+			c->data_segment_cnt--;
+			c->current_mod_arity = M_BPSK;
+			c->current_buffer = c->training_symbols;
+			c->fr_state = FRAMER_EQ_TRAIN;
+			c->eq_train_seq_cnt = 1;
+			c->symbols_wanted = T_LEN;
+			c->T_idx = 0;
+			break;
 		}
 	}
-#ifdef COSTAS_DEBUG
-	dumpfile_rf32_destroy(f_costas_dphi);
-	dumpfile_rf32_destroy(f_costas_err);
-	dumpfile_cf32_destroy(f_costas_out);
-#endif
-#ifdef SYMSYNC_DEBUG
-	dumpfile_cf32_destroy(f_symsync_out);
-#endif
-#ifdef CHAN_DEBUG
-	dumpfile_cf32_destroy(f_chan_out);
-#endif
-#ifdef MF_DEBUG
-	dumpfile_cf32_destroy(f_mf_out);
-#endif
-#ifdef AGC_DEBUG
-	dumpfile_cf32_destroy(f_agc_out);
-	dumpfile_rf32_destroy(f_agc_gain);
-	dumpfile_rf32_destroy(f_agc_rssi);
-	dumpfile_rf32_destroy(f_sig_level);
-	dumpfile_rf32_destroy(f_noise_floor);
-#endif
-#ifdef EQ_DEBUG
-	dumpfile_cf32_destroy(f_eq_out);
+	c->sample_cnt = block_start_sample + resampled_cnt;
+}
+
+static void *hfdl_decoder_thread(void *ctx) {
+	ASSERT(ctx != NULL);
+	struct block *block = ctx;
+	struct hfdl_channel *c = container_of(block, struct hfdl_channel, block);
+
+	struct demod_state *st = c->demod;
+	uint32_t resampled_cnt = 0;
+	bool detached = false;
+#ifdef DUMP_FFT
+	dumpfile_cf32 f_fft_out = dumpfile_cf32_open("f_fft_out.cf32");
 #endif
-#ifdef CORR_DEBUG
-	dumpfile_rf32_destroy(f_corr_A1);
-	dumpfile_rf32_destroy(f_corr_A2);
+	struct shared_buffer *input = c->bb_feed == NULL ? &block->consumer.in->shared_buffer : NULL;
+
+	while(true) {
+		if(c->bb_feed != NULL) {
+			struct bb_block *bb = bb_feed_pop(c->bb_feed);
+			if(bb == NULL) {
+				debug_print(D_MISC, "channel %d: Exiting (front-end node gone)\n", c->chan_freq);
+				break;
+			}
+			if(bb->len > st->resampled_size) {
+				demod_state_resize(c, st, bb->len);
+			}
+			memcpy(st->resampled, bb->samples, bb->len * sizeof(float complex));
+			resampled_cnt = bb->len;
+			if(bb->sample_cnt != c->sample_cnt) {
+				// Blocks have been dropped on the way - the current frame is lost
+				chan_debug("sample clock jump: %" PRIu64 " -> %" PRIu64 "\n", c->sample_cnt, bb->sample_cnt);
+				c->sample_cnt = bb->sample_cnt;
+				framer_reset(c);
+			}
+			XFREE(bb);
+			if(resampled_cnt < 1) {
+				continue;
+			}
+		} else {
+			if(block_heartbeat_idle(block) == false) {
+				debug_print(D_MISC, "channel %d: Exiting (detached by the watchdog)\n", c->chan_freq);
+				detached = true;
+				break;
+			}
+			pthread_barrier_wait(input->consumers_ready);
+			pthread_barrier_wait(input->data_ready);
+			if(block_connection_is_shutdown_signaled(block->consumer.in)) {
+				debug_print(D_MISC, "channel %d: Exiting (ordered shutdown)\n", c->chan_freq);
+				break;
+			}
+			block_heartbeat_busy(block);
+#ifdef DUMP_FFT
+			// XXX: Does not work now due to missing sample clock
+			//dumpfile_cf32_write_block(f_fft_out, input->buf, c->channelizer->ddc->fft_size);
 #endif
-#ifdef DUMP_CONST
-	if(Config.datadumps == true) {
-		fclose(consts);
+			if((resampled_cnt = channelize(c, st, input->buf)) < 1) {
+				continue;
+			}
+			if(c->bb_server != NULL &&
+					bb_server_send(c->bb_server, c->chan_freq, c->sample_cnt, st->resampled, resampled_cnt)) {
+				// Demodulated by a worker node
+				c->sample_cnt += resampled_cnt;
+				continue;
+			}
+		}
+		demodulate(c, st, resampled_cnt);
+		if(c->diversity != NULL) {
+			decode_diversity_frames(c);
+		}
+	}
+	// A detached channel has been replaced by a new instance,
+	// which carries on with its diversity branch
+	if(c->diversity != NULL && !detached) {
+		diversity_branch_done(c->diversity, c->diversity_branch);
+		decode_diversity_frames(c);
 	}
-#endif
 #ifdef DUMP_FFT
 	dumpfile_cf32_destroy(f_fft_out);
 #endif
-	XFREE(channelizer_output);
-	XFREE(resampled);
+	runstats_stage_thread_done(RUNSTATS_STAGE_CHANNEL);
 	block->running = false;
 	return NULL;
 }
 
+// Deterministic mode: processes the FFT frame which the producer has
+// just stored in the shared buffer. There are no barriers to wait on,
+// as the caller steps all blocks one after another.
+static bool hfdl_channel_step(struct block *block) {
+	ASSERT(block != NULL);
+	struct hfdl_channel *c = container_of(block, struct hfdl_channel, block);
+	uint32_t resampled_cnt = channelize(c, c->demod, block->consumer.in->shared_buffer.buf);
+	if(resampled_cnt > 0) {
+		demodulate(c, c->demod, resampled_cnt);
+	}
+	return true;
+}
+
 static int32_t match_sequence(bsequence *templates, size_t template_cnt, bsequence bits, float *result_corr) {
 	float max_corr = 0.f;
 	int32_t max_idx = -1;
@@ -931,14 +1467,45 @@ static void compute_train_bit_error_cnt(struct hfdl_channel *c) {
 		T_seq = (T_seq << 1) | bit;
 	}
 	int32_t error_cnt = count_bit_errors(T, T_seq);
-	STATS_UPDATE(S.train_bits_total += T_LEN);
-	STATS_UPDATE(S.train_bits_bad += error_cnt);
+	STATS_ADD(c->stats, train_bits_total, T_LEN);
+	STATS_ADD(c->stats, train_bits_bad, error_cnt);
 	c->train_bits_total += T_LEN;
 	c->train_bits_bad += error_cnt;
 }
 
+// Moves the frequency error measured by the Costas loop gradually into
+// the channelizer, so that subsequent frames start closer to the correct
+// frequency. The part of the error which has not been moved yet is used
+// as the initial frequency of the Costas loop.
+static void afc_update(struct hfdl_channel *c) {
+	if(c->train_bits_bad > AFC_MAX_TRAIN_BER * c->train_bits_total) {
+		return;
+	}
+	c->afc_residual_hz = (1.0f - AFC_MEASUREMENT_WEIGHT) * c->afc_residual_hz +
+		AFC_MEASUREMENT_WEIGHT * c->costas_freq_err_hz;
+	// Worker nodes have no channelizer - the whole error is left for the Costas loop
+	float max_offset = c->channelizer != NULL ? AFC_MAX_OFFSET_HZ : 0.0f;
+	float new_offset = c->afc_offset_hz + AFC_LOOP_GAIN * c->afc_residual_hz;
+	new_offset = fmaxf(-max_offset, fminf(max_offset, new_offset));
+	c->afc_residual_hz -= new_offset - c->afc_offset_hz;
+	c->afc_offset_hz = new_offset;
+	if(c->channelizer != NULL) {
+		fft_channelizer_set_freq_offset(c->channelizer, -c->afc_offset_hz / c->chan_sample_rate);
+	}
+	c->loop->dphi_init = 2.0f * M_PI * c->afc_residual_hz / HFDL_SYMBOL_RATE;
+	chan_debug("AFC: measured: %.2f Hz residual: %.2f Hz channelizer offset: %.2f Hz\n",
+			c->costas_freq_err_hz, c->afc_residual_hz, c->afc_offset_hz);
+}
+
+// Returns the estimated position of the start of the current frame,
+// given the number of symbols received since the end of the prekey.
+static uint64_t frame_start_estimate(struct hfdl_channel *c, uint32_t symbols_since_prekey) {
+	uint64_t offset = (uint64_t)(PREKEY_LEN + symbols_since_prekey) * SPS;
+	return c->sample_cnt > offset ? c->sample_cnt - offset : 0;
+}
+
 static void sampler_reset(struct hfdl_channel *c) {
-	symsync_crcf_reset(c->ss);
+	gardner_reset(c->ss);
 	c->s_state = SAMPLER_EMIT_BITS;
 	c->bitmask = 0;
 }
@@ -955,92 +1522,187 @@ static void framer_reset(struct hfdl_channel *c) {
 	eqlms_cccf_reset(c->eq);
 	cbuffercf_reset(c->data_symbols);
 	cbuffercf_reset(c->training_symbols);
-	bsequence_reset(c->user_data);
-	for(int32_t i = 0; i < M_SHIFT_CNT; i++) {
-		deinterleaver_reset(c->deinterleaver[i]);
-	}
 	sampler_reset(c);
 }
 
-static void decode_user_data(struct hfdl_channel *c) {
-#define deinterleaver_table_size(d) (uint32_t)((d)->column_cnt * DEINTERLEAVER_ROW_CNT)
+/**********************************
+ * User data decoder
+ **********************************/
+
+#define CONV_CODE_RATE 2
+// When FEC rate is 1/4, every chip is transmitted twice, so the Viterbi
+// decoder gets half of the demodulated soft bits
+#define VITERBI_INPUT_LEN(scheme, data_segment_cnt, code_rate) \
+	((data_segment_cnt) * DATA_FRAME_LEN * (scheme) * CONV_CODE_RATE / (code_rate))
+#define DEINTERLEAVER_COLUMN_CNT(scheme, data_segment_cnt) \
+	((data_segment_cnt) * DATA_FRAME_LEN * (scheme) / DEINTERLEAVER_ROW_CNT)
+
+// Demodulates and deinterleaves user data symbols of the current frame.
+// Always inlined into frame type specific decoders, where all arguments
+// except c, d and viterbi_input are compile-time constants. This lets
+// the compiler unroll the per-symbol soft bit loop, drop the code rate
+// branch and fold the deinterleaver index arithmetic.
+static inline __attribute__((always_inline)) void demod_deinterleave(struct hfdl_channel *c,
+		deinterleaver d, uint8_t *viterbi_input, mod_arity const scheme,
+		uint32_t const num_symbols, int32_t const code_rate,
+		int32_t const column_cnt, int32_t const column_shift) {
 	static float const phase_flip[2] = { [0] = 1.0f, [1] = -1.0f };
-	int32_t M1 = c->M1;
-	uint32_t num_symbols = hfdl_frame_params[M1].data_segment_cnt * DATA_FRAME_LEN;
 	ASSERT(num_symbols == cbuffercf_size(c->data_symbols));
-	uint32_t num_encoded_bits = num_symbols * c->data_mod_arity;
-	chan_debug("got %d user data symbols, deinterleaver table size: %u bitmask: 0x%x\n", num_symbols,
-			deinterleaver_table_size(c->deinterleaver[M1]), c->bitmask);
-	ASSERT(num_encoded_bits == deinterleaver_table_size(c->deinterleaver[M1]));
+	ASSERT(scheme == c->data_mod_arity);
+	ASSERT(column_cnt == d->column_cnt);
+	deinterleaver_reset(d);
+	chan_debug("got %d user data symbols, deinterleaver table size: %d bitmask: 0x%x\n", num_symbols,
+			column_cnt * DEINTERLEAVER_ROW_CNT, c->bitmask);
+	// Flip symbol phase by M_PI when Costas loop synced in an opposite phase
+	float const costas_flip = phase_flip[c->bitmask & 1];
 	uint32_t bits = 0;
 	uint32_t descrambler_bit = 0;
 	float complex symbol;
-	uint8_t soft_bits[c->data_mod_arity];
-	modem data_modem = c->m[c->data_mod_arity];
+	uint8_t soft_bits[MOD_ARITY_MAX];
+	modem data_modem = c->m[scheme];
 	for(uint32_t i = 0; i < num_symbols; i++) {
 		cbuffercf_pop(c->data_symbols, &symbol);
 		descrambler_bit = descrambler_advance(c->descrambler);
 		// Flip symbol phase by M_PI when descrambler outputs 1
-		// Flip symbol phase by M_PI when Costas loop synced in an opposite phase
-		modem_demodulate_soft(data_modem, symbol * phase_flip[descrambler_bit] * phase_flip[c->bitmask & 1],
+		modem_demodulate_soft(data_modem, symbol * phase_flip[descrambler_bit] * costas_flip,
 				&bits, soft_bits);
-		for(uint32_t j = 0; j < c->data_mod_arity; j++) {
-			deinterleaver_push(c->deinterleaver[M1], soft_bits[j]);
+		for(uint32_t j = 0; j < scheme; j++) {
+			deinterleaver_push(d, soft_bits[j], column_cnt, column_shift);
 		}
 	}
-#define CONV_CODE_RATE 2
-	uint32_t viterbi_input_len = num_encoded_bits;
-	// When FEC rate is 1/4, every chip is transmitted twice, so we take mean value of them
-	if(hfdl_frame_params[M1].code_rate == 4) {
-		viterbi_input_len /= 2;
-	}
-	uint8_t viterbi_input[viterbi_input_len];
-	if(hfdl_frame_params[M1].code_rate == 4) {
+	uint32_t const viterbi_input_len = num_symbols * scheme * CONV_CODE_RATE / code_rate;
+	if(code_rate == 4) {
 		uint8_t a, b;
 		for(uint32_t i = 0; i < viterbi_input_len; i++) {
-			a = deinterleaver_pop(c->deinterleaver[M1]);
-			b = deinterleaver_pop(c->deinterleaver[M1]);
+			a = deinterleaver_pop(d);
+			b = deinterleaver_pop(d);
 			// Average without overflow (http://aggregate.org/MAGIC/#Average%20of%20Integers)
 			viterbi_input[i] = (a & b) + ((a ^ b) >> 1);
 		}
 	} else {    // code_rate == 2
 		for(uint32_t i = 0; i < viterbi_input_len; i++) {
-			viterbi_input[i] = deinterleaver_pop(c->deinterleaver[M1]);
+			viterbi_input[i] = deinterleaver_pop(d);
 		}
 	}
+}
+
+// Passes deinterleaved soft bits to the Viterbi decoder, either directly
+// or via the diversity combiner. Common for all frame types.
+static void decode_soft_bits(struct hfdl_channel *c, uint8_t *viterbi_input, uint32_t viterbi_input_len) {
 	debug_print_buf_hex(D_FRAME_DETAIL, viterbi_input, viterbi_input_len, "viterbi_input:\n");
 
-	void *v = c->viterbi_ctx[M1];
+	struct diversity_frame f = {
+		.soft_bits = viterbi_input,
+		.len = viterbi_input_len,
+		.M1 = c->M1,
+		.start_sample = c->frame_start_sample,
+		.end_sample = c->sample_cnt,
+		.branch = c->diversity_branch,
+		.timestamp = c->pdu_timestamp,
+		.freq_err_hz = c->freq_err_hz,
+		.signal_level = c->signal_level,
+		.noise_floor = c->noise_floor
+	};
+	if(c->diversity == NULL) {
+		decode_frame(c, &f);
+		return;
+	}
+	float snr = c->signal_level / fmaxf(c->noise_floor, 1e-6f);
+	f.snr = fmaxf(snr * snr - 1.0f, 0.01f);
+	NEW(struct diversity_frame, copy);
+	*copy = f;
+	copy->soft_bits = XCALLOC(viterbi_input_len, sizeof(uint8_t));
+	memcpy(copy->soft_bits, viterbi_input, viterbi_input_len);
+	diversity_submit(c->diversity, copy);
+	decode_diversity_frames(c);
+}
+
+#define USER_DATA_DEINTERLEAVER(m1, scheme, data_segment_cnt, code_rate, column_shift) \
+static uint32_t deinterleave_user_data_##m1(struct hfdl_channel *c, uint8_t *viterbi_input) { \
+	struct fec_ctx *fec = fec_ctx_borrow(m1); \
+	demod_deinterleave(c, fec->deinterleaver, viterbi_input, scheme, \
+			(data_segment_cnt) * DATA_FRAME_LEN, code_rate, \
+			DEINTERLEAVER_COLUMN_CNT(scheme, data_segment_cnt), column_shift); \
+	fec_ctx_return(m1, fec); \
+	return VITERBI_INPUT_LEN(scheme, data_segment_cnt, code_rate); \
+}
+
+HFDL_FRAME_TYPES(USER_DATA_DEINTERLEAVER)
+
+#define USER_DATA_DEINTERLEAVER_ENTRY(m1, ...) [m1] = deinterleave_user_data_##m1,
+
+static uint32_t (* const user_data_deinterleavers[M_SHIFT_CNT])(struct hfdl_channel *c, uint8_t *viterbi_input) = {
+	HFDL_FRAME_TYPES(USER_DATA_DEINTERLEAVER_ENTRY)
+};
+
+#define VITERBI_INPUT_LEN_MAX VITERBI_INPUT_LEN(M_PSK8, DATA_FRAME_CNT_DOUBLE_SLOT, 2)
+
+static void decode_user_data(struct hfdl_channel *c) {
+	ASSERT(c->M1 >= 0 && c->M1 < M_SHIFT_CNT);
+	uint8_t viterbi_input[VITERBI_INPUT_LEN_MAX];
+	uint32_t viterbi_input_len = user_data_deinterleavers[c->M1](c, viterbi_input);
+	decode_soft_bits(c, viterbi_input, viterbi_input_len);
+}
+
+static void decode_diversity_frames(struct hfdl_channel *c) {
+	struct diversity_frame *f;
+	while((f = diversity_next(c->diversity, c->diversity_branch, c->sample_cnt)) != NULL) {
+		chan_debug("decoding frame from branch %d (%d branch(es) combined, snr: %.1f)\n",
+				f->branch, f->branch_cnt, f->snr);
+		decode_frame(c, f);
+		diversity_frame_destroy(f);
+	}
+}
+
+static void decode_frame(struct hfdl_channel *c, struct diversity_frame const *f) {
+	int32_t M1 = f->M1;
+	uint32_t viterbi_input_len = f->len;
 	uint32_t viterbi_output_len = viterbi_input_len / CONV_CODE_RATE;
 	uint32_t viterbi_output_len_octets = viterbi_output_len / 8 + (viterbi_output_len % 8 != 0 ? 1 : 0);
 	uint8_t viterbi_output[viterbi_output_len_octets];
-	init_viterbi27(v, 0);
-	update_viterbi27_blk(v, viterbi_input, viterbi_output_len);
-	chainback_viterbi27(v, viterbi_output, viterbi_output_len, 0);
-	debug_print(D_FRAME, "code_rate: 1/%d num_encoded_bits: %u viterbi_input_len: %u viterbi_output_len: %u, viterbi_output_len_octets: %u\n",
-			hfdl_frame_params[M1].code_rate, num_encoded_bits, viterbi_input_len, viterbi_output_len, viterbi_output_len_octets);
+	struct fec_ctx *fec = fec_ctx_borrow(M1);
+	init_viterbi27(fec->viterbi, 0);
+	update_viterbi27_blk(fec->viterbi, f->soft_bits, viterbi_output_len);
+	chainback_viterbi27(fec->viterbi, viterbi_output, viterbi_output_len, 0);
+	fec_ctx_return(M1, fec);
+	debug_print(D_FRAME, "code_rate: 1/%d viterbi_input_len: %u viterbi_output_len: %u, viterbi_output_len_octets: %u\n",
+			hfdl_frame_params[M1].code_rate, viterbi_input_len, viterbi_output_len, viterbi_output_len_octets);
 	debug_print_buf_hex(D_FRAME_DETAIL, viterbi_output, viterbi_output_len_octets, "viterbi_output:\n");
 	for(uint32_t i = 0; i < viterbi_output_len_octets; i++) {
 		viterbi_output[i] = REVERSE_BYTE(viterbi_output[i]);
 	}
 	debug_print_buf_hex(D_FRAME_DETAIL, viterbi_output, viterbi_output_len_octets, "viterbi_output (reversed):\n");
-	dispatch_pdu(c, viterbi_output, viterbi_output_len_octets);
+	// SPDUs discipline the slot clock. Frame positions are only meaningful
+	// in the sample clock of the branch which received the frame.
+	uint32_t frame_index = 0;
+	uint8_t frame_offset = 0;
+	if(f->branch == c->diversity_branch &&
+			spdu_frame_timing_get(viterbi_output, viterbi_output_len_octets, &frame_index, &frame_offset)) {
+		chan_debug("SPDU frame_index: %u frame_offset: %u at sample %" PRIu64 "\n",
+				frame_index, frame_offset, f->start_sample);
+		slot_clock_update(&c->slot_clock, f->start_sample, frame_index);
+	}
+	dispatch_pdu(c, f, viterbi_output, viterbi_output_len_octets);
 }
 
-static void dispatch_pdu(struct hfdl_channel *c, uint8_t *buf, size_t len) {
+static void dispatch_pdu(struct hfdl_channel *c, struct diversity_frame const *f, uint8_t *buf, size_t len) {
+	if(c->frame_cb != NULL) {
+		c->frame_cb(buf, len, f->M1, c->frame_cb_ctx);
+		return;
+	}
 	struct metadata *m = hfdl_pdu_metadata_create();
 	struct hfdl_pdu_metadata *hm = container_of(m, struct hfdl_pdu_metadata, metadata);
 	hm->version = 1;
 	hm->freq = c->chan_freq;
-	hm->freq_err_hz = c->freq_err_hz;
-	hm->rssi = LEVEL_TO_DB(c->signal_level);
-	hm->noise_floor = LEVEL_TO_DB(c->noise_floor);
-	m->rx_timestamp.tv_sec = c->pdu_timestamp.tv_sec;
-	m->rx_timestamp.tv_usec = c->pdu_timestamp.tv_usec;
-
-	ASSERT(c->M1 >= 0);
-	ASSERT(c->M1 < M_SHIFT_CNT);
-	struct hfdl_params const *p = &hfdl_frame_params[c->M1];
+	hm->freq_err_hz = f->freq_err_hz;
+	hm->rssi = LEVEL_TO_DB(f->signal_level);
+	hm->noise_floor = LEVEL_TO_DB(f->noise_floor);
+	m->rx_timestamp.tv_sec = f->timestamp.tv_sec;
+	m->rx_timestamp.tv_usec = f->timestamp.tv_usec;
+
+	ASSERT(f->M1 >= 0);
+	ASSERT(f->M1 < M_SHIFT_CNT);
+	struct hfdl_params const *p = &hfdl_frame_params[f->M1];
 	hm->bit_rate = HFDL_SYMBOL_RATE * p->scheme / p->code_rate *
 		DATA_FRAME_LEN / (DATA_FRAME_LEN + T_LEN);
 	hm->slot = p->data_segment_cnt == DATA_FRAME_CNT_SINGLE_SLOT ? 'S' : 'D';
@@ -1048,5 +1710,245 @@ static void dispatch_pdu(struct hfdl_channel *c, uint8_t *buf, size_t len) {
 	uint32_t flags = 0;
 	uint8_t *copy = XCALLOC(len, sizeof(uint8_t));
 	memcpy(copy, buf, len);
-	pdu_decoder_queue_push(m, octet_string_new(copy, len), flags);
+	struct octet_string *pdu = octet_string_new(copy, len);
+	if(c->bb_feed != NULL) {
+		// PDUs are decoded by the front-end node
+		bb_feed_send_pdu(c->bb_feed, m, pdu);
+	} else {
+		pdu_decoder_queue_push(m, pdu, flags);
+	}
+}
+
+/**********************************
+ * Standalone channels
+ **********************************/
+
+// Creates a channel which is driven by the caller instead of a thread
+// (used by the microbenchmarks and the link simulator). Baseband samples
+// written to hfdl_channel_input_buffer() are demodulated by
+// hfdl_channel_process(). Decoded frames are passed to frame_cb,
+// or to the PDU decoder if it's NULL.
+struct block *hfdl_channel_create_standalone(int32_t frequency, hfdl_frame_cb *frame_cb, void *ctx) {
+	struct hfdl_channel *c = unchannelized_channel_create(frequency);
+	c->frame_cb = frame_cb;
+	c->frame_cb_ctx = ctx;
+	return &c->block;
+}
+
+// Returns the demodulator input buffer, resized to hold at least cnt samples.
+// Its contents are overwritten during processing.
+float complex *hfdl_channel_input_buffer(struct block *channel_block, uint32_t cnt) {
+	ASSERT(channel_block != NULL);
+	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
+	ASSERT(c->demod != NULL);
+	if(cnt > c->demod->resampled_size) {
+		demod_state_resize(c, c->demod, cnt);
+	}
+	return c->demod->resampled;
 }
+
+void hfdl_channel_process(struct block *channel_block, uint32_t cnt) {
+	ASSERT(channel_block != NULL);
+	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
+	ASSERT(c->demod != NULL);
+	ASSERT(cnt <= c->demod->resampled_size);
+	demodulate(c, c->demod, cnt);
+}
+
+// Brings a standalone channel back to its initial state, including
+// the AFC, the slot clock and all control loops, so that the result of
+// processing a signal does not depend on what has been processed before.
+void hfdl_channel_reset(struct block *channel_block) {
+	ASSERT(channel_block != NULL);
+	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
+	ASSERT(c->channelizer == NULL);
+	ASSERT(c->demod != NULL);
+	framer_reset(c);
+	agc_crcf_reset(c->agc);
+	firfilt_crcf_reset(c->mf);
+	c->afc_offset_hz = c->afc_residual_hz = c->costas_freq_err_hz = 0.0f;
+	c->loop->dphi_init = 0.0f;
+	costas_cccf_reset(c->loop);
+	modem_reset(c->m[M_BPSK]);
+	modem_reset(c->m[M_PSK4]);
+	modem_reset(c->m[M_PSK8]);
+	// Bits received before the reset would otherwise take part
+	// in the first preamble correlations
+	bsequence_reset(c->bits);
+	descrambler_reset(c->descrambler);
+	// Parameters of the last detected frame, possibly a false detection
+	c->M1 = 0;
+	c->data_segment_cnt = 0;
+	c->data_mod_arity = M_BPSK;
+	c->eq_train_seq_cnt = 0;
+	c->frame_start_sample = 0;
+	c->pdu_timestamp = (struct timeval){ 0 };
+	c->freq_err_hz = c->signal_level = 0.0f;
+	c->noise_floor = 1.0f;
+	c->symbol_cnt = c->sample_cnt = 0;
+	c->symsync_out_idx = 0;
+	c->demod->noise_floor_sampling_clk = 0;
+	c->demod->frame_symbol_cnt = 0.0f;
+	slot_clock_init(&c->slot_clock, c->chan_freq, HFDL_SYMBOL_RATE * SPS);
+}
+
+#ifdef MICROBENCH
+/**********************************
+ * Entry points for dumphfdl-microbench
+ **********************************/
+
+int32_t hfdl_bench_match_sequence(bsequence bits, float *result_corr) {
+	return match_sequence(M1, M_SHIFT_CNT, bits, result_corr);
+}
+
+uint32_t hfdl_bench_user_data_symbol_cnt(int32_t M1) {
+	ASSERT(M1 >= 0 && M1 < M_SHIFT_CNT);
+	return hfdl_frame_params[M1].data_segment_cnt * DATA_FRAME_LEN;
+}
+
+// Demodulates and deinterleaves user data symbols of a frame of the given type.
+// viterbi_input must have room for 3 soft bits per symbol.
+// Returns the number of soft bits stored in viterbi_input.
+uint32_t hfdl_bench_deinterleave(struct block *channel_block, int32_t M1,
+		float complex *symbols, uint8_t *viterbi_input) {
+	ASSERT(channel_block != NULL);
+	ASSERT(M1 >= 0 && M1 < M_SHIFT_CNT);
+	struct hfdl_channel *c = container_of(channel_block, struct hfdl_channel, block);
+	c->M1 = M1;
+	c->data_mod_arity = hfdl_frame_params[M1].scheme;
+	cbuffercf_reset(c->data_symbols);
+	cbuffercf_write(c->data_symbols, symbols, hfdl_bench_user_data_symbol_cnt(M1));
+	return user_data_deinterleavers[M1](c, viterbi_input);
+}
+#endif
+
+#ifdef LINKSIM
+/**********************************
+ * Frame modulator for dumphfdl-linksim
+ **********************************/
+
+// The Viterbi decoder is not fed with tail bits, so the last bits of
+// user data must bring the encoder back to state 0
+#define CONV_TAIL_LEN 6
+// Extra symbols pushed through the pulse shaping filter at the end of the frame
+#define TX_FLUSH_SYMBOLS (HFDL_MF_TAPS_CNT / SPS + 1)
+
+static uint32_t frame_symbol_cnt(int32_t M1) {
+	return PREKEY_LEN + PREAMBLE_LEN + hfdl_frame_params[M1].data_segment_cnt * (DATA_FRAME_LEN + T_LEN);
+}
+
+// Number of user data bits which may be set freely in a frame of the given type
+uint32_t hfdl_sim_payload_bit_cnt(int32_t M1) {
+	ASSERT(M1 >= 0 && M1 < M_SHIFT_CNT);
+	return user_data_bits_cnt(M1) - CONV_TAIL_LEN;
+}
+
+uint32_t hfdl_sim_frame_sample_cnt(int32_t M1) {
+	ASSERT(M1 >= 0 && M1 < M_SHIFT_CNT);
+	return (frame_symbol_cnt(M1) + TX_FLUSH_SYMBOLS) * SPS;
+}
+
+// Encodes the payload and interleaves the chips. This reverses the steps
+// of the user data decoder: chips are stored in the deinterleaver in the
+// order in which it's popped and read out in the order in which it's pushed.
+// Returns the number of chips stored in chips.
+static uint32_t encode_interleave(int32_t M1, uint8_t const *payload, uint8_t *chips) {
+	struct hfdl_params const p = hfdl_frame_params[M1];
+	uint32_t const bit_cnt = user_data_bits_cnt(M1);
+	uint32_t const chip_cnt = p.data_segment_cnt * DATA_FRAME_LEN * p.scheme;
+	deinterleaver d = deinterleaver_create(M1);
+	uint32_t sr = 0;
+	for(uint32_t i = 0; i < bit_cnt; i++) {
+		uint32_t bit = i < bit_cnt - CONV_TAIL_LEN ? (payload[i / 8] >> (i % 8)) & 1 : 0;
+		sr = (sr << 1) | bit;
+		uint8_t const pair[CONV_CODE_RATE] = {
+			__builtin_parity(sr & V27POLYA),
+			__builtin_parity(sr & V27POLYB)
+		};
+		for(int32_t k = 0; k < CONV_CODE_RATE; k++) {
+			// With code rate 1/4 every chip is sent twice
+			for(int32_t r = 0; r < p.code_rate / CONV_CODE_RATE; r++) {
+				d->table[d->row][d->col] = pair[k];
+				deinterleaver_pop(d);
+			}
+		}
+	}
+	deinterleaver_reset(d);
+	for(uint32_t i = 0; i < chip_cnt; i++) {
+		chips[i] = d->table[d->row][d->col];
+		deinterleaver_push(d, chips[i], d->column_cnt, d->push_column_shift);
+	}
+	deinterleaver_destroy(d);
+	return chip_cnt;
+}
+
+static uint32_t bsequence_symbols(bsequence bs, float complex *symbols) {
+	uint32_t len = bsequence_get_length(bs);
+	// Index 0 is the most recently pushed bit
+	for(uint32_t j = 0; j < len; j++) {
+		symbols[j] = bsequence_index(bs, len - 1 - j) ? -1.0f : 1.0f;
+	}
+	return len;
+}
+
+// Produces baseband of a complete frame of the given type carrying the payload,
+// at HFDL_SYMBOL_RATE * SPS, shaped with the receiver's matched filter.
+// Payload bit i is bit (i % 8) of octet (i / 8), like in the decoder output.
+// out must have room for hfdl_sim_frame_sample_cnt(m1) samples.
+// Returns the number of samples written.
+uint32_t hfdl_sim_frame_modulate(int32_t m1, uint8_t const *payload, float complex *out) {
+	ASSERT(m1 >= 0 && m1 < M_SHIFT_CNT);
+	ASSERT(payload != NULL);
+	ASSERT(out != NULL);
+	struct hfdl_params const p = hfdl_frame_params[m1];
+	uint32_t const symbol_cnt = frame_symbol_cnt(m1);
+	float complex *symbols = XCALLOC(symbol_cnt + TX_FLUSH_SYMBOLS, sizeof(float complex));
+	uint8_t *chips = XCALLOC(p.data_segment_cnt * DATA_FRAME_LEN * p.scheme, sizeof(uint8_t));
+	encode_interleave(m1, payload, chips);
+
+	uint32_t n = 0;
+	// The prekey is only used for gain and timing acquisition
+	for(int32_t i = 0; i < PREKEY_LEN; i++) {
+		symbols[n++] = T_seq[0][i % T_LEN];
+	}
+	n += bsequence_symbols(A_bs, symbols + n);
+	n += bsequence_symbols(A_bs, symbols + n);
+	n += bsequence_symbols(M1[m1], symbols + n);
+	n += bsequence_symbols(M2[m1], symbols + n);
+	for(int32_t i = 0; i < 9 * T_LEN; i++) {
+		symbols[n++] = T_seq[0][i % T_LEN];
+	}
+	modem m = modem_create(p.scheme == M_BPSK ? LIQUID_MODEM_BPSK :
+			p.scheme == M_PSK4 ? LIQUID_MODEM_PSK4 : LIQUID_MODEM_PSK8);
+	descrambler scrambler = descrambler_create(LFSR_LEN, LFSR_GENPOLY, LFSR_INIT, DESCRAMBLER_LEN);
+	uint8_t const *chip = chips;
+	for(int32_t seg = 0; seg < p.data_segment_cnt; seg++) {
+		for(int32_t i = 0; i < DATA_FRAME_LEN; i++) {
+			uint32_t sym = 0;
+			for(uint32_t b = 0; b < p.scheme; b++) {
+				sym = (sym << 1) | *chip++;
+			}
+			modem_modulate(m, sym, &symbols[n]);
+			if(descrambler_advance(scrambler)) {
+				symbols[n] = -symbols[n];
+			}
+			n++;
+		}
+		for(int32_t i = 0; i < T_LEN; i++) {
+			symbols[n++] = T_seq[0][i];
+		}
+	}
+	ASSERT(n == symbol_cnt);
+	descrambler_destroy(scrambler);
+	modem_destroy(m);
+
+	firinterp_crcf interp = firinterp_crcf_create(SPS, hfdl_matched_filter, HFDL_MF_TAPS_CNT);
+	for(uint32_t i = 0; i < symbol_cnt + TX_FLUSH_SYMBOLS; i++) {
+		firinterp_crcf_execute(interp, symbols[i], out + i * SPS);
+	}
+	firinterp_crcf_destroy(interp);
+	XFREE(chips);
+	XFREE(symbols);
+	return (symbol_cnt + TX_FLUSH_SYMBOLS) * SPS;
+}
+#endif
@@ -1,7 +1,11 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #pragma once
 #include <stdint.h>
+#include <stddef.h>                 // size_t
+#include <complex.h>
+#include "config.h"                 // WITH_STATSD
 #include "block.h"                  // struct block
+#include "baseband.h"               // bb_server, bb_feed
 
 #define SPS 3
 #define HFDL_SYMBOL_RATE 1800
@@ -9,6 +13,38 @@
 
 void hfdl_init_globals(void);
 struct block *hfdl_channel_create(int32_t sample_rate, int32_t pre_decimation_rate,
-		float transition_bw, int32_t centerfreq, int32_t frequency);
+		float transition_bw, int32_t centerfreq, int32_t frequency, float afc_offset_hz);
+struct block *hfdl_channel_create_remote(int32_t frequency, bb_feed feed);
+void hfdl_channel_set_baseband_server(struct block *channel_block, bb_server server);
+struct block *hfdl_channel_respawn(struct block *stalled);
+float hfdl_channel_get_afc_offset(struct block *channel_block);
+void hfdl_channel_set_diversity_pair(struct block *branch0, struct block *branch1);
 void hfdl_channel_destroy(struct block *channel_block);
 void hfdl_print_summary(void);
+#ifdef WITH_STATSD
+void hfdl_stats_export(void);
+#endif
+void hfdl_stats_destroy(void);
+void hfdl_print_memory_usage(int32_t channel_cnt, struct block **channels);
+void hfdl_decoder_pool_destroy(void);
+
+// Standalone channels
+typedef void (hfdl_frame_cb)(uint8_t const *buf, size_t len, int32_t M1, void *ctx);
+struct block *hfdl_channel_create_standalone(int32_t frequency, hfdl_frame_cb *frame_cb, void *ctx);
+float complex *hfdl_channel_input_buffer(struct block *channel_block, uint32_t cnt);
+void hfdl_channel_process(struct block *channel_block, uint32_t cnt);
+void hfdl_channel_reset(struct block *channel_block);
+
+#ifdef MICROBENCH
+#include <liquid/liquid.h>          // bsequence
+int32_t hfdl_bench_match_sequence(bsequence bits, float *result_corr);
+uint32_t hfdl_bench_user_data_symbol_cnt(int32_t M1);
+uint32_t hfdl_bench_deinterleave(struct block *channel_block, int32_t M1,
+		float complex *symbols, uint8_t *viterbi_input);
+#endif
+
+#ifdef LINKSIM
+uint32_t hfdl_sim_payload_bit_cnt(int32_t M1);
+uint32_t hfdl_sim_frame_sample_cnt(int32_t M1);
+uint32_t hfdl_sim_frame_modulate(int32_t M1, uint8_t const *payload, float complex *out);
+#endif
@@ -1,13 +1,13 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include <stdint.h>
-#include <string.h>                 // memcpy
+#include <string.h>                 // memcpy, strncpy
 #include <sys/time.h>               // struct timeval
 #include <libacars/libacars.h>      // la_type_descriptor, la_proto_node, LA_MSG_DIR_*
-#include <libacars/reassembly.h>    // la_reasm_ctx
 #include <libacars/dict.h>          // la_dict
+#include "reasm.h"                  // reasm_mgr
 #include "pdu.h"                    // enum hfdl_pdu_direction
 #include "acars.h"                  // acars_parse
-#include "position.h"               // position_info
+#include "summary.h"                // struct msg_summary
 #include "util.h"                   // ASSERT, NEW, XCALLOC, XFREE, freq_list_format_text, gs_id_format_text
 
 // HFNPDU types
@@ -232,7 +232,7 @@ static int32_t frequency_data_parse(uint8_t *buf, uint32_t len, struct hfnpdu_fr
 }
 
 la_proto_node *hfnpdu_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction direction,
-		la_reasm_ctx *reasm_ctx, struct timeval rx_timestamp) {
+		enum hfdl_pdu_decode_level decode_level, reasm_mgr reasm, struct timeval rx_timestamp) {
 	ASSERT(buf);
 
 	if(len == 0) {
@@ -259,16 +259,16 @@ la_proto_node *hfnpdu_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction
 			// Parse the initial part of the PDU (it gets repeated in all PDUs in the set)
 			consumed_len = systable_parse(buf, len, &hfnpdu->data.systable_data);
 			if(consumed_len > 0 && (uint32_t)consumed_len < len) {
-				Systable_lock();
 				// If there is any data left, then store it for reassembly
 				systable_store_pdu(Systable,
 						hfnpdu->data.systable_data.systable_version,
 						hfnpdu->data.systable_data.pdu_seq_num,
 						hfnpdu->data.systable_data.total_pdu_cnt,
 						buf + consumed_len, len - consumed_len);
-				// Try to reassemble and decode the complete table
-				node->next = systable_process_pdu_set(Systable);
-				Systable_unlock();
+				// Try to reassemble and decode the complete table.
+				// A newer table gets saved and published asynchronously.
+				node->next = systable_process_pdu_set(Systable,
+						hfnpdu->data.systable_data.systable_version);
 			}
 			break;
 		case PERFORMANCE_DATA:
@@ -283,7 +283,10 @@ la_proto_node *hfnpdu_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction
 		case DELAYED_ECHO:
 			break;
 		case ENVELOPED_DATA:
-			node->next = acars_parse(buf + 2, len - 2, direction, reasm_ctx, rx_timestamp);
+			if(acars_decode_wanted(buf + 2, len - 2, decode_level) == false) {
+				break;
+			}
+			node->next = acars_parse(buf + 2, len - 2, direction, reasm, rx_timestamp);
 			if(node->next == NULL) {
 				node->next = unknown_proto_pdu_new(buf + 2, len - 2);
 			}
@@ -437,61 +440,64 @@ static void hfnpdu_format_text(la_vstring *vstr, void const *data, int32_t inden
 	}
 }
 
-struct position_info *hfnpdu_position_info_extract(la_proto_node *tree) {
-	ASSERT(tree);
-
-	struct position_info *pos_info = NULL;
-	la_proto_node *hfnpdu_node = la_proto_tree_find_protocol(tree, &proto_DEF_hfdl_hfnpdu);
-	if(hfnpdu_node != NULL) {
-		struct hfdl_hfnpdu *hfnpdu = hfnpdu_node->data;
-		struct timestamp *ts = NULL;
-		struct location *loc = NULL;
-		switch(hfnpdu->type) {
-			case PERFORMANCE_DATA:
-				pos_info = position_info_create();
-				struct hfnpdu_perf_data *perf_data = &hfnpdu->data.perf_data;
-				pos_info->aircraft.flight_id = perf_data->flight_id;
-				if(pos_info->aircraft.flight_id[0] != '\0') {
-					pos_info->aircraft.flight_id_present = true;
-				}
-
-				ts = &pos_info->position.timestamp;
-				ts->tm.tm_hour = perf_data->utc_time.hour;
-				ts->tm.tm_min  = perf_data->utc_time.min;
-				ts->tm.tm_sec  = perf_data->utc_time.sec;
-				ts->tm_hour_present = ts->tm_min_present =
-					ts->tm_sec_present = true;
-
-				loc = &pos_info->position.location;
-				loc->lat = perf_data->location.lat;
-				loc->lon = perf_data->location.lon;
-				break;
-			case FREQUENCY_DATA:
-				pos_info = position_info_create();
-				struct hfnpdu_freq_data *freq_data = &hfnpdu->data.freq_data;
-				pos_info->aircraft.flight_id = freq_data->flight_id;
-				if(pos_info->aircraft.flight_id[0] != '\0') {
-					pos_info->aircraft.flight_id_present = true;
-				}
-				ts = &pos_info->position.timestamp;
-				ts->tm.tm_hour = freq_data->utc_time.hour;
-				ts->tm.tm_min  = freq_data->utc_time.min;
-				ts->tm.tm_sec  = freq_data->utc_time.sec;
-				ts->tm_hour_present = ts->tm_min_present =
-					ts->tm_sec_present = true;
-
-				loc = &pos_info->position.location;
-				loc->lat = freq_data->location.lat;
-				loc->lon = freq_data->location.lon;
-				break;
-			case ENVELOPED_DATA:
-				pos_info = acars_position_info_extract(tree);
-				break;
-			default:
-				break;
-		}
+#define MPDU_STATS_SUM(s) ((uint32_t)(s).cnt_300bps + (s).cnt_600bps + (s).cnt_1200bps + (s).cnt_1800bps)
+
+static void perf_data_summarize(struct hfnpdu_perf_data const *pdu, struct msg_perf_data *result) {
+	result->mpdus_rx = MPDU_STATS_SUM(pdu->mpdus_rx);
+	result->mpdus_rx_errs = MPDU_STATS_SUM(pdu->mpdus_rx_errs);
+	result->mpdus_tx = MPDU_STATS_SUM(pdu->mpdus_tx);
+	result->mpdus_delivered = MPDU_STATS_SUM(pdu->mpdus_delivered);
+	result->spdus_rx = pdu->spdus_rx;
+	result->spdus_rx_errs = pdu->spdus_rx_errs;
+	result->freq_search_cnt = pdu->cur_leg.freq_search_cnt;
+	result->flight_leg = pdu->flight_leg;
+	result->gs_id = pdu->gs_id;
+	result->freq_id = pdu->freq_id;
+}
+
+void hfnpdu_summarize(la_proto_node *node, struct msg_summary *summary) {
+	ASSERT(node);
+	ASSERT(summary);
+
+	if(node->td != &proto_DEF_hfdl_hfnpdu) {
+		return;
+	}
+	struct hfdl_hfnpdu const *hfnpdu = node->data;
+	summary->hfnpdu_type = hfnpdu->type;
+	if(hfnpdu->err) {
+		return;
+	}
+	char const *flight_id = NULL;
+	struct time const *utc_time = NULL;
+	struct location const *location = NULL;
+	switch(hfnpdu->type) {
+		case PERFORMANCE_DATA:
+			flight_id = hfnpdu->data.perf_data.flight_id;
+			utc_time = &hfnpdu->data.perf_data.utc_time;
+			location = &hfnpdu->data.perf_data.location;
+			perf_data_summarize(&hfnpdu->data.perf_data, &summary->perf_data);
+			summary->perf_data_present = true;
+			break;
+		case FREQUENCY_DATA:
+			flight_id = hfnpdu->data.freq_data.flight_id;
+			utc_time = &hfnpdu->data.freq_data.utc_time;
+			location = &hfnpdu->data.freq_data.location;
+			break;
+		default:
+			return;
+	}
+	if(flight_id[0] != '\0') {
+		strncpy(summary->flight_id, flight_id, SUMMARY_FLIGHT_ID_LEN);
+		summary->flight_id_present = true;
 	}
-	return pos_info;
+	struct timestamp *ts = &summary->position.timestamp;
+	ts->tm.tm_hour = utc_time->hour;
+	ts->tm.tm_min  = utc_time->min;
+	ts->tm.tm_sec  = utc_time->sec;
+	ts->tm_hour_present = ts->tm_min_present =
+		ts->tm_sec_present = true;
+	summary->position.location = *location;
+	summary->position_present = true;
 }
 
 la_type_descriptor const proto_DEF_hfdl_hfnpdu = {
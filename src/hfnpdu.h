@@ -3,10 +3,10 @@
 #include <stdint.h>
 #include <sys/time.h>                   // struct timeval
 #include <libacars/libacars.h>          // la_proto_node
-#include <libacars/reassembly.h>        // la_reasm_ctx
-#include "pdu.h"                        // enum hfdl_pdu_direction
-#include "position.h"                   // struct position_info
+#include "reasm.h"                      // reasm_mgr
+#include "pdu.h"                        // enum hfdl_pdu_direction, enum hfdl_pdu_decode_level
+#include "summary.h"                    // struct msg_summary
 
 la_proto_node *hfnpdu_parse(uint8_t *buf, uint32_t len, enum hfdl_pdu_direction direction,
-		la_reasm_ctx *reasm_ctx, struct timeval rx_timestamp);
-struct position_info *hfnpdu_position_info_extract(la_proto_node *tree);
+		enum hfdl_pdu_decode_level decode_level, reasm_mgr reasm, struct timeval rx_timestamp);
+void hfnpdu_summarize(la_proto_node *node, struct msg_summary *summary);
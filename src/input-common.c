@@ -4,14 +4,18 @@
 #include "config.h"
 #include "util.h"               // ASSERT, XCALLOC, NEW, container_of
 #include "input-common.h"
-#include "input-helpers.h"      // get_sample_converter
+#include "input-helpers.h"      // get_sample_converter, samples_produce
 #include "input-file.h"         // file_input_vtable
+#include "input-shm.h"          // shm_input_vtable
+#include "iq-shm.h"             // iq_publisher_*
+#include "runstats.h"           // runstats_add
 #ifdef WITH_SOAPYSDR
 #include "input-soapysdr.h"     // soapysdr_input_vtable
 #endif
 
 static struct input_vtable *input_vtables[] = {
 	[INPUT_TYPE_FILE] = &file_input_vtable,
+	[INPUT_TYPE_SHM] = &shm_input_vtable,
 #ifdef WITH_SOAPYSDR
 	[INPUT_TYPE_SOAPYSDR] = &soapysdr_input_vtable,
 #endif
@@ -40,6 +44,18 @@ void input_cfg_destroy(struct input_cfg *cfg) {
 	XFREE(cfg);
 }
 
+// Lets the input driver fill in configuration values which can't be
+// set by the user (eg. the sample rate of a stream published by another
+// process). Called before the configuration is validated.
+bool input_probe(struct input_cfg *cfg) {
+	ASSERT(cfg != NULL);
+	struct input_vtable *vtable = input_vtable_get(cfg->type);
+	if(vtable == NULL || vtable->probe == NULL) {
+		return true;
+	}
+	return vtable->probe(cfg);
+}
+
 struct block *input_create(struct input_cfg *cfg) {
 	if(cfg == NULL) {
 		return NULL;
@@ -57,6 +73,7 @@ struct block *input_create(struct input_cfg *cfg) {
 	input->block.producer = producer;
 	input->block.consumer = consumer;
 	input->block.thread_routine = vtable->rx_thread_routine;
+	input->block.step = vtable->step;
 	input->config = cfg;
 	input->vtable = vtable;
 	return &input->block;
@@ -73,16 +90,37 @@ int32_t input_init(struct block *block) {
 	ASSERT(input->full_scale > 0.f);
 	ASSERT(block->producer.max_tu > 0);
 
-	// Provide sample converter from the native format to complex float
-	input->convert_sample_buffer = get_sample_converter(input->config->sfmt);
-	if(input->convert_sample_buffer == NULL) {
+	// Samples are passed to the consumer in the native format.
+	// Provide sample converter from the native format to complex float.
+	struct sample_type sample_type = {
+		.size = input->bytes_per_sample,
+		.full_scale = input->full_scale,
+		.convert = get_sample_converter(input->config->sfmt)
+	};
+	if(sample_type.convert == NULL) {
 		fprintf(stderr, "No sample conversion routine found for sample format %d\n",
 				input->config->sfmt);
 		ret = -1;
 		goto end;
 	}
+	block->producer.sample_type = sample_type;
 	// TODO: Lookup converters of other, non-native formats supported by the device
 
+	if(input->config->shm_publish_name != NULL) {
+		struct iq_shm_params params = {
+			.sample_format = input->config->sfmt,
+			.sample_size = input->bytes_per_sample,
+			.full_scale = input->full_scale,
+			.sample_rate = input->config->sample_rate,
+			.centerfreq = input->config->centerfreq,
+			.slot_samples = block->producer.max_tu
+		};
+		if((input->publisher = iq_publisher_create(input->config->shm_publish_name, &params)) == NULL) {
+			ret = -1;
+			goto end;
+		}
+	}
+
 end:
 	return ret;
 }
@@ -91,8 +129,20 @@ void input_destroy(struct block *block) {
 	if(block != NULL) {
 		struct input *input = container_of(block, struct input, block);
 		ASSERT(input != NULL);
+		iq_publisher_destroy(input->publisher);
 		if(input->vtable != NULL && input->vtable->destroy != NULL) {
 			input->vtable->destroy(input);
 		}
 	}
 }
+
+// Passes samples read by the input driver to the consumer
+// and to the shared memory ring, if enabled.
+void input_samples_produce(struct input *input, void const *samples, size_t num_samples) {
+	ASSERT(input != NULL);
+	if(input->publisher != NULL) {
+		iq_publisher_write(input->publisher, samples, num_samples);
+	}
+	runstats_add(RUNSTATS_INPUT_SAMPLES, num_samples);
+	samples_produce(&input->block.producer.out->circ_buffer, samples, num_samples);
+}
@@ -1,9 +1,11 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>         // size_t
 #include "config.h"
 #include "block.h"          // struct block, struct producer
+#include "iq-shm.h"         // iq_publisher
 
 typedef enum {
 	INPUT_TYPE_UNDEF,
@@ -11,6 +13,7 @@ typedef enum {
 	INPUT_TYPE_SOAPYSDR,
 #endif
 	INPUT_TYPE_FILE,
+	INPUT_TYPE_SHM,
 	INPUT_TYPE_MAX
 } input_type;
 
@@ -29,6 +32,7 @@ struct input_cfg {
 	char *gain_elements;
 	char *antenna;
 	char *device_settings;
+	char *shm_publish_name;     // publish samples to this shared memory object
 	double gain;
 	double correction;
 	int32_t sample_rate;
@@ -43,18 +47,18 @@ struct input;   // forward declaration
 
 struct input_vtable {
 	struct input *(*create)(struct input_cfg *);
+	bool (*probe)(struct input_cfg *);          // optional
 	int32_t (*init)(struct input *);
 	void (*destroy)(struct input *);
 	void* (*rx_thread_routine)(void *);
+	bool (*step)(struct block *);               // optional, for deterministic mode
 };
 
-typedef void (*convert_sample_buffer_fun)(struct input *, void *, size_t, float complex *);
-
 struct input {
 	struct block block;
 	struct input_vtable *vtable;
 	struct input_cfg *config;
-	convert_sample_buffer_fun convert_sample_buffer;
+	iq_publisher publisher;
 	size_t overflow_count;          // TODO: replace with statsd
 	float full_scale;
 	int32_t bytes_per_sample;
@@ -62,6 +66,8 @@ struct input {
 
 struct input_cfg *input_cfg_create();
 void input_cfg_destroy(struct input_cfg *cfg);
+bool input_probe(struct input_cfg *cfg);
 struct block *input_create(struct input_cfg *cfg);
 int32_t input_init(struct block *block);
 void input_destroy(struct block *block);
+void input_samples_produce(struct input *input, void const *samples, size_t num_samples);
@@ -5,18 +5,19 @@
 #include <string.h>
 #include <unistd.h>         // usleep
 #include <errno.h>          // errno
-#include <liquid/liquid.h>  // cbuffercf_*
 #include "block.h"          // block_*
-#include "input-common.h"   // input, sample_format, input_vtable
+#include "input-common.h"   // input, sample_format, input_vtable, input_samples_produce
 #include "input-helpers.h"  // get_sample_full_scale_value, get_sample_size
 #include "util.h"	        // debug_print, ASSERT, XCALLOC
 #include "globals.h"        // do_exit
+#include "runstats.h"       // runstats_stage_thread_done
 
 #define INPUT_FILE_BUFSIZE_DEFAULT 320000U
 
 struct file_input {
 	struct input input;
 	FILE *fh;
+	void *buf;
 };
 
 struct input *file_input_create(struct input_cfg *cfg) {
@@ -28,51 +29,75 @@ struct input *file_input_create(struct input_cfg *cfg) {
 void file_input_destroy(struct input *input) {
 	if(input != NULL) {
 		struct file_input *fi = container_of(input, struct file_input, input);
+		XFREE(fi->buf);
 		XFREE(fi);
 	}
 }
 
+// Reads the next batch of samples and passes it to the consumer.
+// Returns false on end of file.
+static bool file_input_read(struct input *input) {
+	struct file_input *file_input = container_of(input, struct file_input, input);
+	size_t bufsize = input->config->read_buffer_size;
+	size_t len = fread(file_input->buf, 1, bufsize, file_input->fh);
+	input_samples_produce(input, file_input->buf, len / input->bytes_per_sample);
+	return len == bufsize;
+}
+
+static void file_input_finish(struct input *input) {
+	struct file_input *file_input = container_of(input, struct file_input, input);
+	struct block *block = &input->block;
+	fclose(file_input->fh);
+	file_input->fh = NULL;
+	debug_print(D_MISC, "Shutdown ordered, signaling consumer shutdown\n");
+	block_connection_one2one_shutdown(block->producer.out);
+	do_exit = 1;
+	block->running = false;
+}
+
+static bool file_input_has_room(struct input *input) {
+	struct circ_buffer *circ_buffer = &input->block.producer.out->circ_buffer;
+	pthread_mutex_lock(circ_buffer->mutex);
+	size_t space_available = circ_buffer_space_available(circ_buffer);
+	pthread_mutex_unlock(circ_buffer->mutex);
+	return space_available * input->bytes_per_sample >= (size_t)input->config->read_buffer_size;
+}
+
 void *file_input_thread(void *ctx) {
 	ASSERT(ctx);
 	struct block *block = ctx;
 	struct input *input = container_of(block, struct input, block);
 	struct file_input *file_input = container_of(input, struct file_input, input);
-	struct circ_buffer *circ_buffer = &block->producer.out->circ_buffer;
 
 	ASSERT(file_input->fh != NULL);
-	ASSERT(input->config->read_buffer_size > 0);
-	size_t bufsize = input->config->read_buffer_size;
-
-	void *inbuf = XCALLOC(bufsize, sizeof(uint8_t));
-	float complex *outbuf = XCALLOC(bufsize / input->bytes_per_sample,
-			sizeof(float complex));
-	size_t space_available, len, samples_read;
+	bool more;
 	do {
-		len = fread(inbuf, 1, bufsize, file_input->fh);
-		samples_read = len / input->bytes_per_sample;
-		while(true) {
-			pthread_mutex_lock(circ_buffer->mutex);
-			space_available = cbuffercf_space_available(circ_buffer->buf);
-			pthread_mutex_unlock(circ_buffer->mutex);
-			if(space_available * input->bytes_per_sample >= len) {
-				break;
-			}
+		while(!file_input_has_room(input)) {
 			usleep(100000);
 		}
-		input->convert_sample_buffer(input, inbuf, len, outbuf);
-		complex_samples_produce(circ_buffer, outbuf, samples_read);
-	} while(len == bufsize && do_exit == 0);
-	fclose(file_input->fh);
-	file_input->fh = NULL;
-	debug_print(D_MISC, "Shutdown ordered, signaling consumer shutdown\n");
-	block_connection_one2one_shutdown(block->producer.out);
-	do_exit = 1;
-	block->running = false;
-	XFREE(inbuf);
-	XFREE(outbuf);
+		more = file_input_read(input);
+	} while(more && do_exit == 0);
+	// Before file_input_finish(), which marks the block as not running
+	runstats_stage_thread_done(RUNSTATS_STAGE_INPUT);
+	file_input_finish(input);
 	return NULL;
 }
 
+// Deterministic mode: reads one batch of samples, unless the consumer
+// has not made room for it yet. Returns false after the end of file.
+static bool file_input_step(struct block *block) {
+	ASSERT(block);
+	struct input *input = container_of(block, struct input, block);
+	struct file_input *file_input = container_of(input, struct file_input, input);
+	if(file_input->fh == NULL) {
+		return false;
+	}
+	if(file_input_has_room(input) && !file_input_read(input)) {
+		file_input_finish(input);
+	}
+	return true;
+}
+
 int32_t file_input_init(struct input *input) {
 	ASSERT(input != NULL);
 	struct file_input *file_input = container_of(input, struct file_input, input);
@@ -105,6 +130,7 @@ int32_t file_input_init(struct input *input) {
 		return -1;
 	}
 	input->block.producer.max_tu = input->config->read_buffer_size / input->bytes_per_sample;
+	file_input->buf = XCALLOC(input->config->read_buffer_size, sizeof(uint8_t));
 	debug_print(D_SDR, "%s: max_tu=%zu\n",
 			input->config->source, input->block.producer.max_tu);
 	return 0;
@@ -114,6 +140,7 @@ struct input_vtable const file_input_vtable = {
 	.create = file_input_create,
 	.init = file_input_init,
 	.destroy = file_input_destroy,
-	.rx_thread_routine = file_input_thread
+	.rx_thread_routine = file_input_thread,
+	.step = file_input_step
 };
 
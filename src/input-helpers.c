@@ -2,100 +2,63 @@
 #include <limits.h>             // SHRT_MAX, SCHAR_MAX, UCHAR_MAX
 #include <complex.h>            // CMPLXF
 #include <strings.h>            // strcasecmp()
+#include <stdio.h>              // fprintf
 #include <pthread.h>            // pthread_*
-#include <liquid/liquid.h>      // cbuffercf_*
 #include "input-common.h"       // struct input
 #include "util.h"               // ASSERT, debug_print
 
-static void convert_cf32(struct input *input, void *inbuf, size_t len,
+static void convert_cf32(void const *inbuf, size_t sample_cnt, float full_scale,
 		float complex *outbuf) {
-	if(UNLIKELY(len % input->bytes_per_sample != 0)) {
-		debug_print(D_SDR, "Warning: buf len %zu is not a multiple of %d, truncating\n",
-				len, input->bytes_per_sample);
-		len -= (len % input->bytes_per_sample);
-	}
-	if(UNLIKELY(len == 0)) {
-		return;
-	}
-	float *floatbuf = inbuf;
-	size_t floatbuf_len = len / sizeof(float);
-	size_t outbuf_idx = 0;
-	float re = 0.f, im = 0.f;
-	float const full_scale = input->full_scale;
+	float const *floatbuf = inbuf;
 	ASSERT(full_scale > 0.f);
-	for(size_t i = 0; i < floatbuf_len;) {
-		re = floatbuf[i++] / full_scale;
-		im = floatbuf[i++] / full_scale;
-		outbuf[outbuf_idx++] = CMPLXF(re, im);
+	for(size_t i = 0; i < sample_cnt; i++) {
+		float re = floatbuf[2 * i] / full_scale;
+		float im = floatbuf[2 * i + 1] / full_scale;
+		outbuf[i] = CMPLXF(re, im);
 	}
 }
 
-static void convert_cs16(struct input *input, void *inbuf, size_t len,
+static void convert_cs16(void const *inbuf, size_t sample_cnt, float full_scale,
 		float complex *outbuf) {
-	if(UNLIKELY(len % input->bytes_per_sample != 0)) {
-		debug_print(D_SDR, "Warning: buf len %zu is not a multiple of %d, truncating\n",
-				len, input->bytes_per_sample);
-		len -= (len % input->bytes_per_sample);
-	}
-	if(UNLIKELY(len == 0)) {
-		return;
-	}
-	int16_t *shortbuf = inbuf;
-	size_t shortbuf_len = len / sizeof(int16_t);
-	size_t outbuf_idx = 0;
-	float re = 0.f, im = 0.f;
-	float const full_scale = input->full_scale;
+	int16_t const *shortbuf = inbuf;
 	ASSERT(full_scale > 0.f);
-	for(size_t i = 0; i < shortbuf_len;) {
-		re = (float)shortbuf[i++] / full_scale;
-		im = (float)shortbuf[i++] / full_scale;
-		outbuf[outbuf_idx++] = CMPLXF(re, im);
+	for(size_t i = 0; i < sample_cnt; i++) {
+		float re = (float)shortbuf[2 * i] / full_scale;
+		float im = (float)shortbuf[2 * i + 1] / full_scale;
+		outbuf[i] = CMPLXF(re, im);
 	}
 }
 
-static void convert_cu8(struct input *input, void *inbuf, size_t len,
+static void convert_cu8(void const *inbuf, size_t sample_cnt, float full_scale,
 		float complex *outbuf) {
-	if(UNLIKELY(len % input->bytes_per_sample != 0)) {
-		debug_print(D_SDR, "Warning: buf len %zu is not a multiple of %d, truncating\n",
-				len, input->bytes_per_sample);
-		len -= (len % input->bytes_per_sample);
-	}
-	if(UNLIKELY(len == 0)) {
-		return;
-	}
-	uint8_t *bytebuf = inbuf;
-	size_t bytebuf_len = len / sizeof(uint8_t);
-	size_t outbuf_idx = 0;
-	float re = 0.f, im = 0.f;
-	float const full_scale = input->full_scale;
+	uint8_t const *bytebuf = inbuf;
 	ASSERT(full_scale > 0.f);
-	float const shift = input->full_scale / 2.0f;
-	for(size_t i = 0; i < bytebuf_len;) {
-		re = (bytebuf[i++] - shift) / full_scale;
-		im = (bytebuf[i++] - shift) / full_scale;
-		outbuf[outbuf_idx++] = CMPLXF(re, im);
+	float const shift = full_scale / 2.0f;
+	for(size_t i = 0; i < sample_cnt; i++) {
+		float re = (bytebuf[2 * i] - shift) / full_scale;
+		float im = (bytebuf[2 * i + 1] - shift) / full_scale;
+		outbuf[i] = CMPLXF(re, im);
 	}
 }
 
-void complex_samples_produce(struct circ_buffer *circ_buffer,
-		float complex *samples, size_t num_samples) {
+// Writes raw samples to the circular buffer. Conversion to complex float
+// is done by the consumer.
+void samples_produce(struct circ_buffer *circ_buffer, void const *samples, size_t num_samples) {
 	pthread_mutex_lock(circ_buffer->mutex);
-	size_t cbuf_available = cbuffercf_space_available(circ_buffer->buf);
-	if(cbuf_available < num_samples) {
-		fprintf(stderr, "Sample buffer overrun (%zu/%zu samples lost)\n",
-				num_samples - cbuf_available, num_samples);
-		num_samples = cbuf_available;
-	}
-	cbuffercf_write(circ_buffer->buf, samples, num_samples);
+	size_t written = circ_buffer_write(circ_buffer, samples, num_samples);
 	pthread_mutex_unlock(circ_buffer->mutex);
 	pthread_cond_signal(circ_buffer->cond);
+	if(written < num_samples) {
+		fprintf(stderr, "Sample buffer overrun (%zu/%zu samples lost)\n",
+				num_samples - written, num_samples);
+	}
 }
 
 struct sample_format_params {
 	char const *name;
 	size_t sample_size;                         // octets per complex sample
 	float full_scale;                           // max raw sample value
-	convert_sample_buffer_fun convert_fun;      // sample conversion routine
+	sample_convert_fun convert_fun;             // sample conversion routine
 };
 
 static struct sample_format_params const sample_format_params[] = {
@@ -139,7 +102,7 @@ float get_sample_full_scale_value(sample_format format) {
 	return 0.f;
 }
 
-convert_sample_buffer_fun get_sample_converter(sample_format format) {
+sample_convert_fun get_sample_converter(sample_format format) {
 	return format < SFMT_MAX ? sample_format_params[format].convert_fun : NULL;
 }
 
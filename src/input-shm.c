@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>       // PRIu64
+#include <unistd.h>         // usleep
+#include "block.h"          // block_*
+#include "input-common.h"   // input, sample_format, input_vtable, input_samples_produce
+#include "input-helpers.h"  // get_sample_size
+#include "iq-shm.h"         // iq_subscriber_*
+#include "util.h"           // debug_print, ASSERT, XCALLOC, HZ_TO_KHZ
+#include "globals.h"        // do_exit
+#include "runstats.h"       // runstats_stage_thread_done
+
+// Reads I/Q samples published by another dumphfdl process
+// to a shared memory ring (see iq-shm.h).
+
+// Delay between polls when there is no new data
+#define SHM_INPUT_POLL_INTERVAL_US 2000
+
+struct shm_input {
+	struct input input;
+	iq_subscriber sub;
+};
+
+struct input *shm_input_create(struct input_cfg *cfg) {
+	UNUSED(cfg);
+	NEW(struct shm_input, shm_input);
+	return &shm_input->input;
+}
+
+void shm_input_destroy(struct input *input) {
+	if(input != NULL) {
+		struct shm_input *si = container_of(input, struct shm_input, input);
+		iq_subscriber_detach(si->sub);
+		XFREE(si);
+	}
+}
+
+// Fills in the sample rate, center frequency and sample format of the
+// published stream. Values given on the command line must match them,
+// since the readers have no control over the receiver.
+static bool shm_params_apply(struct input_cfg *cfg, struct iq_shm_params const *params) {
+	if(cfg->sample_rate > 0 && cfg->sample_rate != params->sample_rate) {
+		fprintf(stderr, "%s: sample rate %d does not match the published stream (%d)\n",
+				cfg->source, cfg->sample_rate, params->sample_rate);
+		return false;
+	}
+	if(cfg->centerfreq >= 0 && cfg->centerfreq != params->centerfreq) {
+		fprintf(stderr, "%s: center frequency %.3f kHz does not match the published stream (%.3f kHz)\n",
+				cfg->source, HZ_TO_KHZ(cfg->centerfreq), HZ_TO_KHZ(params->centerfreq));
+		return false;
+	}
+	if(cfg->sfmt != SFMT_UNDEF && (int32_t)cfg->sfmt != params->sample_format) {
+		fprintf(stderr, "%s: sample format does not match the published stream\n", cfg->source);
+		return false;
+	}
+	if(params->sample_format <= SFMT_UNDEF || params->sample_format >= SFMT_MAX ||
+			get_sample_size(params->sample_format) != params->sample_size) {
+		fprintf(stderr, "%s: unsupported sample format %d\n", cfg->source, params->sample_format);
+		return false;
+	}
+	cfg->sample_rate = params->sample_rate;
+	cfg->centerfreq = params->centerfreq;
+	cfg->sfmt = params->sample_format;
+	return true;
+}
+
+bool shm_input_probe(struct input_cfg *cfg) {
+	iq_subscriber sub = iq_subscriber_attach(cfg->source);
+	if(sub == NULL) {
+		return false;
+	}
+	struct iq_shm_params params = iq_subscriber_params(sub);
+	iq_subscriber_detach(sub);
+	if(shm_params_apply(cfg, &params) == false) {
+		return false;
+	}
+	fprintf(stderr, "%s: sample rate: %d, center frequency: %.3f kHz\n",
+			cfg->source, cfg->sample_rate, HZ_TO_KHZ(cfg->centerfreq));
+	return true;
+}
+
+int32_t shm_input_init(struct input *input) {
+	ASSERT(input != NULL);
+	struct shm_input *shm_input = container_of(input, struct shm_input, input);
+	struct input_cfg *cfg = input->config;
+
+	if((shm_input->sub = iq_subscriber_attach(cfg->source)) == NULL) {
+		return -1;
+	}
+	struct iq_shm_params params = iq_subscriber_params(shm_input->sub);
+	if(shm_params_apply(cfg, &params) == false) {
+		return -1;
+	}
+	input->full_scale = params.full_scale;
+	input->bytes_per_sample = params.sample_size;
+	input->block.producer.max_tu = params.slot_samples;
+	debug_print(D_SDR, "%s: sfmt: %d full_scale: %.3f sample_size: %d max_tu: %zu\n",
+			cfg->source, cfg->sfmt, input->full_scale, input->bytes_per_sample,
+			input->block.producer.max_tu);
+	return 0;
+}
+
+void *shm_input_thread(void *ctx) {
+	ASSERT(ctx);
+	struct block *block = ctx;
+	struct input *input = container_of(block, struct input, block);
+	struct shm_input *shm_input = container_of(input, struct shm_input, input);
+
+	void *inbuf = XCALLOC(block->producer.max_tu, input->bytes_per_sample);
+	uint64_t lost_total = 0;
+	while(do_exit == 0) {
+		uint64_t lost = 0;
+		int32_t samples_read = iq_subscriber_read(shm_input->sub, inbuf, &lost);
+		if(lost > 0) {
+			lost_total += lost;
+			input->overflow_count += lost;
+			fprintf(stderr, "%s: reader overrun, %" PRIu64 " sample block(s) lost (%" PRIu64 " total)\n",
+					input->config->source, lost, lost_total);
+		}
+		if(samples_read < 0) {
+			fprintf(stderr, "%s: publisher has exited\n", input->config->source);
+			do_exit = 1;
+			break;
+		} else if(samples_read == 0) {
+			usleep(SHM_INPUT_POLL_INTERVAL_US);
+			continue;
+		}
+		input_samples_produce(input, inbuf, samples_read);
+	}
+	debug_print(D_MISC, "Shutdown ordered, signaling consumer shutdown\n");
+	block_connection_one2one_shutdown(block->producer.out);
+	XFREE(inbuf);
+	runstats_stage_thread_done(RUNSTATS_STAGE_INPUT);
+	block->running = false;
+	return NULL;
+}
+
+struct input_vtable const shm_input_vtable = {
+	.create = shm_input_create,
+	.probe = shm_input_probe,
+	.init = shm_input_init,
+	.destroy = shm_input_destroy,
+	.rx_thread_routine = shm_input_thread
+};
@@ -10,9 +10,10 @@
 #include <SoapySDR/Formats.h>   // SoapySDR_formatToSize()
 #include "globals.h"            // do_exit
 #include "block.h"              // block_*
-#include "input-common.h"       // input, sample_format, input_vtable
+#include "input-common.h"       // input, sample_format, input_vtable, input_samples_produce
 #include "input-helpers.h"      // get_sample_full_scale_value, get_sample_size
 #include "util.h"               // XCALLOC, XFREE, container_of, HZ_TO_KHZ
+#include "runstats.h"           // runstats_stage_thread_done
 
 struct soapysdr_input {
 	struct input input;
@@ -218,7 +219,6 @@ void *soapysdr_input_thread(void *ctx) {
 	struct input *input = container_of(block, struct input, block);
 	struct soapysdr_input *soapysdr_input = container_of(input, struct soapysdr_input, input);
 	void *inbuf = XCALLOC(input->block.producer.max_tu, input->bytes_per_sample);
-	float complex *outbuf = XCALLOC(input->block.producer.max_tu, sizeof(float complex));
 	int32_t ret;
 	if((ret = SoapySDRDevice_activateStream(soapysdr_input->sdr, soapysdr_input->stream, 0, 0, 0)) != 0) {
 		fprintf(stderr, "Failed to activate stream for SoapySDR device '%s': %s\n",
@@ -238,8 +238,7 @@ void *soapysdr_input_thread(void *ctx) {
 				input->config->source, SoapySDR_errToStr(samples_read));
 			continue;
 		}
-		input->convert_sample_buffer(input, inbuf, samples_read * input->bytes_per_sample, outbuf);
-		complex_samples_produce(&input->block.producer.out->circ_buffer, outbuf, samples_read);
+		input_samples_produce(input, inbuf, samples_read);
 	}
 shutdown:
 	debug_print(D_MISC, "Shutdown ordered, signaling consumer shutdown\n");
@@ -247,9 +246,9 @@ shutdown:
 	SoapySDRDevice_closeStream(soapysdr_input->sdr, soapysdr_input->stream);
 	SoapySDRDevice_unmake(soapysdr_input->sdr);
 	block_connection_one2one_shutdown(block->producer.out);
-	block->running = false;
 	XFREE(inbuf);
-	XFREE(outbuf);
+	runstats_stage_thread_done(RUNSTATS_STAGE_INPUT);
+	block->running = false;
 	return NULL;
 }
 
@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                  // fprintf, snprintf
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>               // PRIu64
+#include <string.h>                 // memcpy, strerror, strlen
+#include <errno.h>                  // errno
+#include <fcntl.h>                  // O_*
+#include <unistd.h>                 // ftruncate, close, getpid
+#include <signal.h>                 // kill
+#include <time.h>                   // clock_gettime
+#include <stdatomic.h>              // atomic_*
+#include <sys/mman.h>               // shm_open, shm_unlink, mmap, munmap
+#include <sys/stat.h>               // fstat
+#include <sys/time.h>               // gettimeofday
+#include "iq-shm.h"
+#include "util.h"                   // NEW, XCALLOC, XFREE, ASSERT, debug_print, min
+
+// Number of sample blocks kept in the ring
+#define IQ_SHM_SLOT_CNT 128
+#define IQ_SHM_SLOT_ALIGNMENT 64
+// How often a reader which gets no new data checks if the publisher is alive
+#define IQ_SHM_LIVENESS_CHECK_INTERVAL_MS 1000
+
+struct iq_publisher {
+	char *name;
+	struct iq_shm_hdr *hdr;
+	size_t len;
+	uint64_t seq;
+};
+
+struct iq_subscriber {
+	char *name;
+	struct iq_shm_hdr *hdr;
+	size_t len;
+	uint64_t seq;               // sequence number of the next block to read
+	uint64_t liveness_check_ms; // time of the last publisher liveness check
+};
+
+// Shared memory object names must start with a slash
+static char *shm_name(char const *name) {
+	size_t len = strlen(name) + 2;
+	char *result = XCALLOC(len, sizeof(char));
+	snprintf(result, len, "%s%s", name[0] == '/' ? "" : "/", name);
+	return result;
+}
+
+static struct iq_shm_slot *slot_get(struct iq_shm_hdr *hdr, uint64_t seq) {
+	return (struct iq_shm_slot *)((uint8_t *)hdr + sizeof(struct iq_shm_hdr) +
+			(size_t)(seq % hdr->slot_cnt) * hdr->slot_size);
+}
+
+static uint64_t monotonic_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static bool process_is_alive(int32_t pid) {
+	return pid > 0 && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
+static bool publisher_is_alive(struct iq_shm_hdr const *hdr) {
+	return atomic_load_explicit(&hdr->closed, memory_order_acquire) == false &&
+		process_is_alive(hdr->publisher_pid);
+}
+
+// Checks whether an existing shared memory object may be removed to make
+// room for a new ring, ie. it's a ring whose publisher is gone.
+static bool shm_object_is_stale(char const *path) {
+	bool result = false;
+	int fd = shm_open(path, O_RDONLY, 0);
+	if(fd < 0) {
+		// Removed in the meantime
+		return errno == ENOENT;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct iq_shm_hdr)) {
+		fprintf(stderr, "%s: not a dumphfdl I/Q sample ring\n", path);
+		close(fd);
+		return false;
+	}
+	struct iq_shm_hdr *hdr = mmap(NULL, sizeof(struct iq_shm_hdr), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(hdr == MAP_FAILED) {
+		fprintf(stderr, "Could not map shared memory object %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	if(hdr->magic != IQ_SHM_MAGIC || hdr->version != IQ_SHM_VERSION) {
+		fprintf(stderr, "%s: not a dumphfdl I/Q sample ring or unsupported version; "
+				"remove /dev/shm%s if it's not used\n", path, path);
+	} else if(publisher_is_alive(hdr)) {
+		fprintf(stderr, "%s: already published by process %d\n", path, hdr->publisher_pid);
+	} else {
+		result = true;
+	}
+	munmap(hdr, sizeof(struct iq_shm_hdr));
+	return result;
+}
+
+iq_publisher iq_publisher_create(char const *name, struct iq_shm_params const *params) {
+	ASSERT(name != NULL);
+	ASSERT(params != NULL);
+	ASSERT(params->slot_samples > 0);
+	uint32_t slot_size = (uint32_t)((sizeof(struct iq_shm_slot) + params->slot_samples * params->sample_size +
+			IQ_SHM_SLOT_ALIGNMENT - 1) / IQ_SHM_SLOT_ALIGNMENT * IQ_SHM_SLOT_ALIGNMENT);
+	size_t len = sizeof(struct iq_shm_hdr) + (size_t)IQ_SHM_SLOT_CNT * slot_size;
+	char *path = shm_name(name);
+
+	int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd < 0 && errno == EEXIST && shm_object_is_stale(path)) {
+		// Leftover of a publisher which has not exited cleanly.
+		// Readers still attached to it find out that it's gone.
+		debug_print(D_MISC, "%s: removing stale shared memory object\n", path);
+		shm_unlink(path);
+		fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	}
+	if(fd < 0) {
+		fprintf(stderr, "Could not create shared memory object %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	if(ftruncate(fd, (off_t)len) != 0) {
+		fprintf(stderr, "Could not resize shared memory object %s: %s\n", path, strerror(errno));
+		close(fd);
+		goto fail_unlink;
+	}
+	struct iq_shm_hdr *hdr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(hdr == MAP_FAILED) {
+		fprintf(stderr, "Could not map shared memory object %s: %s\n", path, strerror(errno));
+		goto fail_unlink;
+	}
+	hdr->version = IQ_SHM_VERSION;
+	hdr->sample_format = params->sample_format;
+	hdr->sample_size = params->sample_size;
+	hdr->full_scale = params->full_scale;
+	hdr->sample_rate = params->sample_rate;
+	hdr->centerfreq = params->centerfreq;
+	hdr->slot_cnt = IQ_SHM_SLOT_CNT;
+	hdr->slot_samples = params->slot_samples;
+	hdr->slot_size = slot_size;
+	atomic_init(&hdr->write_seq, 0);
+	atomic_init(&hdr->closed, false);
+	hdr->publisher_pid = (int32_t)getpid();
+	for(uint64_t i = 0; i < IQ_SHM_SLOT_CNT; i++) {
+		atomic_init(&slot_get(hdr, i)->seq, IQ_SHM_SEQ_BUSY);
+	}
+	// Readers check the magic value first, so set it last
+	atomic_thread_fence(memory_order_release);
+	hdr->magic = IQ_SHM_MAGIC;
+
+	NEW(struct iq_publisher, p);
+	p->name = path;
+	p->hdr = hdr;
+	p->len = len;
+	fprintf(stderr, "Publishing I/Q samples to shared memory object %s (%u blocks of %u samples)\n",
+			path, IQ_SHM_SLOT_CNT, params->slot_samples);
+	return p;
+fail_unlink:
+	shm_unlink(path);
+fail:
+	XFREE(path);
+	return NULL;
+}
+
+void iq_publisher_write(iq_publisher p, void const *samples, size_t sample_cnt) {
+	ASSERT(p != NULL);
+	struct iq_shm_hdr *hdr = p->hdr;
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	uint64_t timestamp_us = (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+	uint8_t const *ptr = samples;
+	while(sample_cnt > 0) {
+		uint32_t n = (uint32_t)min(sample_cnt, (size_t)hdr->slot_samples);
+		struct iq_shm_slot *slot = slot_get(hdr, p->seq);
+		atomic_store_explicit(&slot->seq, IQ_SHM_SEQ_BUSY, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		slot->timestamp_us = timestamp_us;
+		slot->sample_cnt = n;
+		memcpy(slot->samples, ptr, (size_t)n * hdr->sample_size);
+		atomic_store_explicit(&slot->seq, p->seq, memory_order_release);
+		p->seq++;
+		atomic_store_explicit(&hdr->write_seq, p->seq, memory_order_release);
+		ptr += (size_t)n * hdr->sample_size;
+		sample_cnt -= n;
+	}
+}
+
+void iq_publisher_destroy(iq_publisher p) {
+	if(p == NULL) {
+		return;
+	}
+	atomic_store_explicit(&p->hdr->closed, true, memory_order_release);
+	munmap(p->hdr, p->len);
+	shm_unlink(p->name);
+	debug_print(D_MISC, "%s: published %" PRIu64 " blocks\n", p->name, p->seq);
+	XFREE(p->name);
+	XFREE(p);
+}
+
+iq_subscriber iq_subscriber_attach(char const *name) {
+	ASSERT(name != NULL);
+	char *path = shm_name(name);
+	struct stat st;
+	int fd = shm_open(path, O_RDONLY, 0);
+	if(fd < 0) {
+		fprintf(stderr, "Could not open shared memory object %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct iq_shm_hdr)) {
+		fprintf(stderr, "%s: not a dumphfdl I/Q sample ring\n", path);
+		close(fd);
+		goto fail;
+	}
+	size_t len = (size_t)st.st_size;
+	struct iq_shm_hdr *hdr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(hdr == MAP_FAILED) {
+		fprintf(stderr, "Could not map shared memory object %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	if(hdr->magic != IQ_SHM_MAGIC || hdr->version != IQ_SHM_VERSION ||
+			len < sizeof(struct iq_shm_hdr) + (size_t)hdr->slot_cnt * hdr->slot_size) {
+		fprintf(stderr, "%s: not a dumphfdl I/Q sample ring or unsupported version\n", path);
+		munmap(hdr, len);
+		goto fail;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	if(publisher_is_alive(hdr) == false) {
+		fprintf(stderr, "%s: publisher has exited\n", path);
+		munmap(hdr, len);
+		goto fail;
+	}
+
+	NEW(struct iq_subscriber, s);
+	s->name = path;
+	s->hdr = hdr;
+	s->len = len;
+	// Start with the most recent data
+	s->seq = atomic_load_explicit(&hdr->write_seq, memory_order_acquire);
+	s->liveness_check_ms = monotonic_ms();
+	return s;
+fail:
+	XFREE(path);
+	return NULL;
+}
+
+struct iq_shm_params iq_subscriber_params(iq_subscriber s) {
+	ASSERT(s != NULL);
+	struct iq_shm_params params = {
+		.sample_format = s->hdr->sample_format,
+		.sample_size = s->hdr->sample_size,
+		.full_scale = s->hdr->full_scale,
+		.sample_rate = s->hdr->sample_rate,
+		.centerfreq = s->hdr->centerfreq,
+		.slot_samples = s->hdr->slot_samples
+	};
+	return params;
+}
+
+// Copies the next block of samples to buf, which must have room for
+// slot_samples samples. Returns the number of samples copied, 0 if there
+// is no new data or -1 if the publisher has exited (either cleanly or
+// without closing the ring). *lost is incremented
+// by the number of blocks which have been overwritten before they could
+// be read.
+int32_t iq_subscriber_read(iq_subscriber s, void *buf, uint64_t *lost) {
+	ASSERT(s != NULL);
+	ASSERT(lost != NULL);
+	struct iq_shm_hdr *hdr = s->hdr;
+	while(true) {
+		uint64_t write_seq = atomic_load_explicit(&hdr->write_seq, memory_order_acquire);
+		if(s->seq == write_seq) {
+			if(atomic_load_explicit(&hdr->closed, memory_order_acquire)) {
+				return -1;
+			}
+			uint64_t now = monotonic_ms();
+			if(now - s->liveness_check_ms >= IQ_SHM_LIVENESS_CHECK_INTERVAL_MS) {
+				s->liveness_check_ms = now;
+				if(process_is_alive(hdr->publisher_pid) == false) {
+					return -1;
+				}
+			}
+			return 0;
+		}
+		if(write_seq - s->seq > hdr->slot_cnt) {
+			// Overrun - skip to the middle of the ring to leave some margin
+			// before the publisher catches up with us again
+			uint64_t next = write_seq - hdr->slot_cnt / 2;
+			*lost += next - s->seq;
+			s->seq = next;
+		}
+		struct iq_shm_slot *slot = slot_get(hdr, s->seq);
+		if(atomic_load_explicit(&slot->seq, memory_order_acquire) != s->seq) {
+			// Being overwritten right now
+			(*lost)++;
+			s->seq++;
+			continue;
+		}
+		uint32_t n = min(slot->sample_cnt, hdr->slot_samples);
+		memcpy(buf, slot->samples, (size_t)n * hdr->sample_size);
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&slot->seq, memory_order_relaxed) != s->seq) {
+			// Overwritten while copying - the copy is unusable
+			(*lost)++;
+			s->seq++;
+			continue;
+		}
+		s->seq++;
+		return (int32_t)n;
+	}
+}
+
+void iq_subscriber_detach(iq_subscriber s) {
+	if(s != NULL) {
+		munmap(s->hdr, s->len);
+		XFREE(s->name);
+		XFREE(s);
+	}
+}
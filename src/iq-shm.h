@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>                 // size_t
+#include <stdatomic.h>              // _Atomic
+
+// I/Q sample broadcast through POSIX shared memory.
+//
+// The publisher (the dumphfdl process which owns the SDR) writes blocks of
+// samples, in the native format of its input, into a ring of fixed-size slots.
+// Any number of other dumphfdl processes may attach to the ring as readers.
+// Readers never block the publisher - a reader which falls behind by more
+// than the length of the ring loses blocks and gets notified about it.
+//
+// Each slot carries a sequence number. The publisher sets it to
+// IQ_SHM_SEQ_BUSY while the slot is being rewritten and to the sequence number
+// of the block afterwards. A reader copies the slot contents and then checks
+// the sequence number again to find out if the block has been overwritten
+// in the meantime.
+//
+// The header holds the process ID of the publisher. A new publisher refuses
+// to take over the name of a ring whose publisher is still running, and
+// readers use it to detect a publisher which has exited without closing
+// the ring (eg. after a crash).
+
+#define IQ_SHM_MAGIC 0x51494844u            // "DHIQ"
+#define IQ_SHM_VERSION 2
+#define IQ_SHM_SEQ_BUSY UINT64_MAX
+
+struct iq_shm_hdr {
+	uint32_t magic;
+	uint32_t version;
+	int32_t sample_format;          // sample_format
+	uint32_t sample_size;           // bytes per sample
+	float full_scale;
+	int32_t sample_rate;
+	int32_t centerfreq;
+	uint32_t slot_cnt;
+	uint32_t slot_samples;          // slot capacity (samples)
+	uint32_t slot_size;             // distance between consecutive slots (bytes)
+	_Atomic uint64_t write_seq;     // sequence number of the next block to be published
+	_Atomic bool closed;            // set when the publisher exits
+	int32_t publisher_pid;
+};
+
+struct iq_shm_slot {
+	_Atomic uint64_t seq;
+	uint64_t timestamp_us;          // wall clock time of publishing
+	uint32_t sample_cnt;
+	uint8_t samples[];
+};
+
+struct iq_shm_params {
+	int32_t sample_format;
+	uint32_t sample_size;
+	float full_scale;
+	int32_t sample_rate;
+	int32_t centerfreq;
+	uint32_t slot_samples;
+};
+
+typedef struct iq_publisher *iq_publisher;
+typedef struct iq_subscriber *iq_subscriber;
+
+iq_publisher iq_publisher_create(char const *name, struct iq_shm_params const *params);
+void iq_publisher_write(iq_publisher p, void const *samples, size_t sample_cnt);
+void iq_publisher_destroy(iq_publisher p);
+
+iq_subscriber iq_subscriber_attach(char const *name);
+struct iq_shm_params iq_subscriber_params(iq_subscriber s);
+int32_t iq_subscriber_read(iq_subscriber s, void *buf, uint64_t *lost);
+void iq_subscriber_detach(iq_subscriber s);
@@ -20,16 +20,16 @@ This file is part of libcsdr.
 
 */
 
-#include <math.h>               // M_PI
+#include "nco.h"                // nco_init, nco_mix_block
 #include "libcsdr_gpl.h"
 
 shift_addition_data_t shift_addition_init(float rate)
 {
 	rate*=2;
 	shift_addition_data_t out;
-	out.sindelta=sin(rate*M_PI);
-	out.cosdelta=cos(rate*M_PI);
 	out.rate=rate;
+	// rate is in half-cycles per sample
+	nco_init(&out.nco, rate/2);
 	return out;
 }
 
@@ -38,37 +38,24 @@ shift_addition_data_t decimating_shift_addition_init(float rate, int32_t decimat
 	return shift_addition_init(rate*decimation);
 }
 
-decimating_shift_addition_status_t decimating_shift_addition_cc(float complex *input, float complex* output, int32_t input_size, shift_addition_data_t d, int32_t decimation, decimating_shift_addition_status_t s)
+decimating_shift_addition_status_t decimating_shift_addition_cc(float complex *input, float complex* output, int32_t input_size, shift_addition_data_t const *d, int32_t decimation, decimating_shift_addition_status_t s)
 {
 	//The original idea was taken from wdsp:
 	//http://svn.tapr.org/repos_sdr_hpsdr/trunk/W5WC/PowerSDR_HPSDR_mRX_PS/Source/wdsp/shift.c
-	//However, this method introduces noise (from floating point rounding errors), which increases until the end of the buffer.
-	//fprintf(stderr, "cosd=%g sind=%g\n", d.cosdelta, d.sindelta);
-	float cosphi=cos(s.starting_phase);
-	float sinphi=sin(s.starting_phase);
-	float cosphi_last, sinphi_last;
-	int32_t i;
+	//However, the recursive rotation used there introduces noise (from floating point
+	//rounding errors), which increases until the end of the buffer. The NCO keeps
+	//the phase in an integer accumulator and recomputes the phasor every few samples,
+	//so the error does not build up, neither within the buffer nor across calls.
 	int32_t k=0;
-	for(i=s.decimation_remain;i<input_size;i+=decimation) //@shift_addition_cc: work
+	if(s.decimation_remain<input_size)
 	{
-
-		// FIXME: optimize this
-		output[k] = CMPLXF(
-					cosphi * crealf(input[i]) - sinphi * cimagf(input[i]),
-					sinphi * crealf(input[i]) + cosphi * cimagf(input[i])
-				);
-		k++;
-		//using the trigonometric addition formulas
-		//cos(phi+delta)=cos(phi)cos(delta)-sin(phi)*sin(delta)
-		cosphi_last=cosphi;
-		sinphi_last=sinphi;
-		cosphi=cosphi_last*d.cosdelta-sinphi_last*d.sindelta;
-		sinphi=sinphi_last*d.cosdelta+cosphi_last*d.sindelta;
+		k=(input_size-s.decimation_remain+decimation-1)/decimation;
 	}
-	s.decimation_remain=i-input_size;
-	s.starting_phase+=d.rate*M_PI*k;
+	struct nco n=d->nco;
+	n.phase=s.phase;
+	nco_mix_block(&n, input+s.decimation_remain, decimation, output, k); //@shift_addition_cc: work
+	s.decimation_remain+=k*decimation-input_size;
+	s.phase=n.phase;
 	s.output_size=k;
-	while(s.starting_phase>M_PI) s.starting_phase-=2*M_PI; //@shift_addition_cc: normalize starting_phase
-	while(s.starting_phase<-M_PI) s.starting_phase+=2*M_PI;
 	return s;
 }
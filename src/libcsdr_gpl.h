@@ -22,12 +22,12 @@ This file is part of libcsdr.
 #pragma once
 #include <stdint.h>
 #include <complex.h>
+#include "nco.h"                // struct nco
 
 typedef struct shift_addition_data_s
 {
-	float sindelta;
-	float cosdelta;
 	float rate;
+	struct nco nco;
 } shift_addition_data_t;
 
 shift_addition_data_t shift_addition_init(float rate);
@@ -35,13 +35,12 @@ shift_addition_data_t shift_addition_init(float rate);
 typedef struct decimating_shift_addition_status_s
 {
 	int32_t decimation_remain;
-	float starting_phase;
+	uint32_t phase;
 	int32_t output_size;
 } decimating_shift_addition_status_t;
 
 decimating_shift_addition_status_t decimating_shift_addition_cc(float complex
-		*input, float complex* output, int32_t input_size, shift_addition_data_t d,
+		*input, float complex* output, int32_t input_size, shift_addition_data_t const *d,
 		int32_t decimation, decimating_shift_addition_status_t s);
 shift_addition_data_t decimating_shift_addition_init(float rate, int
 		decimation);
-
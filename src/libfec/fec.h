@@ -13,7 +13,10 @@
 #define	V27POLYA	0x6d
 #define	V27POLYB	0x4f
 
+#include <stddef.h>
+
 void *create_viterbi27(int len);
+size_t viterbi27_size(int len);
 void set_viterbi27_polynomial(int polys[2]);
 int init_viterbi27(void *vp,int starting_state);
 int update_viterbi27_blk(void *vp,unsigned char sym[],int npairs);
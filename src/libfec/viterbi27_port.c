@@ -101,6 +101,11 @@ void *create_viterbi27(int len){
 	return vp;
 }
 
+/* Number of bytes allocated by create_viterbi27(len) */
+size_t viterbi27_size(int len){
+	return sizeof(struct v27) + (size_t)(len + 6) * sizeof(decision_t);
+}
+
 /* Viterbi chainback */
 int chainback_viterbi27(
 		void *p,
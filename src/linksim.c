@@ -0,0 +1,518 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <inttypes.h>               // PRIu64
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>                 // atoi, atof, strtoull
+#include <string.h>                 // strcmp, strtok_r, memcpy, memset
+#include <getopt.h>                 // getopt_long
+#include <unistd.h>                 // sysconf
+#include <time.h>                   // nanosleep
+#include <math.h>                   // sqrtf, logf, powf, lroundf
+#include <complex.h>
+#include <pthread.h>                // pthread_create, pthread_join
+#include <stdatomic.h>              // atomic_*
+#include "options.h"                // describe_option
+#include "globals.h"                // DUMPHFDL_VERSION
+#include "util.h"                   // NEW, XCALLOC, XFREE
+#include "nco.h"                    // nco_*
+#include "hfdl.h"                   // hfdl_channel_*, hfdl_sim_*, HFDL_SYMBOL_RATE, SPS
+
+// Link-level simulation of the demodulator and the FEC decoder.
+//
+// Frames carrying random payload are modulated, passed through a channel
+// model (Watterson fading, frequency offset, AWGN) and demodulated by
+// a standalone HFDL channel. Every trial starts with a reset receiver
+// and has its own random number generator seeded with the trial number,
+// so the results do not depend on the number of threads. Frame and bit
+// error rates per frame type and SNR are printed in JSON.
+
+#define SAMPLE_RATE (HFDL_SYMBOL_RATE * SPS)
+#define SIM_FREQ 10081000
+#define M1_CNT 8
+#define SNR_POINTS_MAX 256
+// SNR is given in this bandwidth, as usual for HF modems
+#define NOISE_BANDWIDTH_HZ 3000.0f
+// Noise before the frame, to let the AGC and the noise floor estimate settle
+#define LEAD_SAMPLE_CNT (SAMPLE_RATE / 2)
+// Noise after the frame, to let the demodulator finish it
+#define TAIL_SAMPLE_CNT (SAMPLE_RATE / 5)
+// Samples passed to the demodulator in one go, like on a worker node
+#define BLOCK_LEN (SAMPLE_RATE / 10)
+#define FADING_SINUSOID_CNT 16
+#define TRIALS_DEFAULT 100
+#define SNR_MIN_DEFAULT 0.0f
+#define SNR_MAX_DEFAULT 20.0f
+#define SNR_STEP_DEFAULT 2.0f
+
+// Watterson channel with two equal-power paths. Path gains are complex
+// Gaussian processes with Gaussian Doppler spectra. Parameters after
+// ITU-R F.520.
+struct channel_model {
+	char const *name;
+	char const *description;
+	float delay_ms;                 // differential delay of the second path
+	float doppler_spread_hz;        // two-sigma Doppler spread of each path
+};
+
+static struct channel_model const Channel_models[] = {
+	{ "awgn",       "no fading",                    0.0f,   0.0f },
+	{ "good",       "good: 0.5 ms, 0.1 Hz",         0.5f,   0.1f },
+	{ "moderate",   "moderate: 1 ms, 0.5 Hz",       1.0f,   0.5f },
+	{ "poor",       "poor: 2 ms, 1 Hz",             2.0f,   1.0f },
+	{ "flutter",    "flutter: 0.5 ms, 10 Hz",       0.5f,   10.0f },
+	{ NULL,         NULL,                           0.0f,   0.0f }
+};
+
+// Results of all trials of a single frame type at a single SNR
+struct sim_point {
+	int32_t M1;
+	float snr_db;
+	_Atomic uint64_t trials, missed, frame_errors;
+	_Atomic uint64_t bits_decoded, bit_errors;
+};
+
+static struct {
+	int32_t modes[M1_CNT];
+	int32_t mode_cnt;
+	float snr_min, snr_max, snr_step;
+	int32_t trials;
+	int32_t threads;
+	struct channel_model const *channel;
+	float freq_offset_hz;
+	uint64_t seed;
+} Opts;
+
+static struct sim_point *Points;
+static uint32_t Point_cnt;
+static _Atomic uint64_t Next_trial, Trials_done;
+
+struct worker {
+	pthread_t thread;
+	struct block *channel;
+	uint64_t rng;
+	int32_t M1;
+	uint32_t payload_bit_cnt;
+	uint8_t *payload;
+	float complex *tx;
+	float complex *rx;
+	// Best frame of the expected type received in the current trial
+	bool frame_found;
+	uint32_t bit_errors;
+};
+
+/**********************************
+ * Random numbers
+ **********************************/
+
+static uint64_t splitmix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniformly distributed in (0, 1]
+static float rand_uniform(uint64_t *state) {
+	return (float)((xorshift64(state) >> 40) + 1) / (float)(1 << 24);
+}
+
+// Circularly symmetric complex Gaussian with unit variance
+// (|x|^2 is exponentially distributed and the phase is uniform)
+static float complex rand_cgauss(uint64_t *state) {
+	float r = sqrtf(-logf(rand_uniform(state)));
+	return r * nco_phasor((uint32_t)(xorshift64(state) >> 32));
+}
+
+/**********************************
+ * Channel model
+ **********************************/
+
+// Fading gain of a single path, generated as a sum of sinusoids
+// with Gaussian distributed frequencies and uniform phases
+struct fading_path {
+	uint32_t phase[FADING_SINUSOID_CNT];
+	uint32_t freq[FADING_SINUSOID_CNT];
+	float gain;
+};
+
+static void fading_path_init(struct fading_path *p, float doppler_spread_hz, float power, uint64_t *rng) {
+	// Real part of rand_cgauss() has a variance of 1/2
+	float sigma = doppler_spread_hz / 2.0f / (float)SAMPLE_RATE * sqrtf(2.0f);
+	for(int32_t k = 0; k < FADING_SINUSOID_CNT; k++) {
+		p->freq[k] = nco_rad_to_phase(2.0f * M_PI * sigma * crealf(rand_cgauss(rng)));
+		p->phase[k] = (uint32_t)(xorshift64(rng) >> 32);
+	}
+	p->gain = sqrtf(power / FADING_SINUSOID_CNT);
+}
+
+static float complex fading_path_step(struct fading_path *p) {
+	float complex g = 0.0f;
+	for(int32_t k = 0; k < FADING_SINUSOID_CNT; k++) {
+		g += nco_phasor(p->phase[k]);
+		p->phase[k] += p->freq[k];
+	}
+	return p->gain * g;
+}
+
+// Passes len samples of in through the fading channel. The delay is rounded
+// to whole samples. out must have room for the delayed path, ie. for
+// len + delay samples. Returns the number of samples written.
+static uint32_t channel_apply(struct channel_model const *ch, float complex const *in, uint32_t len,
+		float complex *out, uint64_t *rng) {
+	if(ch->doppler_spread_hz <= 0.0f) {
+		memcpy(out, in, len * sizeof(float complex));
+		return len;
+	}
+	uint32_t delay = (uint32_t)lroundf(ch->delay_ms * (float)SAMPLE_RATE / 1000.0f);
+	struct fading_path path[2];
+	fading_path_init(&path[0], ch->doppler_spread_hz, 0.5f, rng);
+	fading_path_init(&path[1], ch->doppler_spread_hz, 0.5f, rng);
+	for(uint32_t n = 0; n < len + delay; n++) {
+		float complex x0 = n < len ? in[n] : 0.0f;
+		float complex x1 = n >= delay ? in[n - delay] : 0.0f;
+		out[n] = fading_path_step(&path[0]) * x0 + fading_path_step(&path[1]) * x1;
+	}
+	return len + delay;
+}
+
+/**********************************
+ * Trials
+ **********************************/
+
+static void frame_received(uint8_t const *buf, size_t len, int32_t M1, void *ctx) {
+	struct worker *w = ctx;
+	// Frames of other types are false preamble detections
+	if(M1 != w->M1 || len * 8 < w->payload_bit_cnt) {
+		return;
+	}
+	uint32_t errors = 0;
+	uint32_t full_octets = w->payload_bit_cnt / 8;
+	for(uint32_t i = 0; i < full_octets; i++) {
+		errors += __builtin_popcount(buf[i] ^ w->payload[i]);
+	}
+	uint32_t remaining_bits = w->payload_bit_cnt % 8;
+	if(remaining_bits > 0) {
+		errors += __builtin_popcount((buf[full_octets] ^ w->payload[full_octets]) & ((1u << remaining_bits) - 1));
+	}
+	if(!w->frame_found || errors < w->bit_errors) {
+		w->bit_errors = errors;
+	}
+	w->frame_found = true;
+}
+
+static void trial_run(struct worker *w, struct sim_point *pt, uint64_t trial_idx) {
+	w->rng = splitmix64(splitmix64(Opts.seed) + trial_idx);
+	if(w->rng == 0) {
+		w->rng = 1;
+	}
+	w->M1 = pt->M1;
+	w->payload_bit_cnt = hfdl_sim_payload_bit_cnt(pt->M1);
+	for(uint32_t i = 0; i < (w->payload_bit_cnt + 7) / 8; i++) {
+		w->payload[i] = xorshift64(&w->rng) & 0xFF;
+	}
+	uint32_t tx_len = hfdl_sim_frame_modulate(pt->M1, w->payload, w->tx);
+	float signal_power = 0.0f;
+	for(uint32_t i = 0; i < tx_len; i++) {
+		signal_power += crealf(w->tx[i] * conjf(w->tx[i]));
+	}
+	signal_power /= (float)tx_len;
+
+	uint32_t rx_len = LEAD_SAMPLE_CNT + tx_len + TAIL_SAMPLE_CNT;
+	memset(w->rx, 0, rx_len * sizeof(float complex));
+	channel_apply(Opts.channel, w->tx, tx_len, w->rx + LEAD_SAMPLE_CNT, &w->rng);
+	if(Opts.freq_offset_hz != 0.0f) {
+		struct nco nco;
+		nco_init(&nco, Opts.freq_offset_hz / (float)SAMPLE_RATE);
+		nco.phase = (uint32_t)(xorshift64(&w->rng) >> 32);
+		nco_mix_block(&nco, w->rx, 1, w->rx, rx_len);
+	}
+	float noise_amplitude = sqrtf(signal_power * (float)SAMPLE_RATE / NOISE_BANDWIDTH_HZ /
+			powf(10.0f, pt->snr_db / 10.0f));
+	for(uint32_t i = 0; i < rx_len; i++) {
+		w->rx[i] += noise_amplitude * rand_cgauss(&w->rng);
+	}
+
+	hfdl_channel_reset(w->channel);
+	w->frame_found = false;
+	for(uint32_t i = 0; i < rx_len; i += BLOCK_LEN) {
+		uint32_t cnt = rx_len - i < BLOCK_LEN ? rx_len - i : BLOCK_LEN;
+		memcpy(hfdl_channel_input_buffer(w->channel, cnt), w->rx + i, cnt * sizeof(float complex));
+		hfdl_channel_process(w->channel, cnt);
+	}
+
+	atomic_fetch_add_explicit(&pt->trials, 1, memory_order_relaxed);
+	if(!w->frame_found) {
+		atomic_fetch_add_explicit(&pt->missed, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&pt->frame_errors, 1, memory_order_relaxed);
+		return;
+	}
+	atomic_fetch_add_explicit(&pt->bits_decoded, w->payload_bit_cnt, memory_order_relaxed);
+	atomic_fetch_add_explicit(&pt->bit_errors, w->bit_errors, memory_order_relaxed);
+	if(w->bit_errors > 0) {
+		atomic_fetch_add_explicit(&pt->frame_errors, 1, memory_order_relaxed);
+	}
+}
+
+static void *worker_thread(void *ctx) {
+	struct worker *w = ctx;
+	uint64_t const total = (uint64_t)Point_cnt * Opts.trials;
+	uint64_t idx;
+	while((idx = atomic_fetch_add(&Next_trial, 1)) < total) {
+		trial_run(w, &Points[idx / Opts.trials], idx);
+		atomic_fetch_add(&Trials_done, 1);
+	}
+	return NULL;
+}
+
+/**********************************
+ * Main
+ **********************************/
+
+static void results_print_json(FILE *f) {
+	fprintf(f, "{\n");
+	fprintf(f, "  \"version\": \"%s\",\n", DUMPHFDL_VERSION);
+	fprintf(f, "  \"channel\": \"%s\",\n", Opts.channel->name);
+	fprintf(f, "  \"freq_offset_hz\": %.2f,\n", Opts.freq_offset_hz);
+	fprintf(f, "  \"snr_bandwidth_hz\": %.0f,\n", NOISE_BANDWIDTH_HZ);
+	fprintf(f, "  \"seed\": %" PRIu64 ",\n", Opts.seed);
+	fprintf(f, "  \"results\": [");
+	for(uint32_t i = 0; i < Point_cnt; i++) {
+		struct sim_point *pt = &Points[i];
+		uint64_t trials = atomic_load(&pt->trials);
+		uint64_t bits_decoded = atomic_load(&pt->bits_decoded);
+		fprintf(f, "%s\n    {\"M1\": %d, \"snr_db\": %.2f, \"trials\": %" PRIu64 ", \"missed\": %" PRIu64
+				", \"frame_errors\": %" PRIu64 ", \"fer\": %.6f, ",
+				i > 0 ? "," : "", pt->M1, pt->snr_db, trials, atomic_load(&pt->missed),
+				atomic_load(&pt->frame_errors),
+				trials > 0 ? (double)atomic_load(&pt->frame_errors) / (double)trials : 0.0);
+		// Bit error rate of frames which have been found
+		if(bits_decoded > 0) {
+			fprintf(f, "\"ber\": %.3e}", (double)atomic_load(&pt->bit_errors) / (double)bits_decoded);
+		} else {
+			fprintf(f, "\"ber\": null}");
+		}
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static bool parse_modes(char *list) {
+	char *saveptr = NULL;
+	Opts.mode_cnt = 0;
+	for(char *tok = strtok_r(list, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+		char *end = NULL;
+		long M1 = strtol(tok, &end, 10);
+		if(end == tok || *end != '\0' || M1 < 0 || M1 >= M1_CNT) {
+			fprintf(stderr, "Invalid frame type '%s' (must be 0-%d)\n", tok, M1_CNT - 1);
+			return false;
+		}
+		if(Opts.mode_cnt == M1_CNT) {
+			fprintf(stderr, "Too many frame types\n");
+			return false;
+		}
+		Opts.modes[Opts.mode_cnt++] = (int32_t)M1;
+	}
+	return Opts.mode_cnt > 0;
+}
+
+static struct channel_model const *channel_model_find(char const *name) {
+	for(struct channel_model const *ch = Channel_models; ch->name != NULL; ch++) {
+		if(strcmp(ch->name, name) == 0) {
+			return ch;
+		}
+	}
+	fprintf(stderr, "Unknown channel model '%s'\n", name);
+	return NULL;
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: dumphfdl-linksim [options]\n\n");
+	fprintf(stderr, "Measures frame and bit error rates of the HFDL demodulator and decoder on simulated signals\n");
+	fprintf(stderr, "and prints the results in JSON.\n\n");
+	fprintf(stderr, "Options:\n");
+	describe_option("--help", "Displays this text", 1);
+	describe_option("--modes <list>", "Comma-separated list of frame types (M1) to simulate (default: 0-7)", 1);
+	fprintf(stderr, "%*s0-3: 300, 600, 1200, 1800 bps single slot\n", USAGE_OPT_NAME_COLWIDTH, "");
+	fprintf(stderr, "%*s4-7: 300, 600, 1200, 1800 bps double slot\n", USAGE_OPT_NAME_COLWIDTH, "");
+	describe_option("--snr-min <dB>", "Lowest SNR in 3 kHz bandwidth", 1);
+	fprintf(stderr, "%*s(default: %.1f)\n", USAGE_OPT_NAME_COLWIDTH, "", SNR_MIN_DEFAULT);
+	describe_option("--snr-max <dB>", "Highest SNR in 3 kHz bandwidth", 1);
+	fprintf(stderr, "%*s(default: %.1f)\n", USAGE_OPT_NAME_COLWIDTH, "", SNR_MAX_DEFAULT);
+	describe_option("--snr-step <dB>", "SNR step", 1);
+	fprintf(stderr, "%*s(default: %.1f)\n", USAGE_OPT_NAME_COLWIDTH, "", SNR_STEP_DEFAULT);
+	describe_option("--trials <integer>", "Number of frames per frame type and SNR", 1);
+	fprintf(stderr, "%*s(default: %d)\n", USAGE_OPT_NAME_COLWIDTH, "", TRIALS_DEFAULT);
+	describe_option("--threads <integer>", "Number of simulation threads (default: number of CPUs)", 1);
+	describe_option("--channel <model>", "Channel model (default: awgn)", 1);
+	for(struct channel_model const *ch = Channel_models; ch->name != NULL; ch++) {
+		fprintf(stderr, "%*s%-10s %s\n", USAGE_OPT_NAME_COLWIDTH, "", ch->name, ch->description);
+	}
+	describe_option("--freq-offset <Hz>", "Carrier frequency offset (default: 0)", 1);
+	describe_option("--seed <integer>", "Random number generator seed (default: 1)", 1);
+}
+
+int32_t main(int32_t argc, char **argv) {
+	Opts.snr_min = SNR_MIN_DEFAULT;
+	Opts.snr_max = SNR_MAX_DEFAULT;
+	Opts.snr_step = SNR_STEP_DEFAULT;
+	Opts.trials = TRIALS_DEFAULT;
+	Opts.threads = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	Opts.channel = &Channel_models[0];
+	Opts.seed = 1;
+	for(int32_t i = 0; i < M1_CNT; i++) {
+		Opts.modes[i] = i;
+	}
+	Opts.mode_cnt = M1_CNT;
+
+#define OPT_HELP 1
+#define OPT_MODES 2
+#define OPT_SNR_MIN 3
+#define OPT_SNR_MAX 4
+#define OPT_SNR_STEP 5
+#define OPT_TRIALS 6
+#define OPT_THREADS 7
+#define OPT_CHANNEL 8
+#define OPT_FREQ_OFFSET 9
+#define OPT_SEED 10
+	static struct option opts[] = {
+		{ "help",           no_argument,        NULL,   OPT_HELP },
+		{ "modes",          required_argument,  NULL,   OPT_MODES },
+		{ "snr-min",        required_argument,  NULL,   OPT_SNR_MIN },
+		{ "snr-max",        required_argument,  NULL,   OPT_SNR_MAX },
+		{ "snr-step",       required_argument,  NULL,   OPT_SNR_STEP },
+		{ "trials",         required_argument,  NULL,   OPT_TRIALS },
+		{ "threads",        required_argument,  NULL,   OPT_THREADS },
+		{ "channel",        required_argument,  NULL,   OPT_CHANNEL },
+		{ "freq-offset",    required_argument,  NULL,   OPT_FREQ_OFFSET },
+		{ "seed",           required_argument,  NULL,   OPT_SEED },
+		{ 0,                0,                  0,      0 }
+	};
+	int c = -1;
+	while((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+		switch(c) {
+			case OPT_MODES:
+				if(!parse_modes(optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_SNR_MIN:
+				Opts.snr_min = atof(optarg);
+				break;
+			case OPT_SNR_MAX:
+				Opts.snr_max = atof(optarg);
+				break;
+			case OPT_SNR_STEP:
+				Opts.snr_step = atof(optarg);
+				break;
+			case OPT_TRIALS:
+				Opts.trials = atoi(optarg);
+				break;
+			case OPT_THREADS:
+				Opts.threads = atoi(optarg);
+				break;
+			case OPT_CHANNEL:
+				if((Opts.channel = channel_model_find(optarg)) == NULL) {
+					return 1;
+				}
+				break;
+			case OPT_FREQ_OFFSET:
+				Opts.freq_offset_hz = atof(optarg);
+				break;
+			case OPT_SEED:
+				Opts.seed = strtoull(optarg, NULL, 10);
+				break;
+			case OPT_HELP:
+				usage();
+				return 0;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if(Opts.trials < 1) {
+		fprintf(stderr, "Invalid number of trials\n");
+		return 1;
+	}
+	if(Opts.threads < 1) {
+		Opts.threads = 1;
+	}
+	if(Opts.snr_step <= 0.0f || Opts.snr_max < Opts.snr_min) {
+		fprintf(stderr, "Invalid SNR range\n");
+		return 1;
+	}
+	uint32_t snr_cnt = (uint32_t)floorf((Opts.snr_max - Opts.snr_min) / Opts.snr_step + 1e-3f) + 1;
+	if(snr_cnt > SNR_POINTS_MAX) {
+		fprintf(stderr, "Too many SNR points (%u, max %d)\n", snr_cnt, SNR_POINTS_MAX);
+		return 1;
+	}
+
+	nco_tables_init();
+	hfdl_init_globals();
+
+	Point_cnt = Opts.mode_cnt * snr_cnt;
+	Points = XCALLOC(Point_cnt, sizeof(struct sim_point));
+	uint32_t max_sample_cnt = 0, max_payload_len = 0;
+	for(int32_t m = 0; m < Opts.mode_cnt; m++) {
+		for(uint32_t s = 0; s < snr_cnt; s++) {
+			Points[m * snr_cnt + s].M1 = Opts.modes[m];
+			Points[m * snr_cnt + s].snr_db = Opts.snr_min + (float)s * Opts.snr_step;
+		}
+		uint32_t sample_cnt = hfdl_sim_frame_sample_cnt(Opts.modes[m]);
+		uint32_t payload_len = (hfdl_sim_payload_bit_cnt(Opts.modes[m]) + 7) / 8;
+		max_sample_cnt = sample_cnt > max_sample_cnt ? sample_cnt : max_sample_cnt;
+		max_payload_len = payload_len > max_payload_len ? payload_len : max_payload_len;
+	}
+
+	// Channels are created here, as the demodulator's global state
+	// is initialized on first use
+	struct worker *workers = XCALLOC(Opts.threads, sizeof(struct worker));
+	for(int32_t i = 0; i < Opts.threads; i++) {
+		struct worker *w = &workers[i];
+		w->channel = hfdl_channel_create_standalone(SIM_FREQ, frame_received, w);
+		w->payload = XCALLOC(max_payload_len, sizeof(uint8_t));
+		w->tx = XCALLOC(max_sample_cnt, sizeof(float complex));
+		w->rx = XCALLOC(LEAD_SAMPLE_CNT + max_sample_cnt + TAIL_SAMPLE_CNT, sizeof(float complex));
+	}
+	uint64_t const total = (uint64_t)Point_cnt * Opts.trials;
+	fprintf(stderr, "Channel: %s, frequency offset: %.2f Hz, %" PRIu64 " trials in %d thread(s)\n",
+			Opts.channel->description, Opts.freq_offset_hz, total, Opts.threads);
+	for(int32_t i = 0; i < Opts.threads; i++) {
+		if(pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0) {
+			fprintf(stderr, "Could not start simulation thread\n");
+			return 1;
+		}
+	}
+	struct timespec const progress_interval = { .tv_sec = 1, .tv_nsec = 0 };
+	uint64_t done;
+	while((done = atomic_load(&Trials_done)) < total) {
+		fprintf(stderr, "\r%" PRIu64 "/%" PRIu64 " trials", done, total);
+		nanosleep(&progress_interval, NULL);
+	}
+	fprintf(stderr, "\r%" PRIu64 "/%" PRIu64 " trials\n", total, total);
+	for(int32_t i = 0; i < Opts.threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	results_print_json(stdout);
+
+	for(int32_t i = 0; i < Opts.threads; i++) {
+		hfdl_channel_destroy(workers[i].channel);
+		XFREE(workers[i].payload);
+		XFREE(workers[i].tx);
+		XFREE(workers[i].rx);
+	}
+	XFREE(workers);
+	XFREE(Points);
+	hfdl_decoder_pool_destroy();
+	hfdl_stats_destroy();
+	return 0;
+}
@@ -2,14 +2,15 @@
 #include <stdint.h>
 #include <sys/time.h>               // struct timeval
 #include <libacars/libacars.h>      // la_type_descriptor, la_proto_node
-#include <libacars/reassembly.h>    // la_reasm_ctx
 #include <libacars/dict.h>          // la_dict
+#include "reasm.h"                  // reasm_mgr
 #include "pdu.h"                    // struct hfdl_pdu_hdr_data, hfdl_pdu_fcs_check
 #include "hfnpdu.h"                 // hfnpdu_parse
 #include "ac_cache.h"               // ac_cache_entry_create, ac_cache_entry_delete
 #include "globals.h"                // AC_cache, AC_cache_lock
 #include "lpdu.h"
 #include "statsd.h"                 // statsd_*
+#include "runstats.h"               // runstats_add
 #include "util.h"                   // ASSERT, NEW, XCALLOC, XFREE, gs_id_format_text,
                                     // ac_id_format_text
 
@@ -119,7 +120,7 @@ static int32_t logoff_request_parse(uint8_t *buf, uint32_t len, struct lpdu_logo
 }
 
 la_proto_node *lpdu_parse(uint8_t *buf, uint32_t len, struct hfdl_pdu_hdr_data
-		mpdu_header, la_reasm_ctx *reasm_ctx, struct timeval rx_timestamp) {
+		mpdu_header, reasm_mgr reasm, struct timeval rx_timestamp) {
 	ASSERT(buf);
 
 	int32_t freq = mpdu_header.freq;
@@ -144,9 +145,11 @@ la_proto_node *lpdu_parse(uint8_t *buf, uint32_t len, struct hfdl_pdu_hdr_data
 	if(!lpdu->crc_ok) {
 		lpdu->err = true;
 		statsd_increment_per_channel(freq, "lpdu.errors.bad_fcs");
+		runstats_add(RUNSTATS_LPDUS_BAD_FCS, 1);
 		goto end;
 	}
 	statsd_increment_per_channel(freq, "lpdus.good");
+	runstats_add(RUNSTATS_LPDUS_GOOD, 1);
 
 	int32_t consumed_len = 0;
 	lpdu->type = buf[0];
@@ -188,7 +191,7 @@ la_proto_node *lpdu_parse(uint8_t *buf, uint32_t len, struct hfdl_pdu_hdr_data
 		lpdu->err = true;
 	} else if((uint32_t)consumed_len < len) {
 		lpdu_node->next = hfnpdu_parse(buf + consumed_len, len - consumed_len, mpdu_header.direction,
-				reasm_ctx, rx_timestamp);
+				mpdu_header.decode_level, reasm, rx_timestamp);
 	}
 end:
 	if(lpdu->err && !Config.output_corrupted_pdus) {
@@ -260,63 +263,41 @@ static void lpdu_format_text(la_vstring *vstr, void const *data, int32_t indent)
 	}
 }
 
-struct position_info *lpdu_position_info_extract(la_proto_node *tree) {
-	ASSERT(tree);
+void lpdu_summarize(la_proto_node *node, struct msg_summary *summary) {
+	ASSERT(node);
+	ASSERT(summary);
 
-	// Don't bother with analyzing uplinks.
-	la_proto_node *lpdu_node = la_proto_tree_find_protocol(tree, &proto_DEF_hfdl_lpdu);
-	if(lpdu_node == NULL) {
-		return NULL;
-	}
-	struct hfdl_lpdu const *lpdu = lpdu_node->data;
-	if(lpdu->mpdu_header.direction != DOWNLINK_PDU) {
-		return NULL;
-	}
-
-	// LPDUs never contain position information, hence we
-	// go looking for it in the HFNPDU straight away.
-	struct position_info *pos_info = hfnpdu_position_info_extract(tree);
-	if(pos_info == NULL) {
-		return NULL;
+	if(node->td != &proto_DEF_hfdl_lpdu) {
+		return;
 	}
-	// Position information has been found. Check for any missing fields
-	// and fill them in, if possible.
-	if(pos_info->aircraft.icao_address_present == false) {
-		switch(lpdu->type) {
-			// These LPDU types have ICAO given directly
-			case LOGON_RESUME:
-			case LOGON_REQUEST_NORMAL:
-			case LOGON_REQUEST_DLS:
-				pos_info->aircraft.icao_address = lpdu->data.logon_request.icao_address;
-				pos_info->aircraft.icao_address_present = true;
-				debug_print(D_MISC, "icao_address: %06X (from LPDU)\n",
-						pos_info->aircraft.icao_address);
-				break;
-				// For other LPDU types we need to look up the ICAO in the AC cache
-			default:
-				AC_cache_lock();
-				uint8_t ac_id = lpdu->mpdu_header.direction == UPLINK_PDU ?
-					lpdu->mpdu_header.dst_id : lpdu->mpdu_header.src_id;
-				struct ac_cache_entry *entry = ac_cache_entry_lookup(AC_cache,
-						lpdu->mpdu_header.freq, ac_id);
-				if(entry != NULL) {
-					pos_info->aircraft.icao_address = entry->icao_address;
-					pos_info->aircraft.icao_address_present = true;
-					debug_print(D_MISC, "icao_address: %06X (from cache)\n",
-							pos_info->aircraft.icao_address);
-				}
-				AC_cache_unlock();
-				break;
-		}
+	struct hfdl_lpdu const *lpdu = node->data;
+	summary->lpdu_type = lpdu->type;
+	summary->lpdu_crc_ok = lpdu->crc_ok;
+	summary->direction = lpdu->mpdu_header.direction;
+	summary->gs_id = lpdu->mpdu_header.direction == UPLINK_PDU ?
+		lpdu->mpdu_header.src_id : lpdu->mpdu_header.dst_id;
+	summary->gs_id_present = true;
+	if(lpdu->err || !lpdu->crc_ok) {
+		return;
 	}
-	if(pos_info->aircraft.icao_address_present == true) {
-		return pos_info;
+	switch(lpdu->type) {
+		// These LPDU types have ICAO given directly
+		case LOGON_RESUME:
+		case LOGON_REQUEST_NORMAL:
+		case LOGON_REQUEST_DLS:
+			summary->icao_address = lpdu->data.logon_request.icao_address;
+			summary->icao_address_present = true;
+			debug_print(D_MISC, "icao_address: %06X (from LPDU)\n", summary->icao_address);
+			break;
+		// For other LPDU types the ICAO has to be looked up in the AC cache.
+		// This is done by msg_summary_extract() when it's actually needed.
+		default:
+			summary->ac_id = lpdu->mpdu_header.direction == UPLINK_PDU ?
+				lpdu->mpdu_header.dst_id : lpdu->mpdu_header.src_id;
+			summary->ac_freq = lpdu->mpdu_header.freq;
+			summary->ac_id_present = true;
+			break;
 	}
-	// Position information without ICAO address is incomplete. Drop it.
-	debug_print(D_MISC, "pos_info (%f, %f) incomplete: unknown icao_address\n",
-			pos_info->position.location.lat, pos_info->position.location.lon);
-	position_info_destroy(pos_info);
-	return NULL;
 }
 
 static void lpdu_destroy(void *data) {
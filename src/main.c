@@ -8,10 +8,14 @@
 #include <signal.h>             // sigaction, SIG*
 #include <string.h>             // strlen, strsep
 #include <math.h>               // roundf
-#include <unistd.h>             // usleep
+#include <unistd.h>             // usleep, sysconf
+#include <time.h>               // time, clock_gettime
+#include <pthread.h>            // pthread_create, pthread_join
+#include <stdatomic.h>          // atomic_fetch_add
 #include <libacars/libacars.h>  // la_config_set_int
 #include <libacars/acars.h>     // LA_ACARS_BEARER_HFDL
 #include <libacars/list.h>      // la_list
+#include <libconfig.h>          // config_*
 #ifdef PROFILING
 #include <gperftools/profiler.h>
 #endif
@@ -21,6 +25,7 @@
 #include "block.h"              // block_*
 #include "libcsdr.h"            // compute_filter_relative_transition_bw
 #include "fft.h"                // csdr_fft_init, csdr_fft_destroy, fft_create
+#include "fastddc.h"            // fft_channelizer_cleanup
 #include "util.h"               // ASSERT
 #include "ac_cache.h"           // ac_cache_create, ac_cache_destroy
 #include "ac_data.h"            // ac_data_create, ac_data_destroy
@@ -28,10 +33,16 @@
 #include "input-helpers.h"      // sample_format_from_string
 #include "output-common.h"      // output_*, fmtr_*
 #include "kvargs.h"             // kvargs
-#include "hfdl.h"               // hfdl_channel_create
+#include "hfdl.h"               // hfdl_channel_create, hfdl_print_memory_usage, hfdl_decoder_pool_destroy, hfdl_stats_*
+#include "afc.h"                // afc_store_*
 #include "pdu.h"                // hfdl_pdu_*
 #include "systable.h"           // systable_*
 #include "statsd.h"             // statsd_*
+#include "dspbuf.h"             // dspbuf_print_stats
+#include "baseband.h"           // bb_*
+#include "watchdog.h"           // watchdog_*
+#include "reasm.h"              // REASM_*_DEFAULT
+#include "runstats.h"           // runstats_*
 
 typedef struct {
 	char *output_spec_string;
@@ -43,6 +54,11 @@ typedef struct {
 
 // Forward declarations
 static la_list *output_add(la_list *outputs, char *output_spec);
+static bool output_add_spec(la_list **outputs, char *output_spec);
+static bool output_config_read(char const *config_file, la_list **outputs, char **bs_db_file);
+static la_list *outputs_reload(la_list *outputs, la_list *output_specs,
+		char const *config_file, char **bs_db_file, la_list **retired);
+static bool outputs_any_running(la_list *output_lists);
 static void outputs_destroy(la_list *outputs);
 static output_params output_params_from_string(char *output_spec);
 static fmtr_instance_t *find_fmtr_instance(la_list *outputs,
@@ -50,6 +66,11 @@ static fmtr_instance_t *find_fmtr_instance(la_list *outputs,
 static void start_all_output_threads(la_list *outputs);
 static void start_all_output_threads_for_fmtr(void *p, void *ctx);
 static void start_output_thread(void *p, void *ctx);
+static int32_t run_worker(char const *address, int32_t channel_cnt, char **freq_args);
+static int32_t channels_create(struct block **channels, int32_t channel_cnt, int32_t const *frequencies,
+		struct input_cfg const *input_cfg, int32_t decimation_rate, float transition_bw, afc_store const *afc);
+static void run_deterministic(struct block *input, struct block *fft,
+		int32_t channel_cnt, struct block *channels[channel_cnt], la_list *outputs);
 
 static void sighandler(int32_t sig) {
 	fprintf(stderr, "Got signal %d, ", sig);
@@ -61,12 +82,50 @@ static void sighandler(int32_t sig) {
 	do_exit++;
 }
 
+static volatile sig_atomic_t do_reload = 0;
+
+static void sighup_handler(int32_t sig) {
+	UNUSED(sig);
+	do_reload = 1;
+}
+
+static volatile sig_atomic_t do_print_stats = 0;
+
+static void sigusr1_handler(int32_t sig) {
+	UNUSED(sig);
+	do_print_stats = 1;
+}
+
+// How often to send demodulator statistics to StatsD (seconds)
+#define STATS_EXPORT_INTERVAL 10
+
+// How long to wait for old outputs to shut down on reload (seconds)
+#define OUTPUT_SHUTDOWN_TIMEOUT 5
+
+// Called from the main loop once per second
+static void stats_poll(void) {
+	if(do_print_stats) {
+		do_print_stats = 0;
+		hfdl_print_summary();
+	}
+#ifdef WITH_STATSD
+	static time_t last_export = 0;
+	time_t now = time(NULL);
+	if(now >= last_export + STATS_EXPORT_INTERVAL) {
+		last_export = now;
+		hfdl_stats_export();
+	}
+#endif
+}
+
 static void setup_signals() {
-	struct sigaction sigact = {0}, pipeact = {0};
+	struct sigaction sigact = {0}, pipeact = {0}, usr1act = {0};
 
 	pipeact.sa_handler = SIG_IGN;
 	sigact.sa_handler = &sighandler;
+	usr1act.sa_handler = &sigusr1_handler;
 	sigaction(SIGPIPE, &pipeact, NULL);
+	sigaction(SIGUSR1, &usr1act, NULL);
 	sigaction(SIGHUP, &sigact, NULL);
 	sigaction(SIGINT, &sigact, NULL);
 	sigaction(SIGQUIT, &sigact, NULL);
@@ -248,6 +307,12 @@ static void usage() {
 	fprintf(stderr, "\nRead I/Q samples from file:\n\n"
 			"%*sdumphfdl [output_options] --iq-file <input_iq_file> [iq_file_options] <freq_1> [<freq_2> [...]]\n",
 			IND(1), "");
+	fprintf(stderr, "\nRead I/Q samples published by another dumphfdl process:\n\n"
+			"%*sdumphfdl [output_options] --iq-shm <name> <freq_1> [<freq_2> [...]]\n",
+			IND(1), "");
+	fprintf(stderr, "\nDecode channels streamed by a front-end node (distributed setup):\n\n"
+			"%*sdumphfdl --baseband-source <host>:<port> <freq_1> [<freq_2> [...]]\n",
+			IND(1), "");
 	fprintf(stderr, "\nGeneral options:\n");
 	describe_option("--help", "Displays this text", 1);
 	describe_option("--version", "Displays program version number", 1);
@@ -259,6 +324,9 @@ static void usage() {
 #endif
 	fprintf(stderr, "common options:\n");
 	describe_option("<freq_1> [<freq_2> [...]]", "HFDL channel frequencies, in kHz, as floating point numbers", 1);
+	describe_option("--watchdog-timeout <integer>", "Restart channels which got stuck for this many seconds", 1);
+	fprintf(stderr, "%*s(default: %d, 0 = disable)\n", USAGE_OPT_NAME_COLWIDTH, "", WATCHDOG_TIMEOUT_DEFAULT);
+	describe_option("--run-stats-file <string>", "On exit, write decoding yield and CPU usage statistics to the given file (JSON)", 1);
 #ifdef WITH_SOAPYSDR
 	fprintf(stderr, "\nsoapysdr_options:\n");
 	describe_option("--soapysdr <device_string>", "Use SoapySDR compatible device identified with the given string", 1);
@@ -280,10 +348,34 @@ static void usage() {
 	describe_option("CS16", "16-bit signed, little-endian (eg. recorded with sdrplay)", 2);
 	describe_option("CF32", "32-bit float, little-endian (eg. Airspy HF+)", 2);
 	describe_option("--read-buffer-size <integer>", "Number of bytes to read from file in one batch", 1);
+	describe_option("--deterministic", "Process the file in a single thread, producing identical output on every run", 1);
+	fprintf(stderr, "%*s(timestamps are computed from the sample count, starting at the Unix epoch)\n", USAGE_OPT_NAME_COLWIDTH, "");
+
+	fprintf(stderr, "\nI/Q sample sharing options:\n");
+	describe_option("--iq-shm-publish <name>", "Publish input samples to the given shared memory object", 1);
+	fprintf(stderr, "%*sso that other dumphfdl processes can read them with --iq-shm\n", USAGE_OPT_NAME_COLWIDTH, "");
+	describe_option("--iq-shm <name>", "Read I/Q samples from the given shared memory object", 1);
+	fprintf(stderr, "%*s(sample rate and center frequency are taken from the publisher)\n", USAGE_OPT_NAME_COLWIDTH, "");
+
+	fprintf(stderr, "\nDiversity reception options:\n");
+	describe_option("--diversity-source <string>", "Second input of the same type and settings as the main input, fed from another antenna", 1);
+	fprintf(stderr, "%*s(I/Q file name or SoapySDR device string). Frames received on both inputs\n", USAGE_OPT_NAME_COLWIDTH, "");
+	fprintf(stderr, "%*sare soft-combined before decoding.\n", USAGE_OPT_NAME_COLWIDTH, "");
+
+	fprintf(stderr, "\nDistributed decoding options:\n");
+	describe_option("--baseband-server [<host>:]<port>", "Accept connections from worker nodes on the given TCP port", 1);
+	fprintf(stderr, "%*sand stream channel baseband to them. Frames decoded by workers are\n", USAGE_OPT_NAME_COLWIDTH, "");
+	fprintf(stderr, "%*sprocessed and output by this process. Listens on localhost only, unless\n", USAGE_OPT_NAME_COLWIDTH, "");
+	fprintf(stderr, "%*s<host> is given. There is no authentication - don't expose the port\n", USAGE_OPT_NAME_COLWIDTH, "");
+	fprintf(stderr, "%*sto untrusted networks.\n", USAGE_OPT_NAME_COLWIDTH, "");
+	describe_option("--baseband-source <host>:<port>", "Run as a worker node: demodulate the given channels streamed", 1);
+	fprintf(stderr, "%*sby the front-end node at <host>:<port> and send decoded frames back to it\n", USAGE_OPT_NAME_COLWIDTH, "");
 
 	fprintf(stderr, "\nOutput options:\n");
 	describe_option("--output <output_specifier>", "Output specification (default: " DEFAULT_OUTPUT ")", 1);
 	describe_option("", "(See \"--output help\" for details)", 1);
+	describe_option("--output-config <string>", "Read additional output specifiers (and --bs-db setting) from the given file", 1);
+	fprintf(stderr, "%*sand re-read it on SIGHUP, replacing all outputs without interrupting decoding\n", USAGE_OPT_NAME_COLWIDTH, "");
 	describe_option("--output-queue-hwm <integer>", "High water mark value for output queues (0 = no limit)", 1);
 	fprintf(stderr, "%*s(default: %d messages, not applicable when using --iq-file)\n", USAGE_OPT_NAME_COLWIDTH, "", OUTPUT_QUEUE_HWM_DEFAULT);
 	describe_option("--output-mpdus", "Include media access control protocol data units in the output (default: false)", 1);
@@ -308,6 +400,16 @@ static void usage() {
 	describe_option("--system-table <string>", "Load system table from the given file", 1);
 	describe_option("--system-table-save <string>", "Save updated system table to the given file", 1);
 
+	fprintf(stderr, "\nACARS reassembly options:\n");
+	describe_option("--reasm-max-size <integer>", "Memory limit for incomplete multiblock messages, in kB", 1);
+	fprintf(stderr, "%*s(default: %d, least recently heard aircraft are evicted first)\n", USAGE_OPT_NAME_COLWIDTH, "", REASM_MAX_SIZE_DEFAULT);
+	describe_option("--reasm-timeout <integer>", "Drop incomplete messages of aircraft not heard for this many seconds", 1);
+	fprintf(stderr, "%*s(default: %d)\n", USAGE_OPT_NAME_COLWIDTH, "", REASM_TIMEOUT_DEFAULT);
+
+	fprintf(stderr, "\nFrequency correction options:\n");
+	describe_option("--afc-file <string>", "Load per-channel frequency offsets from the given file on startup", 1);
+	fprintf(stderr, "%*sand save them there on exit\n", USAGE_OPT_NAME_COLWIDTH, "");
+
 #ifdef WITH_STATSD
 	fprintf(stderr, "\nEtsy StatsD options:\n");
 	describe_option("--statsd <host>:<port>", "Send statistics to Etsy StatsD server <host>:<port>", 1);
@@ -324,11 +426,16 @@ int32_t main(int32_t argc, char **argv) {
 #ifdef DATADUMPS
 #define OPT_DATADUMPS 4
 #endif
+#define OPT_WATCHDOG_TIMEOUT 5
+#define OPT_RUN_STATS_FILE 6
 
 #define OPT_IQ_FILE 10
 #ifdef WITH_SOAPYSDR
 #define OPT_SOAPYSDR 11
 #endif
+#define OPT_DIVERSITY_SOURCE 12
+#define OPT_IQ_SHM 13
+#define OPT_IQ_SHM_PUBLISH 14
 
 #define OPT_SAMPLE_FORMAT 20
 #define OPT_SAMPLE_RATE 21
@@ -340,6 +447,7 @@ int32_t main(int32_t argc, char **argv) {
 #define OPT_DEVICE_SETTINGS 27
 #define OPT_FREQ_OFFSET 28
 #define OPT_READ_BUFFER_SIZE 29
+#define OPT_DETERMINISTIC 30
 
 #define OPT_OUTPUT 40
 #define OPT_OUTPUT_QUEUE_HWM 41
@@ -351,9 +459,11 @@ int32_t main(int32_t argc, char **argv) {
 #define OPT_OUTPUT_MPDUS 49
 #define OPT_OUTPUT_CORRUPTED_PDUS 50
 #define OPT_FREQ_AS_SQUAWK 51
+#define OPT_OUTPUT_CONFIG 52
 
 #define OPT_SYSTABLE_FILE 60
 #define OPT_SYSTABLE_SAVE_FILE 61
+#define OPT_AFC_FILE 62
 
 #ifdef WITH_STATSD
 #define OPT_STATSD 70
@@ -364,6 +474,12 @@ int32_t main(int32_t argc, char **argv) {
 #define OPT_AC_DETAILS 81
 #endif
 
+#define OPT_BASEBAND_SERVER 90
+#define OPT_BASEBAND_SOURCE 91
+
+#define OPT_REASM_MAX_SIZE 100
+#define OPT_REASM_TIMEOUT 101
+
 #define DEFAULT_OUTPUT "decoded:text:file:path=-"
 
 	static struct option opts[] = {
@@ -375,10 +491,15 @@ int32_t main(int32_t argc, char **argv) {
 #ifdef DATADUMPS
 		{ "datadumps",          no_argument,        NULL,   OPT_DATADUMPS },
 #endif
+		{ "watchdog-timeout",   required_argument,  NULL,   OPT_WATCHDOG_TIMEOUT },
+		{ "run-stats-file",     required_argument,  NULL,   OPT_RUN_STATS_FILE },
 		{ "iq-file",            required_argument,  NULL,   OPT_IQ_FILE },
 #ifdef WITH_SOAPYSDR
 		{ "soapysdr",           required_argument,  NULL,   OPT_SOAPYSDR },
 #endif
+		{ "diversity-source",   required_argument,  NULL,   OPT_DIVERSITY_SOURCE },
+		{ "iq-shm",             required_argument,  NULL,   OPT_IQ_SHM },
+		{ "iq-shm-publish",     required_argument,  NULL,   OPT_IQ_SHM_PUBLISH },
 		{ "sample-format",      required_argument,  NULL,   OPT_SAMPLE_FORMAT },
 		{ "sample-rate",        required_argument,  NULL,   OPT_SAMPLE_RATE },
 		{ "centerfreq",         required_argument,  NULL,   OPT_CENTERFREQ },
@@ -389,6 +510,7 @@ int32_t main(int32_t argc, char **argv) {
 		{ "device-settings",    required_argument,  NULL,   OPT_DEVICE_SETTINGS },
 		{ "freq-offset",        required_argument,  NULL,   OPT_FREQ_OFFSET },
 		{ "read-buffer-size",   required_argument,  NULL,   OPT_READ_BUFFER_SIZE },
+		{ "deterministic",      no_argument,        NULL,   OPT_DETERMINISTIC },
 		{ "output",             required_argument,  NULL,   OPT_OUTPUT },
 		{ "output-queue-hwm",   required_argument,  NULL,   OPT_OUTPUT_QUEUE_HWM },
 		{ "utc",                no_argument,        NULL,   OPT_UTC },
@@ -399,12 +521,18 @@ int32_t main(int32_t argc, char **argv) {
 		{ "output-mpdus",       no_argument,        NULL,   OPT_OUTPUT_MPDUS },
 		{ "output-corrupted-pdus", no_argument,     NULL,   OPT_OUTPUT_CORRUPTED_PDUS },
 		{ "freq-as-squawk",     no_argument,        NULL,   OPT_FREQ_AS_SQUAWK },
+		{ "output-config",      required_argument,  NULL,   OPT_OUTPUT_CONFIG },
 #ifdef WITH_SQLITE
 		{ "bs-db",              required_argument,  NULL,   OPT_BS_DB },
 		{ "ac-details",         required_argument,  NULL,   OPT_AC_DETAILS },
 #endif
 		{ "system-table",       required_argument,  NULL,   OPT_SYSTABLE_FILE },
 		{ "system-table-save",  required_argument,  NULL,   OPT_SYSTABLE_SAVE_FILE },
+		{ "afc-file",           required_argument,  NULL,   OPT_AFC_FILE },
+		{ "baseband-server",    required_argument,  NULL,   OPT_BASEBAND_SERVER },
+		{ "baseband-source",    required_argument,  NULL,   OPT_BASEBAND_SOURCE },
+		{ "reasm-max-size",     required_argument,  NULL,   OPT_REASM_MAX_SIZE },
+		{ "reasm-timeout",      required_argument,  NULL,   OPT_REASM_TIMEOUT },
 #ifdef WITH_STATSD
 		{ "statsd",             required_argument,  NULL,   OPT_STATSD },
 #endif
@@ -414,19 +542,28 @@ int32_t main(int32_t argc, char **argv) {
 	// Initialize default config
 	Config.ac_data_details = AC_DETAILS_NORMAL;
 	Config.output_queue_hwm = OUTPUT_QUEUE_HWM_DEFAULT;
+	Config.reasm_max_size = REASM_MAX_SIZE_DEFAULT;
+	Config.reasm_timeout = REASM_TIMEOUT_DEFAULT;
 
 	struct input_cfg *input_cfg = input_cfg_create();
 	input_cfg->sfmt = SFMT_UNDEF;
 	input_cfg->type = INPUT_TYPE_UNDEF;
 	la_list *outputs = NULL;
+	la_list *output_specs = NULL;       // --output arguments, for reloading
+	la_list *retired_outputs = NULL;    // output lists replaced by reloads
+	char const *output_config = NULL;
 	char const *systable_file = NULL;
 	char const *systable_save_file = NULL;
+	char const *afc_file = NULL;
+	char const *run_stats_file = NULL;
+	char *diversity_source = NULL;
+	char const *baseband_server_address = NULL;
+	char const *baseband_source = NULL;
+	int32_t watchdog_timeout = WATCHDOG_TIMEOUT_DEFAULT;
 #ifdef WITH_STATSD
 	char *statsd_addr = NULL;
 #endif
-#ifdef WITH_SQLITE
 	char *bs_db_file = NULL;
-#endif
 
 	print_version();
 
@@ -444,6 +581,16 @@ int32_t main(int32_t argc, char **argv) {
 				input_cfg->type = INPUT_TYPE_SOAPYSDR;
 				break;
 #endif
+			case OPT_DIVERSITY_SOURCE:
+				diversity_source = optarg;
+				break;
+			case OPT_IQ_SHM:
+				input_cfg->source = optarg;
+				input_cfg->type = INPUT_TYPE_SHM;
+				break;
+			case OPT_IQ_SHM_PUBLISH:
+				input_cfg->shm_publish_name = optarg;
+				break;
 			case OPT_SAMPLE_FORMAT:
 				input_cfg->sfmt = sample_format_from_string(optarg);
 				// Validate the result only when the sample format
@@ -494,8 +641,32 @@ int32_t main(int32_t argc, char **argv) {
 					return 1;
 				}
 				break;
+			case OPT_WATCHDOG_TIMEOUT:
+				if(parse_int32(optarg, &watchdog_timeout) == false) {
+					return 1;
+				}
+				break;
+			case OPT_DETERMINISTIC:
+				Config.deterministic = true;
+				break;
 			case OPT_OUTPUT:
 				outputs = output_add(outputs, optarg);
+				output_specs = la_list_append(output_specs, optarg);
+				break;
+			case OPT_OUTPUT_CONFIG:
+				output_config = optarg;
+				break;
+			case OPT_REASM_MAX_SIZE:
+				if(parse_int32(optarg, &Config.reasm_max_size) == false || Config.reasm_max_size <= 0) {
+					fprintf(stderr, "Invalid reassembly memory limit: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case OPT_REASM_TIMEOUT:
+				if(parse_int32(optarg, &Config.reasm_timeout) == false || Config.reasm_timeout <= 0) {
+					fprintf(stderr, "Invalid reassembly timeout: %s\n", optarg);
+					return 1;
+				}
 				break;
 			case OPT_OUTPUT_QUEUE_HWM:
 				if(parse_int32(optarg, &Config.output_queue_hwm) == false) {
@@ -536,9 +707,21 @@ int32_t main(int32_t argc, char **argv) {
 			case OPT_SYSTABLE_SAVE_FILE:
 				systable_save_file = optarg;
 				break;
+			case OPT_AFC_FILE:
+				afc_file = optarg;
+				break;
+			case OPT_RUN_STATS_FILE:
+				run_stats_file = optarg;
+				break;
+			case OPT_BASEBAND_SERVER:
+				baseband_server_address = optarg;
+				break;
+			case OPT_BASEBAND_SOURCE:
+				baseband_source = optarg;
+				break;
 #ifdef WITH_SQLITE
 			case OPT_BS_DB:
-				bs_db_file = optarg;
+				bs_db_file = strdup(optarg);
 				break;
 			case OPT_AC_DETAILS:
 				if(!strcmp(optarg, "normal")) {
@@ -579,10 +762,23 @@ int32_t main(int32_t argc, char **argv) {
 				return 1;
 		}
 	}
+	if(baseband_source != NULL) {
+		input_cfg_destroy(input_cfg);
+		return run_worker(baseband_source, argc - optind, argv + optind);
+	}
 	if(input_cfg->source == NULL) {
 		fprintf(stderr, "No input specified\n");
 		return 1;
 	}
+	if(input_probe(input_cfg) == false) {
+		return 1;
+	}
+	if(Config.deterministic && (input_cfg->type != INPUT_TYPE_FILE ||
+				diversity_source != NULL || baseband_server_address != NULL)) {
+		fprintf(stderr, "--deterministic can only be used with --iq-file, without diversity reception "
+				"and distributed decoding\n");
+		return 1;
+	}
 	int32_t channel_cnt = argc - optind;
 	if(channel_cnt < 1) {
 		fprintf(stderr, "No channel frequencies given\n");
@@ -615,6 +811,10 @@ int32_t main(int32_t argc, char **argv) {
 		fprintf(stderr, "Invalid --output-queue-hwm value: must be a non-negative integer\n");
 		return 1;
 	}
+	if(watchdog_timeout < 0) {
+		fprintf(stderr, "Invalid --watchdog-timeout value: must be a non-negative integer\n");
+		return 1;
+	}
 
 	Systable = systable_create(systable_save_file);
 	if(systable_file != NULL) {
@@ -637,6 +837,9 @@ int32_t main(int32_t argc, char **argv) {
 		return 1;
 	}
 
+	if(output_config != NULL && output_config_read(output_config, &outputs, &bs_db_file) == false) {
+		return 1;
+	}
 	// no --output given?
 	if(outputs == NULL) {
 		outputs = output_add(outputs, DEFAULT_OUTPUT);
@@ -653,6 +856,21 @@ int32_t main(int32_t argc, char **argv) {
 		return 1;
 	}
 
+	// Diversity input uses the same settings as the main input
+	struct input_cfg *div_input_cfg = NULL;
+	struct block *div_input = NULL;
+	if(diversity_source != NULL) {
+		div_input_cfg = input_cfg_create();
+		*div_input_cfg = *input_cfg;
+		div_input_cfg->source = diversity_source;
+		div_input_cfg->shm_publish_name = NULL;
+		div_input = input_create(div_input_cfg);
+		if(div_input == NULL || input_init(div_input) < 0) {
+			fprintf(stderr, "Unable to initialize diversity input %s\n", diversity_source);
+			return 1;
+		}
+	}
+
 	csdr_fft_init();
 
 	int32_t fft_decimation_rate = compute_fft_decimation_rate(input_cfg->sample_rate, HFDL_SYMBOL_RATE * SPS);
@@ -668,6 +886,12 @@ int32_t main(int32_t argc, char **argv) {
 	if(fft == NULL) {
 		return 1;
 	}
+	struct block *div_fft = NULL;
+	if(div_input != NULL) {
+		if((div_fft = fft_create(fft_decimation_rate, fftfilt_transition_bw)) == NULL) {
+			return 1;
+		}
+	}
 
 #ifdef WITH_STATSD
 	if(statsd_addr != NULL) {
@@ -698,77 +922,170 @@ int32_t main(int32_t argc, char **argv) {
 	la_config_set_int("acars_bearer", LA_ACARS_BEARER_HFDL);
 	hfdl_init_globals();
 
+	afc_store *afc = afc_store_load(afc_file);
 	struct block *channels[channel_cnt];
-	for(int32_t i = 0; i < channel_cnt; i++) {
-		channels[i] = hfdl_channel_create(input_cfg->sample_rate, fft_decimation_rate,
-				fftfilt_transition_bw, input_cfg->centerfreq, frequencies[i]);
-		if(channels[i] == NULL) {
-			fprintf(stderr, "Failed to initialize channel %s\n",
-					argv[optind + i]);
+	int32_t failed = channels_create(channels, channel_cnt, frequencies, input_cfg,
+			fft_decimation_rate, fftfilt_transition_bw, afc);
+	if(failed >= 0) {
+		fprintf(stderr, "Failed to initialize channel %s\n", argv[optind + failed]);
+		return 1;
+	}
+	struct block *div_channels[channel_cnt];
+	if(div_input != NULL) {
+		failed = channels_create(div_channels, channel_cnt, frequencies, input_cfg,
+				fft_decimation_rate, fftfilt_transition_bw, afc);
+		if(failed >= 0) {
+			fprintf(stderr, "Failed to initialize diversity channel %s\n", argv[optind + failed]);
 			return 1;
 		}
+		for(int32_t i = 0; i < channel_cnt; i++) {
+			hfdl_channel_set_diversity_pair(channels[i], div_channels[i]);
+		}
+	}
+
+	bb_server baseband_server = NULL;
+	if(baseband_server_address != NULL) {
+		if((baseband_server = bb_server_create(baseband_server_address)) == NULL) {
+			return 1;
+		}
+		for(int32_t i = 0; i < channel_cnt; i++) {
+			hfdl_channel_set_baseband_server(channels[i], baseband_server);
+		}
 	}
 
 	if(block_connect_one2one(input, fft) != 1 ||
 			block_connect_one2many(fft, channel_cnt, channels) != channel_cnt) {
 		return 1;
 	}
+	if(div_input != NULL && (block_connect_one2one(div_input, div_fft) != 1 ||
+			block_connect_one2many(div_fft, channel_cnt, div_channels) != channel_cnt)) {
+		return 1;
+	}
+	dspbuf_print_stats();
+	hfdl_print_memory_usage(channel_cnt, channels);
 
-	start_all_output_threads(outputs);
 	hfdl_pdu_decoder_init();
-	if(hfdl_pdu_decoder_start(outputs) != 0) {
-	    fprintf(stderr, "Failed to start decoder thread, aborting\n");
-	    return 1;
+	if(Config.deterministic == false) {
+		start_all_output_threads(outputs);
+		if(hfdl_pdu_decoder_start(outputs) != 0) {
+			fprintf(stderr, "Failed to start decoder thread, aborting\n");
+			return 1;
+		}
 	}
 
 	setup_signals();
+	if(output_config != NULL) {
+		// SIGHUP reloads the output configuration instead of exiting
+		struct sigaction hupact = { .sa_handler = &sighup_handler };
+		sigaction(SIGHUP, &hupact, NULL);
+	}
 
 #ifdef PROFILING
 	ProfilerStart("dumphfdl.prof");
 #endif
 
+	runstats_start();
+	watchdog wd = NULL, div_wd = NULL;
+	if(Config.deterministic) {
+		run_deterministic(input, fft, channel_cnt, channels, outputs);
+		goto finish;
+	}
 	if(block_set_start(channel_cnt, channels) != channel_cnt ||
 		block_start(fft) != 1 ||
 		block_start(input) != 1) {
 		return 1;
 	}
+	if(div_input != NULL && (
+		block_set_start(channel_cnt, div_channels) != channel_cnt ||
+		block_start(div_fft) != 1 ||
+		block_start(div_input) != 1)) {
+		return 1;
+	}
+	if(watchdog_timeout > 0) {
+		wd = watchdog_create(watchdog_timeout, channel_cnt, channels,
+				hfdl_channel_respawn, hfdl_channel_destroy);
+		if(div_input != NULL) {
+			div_wd = watchdog_create(watchdog_timeout, channel_cnt, div_channels,
+					hfdl_channel_respawn, hfdl_channel_destroy);
+		}
+	}
 	while(!do_exit) {
 		sleep(1);
+		stats_poll();
+		if(do_reload) {
+			do_reload = 0;
+			outputs = outputs_reload(outputs, output_specs, output_config,
+					&bs_db_file, &retired_outputs);
+		}
 	}
+	watchdog_stop(wd);
+	watchdog_stop(div_wd);
 	hfdl_pdu_decoder_stop();
 	fprintf(stderr, "Waiting for all threads to finish\n");
 	while(do_exit < 2 && (
 			block_is_running(input) ||
 			block_is_running(fft) ||
 			block_set_is_any_running(channel_cnt, channels) ||
+			(div_input != NULL && (
+				block_is_running(div_input) ||
+				block_is_running(div_fft) ||
+				block_set_is_any_running(channel_cnt, div_channels))) ||
 			hfdl_pdu_decoder_is_running() ||
-			output_thread_is_any_running(outputs)
+			output_thread_is_any_running(outputs) ||
+			outputs_any_running(retired_outputs)
 			)) {
 		usleep(500000);
 	}
 
+finish:
 #ifdef PROFILING
 	ProfilerStop();
 #endif
 
 	hfdl_print_summary();
+	if(run_stats_file != NULL) {
+		runstats_write(run_stats_file, input_cfg->sample_rate, div_input != NULL ? 2 : 1);
+	}
 
+	watchdog_destroy(wd);
+	watchdog_destroy(div_wd);
+	bb_server_destroy(baseband_server);
 	block_disconnect_one2many(fft, channel_cnt, channels);
 	block_disconnect_one2one(input, fft);
+	if(div_input != NULL) {
+		block_disconnect_one2many(div_fft, channel_cnt, div_channels);
+		block_disconnect_one2one(div_input, div_fft);
+		for(int32_t i = 0; i < channel_cnt; i++) {
+			hfdl_channel_destroy(div_channels[i]);
+		}
+		input_destroy(div_input);
+		input_cfg_destroy(div_input_cfg);
+		fft_destroy(div_fft);
+	}
 	for(int32_t i = 0; i < channel_cnt; i++) {
+		afc_store_set(afc, frequencies[i], hfdl_channel_get_afc_offset(channels[i]));
 		hfdl_channel_destroy(channels[i]);
 	}
+	hfdl_decoder_pool_destroy();
+	hfdl_stats_destroy();
+	if(afc_file != NULL) {
+		afc_store_save(afc, afc_file);
+	}
+	afc_store_destroy(afc);
 	input_destroy(input);
 	input_cfg_destroy(input_cfg);
 
 	fft_destroy(fft);
+	fft_channelizer_cleanup();
 	csdr_fft_destroy();
 
 	outputs_destroy(outputs);
+	la_list_free_full(retired_outputs, outputs_destroy);
+	la_list_free(output_specs);
 
-	Systable_lock();
+	// Not locked - the persistence thread may need the lock
+	// to publish the last table before it exits
 	systable_destroy(Systable);
-	Systable_unlock();
 
 	AC_cache_lock();
 	ac_cache_destroy(AC_cache);
@@ -777,78 +1094,356 @@ int32_t main(int32_t argc, char **argv) {
 #ifdef WITH_SQLITE
 	ac_data_destroy(AC_data);
 #endif
+	XFREE(bs_db_file);
+
+	return 0;
+}
+
+// Drives the whole block graph from the main thread. Each FFT frame is
+// passed through all channels, the PDU decoder and the outputs before
+// the next one is computed, so the results do not depend on thread
+// scheduling and are identical on every run.
+static void run_deterministic(struct block *input, struct block *fft,
+		int32_t channel_cnt, struct block *channels[channel_cnt], la_list *outputs) {
+	outputs_init(outputs);
+	// All stages run in this thread, so CPU time is accounted per step
+	struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	bool input_active = true;
+	while(input_active && do_exit == 0) {
+		input_active = block_step(input);
+		runstats_stage_time_add(RUNSTATS_STAGE_INPUT, &t);
+		while(block_step(fft)) {
+			runstats_stage_time_add(RUNSTATS_STAGE_FFT, &t);
+			for(int32_t i = 0; i < channel_cnt; i++) {
+				block_step(channels[i]);
+			}
+			runstats_stage_time_add(RUNSTATS_STAGE_CHANNEL, &t);
+			hfdl_pdu_decoder_step(outputs);
+			runstats_stage_time_add(RUNSTATS_STAGE_PDU, &t);
+			outputs_step(outputs);
+			runstats_stage_time_add(RUNSTATS_STAGE_OUTPUT, &t);
+		}
+		runstats_stage_time_add(RUNSTATS_STAGE_FFT, &t);
+	}
+	hfdl_pdu_decoder_stop();
+	hfdl_pdu_decoder_step(outputs);
+	runstats_stage_time_add(RUNSTATS_STAGE_PDU, &t);
+	outputs_step(outputs);
+	runstats_stage_time_add(RUNSTATS_STAGE_OUTPUT, &t);
+}
 
+// Worker node of a distributed setup. Demodulates channels streamed
+// by the front-end node and sends decoded frames back to it.
+static int32_t run_worker(char const *address, int32_t channel_cnt, char **freq_args) {
+	if(channel_cnt < 1) {
+		fprintf(stderr, "No channel frequencies given\n");
+		return 1;
+	}
+	int32_t frequencies[channel_cnt];
+	for(int32_t i = 0; i < channel_cnt; i++) {
+		if(parse_frequency(freq_args[i], &frequencies[i]) == false) {
+			return 1;
+		}
+	}
+	hfdl_init_globals();
+	bb_client client = bb_client_connect(address);
+	if(client == NULL) {
+		return 1;
+	}
+	struct block *channels[channel_cnt];
+	for(int32_t i = 0; i < channel_cnt; i++) {
+		bb_feed feed = bb_client_subscribe(client, frequencies[i]);
+		if(feed == NULL) {
+			return 1;
+		}
+		channels[i] = hfdl_channel_create_remote(frequencies[i], feed);
+	}
+
+	setup_signals();
+	if(bb_client_start(client) != 0 ||
+			block_set_start(channel_cnt, channels) != channel_cnt) {
+		return 1;
+	}
+	while(!do_exit) {
+		sleep(1);
+		stats_poll();
+	}
+	fprintf(stderr, "Waiting for all threads to finish\n");
+	while(do_exit < 2 && (
+			bb_client_is_running(client) ||
+			block_set_is_any_running(channel_cnt, channels))) {
+		usleep(500000);
+	}
+	hfdl_print_summary();
+	for(int32_t i = 0; i < channel_cnt; i++) {
+		hfdl_channel_destroy(channels[i]);
+	}
+	hfdl_decoder_pool_destroy();
+	hfdl_stats_destroy();
+	bb_client_destroy(client);
 	return 0;
 }
 
+#define CHANNEL_CREATE_THREADS_MAX 16
+
+struct channels_create_ctx {
+	struct block **channels;
+	int32_t const *frequencies;
+	struct input_cfg const *input_cfg;
+	afc_store const *afc;
+	int32_t channel_cnt;
+	int32_t decimation_rate;
+	float transition_bw;
+	_Atomic int32_t next;
+};
+
+static void *channels_create_thread(void *arg) {
+	struct channels_create_ctx *ctx = arg;
+	int32_t i;
+	while((i = atomic_fetch_add(&ctx->next, 1)) < ctx->channel_cnt) {
+		ctx->channels[i] = hfdl_channel_create(ctx->input_cfg->sample_rate, ctx->decimation_rate,
+				ctx->transition_bw, ctx->input_cfg->centerfreq, ctx->frequencies[i],
+				afc_store_get(ctx->afc, ctx->frequencies[i]));
+	}
+	return NULL;
+}
+
+// Creates channels on a pool of threads, as designing channelizer filters
+// takes a while with large FFT sizes. FFTW planning is serialized in
+// csdr_make_fft_c2c. Returns the index of the first channel which could not
+// be created or -1 if all channels have been created successfully.
+static int32_t channels_create(struct block **channels, int32_t channel_cnt, int32_t const *frequencies,
+		struct input_cfg const *input_cfg, int32_t decimation_rate, float transition_bw, afc_store const *afc) {
+	struct channels_create_ctx ctx = {
+		.channels = channels,
+		.frequencies = frequencies,
+		.input_cfg = input_cfg,
+		.afc = afc,
+		.channel_cnt = channel_cnt,
+		.decimation_rate = decimation_rate,
+		.transition_bw = transition_bw
+	};
+	atomic_init(&ctx.next, 0);
+	long cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+	int32_t thread_cnt = (int32_t)max(cpu_cnt, 1);
+	thread_cnt = min(thread_cnt, min(channel_cnt, CHANNEL_CREATE_THREADS_MAX));
+	pthread_t threads[CHANNEL_CREATE_THREADS_MAX];
+	int32_t started = 0;
+	// The calling thread does its share of work, too
+	for(; started < thread_cnt - 1; started++) {
+		if(pthread_create(&threads[started], NULL, channels_create_thread, &ctx) != 0) {
+			break;
+		}
+	}
+	channels_create_thread(&ctx);
+	for(int32_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	debug_print(D_DSP, "%d channels created by %d threads\n", channel_cnt, started + 1);
+	for(int32_t i = 0; i < channel_cnt; i++) {
+		if(channels[i] == NULL) {
+			return i;
+		}
+	}
+	return -1;
+}
+
 static la_list *output_add(la_list *outputs, char *output_spec) {
 	if(!strcmp(output_spec, "help")) {
 		output_usage();
 		_exit(0);
 	}
+	if(output_add_spec(&outputs, output_spec) == false) {
+		_exit(1);
+	}
+	return outputs;
+}
+
+// Adds the output described by output_spec to the list of formatters
+// and outputs. Returns false if the specifier is invalid.
+static bool output_add_spec(la_list **outputs, char *output_spec) {
 	output_params oparams = output_params_from_string(output_spec);
 	if(oparams.err == true) {
 		fprintf(stderr, "Could not parse output specifier '%s': %s\n", output_spec, oparams.errstr);
-		_exit(1);
+		return false;
 	}
 	debug_print(D_MISC, "intype: %s outformat: %s outtype: %s\n",
 			oparams.intype, oparams.outformat, oparams.outtype);
 
+	bool result = false;
 	fmtr_input_type_t intype = fmtr_input_type_from_string(oparams.intype);
 	if(intype == FMTR_INTYPE_UNKNOWN) {
 		fprintf(stderr, "Data type '%s' is unknown\n", oparams.intype);
-		_exit(1);
+		goto end;
 	}
 
 	output_format_t outfmt = output_format_from_string(oparams.outformat);
 	if(outfmt == OFMT_UNKNOWN) {
 		fprintf(stderr, "Output format '%s' is unknown\n", oparams.outformat);
-		_exit(1);
+		goto end;
 	}
 
 	fmtr_descriptor_t *fmttd = fmtr_descriptor_get(outfmt);
 	ASSERT(fmttd != NULL);
-	fmtr_instance_t *fmtr = find_fmtr_instance(outputs, fmttd, intype);
+	fmtr_instance_t *fmtr = find_fmtr_instance(*outputs, fmttd, intype);
 	if(fmtr == NULL) {      // we haven't added this formatter to the list yet
 		if(!fmttd->supports_data_type(intype)) {
 			fprintf(stderr,
 					"Unsupported data_type:format combination: '%s:%s'\n",
 					oparams.intype, oparams.outformat);
-			_exit(1);
+			goto end;
 		}
 		fmtr = fmtr_instance_new(fmttd, intype);
 		ASSERT(fmtr != NULL);
-		outputs = la_list_append(outputs, fmtr);
+		*outputs = la_list_append(*outputs, fmtr);
 	}
 
 	output_descriptor_t *otd = output_descriptor_get(oparams.outtype);
 	if(otd == NULL) {
 		fprintf(stderr, "Output type '%s' is unknown\n", oparams.outtype);
-		_exit(1);
+		goto end;
 	}
 	if(!otd->supports_format(outfmt)) {
 		fprintf(stderr, "Unsupported format:output combination: '%s:%s'\n",
 				oparams.outformat, oparams.outtype);
-		_exit(1);
+		goto end;
 	}
 
 	void *output_cfg = otd->configure(oparams.outopts);
 	if(output_cfg == NULL) {
 		fprintf(stderr, "Invalid output configuration\n");
-		_exit(1);
+		goto end;
 	}
 
 	output_instance_t *output = output_instance_new(otd, outfmt, output_cfg);
 	ASSERT(output != NULL);
 	fmtr->outputs = la_list_append(fmtr->outputs, output);
-
+	result = true;
+end:
 	// oparams is no longer needed after this point.
 	// No need to free intype, outformat and outtype fields, because they
 	// point into output_spec_string.
 	XFREE(oparams.output_spec_string);
 	kvargs_destroy(oparams.outopts);
+	return result;
+}
 
-	return outputs;
+// Reads the output configuration file, which looks like this:
+//
+// outputs = ( "decoded:text:file:path=/var/log/hfdl.log", "decoded:json:udp:address=127.0.0.1,port=5555" );
+// bs_db = "/home/pi/basestation.sqb";     # optional
+//
+// Outputs are appended to the given list. Returns false on error.
+static bool output_config_read(char const *config_file, la_list **outputs, char **bs_db_file) {
+	ASSERT(config_file != NULL);
+	config_t cfg;
+	bool result = false;
+	config_init(&cfg);
+	if(config_read_file(&cfg, config_file) != CONFIG_TRUE) {
+		fprintf(stderr, "Could not read output configuration from %s: line %d: %s\n",
+				config_file, config_error_line(&cfg), config_error_text(&cfg));
+		goto end;
+	}
+	config_setting_t *specs = config_lookup(&cfg, "outputs");
+	if(specs != NULL) {
+		if(!config_setting_is_aggregate(specs)) {
+			fprintf(stderr, "%s: outputs: must be a list of strings\n", config_file);
+			goto end;
+		}
+		for(int32_t i = 0; i < config_setting_length(specs); i++) {
+			char const *spec = config_setting_get_string_elem(specs, i);
+			if(spec == NULL) {
+				fprintf(stderr, "%s: outputs: element %d is not a string\n", config_file, i + 1);
+				goto end;
+			}
+			char *spec_copy = strdup(spec);
+			bool ok = output_add_spec(outputs, spec_copy);
+			XFREE(spec_copy);
+			if(!ok) {
+				goto end;
+			}
+		}
+	}
+	char const *bs_db = NULL;
+	if(config_lookup_string(&cfg, "bs_db", &bs_db) == CONFIG_TRUE) {
+#ifdef WITH_SQLITE
+		XFREE(*bs_db_file);
+		*bs_db_file = strdup(bs_db);
+#else
+		UNUSED(bs_db_file);
+		fprintf(stderr, "%s: bs_db: ignored, SQLite support is not enabled\n", config_file);
+#endif
+	}
+	result = true;
+end:
+	config_destroy(&cfg);
+	return result;
+}
+
+// Builds a new list of formatters and outputs from --output options and
+// the output configuration file and hands it over to the PDU decoder.
+// DSP blocks and caches are not touched. Outputs of the old list are
+// given up to OUTPUT_SHUTDOWN_TIMEOUT seconds to write out their queues
+// and shut down before the new ones are started. The old list is
+// appended to retired, as the decoder may not have switched over yet.
+// Returns the list which is current after the reload.
+static la_list *outputs_reload(la_list *outputs, la_list *output_specs,
+		char const *config_file, char **bs_db_file, la_list **retired) {
+	fprintf(stderr, "Reloading output configuration from %s\n", config_file);
+	la_list *new_outputs = NULL;
+	char *new_bs_db_file = *bs_db_file != NULL ? strdup(*bs_db_file) : NULL;
+	bool ok = true;
+	for(la_list *l = output_specs; l != NULL && ok; l = la_list_next(l)) {
+		ok = output_add_spec(&new_outputs, l->data);
+	}
+	if(ok == false || output_config_read(config_file, &new_outputs, &new_bs_db_file) == false) {
+		fprintf(stderr, "Keeping the current output configuration\n");
+		outputs_destroy(new_outputs);
+		XFREE(new_bs_db_file);
+		return outputs;
+	}
+	if(new_outputs == NULL) {
+		output_add_spec(&new_outputs, DEFAULT_OUTPUT);
+	}
+	ac_data *new_ac_data = NULL;
+	if(new_bs_db_file != NULL && (*bs_db_file == NULL || strcmp(new_bs_db_file, *bs_db_file) != 0)) {
+		if((new_ac_data = ac_data_create(new_bs_db_file)) == NULL) {
+			fprintf(stderr, "Failed to open aircraft database %s, keeping the current one\n",
+					new_bs_db_file);
+			XFREE(new_bs_db_file);
+		} else {
+			XFREE(*bs_db_file);
+			*bs_db_file = new_bs_db_file;
+		}
+	} else {
+		XFREE(new_bs_db_file);
+	}
+	// New outputs are active from the start, so messages routed to them
+	// wait in their queues until their threads are started. Old outputs
+	// have to release their resources first (eg. a listening socket
+	// which is being reused by the new configuration).
+	hfdl_pdu_decoder_reconfigure(new_outputs, new_ac_data);
+	int32_t wait_cnt = 0;
+	while(output_thread_is_any_running(outputs) && wait_cnt++ < OUTPUT_SHUTDOWN_TIMEOUT * 10) {
+		usleep(100000);
+	}
+	if(output_thread_is_any_running(outputs)) {
+		fprintf(stderr, "Old outputs did not shut down within %d seconds, "
+				"starting new ones anyway\n", OUTPUT_SHUTDOWN_TIMEOUT);
+	}
+	start_all_output_threads(new_outputs);
+	*retired = la_list_append(*retired, outputs);
+	return new_outputs;
+}
+
+static bool outputs_any_running(la_list *output_lists) {
+	for(la_list *l = output_lists; l != NULL; l = la_list_next(l)) {
+		if(output_thread_is_any_running(l->data)) {
+			return true;
+		}
+	}
+	return false;
 }
 
 static void outputs_destroy(la_list *outputs) {
@@ -0,0 +1,737 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#define _GNU_SOURCE                 // sched_setaffinity, sched_getcpu, CPU_*
+#include <stdint.h>
+#include <inttypes.h>               // PRIu64
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>                 // qsort, strtol
+#include <string.h>                 // strstr, memset
+#include <getopt.h>                 // getopt_long
+#include <sched.h>                  // sched_setaffinity, sched_getcpu
+#include <time.h>                   // clock_gettime
+#include <complex.h>
+#include <sys/time.h>               // gettimeofday
+#include <liquid/liquid.h>          // msresamp_crcf_*, bsequence_*
+#include <libacars/libacars.h>      // la_proto_node, la_config_set_int
+#include <libacars/acars.h>         // LA_ACARS_BEARER_HFDL
+#include <libacars/list.h>          // la_list
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>              // __rdtsc
+#define HAVE_RDTSC
+#endif
+#include "options.h"                // describe_option
+#include "globals.h"                // Config, Systable, AC_cache
+#include "util.h"                   // NEW, XCALLOC, XFREE, octet_string_*
+#include "dspbuf.h"                 // DSPBUF_ALLOC, DSPBUF_FREE
+#include "fft.h"                    // csdr_fft_*, FFT_PLAN_T
+#include "fastddc.h"                // fft_channelizer_*, fastddc_inv_cc
+#include "libcsdr.h"                // compute_fft_decimation_rate, compute_filter_relative_transition_bw
+#include "libcsdr_gpl.h"            // decimating_shift_addition_cc
+#include "input-helpers.h"          // get_sample_converter, get_sample_size, get_sample_full_scale_value
+#include "libfec/fec.h"             // *_viterbi27*
+#include "crc.h"                    // crc16_ccitt
+#include "pdu.h"                    // hfdl_pdu_*
+#include "mpdu.h"                   // mpdu_parse
+#include "reasm.h"                  // reasm_mgr_*
+#include "summary.h"                // msg_summary_extract
+#include "fmtr-text.h"              // fmtr_DEF_text
+#include "fmtr-basestation.h"       // fmtr_DEF_basestation
+#include "hfdl.h"                   // hfdl_channel_*, hfdl_bench_*, HFDL_SYMBOL_RATE, SPS
+
+// Microbenchmarks of DSP and decoder kernels.
+//
+// Every benchmark runs a kernel over a fixed block of synthetic input
+// a number of times after a few warm-up runs, with the process pinned
+// to a single CPU. The median and 99th percentile of run times are
+// reported in JSON, together with the time and CPU cycles per processed
+// item, so that results of different builds can be compared with
+// a simple script.
+
+#define ITERATIONS_DEFAULT 200
+#define WARMUP_DEFAULT 20
+#define RESULTS_MAX 64
+#define BENCH_FREQ 10081000
+#define BENCH_GS_ID 4
+#define BENCH_AC_ID 42
+#define BENCH_ICAO 0x4CA123
+
+struct bench_result {
+	char name[64];
+	char const *unit;
+	uint64_t items;                 // items processed in a single run
+	uint64_t median_ns, p99_ns;
+	uint64_t median_cycles;
+};
+
+static struct {
+	int32_t iterations;
+	int32_t warmup;
+	int32_t cpu;
+	char const *filter;
+} Opts;
+
+static struct bench_result Results[RESULTS_MAX];
+static int32_t Result_cnt;
+
+typedef void (bench_fun)(void *ctx);
+
+/**********************************
+ * Timing harness
+ **********************************/
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cycles_now(void) {
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int compare_uint64(void const *a, void const *b) {
+	uint64_t x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+	return x < y ? -1 : x > y;
+}
+
+static bool bench_wanted(char const *name) {
+	return Opts.filter == NULL || strstr(name, Opts.filter) != NULL;
+}
+
+// Runs fun repeatedly and records its timing. If setup is not NULL,
+// it's called before each run and is not included in the measurement
+// (eg. to restore an input buffer which fun modifies in place).
+static void bench_run_with_setup(char const *name, char const *unit, uint64_t items,
+		bench_fun *setup, bench_fun *fun, void *ctx) {
+	if(!bench_wanted(name) || Result_cnt >= RESULTS_MAX) {
+		return;
+	}
+	fprintf(stderr, "%s...\n", name);
+	for(int32_t i = 0; i < Opts.warmup; i++) {
+		if(setup != NULL) {
+			setup(ctx);
+		}
+		fun(ctx);
+	}
+	uint64_t *ns = XCALLOC(Opts.iterations, sizeof(uint64_t));
+	uint64_t *cycles = XCALLOC(Opts.iterations, sizeof(uint64_t));
+	for(int32_t i = 0; i < Opts.iterations; i++) {
+		if(setup != NULL) {
+			setup(ctx);
+		}
+		uint64_t t0 = now_ns();
+		uint64_t c0 = cycles_now();
+		fun(ctx);
+		cycles[i] = cycles_now() - c0;
+		ns[i] = now_ns() - t0;
+	}
+	qsort(ns, Opts.iterations, sizeof(uint64_t), compare_uint64);
+	qsort(cycles, Opts.iterations, sizeof(uint64_t), compare_uint64);
+
+	struct bench_result *r = &Results[Result_cnt++];
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	r->unit = unit;
+	r->items = items;
+	r->median_ns = ns[Opts.iterations / 2];
+	r->p99_ns = ns[(Opts.iterations * 99) / 100];
+	r->median_cycles = cycles[Opts.iterations / 2];
+	XFREE(ns);
+	XFREE(cycles);
+}
+
+static void bench_run(char const *name, char const *unit, uint64_t items, bench_fun *fun, void *ctx) {
+	bench_run_with_setup(name, unit, items, NULL, fun, ctx);
+}
+
+static void results_print_json(FILE *f) {
+	fprintf(f, "{\n");
+	fprintf(f, "  \"version\": \"%s\",\n", DUMPHFDL_VERSION);
+	fprintf(f, "  \"cpu\": %d,\n", Opts.cpu);
+	fprintf(f, "  \"iterations\": %d,\n", Opts.iterations);
+	fprintf(f, "  \"warmup\": %d,\n", Opts.warmup);
+	fprintf(f, "  \"results\": [");
+	for(int32_t i = 0; i < Result_cnt; i++) {
+		struct bench_result const *r = &Results[i];
+		fprintf(f, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"items\": %" PRIu64
+				", \"median_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"ns_per_item\": %.3f, ",
+				i > 0 ? "," : "", r->name, r->unit, r->items, r->median_ns, r->p99_ns,
+				(double)r->median_ns / (double)r->items);
+#ifdef HAVE_RDTSC
+		fprintf(f, "\"cycles_per_item\": %.3f}", (double)r->median_cycles / (double)r->items);
+#else
+		fprintf(f, "\"cycles_per_item\": null}");
+#endif
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static bool pin_to_cpu(int32_t cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(sched_setaffinity(0, sizeof(set), &set) != 0) {
+		fprintf(stderr, "Could not pin the process to CPU %d\n", cpu);
+		return false;
+	}
+	return true;
+}
+
+/**********************************
+ * Synthetic input
+ **********************************/
+
+// Fixed seed, so that all runs process the same data
+static uint32_t Rand_state = 0x12345678u;
+
+static uint32_t xorshift32(void) {
+	uint32_t x = Rand_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return Rand_state = x;
+}
+
+// Uniformly distributed in [-1, 1)
+static float rand_float(void) {
+	return (float)(xorshift32() >> 8) / (float)(1 << 23) - 1.0f;
+}
+
+static void fill_noise(float complex *buf, size_t len, float amplitude) {
+	for(size_t i = 0; i < len; i++) {
+		buf[i] = amplitude * CMPLXF(rand_float(), rand_float());
+	}
+}
+
+static void fill_bytes(uint8_t *buf, size_t len) {
+	for(size_t i = 0; i < len; i++) {
+		buf[i] = xorshift32() & 0xFF;
+	}
+}
+
+/**********************************
+ * Sample converters
+ **********************************/
+
+#define CONVERT_SAMPLE_CNT 65536
+
+struct convert_ctx {
+	sample_convert_fun convert;
+	void *in;
+	float complex *out;
+	float full_scale;
+};
+
+static void convert_run(void *p) {
+	struct convert_ctx *ctx = p;
+	ctx->convert(ctx->in, CONVERT_SAMPLE_CNT, ctx->full_scale, ctx->out);
+}
+
+static void bench_converters(void) {
+	static struct {
+		sample_format sfmt;
+		char const *name;
+	} const formats[] = {
+		{ SFMT_CU8, "convert.cu8" },
+		{ SFMT_CS16, "convert.cs16" },
+		{ SFMT_CF32, "convert.cf32" }
+	};
+	for(size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		sample_format sfmt = formats[i].sfmt;
+		struct convert_ctx ctx = {
+			.convert = get_sample_converter(sfmt),
+			.in = XCALLOC(CONVERT_SAMPLE_CNT, get_sample_size(sfmt)),
+			.out = XCALLOC(CONVERT_SAMPLE_CNT, sizeof(float complex)),
+			.full_scale = get_sample_full_scale_value(sfmt)
+		};
+		if(sfmt == SFMT_CF32) {
+			fill_noise(ctx.in, CONVERT_SAMPLE_CNT, 0.5f);
+		} else {
+			fill_bytes(ctx.in, CONVERT_SAMPLE_CNT * get_sample_size(sfmt));
+		}
+		bench_run(formats[i].name, "samples", CONVERT_SAMPLE_CNT, convert_run, &ctx);
+		XFREE(ctx.in);
+		XFREE(ctx.out);
+	}
+}
+
+/**********************************
+ * FFT and channelizer
+ **********************************/
+
+struct fft_ctx {
+	FFT_PLAN_T *plan;
+};
+
+static void fft_run(void *p) {
+	struct fft_ctx *ctx = p;
+	csdr_fft_execute(ctx->plan);
+}
+
+struct fastddc_ctx {
+	fft_channelizer c;
+	float complex *in, *out;
+};
+
+static void fastddc_run(void *p) {
+	struct fastddc_ctx *ctx = p;
+	fft_channelizer c = ctx->c;
+	c->shift_status = fastddc_inv_cc(ctx->in, ctx->out, c->ddc, c->inv_plan,
+			c->filtertaps_fft, c->shift_status);
+}
+
+struct dsa_ctx {
+	fastddc_t *ddc;
+	float complex *in, *out;
+	decimating_shift_addition_status_t status;
+};
+
+static void dsa_run(void *p) {
+	struct dsa_ctx *ctx = p;
+	ctx->status = decimating_shift_addition_cc(ctx->in, ctx->out, ctx->ddc->post_input_size,
+			&ctx->ddc->dsadata, ctx->ddc->post_decimation, ctx->status);
+}
+
+struct resamp_ctx {
+	msresamp_crcf resampler;
+	float complex *in, *out;
+	uint32_t len;
+};
+
+static void resamp_run(void *p) {
+	struct resamp_ctx *ctx = p;
+	uint32_t out_len = 0;
+	msresamp_crcf_execute(ctx->resampler, ctx->in, ctx->len, ctx->out, &out_len);
+}
+
+// FFT sizes and decimation rates depend on the input sample rate,
+// so the channelizer is benchmarked for a few typical ones
+static void bench_channelizer(int32_t sample_rate) {
+	char name[64];
+	int32_t decimation = compute_fft_decimation_rate(sample_rate, HFDL_SYMBOL_RATE * SPS);
+	float transition_bw = compute_filter_relative_transition_bw(sample_rate, HFDL_CHANNEL_TRANSITION_BW_HZ);
+	fft_channelizer c = fft_channelizer_create(decimation, transition_bw, 0.1f);
+	if(c == NULL) {
+		fprintf(stderr, "Could not create channelizer for sample rate %d\n", sample_rate);
+		return;
+	}
+	fastddc_t *ddc = c->ddc;
+	int32_t rate_k = sample_rate / 1000;
+
+	struct fft_ctx fft = {0};
+	float complex *fft_in = DSPBUF_ALLOC(ddc->fft_size, sizeof(float complex));
+	float complex *fft_out = DSPBUF_ALLOC(ddc->fft_size, sizeof(float complex));
+	fill_noise(fft_in, ddc->fft_size, 0.5f);
+	fft.plan = csdr_make_fft_c2c(ddc->fft_size, fft_in, fft_out, 1, 0);
+	snprintf(name, sizeof(name), "csdr_fft_execute.%d", ddc->fft_size);
+	bench_run(name, "points", ddc->fft_size, fft_run, &fft);
+
+	// fft_out now holds a spectrum of noise, which is what
+	// the channelizer gets from the forward FFT
+	struct fastddc_ctx fastddc = {
+		.c = c,
+		.in = fft_out,
+		.out = XCALLOC(ddc->post_input_size, sizeof(float complex))
+	};
+	snprintf(name, sizeof(name), "fastddc_inv_cc.%dk", rate_k);
+	bench_run(name, "input samples", ddc->input_size, fastddc_run, &fastddc);
+
+	struct dsa_ctx dsa = {
+		.ddc = ddc,
+		.in = XCALLOC(ddc->post_input_size, sizeof(float complex)),
+		.out = XCALLOC(ddc->post_input_size, sizeof(float complex))
+	};
+	fill_noise(dsa.in, ddc->post_input_size, 0.5f);
+	snprintf(name, sizeof(name), "decimating_shift_addition_cc.%dk", rate_k);
+	bench_run(name, "samples", ddc->post_input_size, dsa_run, &dsa);
+
+	float chan_rate = (float)sample_rate / (float)decimation;
+	struct resamp_ctx resamp = {
+		.resampler = msresamp_crcf_create((float)(HFDL_SYMBOL_RATE * SPS) / chan_rate, 60.0f),
+		.len = ddc->post_input_size / ddc->post_decimation
+	};
+	resamp.in = XCALLOC(resamp.len, sizeof(float complex));
+	resamp.out = XCALLOC(resamp.len + 64, sizeof(float complex));
+	fill_noise(resamp.in, resamp.len, 0.5f);
+	snprintf(name, sizeof(name), "msresamp_crcf_execute.%dk", rate_k);
+	bench_run(name, "samples", resamp.len, resamp_run, &resamp);
+
+	msresamp_crcf_destroy(resamp.resampler);
+	XFREE(resamp.in);
+	XFREE(resamp.out);
+	XFREE(dsa.in);
+	XFREE(dsa.out);
+	XFREE(fastddc.out);
+	csdr_destroy_fft_c2c(fft.plan);
+	DSPBUF_FREE(fft_in);
+	DSPBUF_FREE(fft_out);
+	fft_channelizer_destroy(c);
+}
+
+/**********************************
+ * Demodulator and FEC
+ **********************************/
+
+#define DEMOD_BLOCK_LEN (HFDL_SYMBOL_RATE * SPS / 10)
+
+struct demod_ctx {
+	struct block *channel;
+	float complex *noise;
+};
+
+// demodulate() works in place, so every run starts from the same input
+static void demod_setup(void *p) {
+	struct demod_ctx *ctx = p;
+	memcpy(hfdl_channel_input_buffer(ctx->channel, DEMOD_BLOCK_LEN), ctx->noise,
+			DEMOD_BLOCK_LEN * sizeof(float complex));
+}
+
+static void demod_run(void *p) {
+	struct demod_ctx *ctx = p;
+	hfdl_channel_process(ctx->channel, DEMOD_BLOCK_LEN);
+}
+
+struct correlate_ctx {
+	bsequence a, b;
+	int32_t result;
+	float corr;
+};
+
+static void correlate_run(void *p) {
+	struct correlate_ctx *ctx = p;
+	ctx->result = bsequence_correlate(ctx->a, ctx->b);
+}
+
+static void match_sequence_run(void *p) {
+	struct correlate_ctx *ctx = p;
+	ctx->result = hfdl_bench_match_sequence(ctx->b, &ctx->corr);
+}
+
+struct deinterleave_ctx {
+	struct block *channel;
+	int32_t M1;
+	float complex *symbols;
+	uint8_t *viterbi_input;
+};
+
+static void deinterleave_run(void *p) {
+	struct deinterleave_ctx *ctx = p;
+	hfdl_bench_deinterleave(ctx->channel, ctx->M1, ctx->symbols, ctx->viterbi_input);
+}
+
+// Longest frame: 1800 bps, double slot
+#define VITERBI_OUTPUT_BITS 7560
+
+struct viterbi_ctx {
+	void *viterbi;
+	uint8_t soft_bits[2 * VITERBI_OUTPUT_BITS];
+	uint8_t output[VITERBI_OUTPUT_BITS / 8];
+};
+
+static void viterbi_update_run(void *p) {
+	struct viterbi_ctx *ctx = p;
+	init_viterbi27(ctx->viterbi, 0);
+	update_viterbi27_blk(ctx->viterbi, ctx->soft_bits, VITERBI_OUTPUT_BITS);
+}
+
+static void viterbi_chainback_run(void *p) {
+	struct viterbi_ctx *ctx = p;
+	chainback_viterbi27(ctx->viterbi, ctx->output, VITERBI_OUTPUT_BITS, 0);
+}
+
+#define CRC_BUF_LEN 512
+
+struct crc_ctx {
+	uint8_t buf[CRC_BUF_LEN];
+	uint16_t result;
+};
+
+static void crc_run(void *p) {
+	struct crc_ctx *ctx = p;
+	ctx->result = crc16_ccitt(ctx->buf, CRC_BUF_LEN, 0xFFFFu);
+}
+
+static void bench_demod(void) {
+	char name[64];
+	struct block *channel = hfdl_channel_create_standalone(BENCH_FREQ, NULL, NULL);
+
+	// Noise only, so this measures the preamble search path,
+	// which is where the demodulator spends most of its time
+	struct demod_ctx demod = {
+		.channel = channel,
+		.noise = XCALLOC(DEMOD_BLOCK_LEN, sizeof(float complex))
+	};
+	fill_noise(demod.noise, DEMOD_BLOCK_LEN, 0.1f);
+	bench_run_with_setup("demodulate", "samples", DEMOD_BLOCK_LEN, demod_setup, demod_run, &demod);
+	XFREE(demod.noise);
+
+	struct correlate_ctx corr = {
+		.a = bsequence_create(127),
+		.b = bsequence_create(127)
+	};
+	for(int32_t i = 0; i < 127; i++) {
+		bsequence_push(corr.a, xorshift32() & 1);
+		bsequence_push(corr.b, xorshift32() & 1);
+	}
+	bench_run("bsequence_correlate", "bits", 127, correlate_run, &corr);
+	bench_run("match_sequence", "sequences", 1, match_sequence_run, &corr);
+	bsequence_destroy(corr.a);
+	bsequence_destroy(corr.b);
+
+	// Includes soft demapping and descrambling, which are done
+	// in the same pass
+	uint32_t max_symbol_cnt = hfdl_bench_user_data_symbol_cnt(7);
+	struct deinterleave_ctx dei = {
+		.channel = channel,
+		.symbols = XCALLOC(max_symbol_cnt, sizeof(float complex)),
+		.viterbi_input = XCALLOC(3 * max_symbol_cnt, sizeof(uint8_t))
+	};
+	fill_noise(dei.symbols, max_symbol_cnt, 1.0f);
+	for(int32_t M1 = 0; M1 < 8; M1++) {
+		dei.M1 = M1;
+		snprintf(name, sizeof(name), "deinterleave.M1_%d", M1);
+		bench_run(name, "symbols", hfdl_bench_user_data_symbol_cnt(M1), deinterleave_run, &dei);
+	}
+	XFREE(dei.symbols);
+	XFREE(dei.viterbi_input);
+	hfdl_channel_destroy(channel);
+
+	NEW(struct viterbi_ctx, vit);
+	vit->viterbi = create_viterbi27(VITERBI_OUTPUT_BITS);
+	fill_bytes(vit->soft_bits, sizeof(vit->soft_bits));
+	bench_run("update_viterbi27_blk", "bits", VITERBI_OUTPUT_BITS, viterbi_update_run, vit);
+	bench_run("chainback_viterbi27", "bits", VITERBI_OUTPUT_BITS, viterbi_chainback_run, vit);
+	delete_viterbi27(vit->viterbi);
+	XFREE(vit);
+
+	struct crc_ctx crc;
+	fill_bytes(crc.buf, CRC_BUF_LEN);
+	bench_run("crc16_ccitt", "octets", CRC_BUF_LEN, crc_run, &crc);
+}
+
+/**********************************
+ * PDU decoder and formatters
+ **********************************/
+
+#define MPDU_BUF_LEN 160
+
+// Appends an LPDU with its FCS and returns its length
+static uint32_t lpdu_append(uint8_t *buf, uint8_t const *payload, uint32_t len) {
+	memcpy(buf, payload, len);
+	uint16_t fcs = crc16_ccitt(buf, len, 0xFFFFu) ^ 0xFFFFu;
+	buf[len] = fcs & 0xFF;
+	buf[len + 1] = fcs >> 8;
+	return len + 2;
+}
+
+// Builds a downlink MPDU with two LPDUs: a Performance Data HFNPDU
+// (carrying a position) and an ACARS message.
+// Returns the length of the MPDU.
+static uint32_t mpdu_build(uint8_t *buf, time_t now) {
+	// Unnumbered data, Performance data HFNPDU
+	uint8_t perf[48] = { 0x0D, 0xFF, 0xD1, 'B', 'A', 'W', '1', '2', '3' };
+	uint32_t lat = 151460, lon = (uint32_t)-4369 & 0xFFFFF;    // 52.0N, 1.5W
+	perf[9] = lat & 0xFF;
+	perf[10] = (lat >> 8) & 0xFF;
+	perf[11] = ((lat >> 16) & 0xF) | (lon & 0xF) << 4;
+	perf[12] = (lon >> 4) & 0xFF;
+	perf[13] = (lon >> 12) & 0xFF;
+	uint32_t utc = (now - 10) % 86400 / 2;
+	perf[14] = utc & 0xFF;
+	perf[15] = utc >> 8;
+	perf[18] = BENCH_GS_ID;
+	for(int32_t i = 28; i < 47; i++) {
+		perf[i] = i;
+	}
+	// Unnumbered data, Enveloped data HFNPDU with an ACARS message
+	static char const acars[] =
+		"\x0D\xFF\xFF\x01" "2.G-ABCD\x15H11\x02" "D01ABA0123"
+		"/FB TEST MESSAGE FOR DECODER BENCHMARK\x03\x00\x00\x7F";
+
+	uint8_t *ptr = buf + 10;                                    // 6 octets of header, 2 LPDU sizes, FCS
+	uint32_t perf_len = lpdu_append(ptr, perf, sizeof(perf));
+	ptr += perf_len;
+	uint32_t acars_len = lpdu_append(ptr, (uint8_t const *)acars, sizeof(acars) - 1);
+	ptr += acars_len;
+
+	buf[0] = 0x01 | 0x02 | 2 << 2;                              // MPDU, downlink, 2 LPDUs
+	buf[1] = BENCH_GS_ID;
+	buf[2] = BENCH_AC_ID;
+	buf[3] = buf[4] = buf[5] = 0;
+	buf[6] = perf_len - 1;
+	buf[7] = acars_len - 1;
+	uint16_t fcs = crc16_ccitt(buf, 8, 0xFFFFu) ^ 0xFFFFu;
+	buf[8] = fcs & 0xFF;
+	buf[9] = fcs >> 8;
+	return ptr - buf;
+}
+
+struct pdu_ctx {
+	struct octet_string *pdu;
+	struct timeval rx_timestamp;
+	reasm_mgr reasm;
+	struct metadata *metadata;
+	la_list *lpdus;
+	struct msg_summary *summaries;
+	fmtr_descriptor_t *fmtr;
+};
+
+static void mpdu_parse_run(void *p) {
+	struct pdu_ctx *ctx = p;
+	la_list *lpdus = mpdu_parse(ctx->pdu, ctx->reasm, ctx->rx_timestamp, BENCH_FREQ, PDU_DECODE_FULL);
+	la_list_free_full(lpdus, la_proto_tree_destroy);
+}
+
+static void format_run(void *p) {
+	struct pdu_ctx *ctx = p;
+	int32_t i = 0;
+	for(la_list *l = ctx->lpdus; l != NULL; l = la_list_next(l), i++) {
+		struct octet_string *out = ctx->fmtr->format_decoded_msg(ctx->metadata, l->data, &ctx->summaries[i]);
+		octet_string_destroy(out);
+	}
+}
+
+static void bench_pdu(void) {
+	uint8_t buf[MPDU_BUF_LEN];
+	struct pdu_ctx ctx = {0};
+	gettimeofday(&ctx.rx_timestamp, NULL);
+	uint32_t len = mpdu_build(buf, ctx.rx_timestamp.tv_sec);
+	ctx.pdu = octet_string_new(buf, len);
+	ctx.reasm = reasm_mgr_create(REASM_MAX_SIZE_DEFAULT, REASM_TIMEOUT_DEFAULT);
+	bench_run("mpdu_parse", "MPDUs", 1, mpdu_parse_run, &ctx);
+
+	ctx.lpdus = mpdu_parse(ctx.pdu, ctx.reasm, ctx.rx_timestamp, BENCH_FREQ, PDU_DECODE_FULL);
+	int32_t lpdu_cnt = la_list_length(ctx.lpdus);
+	ctx.summaries = XCALLOC(lpdu_cnt > 0 ? lpdu_cnt : 1, sizeof(struct msg_summary));
+	int32_t i = 0;
+	for(la_list *l = ctx.lpdus; l != NULL; l = la_list_next(l), i++) {
+		msg_summary_extract(l->data, &ctx.summaries[i]);
+	}
+	ctx.metadata = hfdl_pdu_metadata_create();
+	struct hfdl_pdu_metadata *hm = container_of(ctx.metadata, struct hfdl_pdu_metadata, metadata);
+	hm->version = 1;
+	hm->freq = BENCH_FREQ;
+	hm->bit_rate = 1200;
+	hm->slot = 'S';
+	ctx.metadata->rx_timestamp = ctx.rx_timestamp;
+
+	if(lpdu_cnt > 0) {
+		ctx.fmtr = &fmtr_DEF_text;
+		bench_run("fmtr_text", "messages", lpdu_cnt, format_run, &ctx);
+		ctx.fmtr = &fmtr_DEF_basestation;
+		bench_run("fmtr_basestation", "messages", lpdu_cnt, format_run, &ctx);
+	} else {
+		fprintf(stderr, "Benchmark MPDU could not be decoded, skipping formatters\n");
+	}
+
+	metadata_destroy(ctx.metadata);
+	XFREE(ctx.summaries);
+	la_list_free_full(ctx.lpdus, la_proto_tree_destroy);
+	reasm_mgr_destroy(ctx.reasm);
+	XFREE(ctx.pdu);
+}
+
+/**********************************
+ * Main
+ **********************************/
+
+static void usage(void) {
+	fprintf(stderr, "Usage: dumphfdl-microbench [options]\n\n");
+	fprintf(stderr, "Runs benchmarks of DSP and decoder kernels and prints the results in JSON.\n\n");
+	fprintf(stderr, "Options:\n");
+	describe_option("--help", "Displays this text", 1);
+	describe_option("--iterations <integer>", "Number of timed runs of each benchmark", 1);
+	fprintf(stderr, "%*s(default: %d)\n", USAGE_OPT_NAME_COLWIDTH, "", ITERATIONS_DEFAULT);
+	describe_option("--warmup <integer>", "Number of untimed runs before timing starts", 1);
+	fprintf(stderr, "%*s(default: %d)\n", USAGE_OPT_NAME_COLWIDTH, "", WARMUP_DEFAULT);
+	describe_option("--cpu <integer>", "Pin the process to this CPU (default: the CPU it starts on)", 1);
+	describe_option("--filter <string>", "Run only benchmarks with names containing this string", 1);
+}
+
+int32_t main(int32_t argc, char **argv) {
+	Opts.iterations = ITERATIONS_DEFAULT;
+	Opts.warmup = WARMUP_DEFAULT;
+	Opts.cpu = -1;
+
+#define OPT_HELP 1
+#define OPT_ITERATIONS 2
+#define OPT_WARMUP 3
+#define OPT_CPU 4
+#define OPT_FILTER 5
+	static struct option opts[] = {
+		{ "help",       no_argument,        NULL,   OPT_HELP },
+		{ "iterations", required_argument,  NULL,   OPT_ITERATIONS },
+		{ "warmup",     required_argument,  NULL,   OPT_WARMUP },
+		{ "cpu",        required_argument,  NULL,   OPT_CPU },
+		{ "filter",     required_argument,  NULL,   OPT_FILTER },
+		{ 0,            0,                  0,      0 }
+	};
+	int c = -1;
+	while((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+		switch(c) {
+			case OPT_ITERATIONS:
+				Opts.iterations = atoi(optarg);
+				break;
+			case OPT_WARMUP:
+				Opts.warmup = atoi(optarg);
+				break;
+			case OPT_CPU:
+				Opts.cpu = atoi(optarg);
+				break;
+			case OPT_FILTER:
+				Opts.filter = optarg;
+				break;
+			case OPT_HELP:
+				usage();
+				return 0;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if(Opts.iterations < 1 || Opts.warmup < 0) {
+		fprintf(stderr, "Invalid number of iterations\n");
+		return 1;
+	}
+	if(Opts.cpu < 0) {
+		Opts.cpu = sched_getcpu();
+	}
+	if(Opts.cpu < 0 || !pin_to_cpu(Opts.cpu)) {
+		return 1;
+	}
+
+	Config.reasm_max_size = REASM_MAX_SIZE_DEFAULT;
+	Config.reasm_timeout = REASM_TIMEOUT_DEFAULT;
+	Systable = systable_create(NULL);
+	AC_cache = ac_cache_create();
+	AC_cache_lock();
+	ac_cache_entry_create(AC_cache, BENCH_FREQ, BENCH_AC_ID, BENCH_ICAO);
+	AC_cache_unlock();
+	la_config_set_int("acars_bearer", LA_ACARS_BEARER_HFDL);
+	csdr_fft_init();
+	hfdl_init_globals();
+	// Frames falsely detected in noise by the demodulator benchmark
+	// are queued for decoding, which never happens
+	hfdl_pdu_decoder_init();
+
+	bench_converters();
+	static int32_t const sample_rates[] = { 250000, 768000, 2000000 };
+	for(size_t i = 0; i < sizeof(sample_rates) / sizeof(sample_rates[0]); i++) {
+		bench_channelizer(sample_rates[i]);
+	}
+	bench_demod();
+	bench_pdu();
+
+	results_print_json(stdout);
+
+	hfdl_decoder_pool_destroy();
+	hfdl_stats_destroy();
+	fft_channelizer_cleanup();
+	csdr_fft_destroy();
+	ac_cache_destroy(AC_cache);
+	systable_destroy(Systable);
+	return 0;
+}
@@ -2,11 +2,12 @@
 #include <stdint.h>
 #include <sys/time.h>                       // struct timeval
 #include <libacars/libacars.h>              // la_type_descriptor, la_proto_node
-#include <libacars/reassembly.h>            // la_reasm_ctx
 #include <libacars/list.h>                  // la_list
+#include "reasm.h"                          // reasm_mgr
 #include "pdu.h"                            // struct hfdl_pdu_hdr_data, hfdl_pdu_fcs_check
 #include "lpdu.h"                           // lpdu_parse
 #include "statsd.h"                         // statsd_*
+#include "runstats.h"                       // runstats_add
 #include "util.h"                           // NEW, ASSERT, struct octet_string, {ac,gs}_id_format_text
 
 struct hfdl_mpdu {
@@ -24,11 +25,11 @@ struct mpdu_dst {
 la_type_descriptor const proto_DEF_hfdl_mpdu;
 static int32_t parse_lpdu_list(uint8_t *lpdu_len_ptr, uint8_t *data_ptr,
 		uint8_t *endptr, uint32_t lpdu_cnt, la_list **lpdu_list,
-		struct hfdl_pdu_hdr_data mpdu_header, la_reasm_ctx *reasm_ctx,
+		struct hfdl_pdu_hdr_data mpdu_header, reasm_mgr reasm,
 		struct timeval rx_timestamp);
 
-la_list *mpdu_parse(struct octet_string *pdu, la_reasm_ctx *reasm_ctx,
-		struct timeval rx_timestamp, int32_t freq) {
+la_list *mpdu_parse(struct octet_string *pdu, reasm_mgr reasm,
+		struct timeval rx_timestamp, int32_t freq, enum hfdl_pdu_decode_level decode_level) {
 	ASSERT(pdu);
 	ASSERT(pdu->buf);
 	ASSERT(pdu->len > 0);
@@ -47,6 +48,7 @@ la_list *mpdu_parse(struct octet_string *pdu, la_reasm_ctx *reasm_ctx,
 
 	struct hfdl_pdu_hdr_data mpdu_header = {0};
 	mpdu_header.freq = freq;
+	mpdu_header.decode_level = decode_level;
 	uint32_t aircraft_cnt = 0;
 	uint32_t lpdu_cnt = 0;
 	uint32_t hdr_len = 0;
@@ -82,8 +84,10 @@ la_list *mpdu_parse(struct octet_string *pdu, la_reasm_ctx *reasm_ctx,
 	if(hfdl_pdu_fcs_check(buf, hdr_len)) {
 		mpdu_header.crc_ok = true;
 		statsd_increment_per_channel(freq, "frames.good");
+		runstats_add(RUNSTATS_FRAMES_GOOD, 1);
 	} else {
 		statsd_increment_per_channel(freq, "frame.errors.bad_fcs");
+		runstats_add(RUNSTATS_FRAMES_BAD_FCS, 1);
 		goto end;
 	}
 
@@ -94,7 +98,7 @@ la_list *mpdu_parse(struct octet_string *pdu, la_reasm_ctx *reasm_ctx,
 		mpdu_header.dst_id = buf[1] & 0x7f;
 		uint8_t *hdrptr = buf + 6;              // First LPDU size octet
 		if(parse_lpdu_list(hdrptr, dataptr, buf + len, lpdu_cnt, &lpdu_list,
-					mpdu_header, reasm_ctx, rx_timestamp) < 0) {
+					mpdu_header, reasm, rx_timestamp) < 0) {
 			goto end;
 		}
 	} else {                                    // UPLINK_PDU
@@ -114,7 +118,7 @@ la_list *mpdu_parse(struct octet_string *pdu, la_reasm_ctx *reasm_ctx,
 			}
 			if((consumed_octets = parse_lpdu_list(hdrptr, dataptr, buf + len,
 							lpdu_cnt, &lpdu_list, mpdu_header,
-							reasm_ctx, rx_timestamp)) < 0) {
+							reasm, rx_timestamp)) < 0) {
 				goto end;
 			}
 		}
@@ -134,14 +138,14 @@ end:
 
 static int32_t parse_lpdu_list(uint8_t *lpdu_len_ptr, uint8_t *data_ptr,
 		uint8_t *endptr, uint32_t lpdu_cnt, la_list **lpdu_list,
-		struct hfdl_pdu_hdr_data mpdu_header, la_reasm_ctx *reasm_ctx,
+		struct hfdl_pdu_hdr_data mpdu_header, reasm_mgr reasm,
 		struct timeval rx_timestamp) {
 	int32_t consumed_octets = 0;
 	for(uint32_t j = 0; j < lpdu_cnt; j++) {
 		uint32_t lpdu_len = *lpdu_len_ptr + 1;
 		if(data_ptr + lpdu_len <= endptr) {
 			debug_print(D_PROTO, "lpdu %u/%u: lpdu_len=%u\n", j + 1, lpdu_cnt, lpdu_len);
-			la_proto_node *node = lpdu_parse(data_ptr, lpdu_len, mpdu_header, reasm_ctx, rx_timestamp);
+			la_proto_node *node = lpdu_parse(data_ptr, lpdu_len, mpdu_header, reasm, rx_timestamp);
 			if(node != NULL) {
 				*lpdu_list = la_list_append(*lpdu_list, node);
 			}
@@ -2,9 +2,10 @@
 #pragma once
 #include <stdint.h>
 #include <sys/time.h>               // struct timeval
-#include <libacars/reassembly.h>    // la_reasm_ctx
 #include <libacars/list.h>          // la_list
+#include "reasm.h"                  // reasm_mgr
 #include "util.h"                   // struct octet_string
+#include "pdu.h"                    // enum hfdl_pdu_decode_level
 
-la_list *mpdu_parse(struct octet_string *pdu, la_reasm_ctx *reasm_ctx, struct
-		timeval rx_timestamp, int32_t freq);
+la_list *mpdu_parse(struct octet_string *pdu, reasm_mgr reasm, struct
+		timeval rx_timestamp, int32_t freq, enum hfdl_pdu_decode_level decode_level);
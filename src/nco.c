@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <stddef.h>                 // size_t
+#include <complex.h>
+#include <math.h>                   // M_PI
+#include <pthread.h>                // pthread_once
+#include "nco.h"
+#include "util.h"                   // ASSERT
+
+float complex Nco_table_coarse[NCO_TABLE_SIZE];
+float complex Nco_table_fine[NCO_TABLE_SIZE];
+static pthread_once_t Nco_tables_once = PTHREAD_ONCE_INIT;
+
+static void nco_tables_compute(void) {
+	for(int32_t i = 0; i < NCO_TABLE_SIZE; i++) {
+		double coarse = 2.0 * M_PI * (double)i / (double)NCO_TABLE_SIZE;
+		double fine = coarse / (double)NCO_TABLE_SIZE;
+		Nco_table_coarse[i] = CMPLXF(cos(coarse), sin(coarse));
+		Nco_table_fine[i] = CMPLXF(cos(fine), sin(fine));
+	}
+}
+
+void nco_tables_init(void) {
+	pthread_once(&Nco_tables_once, nco_tables_compute);
+}
+
+// freq - frequency normalized to the sampling rate (cycles per sample)
+void nco_init(struct nco *n, float freq) {
+	ASSERT(n != NULL);
+	nco_tables_init();
+	n->phase = 0;
+	nco_set_frequency(n, freq);
+}
+
+void nco_set_frequency(struct nco *n, float freq) {
+	ASSERT(n != NULL);
+	n->freq = nco_rad_to_phase(2.0f * M_PI * (freq - rintf(freq)));
+	// Compute step phasors from the quantized frequency, so that they
+	// match the phase accumulator exactly
+	for(int32_t k = 0; k < NCO_BLOCK_LEN; k++) {
+		double phi = 2.0 * M_PI * (double)(uint32_t)(n->freq * (uint32_t)k) / 4294967296.0;
+		n->step[k] = CMPLXF(cos(phi), sin(phi));
+	}
+}
+
+// Computes out[k] = in[k * in_stride] * exp(j*phase_k) for k = 0..len-1
+// and advances the phase accordingly.
+void nco_mix_block(struct nco *n, float complex const *in, size_t in_stride,
+		float complex *out, size_t len) {
+	ASSERT(n != NULL);
+	float complex rot[NCO_BLOCK_LEN];
+	uint32_t const block_freq = n->freq * NCO_BLOCK_LEN;
+	size_t k = 0;
+	for(; k + NCO_BLOCK_LEN <= len; k += NCO_BLOCK_LEN) {
+		float complex const base = nco_phasor(n->phase);
+		float complex const *x = in + k * in_stride;
+		for(int32_t j = 0; j < NCO_BLOCK_LEN; j++) {
+			rot[j] = base * n->step[j];
+		}
+		for(int32_t j = 0; j < NCO_BLOCK_LEN; j++) {
+			out[k + j] = x[j * in_stride] * rot[j];
+		}
+		n->phase += block_freq;
+	}
+	if(k < len) {
+		float complex const base = nco_phasor(n->phase);
+		float complex const *x = in + k * in_stride;
+		size_t remaining = len - k;
+		for(size_t j = 0; j < remaining; j++) {
+			out[k + j] = x[j * in_stride] * base * n->step[j];
+		}
+		n->phase += n->freq * (uint32_t)remaining;
+	}
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>                 // size_t
+#include <complex.h>
+#include <math.h>                   // M_PI
+
+// Numerically controlled oscillator with table-based phasor generation.
+//
+// Phase is kept in a 32-bit unsigned accumulator (2^32 == 2*pi), so it wraps
+// around for free and does not accumulate rounding errors. Phasors are
+// computed as a product of two table entries (coarse * fine), which gives
+// a phase resolution of 2*pi/2^20 without calling sin/cos/cexp.
+
+#define NCO_TABLE_BITS 10
+#define NCO_TABLE_SIZE (1 << NCO_TABLE_BITS)
+// Number of consecutive samples rotated using precomputed step phasors.
+// The phasor is recomputed from the phase accumulator at the start of each
+// such run, so rounding errors can't build up.
+#define NCO_BLOCK_LEN 8
+
+struct nco {
+	uint32_t phase;                         // current phase
+	uint32_t freq;                          // phase increment per sample
+	float complex step[NCO_BLOCK_LEN];      // exp(j*2*pi*freq*k), k = 0..NCO_BLOCK_LEN-1
+};
+
+extern float complex Nco_table_coarse[NCO_TABLE_SIZE];
+extern float complex Nco_table_fine[NCO_TABLE_SIZE];
+
+void nco_tables_init(void);
+void nco_init(struct nco *n, float freq);
+void nco_set_frequency(struct nco *n, float freq);
+void nco_mix_block(struct nco *n, float complex const *in, size_t in_stride,
+		float complex *out, size_t len);
+
+// Converts phase in radians to the accumulator format
+static inline uint32_t nco_rad_to_phase(float rad) {
+	return (uint32_t)(int64_t)(rad * (float)(2147483648.0 / M_PI));
+}
+
+// Returns exp(j*phase). nco_tables_init() must have been called before.
+static inline float complex nco_phasor(uint32_t phase) {
+	return Nco_table_coarse[phase >> (32 - NCO_TABLE_BITS)] *
+		Nco_table_fine[(phase >> (32 - 2 * NCO_TABLE_BITS)) & (NCO_TABLE_SIZE - 1)];
+}
@@ -7,9 +7,11 @@
 #include "options.h"            // describe_option
 #include "metadata.h"           // struct metadata, metadata_copy, metadata_destroy
 #include "output-common.h"
+#include "runstats.h"           // runstats_stage_thread_done
 
 #include "fmtr-text.h"          // fmtr_DEF_text
 #include "fmtr-basestation.h"   // fmtr_DEF_basestation
+#include "fmtr-perfstats.h"     // fmtr_DEF_perfstats
 
 #include "output-file.h"        // out_DEF_file
 #include "output-tcp.h"         // out_DEF_tcp
@@ -42,6 +44,7 @@ static la_dict const fmtr_intype_names[] = {
 static la_dict const fmtr_descriptors[] = {
 	{ .id = OFMT_TEXT,                  .val = &fmtr_DEF_text },
 	{ .id = OFMT_BASESTATION,           .val = &fmtr_DEF_basestation },
+	{ .id = OFMT_PERFSTATS,             .val = &fmtr_DEF_perfstats },
 	{ .id = OFMT_UNKNOWN,               .val = NULL }
 };
 
@@ -202,44 +205,65 @@ void output_usage() {
 	fprintf(stderr, "\n");
 }
 
-void *output_thread(void *arg) {
-	ASSERT(arg != NULL);
-	output_instance_t *oi = arg;
-	ASSERT(oi->ctx != NULL);
+// Runs the init routine of the output. On failure the caller
+// shall deactivate the output with output_instance_deactivate().
+static bool output_instance_init(output_instance_t *oi) {
 	output_ctx_t *ctx = oi->ctx;
-
-	if(oi->td->init != NULL) {
-		if(oi->td->init(ctx->priv) < 0) {
-			goto fail;
+	if(oi->td->init != NULL && oi->td->init(ctx->priv) < 0) {
+		if(oi->td->handle_failure != NULL) {
+			oi->td->handle_failure(ctx->priv);
 		}
+		return false;
 	}
+	return true;
+}
 
-	while(1) {
-		output_qentry_t *q = g_async_queue_pop(ctx->q);
-		ASSERT(q != NULL);
-		if(q->flags & OUT_FLAG_ORDERED_SHUTDOWN) {
-			output_qentry_destroy(q);
-			break;
-		}
-		int32_t result = oi->td->produce(ctx->priv, q->format, q->metadata, q->msg);
-		output_qentry_destroy(q);
-		if(result < 0) {
-			break;
+// Stops routing messages to the output and flushes its queue
+static void output_instance_deactivate(output_instance_t *oi) {
+	oi->ctx->active = false;
+	output_queue_drain(oi->ctx->q);
+}
+
+// Hands over a queued message to the output. Returns false when
+// the output has been shut down, either on request or due to an error.
+// The caller shall then mark the output as inactive.
+static bool output_instance_process(output_instance_t *oi, output_qentry_t *q) {
+	ASSERT(q != NULL);
+	output_ctx_t *ctx = oi->ctx;
+	int32_t result = -1;
+	if((q->flags & OUT_FLAG_ORDERED_SHUTDOWN) == 0) {
+		result = oi->td->produce(ctx->priv, q->format, q->metadata, q->msg);
+	}
+	output_qentry_destroy(q);
+	if(result < 0) {
+		if(oi->td->handle_shutdown != NULL) {
+			oi->td->handle_shutdown(ctx->priv);
 		}
+		return false;
 	}
+	return true;
+}
 
-	if(oi->td->handle_shutdown != NULL) {
-		oi->td->handle_shutdown(ctx->priv);
-	}
-	ctx->active = false;
-	return NULL;
+void *output_thread(void *arg) {
+	ASSERT(arg != NULL);
+	output_instance_t *oi = arg;
+	ASSERT(oi->ctx != NULL);
+	output_ctx_t *ctx = oi->ctx;
 
-fail:
-	ctx->active = false;
-	if(oi->td->handle_failure != NULL) {
-		oi->td->handle_failure(ctx->priv);
+	// CPU time is recorded before the output is marked as inactive,
+	// because the main thread writes the run statistics once all
+	// outputs have become inactive.
+	if(output_instance_init(oi) == false) {
+		runstats_stage_thread_done(RUNSTATS_STAGE_OUTPUT);
+		output_instance_deactivate(oi);
+		return NULL;
 	}
-	output_queue_drain(ctx->q);
+	output_qentry_t *q = NULL;
+	do {
+		q = g_async_queue_pop(ctx->q);
+	} while(output_instance_process(oi, q));
+	runstats_stage_thread_done(RUNSTATS_STAGE_OUTPUT);
+	ctx->active = false;
 	return NULL;
 }
 
@@ -293,3 +317,31 @@ bool output_thread_is_any_running(la_list *fmtr_list) {
 	}
 	return false;
 }
+
+// Deterministic mode: runs init routines of all outputs in the calling thread
+void outputs_init(la_list *fmtr_list) {
+	for(la_list *fl = fmtr_list; fl != NULL; fl = la_list_next(fl)) {
+		fmtr_instance_t *fmtr = fl->data;
+		for(la_list *ol = fmtr->outputs; ol != NULL; ol = la_list_next(ol)) {
+			if(output_instance_init(ol->data) == false) {
+				output_instance_deactivate(ol->data);
+			}
+		}
+	}
+}
+
+// Deterministic mode: passes all queued messages to outputs
+void outputs_step(la_list *fmtr_list) {
+	for(la_list *fl = fmtr_list; fl != NULL; fl = la_list_next(fl)) {
+		fmtr_instance_t *fmtr = fl->data;
+		for(la_list *ol = fmtr->outputs; ol != NULL; ol = la_list_next(ol)) {
+			output_instance_t *output = ol->data;
+			output_qentry_t *q = NULL;
+			while(output->ctx->active && (q = g_async_queue_try_pop(output->ctx->q)) != NULL) {
+				if(output_instance_process(output, q) == false) {
+					output->ctx->active = false;
+				}
+			}
+		}
+	}
+}
@@ -9,6 +9,8 @@
 #include "kvargs.h"                     // kvargs
 #include "options.h"                    // options_descr_t
 #include "metadata.h"                   // struct metadata
+#include "pdu.h"                        // enum hfdl_pdu_decode_level
+#include "summary.h"                    // struct msg_summary
 
 // default output specification - decoded text output to stdout
 #define DEFAULT_OUTPUT "decoded:text:file:path=-"
@@ -29,10 +31,11 @@ typedef enum {
 typedef enum {
 	OFMT_UNKNOWN    = 0,
 	OFMT_TEXT       = 1,
-	OFMT_BASESTATION = 2
+	OFMT_BASESTATION = 2,
+	OFMT_PERFSTATS  = 3
 } output_format_t;
 
-typedef struct octet_string* (fmt_decoded_fun_t)(struct metadata *, la_proto_node *);
+typedef struct octet_string* (fmt_decoded_fun_t)(struct metadata *, la_proto_node *, struct msg_summary const *);
 typedef struct octet_string* (fmt_raw_fun_t)(struct metadata *, struct octet_string *);
 typedef bool (intype_check_fun_t)(fmtr_input_type_t);
 
@@ -44,6 +47,7 @@ typedef struct {
     fmt_raw_fun_t *format_raw_msg;
     intype_check_fun_t *supports_data_type;
     output_format_t output_format;
+    enum hfdl_pdu_decode_level decode_level;    // what format_decoded_msg needs
 } fmtr_descriptor_t;
 
 // Frame formatter instance
@@ -117,5 +121,7 @@ void *output_thread(void *arg);
 void output_queue_push(void *data, void *ctx);
 void shutdown_outputs(la_list *fmtr_list);
 bool output_thread_is_any_running(la_list *fmtr_list);
+void outputs_init(la_list *fmtr_list);
+void outputs_step(la_list *fmtr_list);
 
 void output_usage();
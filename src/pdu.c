@@ -5,22 +5,33 @@
 #include <glib.h>                   // GAsyncQueue, g_async_queue_*
 #include <libacars/libacars.h>      // la_proto_tree_destroy()
 #include <libacars/list.h>          // la_list_*
-#include <libacars/reassembly.h>    // la_reasm_ctx, la_reasm_ctx_new()
 #include "util.h"                   // NEW, ASSERT, struct octet_string
+#include "globals.h"                // AC_data, Config
 #include "output-common.h"          // output_queue_push, shutdown_outputs
 #include "crc.h"                    // crc16_ccitt
 #include "mpdu.h"                   // mpdu_parse
+#include "reasm.h"                  // reasm_mgr_*
 #include "spdu.h"                   // spdu_parse
 #include "statsd.h"                 // statsd_*
+#include "summary.h"                // msg_summary_extract
+#include "runstats.h"               // runstats_*
 #include "pdu.h"                    // struct hfdl_pdu_metadata
 
 struct hfdl_pdu_qentry {
 	struct metadata *metadata;
 	struct octet_string *pdu;
+	la_list *fmtr_list;             // PDU_FLAG_RECONFIGURE only
+	ac_data *ac_data;               // PDU_FLAG_RECONFIGURE only
 	uint32_t flags;
 };
 
+// Queue entry flag (in addition to OUT_FLAG_*)
+#define PDU_FLAG_RECONFIGURE (1 << 8)
+
 static GAsyncQueue *pdu_decoder_queue;
+static la_list *fmtr_list;
+static enum hfdl_pdu_decode_level decode_level;
+static reasm_mgr reasm;
 static bool pdu_decoder_thread_active = false;
 
 /******************************
@@ -28,6 +39,8 @@ static bool pdu_decoder_thread_active = false;
  ******************************/
 
 static void *pdu_decoder_thread(void *ctx);
+static bool pdu_decoder_process(struct hfdl_pdu_qentry *q);
+static void fmtr_list_set(la_list *list);
 static struct metadata_vtable hfdl_pdu_metadata_vtable;
 
 /******************************
@@ -44,17 +57,51 @@ void pdu_decoder_queue_push(struct metadata *metadata, struct octet_string *pdu,
 
 void hfdl_pdu_decoder_init(void) {
 	pdu_decoder_queue = g_async_queue_new();
+	reasm = reasm_mgr_create(Config.reasm_max_size, Config.reasm_timeout);
 }
 
 int32_t hfdl_pdu_decoder_start(void *ctx) {
 	pthread_t pdu_th;
-	int32_t ret = start_thread(&pdu_th, pdu_decoder_thread, ctx);
+	fmtr_list_set(ctx);
+	int32_t ret = start_thread(&pdu_th, pdu_decoder_thread, NULL);
 	if(ret == 0) {
 		pdu_decoder_thread_active = true;
 	}
 	return ret;
 }
 
+// Deterministic mode: decodes all queued PDUs in the calling thread.
+// Returns false once the decoder has been shut down.
+bool hfdl_pdu_decoder_step(void *ctx) {
+	ASSERT(ctx != NULL);
+	struct hfdl_pdu_qentry *q = NULL;
+	if(fmtr_list != ctx) {
+		fmtr_list_set(ctx);
+	}
+	pdu_decoder_thread_active = true;
+	while((q = g_async_queue_try_pop(pdu_decoder_queue)) != NULL) {
+		if(pdu_decoder_process(q) == false) {
+			pdu_decoder_thread_active = false;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Switches the decoder to a new list of formatters and outputs, after
+// all PDUs queued so far have been processed. Outputs on the old list
+// are shut down after writing out messages which are already in their
+// queues. If new_ac_data is not NULL, it replaces the current aircraft
+// database at the same time.
+void hfdl_pdu_decoder_reconfigure(la_list *new_fmtr_list, ac_data *new_ac_data) {
+	ASSERT(new_fmtr_list != NULL);
+	NEW(struct hfdl_pdu_qentry, qentry);
+	qentry->fmtr_list = new_fmtr_list;
+	qentry->ac_data = new_ac_data;
+	qentry->flags = PDU_FLAG_RECONFIGURE;
+	g_async_queue_push(pdu_decoder_queue, qentry);
+}
+
 void hfdl_pdu_decoder_stop(void) {
 	pdu_decoder_queue_push(NULL, NULL, OUT_FLAG_ORDERED_SHUTDOWN);
 }
@@ -88,12 +135,11 @@ struct metadata *hfdl_pdu_metadata_create() {
  * Private variables and methods
  ****************************************/
 
-static void *pdu_decoder_thread(void *ctx) {
-	ASSERT(ctx != NULL);
-	la_list *fmtr_list = ctx;
-	struct hfdl_pdu_qentry *q = NULL;
+// Decodes a queued PDU and passes the results to formatters and outputs.
+// Returns false when the entry is a shutdown request.
+static bool pdu_decoder_process(struct hfdl_pdu_qentry *q) {
 	la_list *lpdu_list = NULL;
-	la_reasm_ctx *reasm_ctx = la_reasm_ctx_new();
+	struct msg_summary *summaries = NULL;
 	enum {
 		DECODING_NOT_DONE,
 		DECODING_SUCCESS,
@@ -101,78 +147,123 @@ static void *pdu_decoder_thread(void *ctx) {
 	} decoding_status;
 	#define IS_MPDU(buf) ((buf)[0] & 1)
 
-	while(true) {
-		q = g_async_queue_pop(pdu_decoder_queue);
-		if(q->flags & OUT_FLAG_ORDERED_SHUTDOWN) {
-			fprintf(stderr, "Shutting down decoder thread\n");
-			shutdown_outputs(fmtr_list);
-			XFREE(q);
-			break;
+	if(q->flags & OUT_FLAG_ORDERED_SHUTDOWN) {
+		fprintf(stderr, "Shutting down decoder thread\n");
+		shutdown_outputs(fmtr_list);
+		XFREE(q);
+		reasm_mgr_print_stats(reasm);
+		reasm_mgr_destroy(reasm);
+		reasm = NULL;
+		return false;
+	} else if(q->flags & PDU_FLAG_RECONFIGURE) {
+		fprintf(stderr, "Switching to the new output configuration\n");
+		shutdown_outputs(fmtr_list);
+		fmtr_list_set(q->fmtr_list);
+		if(q->ac_data != NULL) {
+			ac_data_destroy(AC_data);
+			AC_data = q->ac_data;
+			Config.ac_data_available = true;
 		}
-		ASSERT(q->metadata != NULL);
-
-		fmtr_instance_t *fmtr = NULL;
-		decoding_status = DECODING_NOT_DONE;
-		for(la_list *p = fmtr_list; p != NULL; p = la_list_next(p)) {
-			fmtr = p->data;
-			if(fmtr->intype == FMTR_INTYPE_DECODED_FRAME) {
-				// Decode the pdu unless we've done it before
-				if(decoding_status == DECODING_NOT_DONE) {
-					struct hfdl_pdu_metadata *hm = container_of(q->metadata,
-							struct hfdl_pdu_metadata, metadata);
-					statsd_increment_per_channel(hm->freq, "frames.processed");
-					if(IS_MPDU(q->pdu->buf)) {
-						lpdu_list = mpdu_parse(q->pdu, reasm_ctx, q->metadata->rx_timestamp, hm->freq);
-					} else {
-						lpdu_list = spdu_parse(q->pdu, hm->freq);
-					}
-					if(lpdu_list != NULL) {
-						decoding_status = DECODING_SUCCESS;
-					} else {
-						decoding_status = DECODING_FAILURE;
-					}
+		XFREE(q);
+		return true;
+	}
+	ASSERT(q->metadata != NULL);
+
+	fmtr_instance_t *fmtr = NULL;
+	decoding_status = DECODING_NOT_DONE;
+	for(la_list *p = fmtr_list; p != NULL; p = la_list_next(p)) {
+		fmtr = p->data;
+		if(fmtr->intype == FMTR_INTYPE_DECODED_FRAME) {
+			// Decode the pdu unless we've done it before
+			if(decoding_status == DECODING_NOT_DONE) {
+				struct hfdl_pdu_metadata *hm = container_of(q->metadata,
+						struct hfdl_pdu_metadata, metadata);
+				statsd_increment_per_channel(hm->freq, "frames.processed");
+				if(IS_MPDU(q->pdu->buf)) {
+					lpdu_list = mpdu_parse(q->pdu, reasm, q->metadata->rx_timestamp, hm->freq,
+							decode_level);
+				} else {
+					lpdu_list = spdu_parse(q->pdu, hm->freq);
 				}
-				if(decoding_status == DECODING_SUCCESS) {
-					for(la_list *lpdu = lpdu_list; lpdu != NULL; lpdu = la_list_next(lpdu)) {
-						ASSERT(lpdu->data != NULL);
-						struct octet_string *serialized_msg = fmtr->td->format_decoded_msg(q->metadata, lpdu->data);
-						// First check if the formatter actually returned something.
-						// A formatter might be suitable only for a particular message type. If this is the case.
-						// it will return NULL for all messages it cannot handle.
-						// An example is pp_acars which only deals with ACARS messages.
-						if(serialized_msg != NULL) {
-							output_qentry_t qentry = {
-								.msg = serialized_msg,
-								.metadata = q->metadata,
-								.format = fmtr->td->output_format
-							};
-							la_list_foreach(fmtr->outputs, output_queue_push, &qentry);
-							// output_queue_push makes a copy of serialized_msg, so it's safe to free it now
-							octet_string_destroy(serialized_msg);
-						}
+				if(lpdu_list != NULL) {
+					decoding_status = DECODING_SUCCESS;
+					// Extract the summary of each message once for all formatters
+					summaries = XCALLOC(la_list_length(lpdu_list), sizeof(struct msg_summary));
+					int32_t i = 0;
+					for(la_list *lpdu = lpdu_list; lpdu != NULL; lpdu = la_list_next(lpdu), i++) {
+						msg_summary_extract(lpdu->data, &summaries[i]);
 					}
+				} else {
+					decoding_status = DECODING_FAILURE;
 				}
-			} else if(fmtr->intype == FMTR_INTYPE_RAW_FRAME) {
-				struct octet_string *serialized_msg = fmtr->td->format_raw_msg(q->metadata, q->pdu);
-				if(serialized_msg != NULL) {
-					output_qentry_t qentry = {
-						.msg = serialized_msg,
-						.metadata = q->metadata,
-						.format = fmtr->td->output_format
-					};
-					la_list_foreach(fmtr->outputs, output_queue_push, &qentry);
-					// output_queue_push makes a copy of serialized_msg, so it's safe to free it now
-					octet_string_destroy(serialized_msg);
+			}
+			if(decoding_status == DECODING_SUCCESS) {
+				int32_t i = 0;
+				for(la_list *lpdu = lpdu_list; lpdu != NULL; lpdu = la_list_next(lpdu), i++) {
+					ASSERT(lpdu->data != NULL);
+					struct octet_string *serialized_msg = fmtr->td->format_decoded_msg(q->metadata, lpdu->data,
+							&summaries[i]);
+					// First check if the formatter actually returned something.
+					// A formatter might be suitable only for a particular message type. If this is the case.
+					// it will return NULL for all messages it cannot handle.
+					// An example is pp_acars which only deals with ACARS messages.
+					if(serialized_msg != NULL) {
+						output_qentry_t qentry = {
+							.msg = serialized_msg,
+							.metadata = q->metadata,
+							.format = fmtr->td->output_format
+						};
+						la_list_foreach(fmtr->outputs, output_queue_push, &qentry);
+						// output_queue_push makes a copy of serialized_msg, so it's safe to free it now
+						octet_string_destroy(serialized_msg);
+					}
 				}
 			}
+		} else if(fmtr->intype == FMTR_INTYPE_RAW_FRAME) {
+			struct octet_string *serialized_msg = fmtr->td->format_raw_msg(q->metadata, q->pdu);
+			if(serialized_msg != NULL) {
+				output_qentry_t qentry = {
+					.msg = serialized_msg,
+					.metadata = q->metadata,
+					.format = fmtr->td->output_format
+				};
+				la_list_foreach(fmtr->outputs, output_queue_push, &qentry);
+				// output_queue_push makes a copy of serialized_msg, so it's safe to free it now
+				octet_string_destroy(serialized_msg);
+			}
 		}
-		la_list_free_full(lpdu_list, la_proto_tree_destroy);
-		lpdu_list = NULL;
-		octet_string_destroy(q->pdu);
-		XFREE(q->metadata);
-		XFREE(q);
 	}
-	la_reasm_ctx_destroy(reasm_ctx);
+	la_list_free_full(lpdu_list, la_proto_tree_destroy);
+	XFREE(summaries);
+	octet_string_destroy(q->pdu);
+	XFREE(q->metadata);
+	XFREE(q);
+	return true;
+}
+
+// Sets the list of formatters and computes how deep the PDUs need to be
+// decoded to satisfy all of them
+static void fmtr_list_set(la_list *list) {
+	fmtr_list = list;
+	decode_level = PDU_DECODE_HEADERS;
+	for(la_list *p = fmtr_list; p != NULL; p = la_list_next(p)) {
+		fmtr_instance_t *fmtr = p->data;
+		if(fmtr->intype == FMTR_INTYPE_DECODED_FRAME && fmtr->td->decode_level > decode_level) {
+			decode_level = fmtr->td->decode_level;
+		}
+	}
+	debug_print(D_PROTO, "decode_level: %d\n", decode_level);
+}
+
+static void *pdu_decoder_thread(void *ctx) {
+	UNUSED(ctx);
+	struct hfdl_pdu_qentry *q = NULL;
+	do {
+		q = g_async_queue_pop(pdu_decoder_queue);
+	} while(pdu_decoder_process(q));
+	// Before clearing the running flag, which the main thread waits for
+	// before writing the run statistics
+	runstats_stage_thread_done(RUNSTATS_STAGE_PDU);
 	pdu_decoder_thread_active = false;
 	return NULL;
 }
@@ -2,7 +2,9 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <libacars/list.h>          // la_list
 #include "metadata.h"               // struct metadata
+#include "ac_data.h"                // ac_data
 #include "util.h"                   // struct octet string
 
 struct hfdl_pdu_metadata {
@@ -22,6 +24,16 @@ enum hfdl_pdu_direction {
 	DOWNLINK_PDU = 1
 };
 
+// How deep the PDU decoder goes, depending on what the active formatters use.
+// Link layer headers are always decoded, as they keep the aircraft cache
+// up to date. Decoding ACARS (including all applications carried in it)
+// is the most expensive part, so it is done only when needed.
+enum hfdl_pdu_decode_level {
+	PDU_DECODE_HEADERS = 0,     // MPDU, LPDU and HFNPDU only
+	PDU_DECODE_POSITIONS = 1,   // additionally ACARS messages which may carry a position
+	PDU_DECODE_FULL = 2
+};
+
 // Useful fields extracted from MPDU/SPDU header or PDU metadata
 // that need to be passed down below the MPDU layer
 struct hfdl_pdu_hdr_data {
@@ -29,11 +41,14 @@ struct hfdl_pdu_hdr_data {
 	uint8_t src_id;         // GS ID for uplinks, AC ID for downlinks
 	uint8_t dst_id;         // AC ID for uplinks, GS ID for downlinks
 	enum hfdl_pdu_direction direction;
+	enum hfdl_pdu_decode_level decode_level;
 	bool crc_ok;
 };
 
 void hfdl_pdu_decoder_init(void);
 int32_t hfdl_pdu_decoder_start(void *ctx);
+bool hfdl_pdu_decoder_step(void *ctx);
+void hfdl_pdu_decoder_reconfigure(la_list *new_fmtr_list, ac_data *new_ac_data);
 void hfdl_pdu_decoder_stop(void);
 bool hfdl_pdu_decoder_is_running(void);
 bool hfdl_pdu_fcs_check(uint8_t *buf, uint32_t hdr_len);
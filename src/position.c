@@ -2,50 +2,19 @@
 #include <math.h>                       // fabsf
 #include <time.h>
 #include <errno.h>
-#include <libacars/libacars.h>          // la_proto_node
 #include "position.h"
-#include "lpdu.h"                       // lpdu_position_info_extract
 #include "util.h"
 
 /******************************
  * Forward declarations
  ******************************/
 
-bool location_is_valid(struct location *loc);
-void fixup_timestamp(struct timestamp *ts);
+static void date_yesterday(struct tm *now, struct tm *result);
 
 /******************************
  * Public methods
  ******************************/
 
-struct position_info *position_info_create(void) {
-	NEW(struct position_info, pos_info);
-	return pos_info;
-}
-
-struct position_info *position_info_extract(la_proto_node *tree) {
-	ASSERT(tree);
-
-	struct position_info *pos_info = lpdu_position_info_extract(tree);
-	if(pos_info != NULL && location_is_valid(&pos_info->position.location)) {
-		fixup_timestamp(&pos_info->position.timestamp);
-	} else {
-		position_info_destroy(pos_info);
-		pos_info = NULL;
-	}
-	return pos_info;
-}
-
-void position_info_destroy(struct position_info *pos_info) {
-	XFREE(pos_info);
-}
-
-/****************************************
- * Private variables and methods
- ****************************************/
-
-static void date_yesterday(struct tm *now, struct tm *result);
-
 bool location_is_valid(struct location *loc) {
 	ASSERT(loc);
 
@@ -117,6 +86,10 @@ void fixup_timestamp(struct timestamp *ts) {
 			tm_pos.tm_hour, tm_pos.tm_min, tm_pos.tm_sec, t_pos);
 }
 
+/****************************************
+ * Private variables and methods
+ ****************************************/
+
 // Computes the date of the previous day
 // Only tm_yday, tm_mon and tm_mday fields are valid in the result.
 static void date_yesterday(struct tm *now, struct tm *result) {
@@ -3,16 +3,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <time.h>                   // struct tm
-#include <libacars/libacars.h>      // la_proto_node
 #include "util.h"                   // struct location
 
-struct ac_info {
-	char *flight_id;
-	uint32_t icao_address;
-	bool flight_id_present;
-	bool icao_address_present;
-};
-
 struct timestamp {
 	time_t t;
 	struct tm tm;
@@ -28,11 +20,5 @@ struct position {
 	struct location location;
 };
 
-struct position_info {
-	struct ac_info aircraft;
-	struct position position;
-};
-
-struct position_info *position_info_create(void);
-struct position_info *position_info_extract(la_proto_node *tree);
-void position_info_destroy(struct position_info *pos_info);
+bool location_is_valid(struct location *loc);
+void fixup_timestamp(struct timestamp *ts);
@@ -0,0 +1,277 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                          // fprintf, snprintf
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>                         // strdup, strcmp, memcpy
+#include <inttypes.h>                       // PRIu64
+#include <time.h>                           // time_t
+#include <libacars/libacars.h>              // la_proto_node, la_proto_tree_find_acars
+#include <libacars/acars.h>                 // la_acars_parse_and_reassemble, la_acars_msg
+#include <libacars/reassembly.h>            // la_reasm_ctx_*
+#include <libacars/hash.h>                  // la_hash_*
+#include "reasm.h"
+#include "statsd.h"                         // statsd_*
+#include "util.h"                           // NEW, XREALLOC, XFREE, ASSERT, debug_print
+
+// Estimated size of an empty reassembly context and its bookkeeping
+#define REASM_ENTRY_OVERHEAD 512
+// How often to look for timed out entries (seconds)
+#define REASM_EXPIRATION_INTERVAL 60
+// Message direction + aircraft registration
+#define REASM_KEY_LEN 8
+// ACARS message label + message sequence number without the block letter
+#define REASM_MSG_KEY_LEN 5
+
+enum reasm_dir {
+	REASM_UPLINK = 0,
+	REASM_DOWNLINK = 1,
+	REASM_DIR_CNT
+};
+
+#define REASM_MSG_DIR(dir) ((dir) == REASM_DOWNLINK ? LA_MSG_DIR_AIR2GND : LA_MSG_DIR_GND2AIR)
+
+static char const *reasm_dir_names[REASM_DIR_CNT] = {
+	[REASM_UPLINK] = "uplink",
+	[REASM_DOWNLINK] = "downlink"
+};
+
+struct reasm_entry {
+	struct reasm_entry *prev, *next;    // LRU list, most recently used first
+	char *key;
+	la_reasm_ctx *ctx;
+	char (*pending)[REASM_MSG_KEY_LEN + 1];     // incomplete messages
+	uint32_t pending_cnt, pending_alloc;
+	size_t pending_bytes;               // size of fragments of incomplete messages
+	time_t last_seen;
+	enum reasm_dir dir;
+};
+
+// Counts of multiblock ACARS messages
+struct reasm_stats {
+	uint64_t completed;
+	uint64_t timed_out;
+	uint64_t evicted;
+	uint32_t in_progress;
+};
+
+struct reasm_mgr {
+	la_hash *entries;
+	struct reasm_entry *head, *tail;
+	size_t size;                        // estimated size of all entries
+	size_t max_size;
+	time_t timeout;
+	time_t last_expiration_time;
+	struct reasm_stats stats[REASM_DIR_CNT];
+};
+
+/******************************
+ * Forward declarations
+ ******************************/
+
+static void reasm_entry_destroy(void *data);
+static void reasm_key_destroy(void *key);
+static void reasm_mgr_expire(reasm_mgr m, time_t now);
+
+/******************************
+ * Public methods
+ ******************************/
+
+// max_size is given in kilobytes, timeout in seconds
+reasm_mgr reasm_mgr_create(size_t max_size, int32_t timeout) {
+	NEW(struct reasm_mgr, m);
+	m->entries = la_hash_new(la_hash_key_str, la_hash_compare_keys_str,
+			reasm_key_destroy, reasm_entry_destroy);
+	m->max_size = max_size * 1024;
+	m->timeout = timeout;
+	return m;
+}
+
+static void lru_unlink(reasm_mgr m, struct reasm_entry *e) {
+	if(e->prev != NULL) {
+		e->prev->next = e->next;
+	} else {
+		m->head = e->next;
+	}
+	if(e->next != NULL) {
+		e->next->prev = e->prev;
+	} else {
+		m->tail = e->prev;
+	}
+	e->prev = e->next = NULL;
+}
+
+static void lru_push_front(reasm_mgr m, struct reasm_entry *e) {
+	e->prev = NULL;
+	e->next = m->head;
+	if(m->head != NULL) {
+		m->head->prev = e;
+	} else {
+		m->tail = e;
+	}
+	m->head = e;
+}
+
+static int32_t reasm_pending_find(struct reasm_entry const *e, char const *msg_key) {
+	for(uint32_t i = 0; i < e->pending_cnt; i++) {
+		if(strcmp(e->pending[i], msg_key) == 0) {
+			return (int32_t)i;
+		}
+	}
+	return -1;
+}
+
+static void reasm_pending_add(reasm_mgr m, struct reasm_entry *e, char const *msg_key) {
+	if(reasm_pending_find(e, msg_key) >= 0) {
+		return;
+	}
+	if(e->pending_cnt == e->pending_alloc) {
+		e->pending_alloc = e->pending_alloc > 0 ? 2 * e->pending_alloc : 4;
+		e->pending = XREALLOC(e->pending, e->pending_alloc * sizeof(e->pending[0]));
+	}
+	snprintf(e->pending[e->pending_cnt++], sizeof(e->pending[0]), "%s", msg_key);
+	m->stats[e->dir].in_progress++;
+}
+
+// Returns true if the message has been in progress
+static bool reasm_pending_remove(reasm_mgr m, struct reasm_entry *e, char const *msg_key) {
+	int32_t i = reasm_pending_find(e, msg_key);
+	if(i < 0) {
+		return false;
+	}
+	memcpy(e->pending[i], e->pending[--e->pending_cnt], sizeof(e->pending[0]));
+	m->stats[e->dir].in_progress--;
+	return true;
+}
+
+// Removes the entry together with the reassembly context.
+// Incomplete messages are counted as evicted or timed out.
+static void reasm_entry_drop(reasm_mgr m, struct reasm_entry *e, bool evicted) {
+	if(e->pending_cnt > 0) {
+		debug_print(D_PROTO, "%s: %s, dropping %u incomplete messages (%zu bytes)\n",
+				e->key, evicted ? "evicted" : "timed out", e->pending_cnt, e->pending_bytes);
+	}
+	for(uint32_t i = 0; i < e->pending_cnt; i++) {
+		if(evicted) {
+			m->stats[e->dir].evicted++;
+			statsd_increment_per_msgdir(REASM_MSG_DIR(e->dir), "acars.reasm.evicted");
+		} else {
+			m->stats[e->dir].timed_out++;
+			statsd_increment_per_msgdir(REASM_MSG_DIR(e->dir), "acars.reasm.timed_out");
+		}
+	}
+	m->stats[e->dir].in_progress -= e->pending_cnt;
+	e->pending_cnt = 0;
+	m->size -= e->pending_bytes;
+	e->pending_bytes = 0;
+	lru_unlink(m, e);
+	m->size -= REASM_ENTRY_OVERHEAD;
+	la_hash_remove(m->entries, e->key);
+}
+
+la_proto_node *reasm_mgr_acars_parse(reasm_mgr m, uint8_t *buf, uint32_t len,
+		la_msg_dir msg_dir, struct timeval rx_timestamp) {
+	ASSERT(m != NULL);
+	ASSERT(buf != NULL);
+	// Mode + aircraft registration
+	if(len < 8) {
+		return la_acars_parse_and_reassemble(buf, len, msg_dir, NULL, rx_timestamp);
+	}
+	reasm_mgr_expire(m, rx_timestamp.tv_sec);
+
+	enum reasm_dir dir = msg_dir == LA_MSG_DIR_AIR2GND ? REASM_DOWNLINK : REASM_UPLINK;
+	char key[REASM_KEY_LEN + 1];
+	snprintf(key, sizeof(key), "%c%.7s", dir == REASM_DOWNLINK ? 'D' : 'U', (char *)buf + 1);
+	struct reasm_entry *e = la_hash_lookup(m->entries, key);
+	if(e == NULL) {
+		e = XCALLOC(1, sizeof(struct reasm_entry));
+		e->key = strdup(key);
+		e->ctx = la_reasm_ctx_new();
+		e->dir = dir;
+		la_hash_insert(m->entries, e->key, e);
+		m->size += REASM_ENTRY_OVERHEAD;
+	} else {
+		lru_unlink(m, e);
+	}
+	lru_push_front(m, e);
+	e->last_seen = rx_timestamp.tv_sec;
+
+	la_proto_node *node = la_acars_parse_and_reassemble(buf, len, msg_dir, e->ctx, rx_timestamp);
+	la_proto_node *acars_node = la_proto_tree_find_acars(node);
+	if(acars_node != NULL) {
+		la_acars_msg const *amsg = acars_node->data;
+		// Fragments of a message share the label and the sequence number,
+		// except for the trailing block letter
+		char msg_key[REASM_MSG_KEY_LEN + 1];
+		snprintf(msg_key, sizeof(msg_key), "%.2s%.3s", amsg->label, amsg->msg_num);
+		if(amsg->err == false && amsg->reasm_status == LA_REASM_IN_PROGRESS) {
+			reasm_pending_add(m, e, msg_key);
+			e->pending_bytes += len;
+			m->size += len;
+		} else if(amsg->err == false && amsg->reasm_status == LA_REASM_COMPLETE) {
+			m->stats[dir].completed++;
+			reasm_pending_remove(m, e, msg_key);
+			if(e->pending_cnt == 0) {
+				// Fragment sizes are not tracked per message
+				m->size -= e->pending_bytes;
+				e->pending_bytes = 0;
+			}
+		}
+	}
+	// Keep within the size limit, but never evict the aircraft we've just heard
+	while(m->size > m->max_size && m->tail != NULL && m->tail != e) {
+		reasm_entry_drop(m, m->tail, true);
+	}
+	statsd_set("acars.reasm.size", m->size);
+	return node;
+}
+
+void reasm_mgr_print_stats(reasm_mgr m) {
+	if(m == NULL) {
+		return;
+	}
+	for(int32_t i = 0; i < REASM_DIR_CNT; i++) {
+		struct reasm_stats const *s = &m->stats[i];
+		uint64_t finished = s->completed + s->timed_out + s->evicted;
+		fprintf(stderr, "ACARS reassembly (%s): multiblock messages: %" PRIu64 " completed, "
+				"%" PRIu64 " timed out, %" PRIu64 " evicted, %u in progress (hit rate: %.1f%%)\n",
+				reasm_dir_names[i], s->completed, s->timed_out, s->evicted, s->in_progress,
+				finished > 0 ? 100.0 * (double)s->completed / (double)finished : 0.0);
+	}
+	fprintf(stderr, "ACARS reassembly: %zu kB used out of %zu kB\n", m->size / 1024, m->max_size / 1024);
+}
+
+void reasm_mgr_destroy(reasm_mgr m) {
+	if(m != NULL) {
+		la_hash_destroy(m->entries);
+		XFREE(m);
+	}
+}
+
+/****************************************
+ * Private variables and methods
+ ****************************************/
+
+// Entries are ordered by the time they have been used last,
+// so timed out ones are at the tail of the LRU list
+static void reasm_mgr_expire(reasm_mgr m, time_t now) {
+	if(m->last_expiration_time + REASM_EXPIRATION_INTERVAL > now) {
+		return;
+	}
+	m->last_expiration_time = now;
+	while(m->tail != NULL && m->tail->last_seen + m->timeout < now) {
+		reasm_entry_drop(m, m->tail, false);
+	}
+}
+
+static void reasm_entry_destroy(void *data) {
+	struct reasm_entry *e = data;
+	if(e != NULL) {
+		la_reasm_ctx_destroy(e->ctx);
+		XFREE(e->pending);
+		XFREE(e);
+	}
+}
+
+static void reasm_key_destroy(void *key) {
+	XFREE(key);
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>                     // size_t
+#include <sys/time.h>                   // struct timeval
+#include <libacars/libacars.h>          // la_proto_node, la_msg_dir
+
+// ACARS reassembly manager.
+//
+// libacars keeps fragments of multiblock ACARS messages (and of MIAM
+// messages carried in them) in a reassembly context until the message is
+// complete or its fragments time out. The manager gives each aircraft
+// a separate context and bounds the estimated total size of all contexts.
+// When the limit is exceeded, contexts of the least recently heard aircraft
+// are evicted together with their incomplete messages. Contexts of aircraft
+// which have not been heard for longer than the timeout are destroyed, too.
+// Statistics count multiblock ACARS messages. MIAM fragments are kept in
+// the same contexts and are subject to the same limits, but they are not
+// counted separately.
+
+#define REASM_MAX_SIZE_DEFAULT 8192         // kB
+#define REASM_TIMEOUT_DEFAULT 600           // seconds
+
+typedef struct reasm_mgr *reasm_mgr;
+
+reasm_mgr reasm_mgr_create(size_t max_size, int32_t timeout);
+la_proto_node *reasm_mgr_acars_parse(reasm_mgr m, uint8_t *buf, uint32_t len,
+		la_msg_dir msg_dir, struct timeval rx_timestamp);
+void reasm_mgr_print_stats(reasm_mgr m);
+void reasm_mgr_destroy(reasm_mgr m);
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                  // fopen, fprintf
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>               // PRIu64
+#include <string.h>                 // strerror
+#include <errno.h>                  // errno
+#include <stdatomic.h>              // atomic_*
+#include <time.h>                   // clock_gettime
+#include <sys/resource.h>           // getrusage
+#include "runstats.h"
+#include "util.h"                   // ASSERT
+
+static _Atomic uint64_t Counters[RUNSTATS_COUNTER_CNT];
+static _Atomic uint64_t Stage_time_ns[RUNSTATS_STAGE_CNT];
+static struct timespec Start_time;
+
+static char const *counter_names[RUNSTATS_COUNTER_CNT] = {
+	[RUNSTATS_INPUT_SAMPLES] = "input_samples",
+	[RUNSTATS_FRAMES_GOOD] = "frames_good",
+	[RUNSTATS_FRAMES_BAD_FCS] = "frames_bad_fcs",
+	[RUNSTATS_LPDUS_GOOD] = "lpdus_good",
+	[RUNSTATS_LPDUS_BAD_FCS] = "lpdus_bad_fcs"
+};
+
+static char const *stage_names[RUNSTATS_STAGE_CNT] = {
+	[RUNSTATS_STAGE_INPUT] = "input",
+	[RUNSTATS_STAGE_FFT] = "fft",
+	[RUNSTATS_STAGE_CHANNEL] = "channel",
+	[RUNSTATS_STAGE_PDU] = "pdu",
+	[RUNSTATS_STAGE_OUTPUT] = "output"
+};
+
+static uint64_t timespec_ns(struct timespec const *ts) {
+	return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+static double timeval_sec(struct timeval const *tv) {
+	return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+void runstats_add(enum runstats_counter counter, uint64_t value) {
+	ASSERT(counter < RUNSTATS_COUNTER_CNT);
+	atomic_fetch_add_explicit(&Counters[counter], value, memory_order_relaxed);
+}
+
+// Called by a stage thread just before it returns
+void runstats_stage_thread_done(enum runstats_stage stage) {
+	ASSERT(stage < RUNSTATS_STAGE_CNT);
+	struct timespec now;
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+		atomic_fetch_add_explicit(&Stage_time_ns[stage], timespec_ns(&now), memory_order_relaxed);
+	}
+}
+
+// Adds CPU time used by the calling thread since *since to the given stage
+// and advances *since. Used when several stages run in one thread.
+void runstats_stage_time_add(enum runstats_stage stage, struct timespec *since) {
+	ASSERT(stage < RUNSTATS_STAGE_CNT);
+	ASSERT(since != NULL);
+	struct timespec now;
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+		atomic_fetch_add_explicit(&Stage_time_ns[stage], timespec_ns(&now) - timespec_ns(since),
+				memory_order_relaxed);
+		*since = now;
+	}
+}
+
+void runstats_start(void) {
+	clock_gettime(CLOCK_MONOTONIC, &Start_time);
+}
+
+// input_cnt is the number of inputs fed with the same signal
+// (2 with diversity reception), so that input_seconds is the duration
+// of the recording and not the sum over all inputs.
+bool runstats_write(char const *file, int32_t sample_rate, int32_t input_cnt) {
+	ASSERT(file != NULL);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	struct rusage ru;
+	if(getrusage(RUSAGE_SELF, &ru) != 0) {
+		fprintf(stderr, "getrusage() failed: %s\n", strerror(errno));
+		return false;
+	}
+	FILE *f = fopen(file, "w");
+	if(f == NULL) {
+		fprintf(stderr, "Could not write run statistics to %s: %s\n", file, strerror(errno));
+		return false;
+	}
+	uint64_t samples = atomic_load(&Counters[RUNSTATS_INPUT_SAMPLES]);
+	double input_sec = sample_rate > 0 && input_cnt > 0 ?
+		(double)samples / (double)sample_rate / (double)input_cnt : 0.0;
+	double cpu_sec = timeval_sec(&ru.ru_utime) + timeval_sec(&ru.ru_stime);
+	uint64_t lpdus = atomic_load(&Counters[RUNSTATS_LPDUS_GOOD]);
+
+	fprintf(f, "{\n");
+	for(int32_t i = 0; i < RUNSTATS_COUNTER_CNT; i++) {
+		fprintf(f, "  \"%s\": %" PRIu64 ",\n", counter_names[i], atomic_load(&Counters[i]));
+	}
+	fprintf(f, "  \"input_sec\": %.3f,\n", input_sec);
+	fprintf(f, "  \"wall_sec\": %.3f,\n", (double)(timespec_ns(&now) - timespec_ns(&Start_time)) / 1e9);
+	fprintf(f, "  \"cpu_sec\": %.3f,\n", cpu_sec);
+	fprintf(f, "  \"cpu_sec_per_input_sec\": %.6f,\n", input_sec > 0.0 ? cpu_sec / input_sec : 0.0);
+	fprintf(f, "  \"lpdus_per_cpu_sec\": %.3f,\n", cpu_sec > 0.0 ? (double)lpdus / cpu_sec : 0.0);
+	// kilobytes on Linux
+	fprintf(f, "  \"peak_rss_kb\": %ld,\n", ru.ru_maxrss);
+	fprintf(f, "  \"stage_cpu_sec\": {");
+	for(int32_t i = 0; i < RUNSTATS_STAGE_CNT; i++) {
+		fprintf(f, "%s\"%s\": %.3f", i > 0 ? ", " : " ", stage_names[i],
+				(double)atomic_load(&Stage_time_ns[i]) / 1e9);
+	}
+	fprintf(f, " }\n}\n");
+	bool result = (fclose(f) == 0);
+	if(!result) {
+		fprintf(stderr, "Could not write run statistics to %s: %s\n", file, strerror(errno));
+	}
+	return result;
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>                   // struct timespec
+
+// Decoding yield and resource usage of the whole run.
+//
+// Counters are updated unconditionally (it's a relaxed atomic add per frame
+// or per batch of samples). CPU time of each processing stage is taken from
+// the thread CPU clock when the stage thread exits, or around each step in
+// deterministic mode. The summary is written in JSON on exit when
+// --run-stats-file is given, to be compared between builds by
+// extras/yield_harness.py.
+
+enum runstats_counter {
+	RUNSTATS_INPUT_SAMPLES = 0,
+	RUNSTATS_FRAMES_GOOD,
+	RUNSTATS_FRAMES_BAD_FCS,
+	RUNSTATS_LPDUS_GOOD,
+	RUNSTATS_LPDUS_BAD_FCS,
+	RUNSTATS_COUNTER_CNT
+};
+
+enum runstats_stage {
+	RUNSTATS_STAGE_INPUT = 0,   // reading and sample format conversion
+	RUNSTATS_STAGE_FFT,
+	RUNSTATS_STAGE_CHANNEL,     // channelizer, demodulator and FEC (sum over channels)
+	RUNSTATS_STAGE_PDU,         // PDU decoder and formatters
+	RUNSTATS_STAGE_OUTPUT,
+	RUNSTATS_STAGE_CNT
+};
+
+void runstats_add(enum runstats_counter counter, uint64_t value);
+void runstats_stage_thread_done(enum runstats_stage stage);
+void runstats_stage_time_add(enum runstats_stage stage, struct timespec *since);
+void runstats_start(void);
+bool runstats_write(char const *file, int32_t sample_rate, int32_t input_cnt);
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>               // PRIu64
+#include <math.h>                   // fabs, round
+#include "slot_clock.h"
+#include "util.h"                   // ASSERT, debug_print
+
+// TDMA frame index is a 12-bit counter
+#define FRAME_INDEX_MASK 0xFFFu
+// Maximum difference between the predicted and the actual SPDU position
+// (in slots) for the update to be treated as a correction rather than a relock
+#define MAX_PHASE_ERR_SLOTS 0.1
+// Weight of a new frame length measurement
+#define FRAME_LEN_AVG_WEIGHT 0.25
+// Maximum relative deviation of the frame length from the nominal value
+#define MAX_FRAME_LEN_DEV 1e-3
+// The clock is considered unlocked when no SPDU has been received
+// for this number of TDMA frames
+#define LOCK_TIMEOUT_FRAMES 4
+
+void slot_clock_init(struct slot_clock *sc, int32_t freq, uint32_t sample_rate) {
+	ASSERT(sc != NULL);
+	sc->freq = freq;
+	sc->sample_rate = sample_rate;
+	sc->frame_len = (double)sample_rate * HFDL_TDMA_FRAME_LEN_SEC;
+	sc->ref_sample = 0.0;
+	sc->ref_index = 0;
+	sc->last_update = 0;
+	sc->locked = false;
+}
+
+// Called for each SPDU received. frame_start is the position of the first
+// sample of the SPDU frame (the beginning of its prekey).
+void slot_clock_update(struct slot_clock *sc, uint64_t frame_start, uint32_t frame_index) {
+	ASSERT(sc != NULL);
+	double nominal_frame_len = (double)sc->sample_rate * HFDL_TDMA_FRAME_LEN_SEC;
+	double slot_len = sc->frame_len / HFDL_TDMA_SLOTS_PER_FRAME;
+	if(sc->locked) {
+		uint32_t frame_cnt = (frame_index - sc->ref_index) & FRAME_INDEX_MASK;
+		double elapsed = (double)frame_start - sc->ref_sample;
+		double err = elapsed - frame_cnt * sc->frame_len;
+		if(frame_cnt > 0 && fabs(err) < MAX_PHASE_ERR_SLOTS * slot_len) {
+			double measured_frame_len = elapsed / frame_cnt;
+			sc->frame_len = (1.0 - FRAME_LEN_AVG_WEIGHT) * sc->frame_len + FRAME_LEN_AVG_WEIGHT * measured_frame_len;
+			if(fabs(sc->frame_len / nominal_frame_len - 1.0) > MAX_FRAME_LEN_DEV) {
+				sc->frame_len = nominal_frame_len;
+			}
+			debug_print(D_DSP, "%d: frame_index: %u (+%u) phase error: %.1f samples, frame_len: %.2f\n",
+					sc->freq, frame_index, frame_cnt, err, sc->frame_len);
+		} else if(frame_cnt > 0) {
+			debug_print(D_DSP, "%d: frame_index: %u (+%u) phase error too large (%.1f samples), relocking\n",
+					sc->freq, frame_index, frame_cnt, err);
+			sc->frame_len = nominal_frame_len;
+		}
+	} else {
+		debug_print(D_DSP, "%d: locked at sample %" PRIu64 ", frame_index: %u\n", sc->freq, frame_start, frame_index);
+	}
+	sc->ref_sample = (double)frame_start;
+	sc->ref_index = frame_index;
+	sc->last_update = frame_start;
+	sc->locked = true;
+}
+
+// Returns true if the clock has been updated recently enough to be trusted.
+bool slot_clock_is_locked(struct slot_clock *sc, uint64_t now) {
+	ASSERT(sc != NULL);
+	if(sc->locked && now > sc->last_update + (uint64_t)(LOCK_TIMEOUT_FRAMES * sc->frame_len)) {
+		debug_print(D_DSP, "%d: no SPDU for %d frames, unlocked\n", sc->freq, LOCK_TIMEOUT_FRAMES);
+		sc->locked = false;
+	}
+	return sc->locked;
+}
+
+// Returns true if a frame starting at the given sample would start
+// within +/- window samples from a slot boundary.
+bool slot_clock_in_window(struct slot_clock const *sc, uint64_t frame_start, uint32_t window) {
+	ASSERT(sc != NULL);
+	double slot_len = sc->frame_len / HFDL_TDMA_SLOTS_PER_FRAME;
+	double elapsed = (double)frame_start - sc->ref_sample;
+	double err = elapsed - round(elapsed / slot_len) * slot_len;
+	return fabs(err) <= (double)window;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// HFDL TDMA slot clock.
+// HFDL ground stations divide time into 32-second frames of 13 slots and
+// transmit a squitter (SPDU) at the start of each frame. All transmissions on
+// the channel start at slot boundaries. The slot clock is locked to the
+// positions of received SPDUs (in the channel sample clock) and predicts
+// where subsequent slots begin.
+
+#define HFDL_TDMA_FRAME_LEN_SEC 32
+#define HFDL_TDMA_SLOTS_PER_FRAME 13
+
+struct slot_clock {
+	double frame_len;           // TDMA frame length, in samples
+	double ref_sample;          // start of the most recent SPDU frame
+	uint64_t last_update;       // sample clock at the most recent update
+	uint32_t ref_index;         // TDMA frame index of the most recent SPDU
+	uint32_t sample_rate;
+	int32_t freq;               // channel frequency (for debugging)
+	bool locked;
+};
+
+void slot_clock_init(struct slot_clock *sc, int32_t freq, uint32_t sample_rate);
+void slot_clock_update(struct slot_clock *sc, uint64_t frame_start, uint32_t frame_index);
+bool slot_clock_is_locked(struct slot_clock *sc, uint64_t now);
+bool slot_clock_in_window(struct slot_clock const *sc, uint64_t frame_start, uint32_t window);
@@ -5,10 +5,13 @@
 #include "pdu.h"                    // struct hfdl_pdu_hdr_data, hfdl_pdu_fcs_check
 #include "spdu.h"
 #include "statsd.h"                 // statsd_*
+#include "runstats.h"               // runstats_add
 #include "util.h"                   // NEW, ASSERT, struct octet_string, freq_list_format_text, gs_id_format_text
 #include "crc.h"                    // crc16_ccitt
 
 #define SPDU_LEN 66
+#define SPDU_FRAME_INDEX(buf) ((buf)[2] | (((buf)[3] & 0xF) << 8))
+#define SPDU_FRAME_OFFSET(buf) ((buf)[3] >> 4)
 #define GS_STATUS_CNT 3
 
 struct gs_status {
@@ -35,6 +38,20 @@ struct hfdl_spdu {
 la_type_descriptor const proto_DEF_hfdl_spdu;
 static void gs_status_format_text(la_vstring *vstr, int32_t indent, struct gs_status const *gs);
 
+// Extracts TDMA frame timing fields from a raw frame without decoding it.
+// Returns false if the frame is not a valid SPDU.
+bool spdu_frame_timing_get(uint8_t *buf, size_t len, uint32_t *frame_index, uint8_t *frame_offset) {
+	ASSERT(buf);
+	ASSERT(frame_index);
+	ASSERT(frame_offset);
+	if(len < SPDU_LEN || (buf[0] & 1) != 0 || !hfdl_pdu_fcs_check(buf, 64u)) {
+		return false;
+	}
+	*frame_index = SPDU_FRAME_INDEX(buf);
+	*frame_offset = SPDU_FRAME_OFFSET(buf);
+	return true;
+}
+
 la_list *spdu_parse(struct octet_string *pdu, int32_t freq) {
 #ifndef WITH_STATSD
 	UNUSED(freq);
@@ -60,8 +77,10 @@ la_list *spdu_parse(struct octet_string *pdu, int32_t freq) {
 	if(hfdl_pdu_fcs_check(pdu->buf, 64u)) {
 		spdu->header.crc_ok = true;
 		statsd_increment_per_channel(freq, "frames.good");
+		runstats_add(RUNSTATS_FRAMES_GOOD, 1);
 	} else {
 		statsd_increment_per_channel(freq, "frame.errors.bad_fcs");
+		runstats_add(RUNSTATS_FRAMES_BAD_FCS, 1);
 		goto end;
 	}
 	uint8_t *buf = pdu->buf;
@@ -74,8 +93,8 @@ la_list *spdu_parse(struct octet_string *pdu, int32_t freq) {
 	spdu->iso8208_supported = buf[0] & 0x20;
 	spdu->change_note = (buf[0] & 0xC0) >> 6;
 
-	spdu->frame_index = buf[2] | ((buf[3] & 0xF) << 8);
-	spdu->frame_offset = buf[3] >> 4;
+	spdu->frame_index = SPDU_FRAME_INDEX(buf);
+	spdu->frame_offset = SPDU_FRAME_OFFSET(buf);
 
 	spdu->min_priority = buf[52] & 0xF;
 	spdu->systable_version = buf[53] | ((buf[54] & 0xF) << 8);
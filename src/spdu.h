@@ -1,7 +1,10 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>                 // size_t
 #include <libacars/list.h>          // la_list
 #include "util.h"                   // struct octet_string
 
 la_list *spdu_parse(struct octet_string *pdu, int32_t freq);
+bool spdu_frame_timing_get(uint8_t *buf, size_t len, uint32_t *frame_index, uint8_t *frame_offset);
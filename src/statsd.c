@@ -18,6 +18,7 @@ static char const *counters_per_channel[] = {
 	"demod.preamble.A2_found",
 	"demod.preamble.M1_found",
 	"demod.preamble.errors.M1_not_found",
+	"demod.stalls",
 	"frame.errors.bad_fcs",
 	"frame.errors.too_short",
 	"frame.dir.air2gnd",
@@ -39,6 +40,8 @@ static char const *counters_per_msgdir[] = {
 	"acars.reasm.duplicate",
 	"acars.reasm.out_of_seq",
 	"acars.reasm.invalid_args",
+	"acars.reasm.timed_out",
+	"acars.reasm.evicted",
 	NULL
 };
 
@@ -141,6 +144,15 @@ void statsd_gauge_set(char *gauge, size_t value) {
 	statsd_gauge(statsd, gauge, value);
 }
 
+void statsd_gauge_per_channel_set(int32_t freq, char *gauge, size_t value) {
+	if(statsd == NULL) {
+		return;
+	}
+	char metric[256];
+	snprintf(metric, sizeof(metric), "channels.%d.%s", freq, gauge);
+	statsd_gauge(statsd, metric, value);
+}
+
 void statsd_timing_delta_per_channel_send(int32_t freq, char *timer, struct timeval ts) {
 	if(statsd == NULL) {
 		return;
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <libacars/libacars.h>          // la_proto_node
+#include "summary.h"
+#include "position.h"                   // location_is_valid, fixup_timestamp
+#include "lpdu.h"                       // lpdu_summarize
+#include "hfnpdu.h"                     // hfnpdu_summarize
+#include "acars.h"                      // acars_summarize
+#include "ac_cache.h"                   // ac_cache_entry_lookup
+#include "globals.h"                    // AC_cache, AC_cache_lock, AC_cache_unlock
+#include "util.h"                       // ASSERT, debug_print
+
+// Looks up the ICAO address of the aircraft in the AC cache
+static void icao_address_lookup(struct msg_summary *summary) {
+	AC_cache_lock();
+	struct ac_cache_entry *entry = ac_cache_entry_lookup(AC_cache, summary->ac_freq, summary->ac_id);
+	if(entry != NULL) {
+		summary->icao_address = entry->icao_address;
+		summary->icao_address_present = true;
+		debug_print(D_MISC, "icao_address: %06X (from cache)\n", summary->icao_address);
+	}
+	AC_cache_unlock();
+}
+
+void msg_summary_extract(la_proto_node *tree, struct msg_summary *summary) {
+	ASSERT(summary);
+
+	*summary = (struct msg_summary){
+		.lpdu_type = -1,
+		.hfnpdu_type = -1
+	};
+	// Each of these picks up fields from nodes of its own type only
+	for(la_proto_node *node = tree; node != NULL; node = node->next) {
+		lpdu_summarize(node, summary);
+		hfnpdu_summarize(node, summary);
+		acars_summarize(node, summary);
+	}
+	if(summary->position_present == false) {
+		return;
+	}
+	// Only positions need the ICAO address, so the AC cache is not
+	// consulted for other messages
+	if(summary->icao_address_present == false && summary->ac_id_present) {
+		icao_address_lookup(summary);
+	}
+	// Don't bother with positions in uplinks. Positions without ICAO address
+	// are incomplete, so drop them too.
+	if(summary->direction != DOWNLINK_PDU) {
+		summary->position_present = false;
+	} else if(summary->icao_address_present == false) {
+		debug_print(D_MISC, "position (%f, %f) incomplete: unknown icao_address\n",
+				summary->position.location.lat, summary->position.location.lon);
+		summary->position_present = false;
+	} else if(location_is_valid(&summary->position.location) == false) {
+		summary->position_present = false;
+	} else {
+		fixup_timestamp(&summary->position.timestamp);
+	}
+}
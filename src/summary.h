@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <libacars/libacars.h>          // la_proto_node
+#include "pdu.h"                        // enum hfdl_pdu_direction
+#include "position.h"                   // struct position
+
+// Frequently used fields of a decoded message, extracted with a single pass
+// over its protocol tree right after decoding. Formatters and other consumers
+// read them from here instead of searching the tree on their own.
+// The summary does not point into the tree, so it may be freely copied.
+
+#define SUMMARY_FLIGHT_ID_LEN 8
+
+// Link statistics from a Performance Data HFNPDU, summed over all bit rates
+struct msg_perf_data {
+	uint32_t mpdus_rx;
+	uint32_t mpdus_rx_errs;
+	uint32_t mpdus_tx;
+	uint32_t mpdus_delivered;
+	uint16_t spdus_rx;
+	uint16_t spdus_rx_errs;
+	uint16_t freq_search_cnt;                   // cumulative over the current flight leg
+	uint8_t flight_leg;
+	uint8_t gs_id;
+	uint8_t freq_id;
+};
+
+struct msg_summary {
+	struct position position;                   // downlink position of a known aircraft
+	struct msg_perf_data perf_data;
+	uint32_t icao_address;
+	int32_t ac_freq;                            // channel where ac_id is valid
+	int32_t lpdu_type;                          // -1 if there is no LPDU
+	int32_t hfnpdu_type;                        // -1 if there is no HFNPDU
+	enum hfdl_pdu_direction direction;
+	uint8_t gs_id;
+	uint8_t ac_id;
+	char flight_id[SUMMARY_FLIGHT_ID_LEN + 1];
+	char acars_label[3];
+	bool lpdu_crc_ok;
+	bool acars_crc_ok;
+	bool icao_address_present;
+	bool flight_id_present;
+	bool position_present;
+	bool perf_data_present;
+	bool gs_id_present;
+	bool ac_id_present;
+	bool acars_present;
+};
+
+void msg_summary_extract(la_proto_node *tree, struct msg_summary *summary);
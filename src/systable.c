@@ -1,13 +1,18 @@
+#include <stdio.h>                  // fprintf, snprintf, rename, remove
 #include <stdint.h>
 #include <stdbool.h>
-#include <string.h>                 // strdup
+#include <string.h>                 // strdup, strerror
+#include <errno.h>                  // errno
 #include <math.h>                   // fabs
+#include <pthread.h>                // pthread_*
+#include <glib.h>                   // GAsyncQueue, g_async_queue_*
 #include <libconfig.h>              // config_*
 #include <libacars/libacars.h>      // la_proto_node
 #include <libacars/dict.h>          // la_dict_*
 #include <libacars/list.h>          // la_list
 #include "systable.h"
-#include "util.h"                   // NEW, XFREE, struct location, parse_coordinate
+#include "globals.h"                // Config, Systable_lock, Systable_unlock
+#include "util.h"                   // NEW, XFREE, struct location, parse_coordinate, stop_thread
 
 enum systable_err_code {
 	ST_ERR_OK = 0,
@@ -24,6 +29,7 @@ enum systable_err_code {
 	ST_ERR_STATION_COORDINATE_WRONG_TYPE,
 	ST_ERR_FREQUENCIES_MISSING,
 	ST_ERR_FREQUENCY_WRONG_TYPE,
+	ST_ERR_SAVEFILE_RENAME,
 	ST_ERR_MAX
 };
 
@@ -80,6 +86,10 @@ static la_dict const systable_error_messages[] = {
 		.id = ST_ERR_FREQUENCY_WRONG_TYPE,
 		.val = "frequency setting has wrong type (must be a number)"
 	},
+	{
+		.id = ST_ERR_SAVEFILE_RENAME,
+		.val = "could not replace the save file with the temporary file"
+	},
 	{
 		.id = 0,
 		.val = NULL
@@ -88,6 +98,8 @@ static la_dict const systable_error_messages[] = {
 
 #define STATION_ID_MAX 127
 #define SYSTABLE_VERSION_MAX 4095
+// Number of PDU sets of different versions which may be reassembled at the same time
+#define SYSTABLE_PDU_SET_SLOTS 4
 
 // Parameters of a single ground station
 // as decoded from a System table PDU set
@@ -125,18 +137,35 @@ struct systable_err {
 struct _systable {
 	config_t cfg;                                           // system table as a libconfig object
 	config_setting_t const *stations[STATION_ID_MAX+1];     // quick access to GS params (indexed by GS ID)
-	struct systable_pdu_set *pdu_set;                       // System Table PDUs received from ground stations
 	char *savefile_path;                                    // where to save updated table
 	struct systable_err err;                                // diagnostics for the last operation
 	bool available;                                         // is this system table ready to use
 };
 
 // Main system table object
+//
+// PDU sets are reassembled and decoded by the PDU decoder thread. When a set
+// contains a newer table than the current one, its copy is handed over to
+// the persistence thread which generates the new configuration, validates it,
+// writes it to the savefile and finally publishes it by replacing
+// the current table while holding Systable_lock. This way disk I/O never
+// stalls frame decoding. The current table is replaced only by the
+// persistence thread, so it may read it without locking.
 struct systable {
-	struct _systable *current, *new;
+	struct _systable *current;
+	struct systable_pdu_set *pdu_sets[SYSTABLE_PDU_SET_SLOTS];  // PDU decoder thread only, indexed by version
+	int32_t queued_version;                                 // PDU decoder thread only
+	GAsyncQueue *persist_queue;
+	pthread_t persist_th;
+	bool persist_th_active;
 	struct systable_err err;                                // diagnostics for the last operation
 };
 
+// Persistence thread work item
+struct systable_persist_job {
+	struct systable_decoding_result *result;                // NULL = stop the thread
+};
+
 /******************************
  * Forward declarations
  ******************************/
@@ -145,12 +174,17 @@ la_type_descriptor proto_DEF_systable_decoding_result;
 static bool systable_validate(struct _systable *st);
 static bool systable_populate_stations_cache(struct _systable *st);
 static bool systable_is_newer(int32_t v_old, int32_t v_new);
-static bool systable_generate_config(config_t *cfg, struct systable_decoding_result *result);
+static bool systable_generate_config(config_t *cfg, struct systable_decoding_result const *result);
 static bool systable_save_config(struct _systable *st);
 static struct _systable *_systable_create(char const *savefile);
 static struct systable_pdu_set *pdu_set_create(uint8_t len);
 static struct systable_decoding_result *systable_decode(uint8_t *buf, uint32_t len);
+static struct systable_decoding_result *systable_decoding_result_copy(struct systable_decoding_result const *result);
+static void systable_decoding_result_destroy(void *data);
 static void systable_copy_station_names(config_t *dst, config_setting_t const **stations);
+static void systable_persist(systable *st, struct systable_decoding_result const *result);
+static void *systable_persist_thread(void *ctx);
+static char const *systable_err_text(struct systable_err const *err);
 static void pdu_set_destroy(struct systable_pdu_set *ps);
 
 /******************************
@@ -160,7 +194,8 @@ static void pdu_set_destroy(struct systable_pdu_set *ps);
 systable *systable_create(char const *savefile) {
 	NEW(systable, st);
 	st->current = _systable_create(savefile);
-	st->new = _systable_create(savefile);
+	st->queued_version = -1;
+	st->persist_queue = g_async_queue_new();
 	return st;
 }
 
@@ -177,7 +212,7 @@ bool systable_read_from_file(systable *st, char const *file) {
 	if(result) {
 		result &= systable_populate_stations_cache(st->current);
 	}
-	// If there was an error, then propagate it up from st->new to st,
+	// If there was an error, then propagate it up from st->current to st,
 	// so that systable_error_text() can return the correct error message.
 	if(!result) {
 		st->err = st->current->err;
@@ -190,11 +225,7 @@ char const *systable_error_text(systable const *st) {
 	if(st == NULL) {
 		return NULL;
 	}
-	ASSERT(st->err.code < ST_ERR_MAX);
-	if(st->err.code == ST_ERR_LIBCONFIG) {
-		return config_error_text(st->err.cfg);
-	}
-	return la_dict_search(systable_error_messages, st->err.code);
+	return systable_err_text(&st->err);
 }
 
 int32_t systable_file_error_line(systable const *st) {
@@ -269,20 +300,33 @@ void _systable_destroy(struct _systable *st) {
 	}
 }
 
+// Tables queued for saving are written out before the persistence
+// thread terminates. Must not be called with Systable_lock held,
+// as the thread may need it to publish the last table.
 void systable_destroy(systable *st) {
 	if(st != NULL) {
+		if(st->persist_th_active) {
+			NEW(struct systable_persist_job, job);
+			g_async_queue_push(st->persist_queue, job);
+			stop_thread(st->persist_th);
+		}
+		g_async_queue_unref(st->persist_queue);
+		for(int32_t i = 0; i < SYSTABLE_PDU_SET_SLOTS; i++) {
+			pdu_set_destroy(st->pdu_sets[i]);
+		}
 		_systable_destroy(st->current);
-		_systable_destroy(st->new);
 		XFREE(st);
 	}
 }
 
-void systable_store_pdu(systable const *st, int16_t version, uint8_t idx,
+// Called by the PDU decoder thread only - does not require Systable_lock.
+void systable_store_pdu(systable *st, int16_t version, uint8_t idx,
 		uint8_t pdu_set_len, uint8_t *buf, uint32_t buf_len) {
-	if(st == NULL || pdu_set_len < 1 || idx >= pdu_set_len) {
+	if(st == NULL || version < 0 || pdu_set_len < 1 || idx >= pdu_set_len) {
 		return;
 	}
-	struct systable_pdu_set *ps = st->new->pdu_set;
+	struct systable_pdu_set **slot = &st->pdu_sets[version % SYSTABLE_PDU_SET_SLOTS];
+	struct systable_pdu_set *ps = *slot;
 	// If we have some PDUs stored already but the version or the PDU set
 	// length do not match, then ditch the old PDU set and start over.
 	if(ps != NULL && (ps->version != version || ps->len != pdu_set_len)) {
@@ -293,7 +337,7 @@ void systable_store_pdu(systable const *st, int16_t version, uint8_t idx,
 	}
 	// Allocate a PDU set if not done before
 	if(ps == NULL) {
-		ps = st->new->pdu_set = pdu_set_create(pdu_set_len);
+		ps = *slot = pdu_set_create(pdu_set_len);
 		ps->version = version;
 	}
 	// If there is a PDU stored already at idx and its contents is different
@@ -313,22 +357,25 @@ void systable_store_pdu(systable const *st, int16_t version, uint8_t idx,
 }
 
 // A one-shot function which:
-// - reassembles the PDU set if it's complete
+// - reassembles the PDU set of the given version if it's complete
 // - decodes the reassembled System Table message
 // - if the new system table is newer than the current one
-//   (or if there is no current one):
-//   - replaces the currently used system table with the new one
-//   - stores the new system table in the savefile, if configured to do so
+//   (or if there is no current one) and than the one queued for saving
+//   most recently, passes it to the persistence thread, which
+//   replaces the currently used system table with the new one
+//   and stores it in the savefile, if configured to do so
 // Returns the decoded system table as a la_proto_node or NULL
 // if decoding was not attempted due to incomplete PDU set.
-la_proto_node *systable_process_pdu_set(systable *st) {
-	if(st == NULL) {
+// Called by the PDU decoder thread only - does not require Systable_lock.
+la_proto_node *systable_process_pdu_set(systable *st, int16_t version) {
+	if(st == NULL || version < 0) {
 		return NULL;
 	}
 	// Check if we have a complete PDU set
 	uint32_t total_len = 0;
-	struct systable_pdu_set *ps = st->new->pdu_set;
-	if(ps != NULL && ps->len > 0 && ps->pdus != NULL) {
+	struct systable_pdu_set **slot = &st->pdu_sets[version % SYSTABLE_PDU_SET_SLOTS];
+	struct systable_pdu_set *ps = *slot;
+	if(ps != NULL && ps->version == version && ps->len > 0 && ps->pdus != NULL) {
 		for(uint8_t i = 0; i < ps->len; i++) {
 			if(ps->pdus[i] == NULL) {
 				debug_print(D_MISC, "Not ready to decode systable, PDU %hhu missing\n", i);
@@ -351,36 +398,34 @@ la_proto_node *systable_process_pdu_set(systable *st) {
 	ASSERT(result != NULL);
 	result->version = ps->version;
 
-	pdu_set_destroy(st->new->pdu_set);
-	st->new->pdu_set = NULL;
+	pdu_set_destroy(ps);
+	*slot = NULL;
 	XFREE(buf);
 
-	if(!result->err &&
-			(!systable_is_available(st) || systable_is_newer(systable_get_version(st), result->version))) {
-		debug_print(D_MISC, "Decoded systable is newer than the current one (%d > %d), updating\n",
-				result->version, systable_get_version(st));
-		config_init(&st->new->cfg);
-		if(systable_generate_config(&st->new->cfg, result)) {
-			systable_copy_station_names(&st->new->cfg, st->current->stations);
-			if(systable_save_config(st->new)) {
-				fprintf(stderr, "System table version %d saved to %s\n", result->version, st->new->savefile_path);
-			} else {
-				st->err = st->new->err;
-				fprintf(stderr, "Could not save system table to %s: %s\n", st->new->savefile_path,
-						systable_error_text(st));
+	if(!result->err) {
+		int32_t latest_version = st->queued_version;
+		if(latest_version < 0) {
+			Systable_lock();
+			latest_version = systable_get_version(st);
+			Systable_unlock();
+		}
+		if(systable_is_newer(latest_version, result->version)) {
+			debug_print(D_MISC, "Decoded systable is newer than the current one (%d > %d), updating\n",
+					result->version, latest_version);
+			st->queued_version = result->version;
+			// In deterministic mode the new table is published before decoding
+			// any subsequent PDUs, so that the output is reproducible.
+			if(!Config.deterministic && !st->persist_th_active) {
+				st->persist_th_active =
+					pthread_create(&st->persist_th, NULL, systable_persist_thread, st) == 0;
 			}
-			if(systable_populate_stations_cache(st->new)) {
-				_systable_destroy(st->current);
-				st->current = st->new;
-				st->current->available = true;
+			if(st->persist_th_active) {
+				NEW(struct systable_persist_job, job);
+				job->result = systable_decoding_result_copy(result);
+				g_async_queue_push(st->persist_queue, job);
 			} else {
-				st->err = st->new->err;
-				fprintf(stderr, "Failed to populate ground station cache: %s\n",
-						systable_error_text(st));
-				fprintf(stderr,	"Keeping the old system table\n");
-				_systable_destroy(st->new);
+				systable_persist(st, result);
 			}
-			st->new = _systable_create(st->current->savefile_path);
 		}
 	}
 
@@ -435,6 +480,71 @@ static struct _systable *_systable_create(char const *savefile) {
 	return _st;
 }
 
+static char const *systable_err_text(struct systable_err const *err) {
+	ASSERT(err->code < ST_ERR_MAX);
+	if(err->code == ST_ERR_LIBCONFIG) {
+		return config_error_text(err->cfg);
+	}
+	return la_dict_search(systable_error_messages, err->code);
+}
+
+// Builds a new table from the decoding result, validates it, saves it
+// and replaces the current table with it.
+static void systable_persist(systable *st, struct systable_decoding_result const *result) {
+	ASSERT(st);
+	ASSERT(result);
+
+	// st->current is only replaced by us, so it's safe to read it without locking
+	struct _systable *new = _systable_create(st->current->savefile_path);
+	config_init(&new->cfg);
+	if(systable_generate_config(&new->cfg, result) == false) {
+		fprintf(stderr, "Could not generate system table version %d\n", result->version);
+		goto fail;
+	}
+	systable_copy_station_names(&new->cfg, st->current->stations);
+	if(systable_validate(new) == false || systable_populate_stations_cache(new) == false) {
+		fprintf(stderr, "System table version %d is invalid: %s\n", result->version,
+				systable_err_text(&new->err));
+		fprintf(stderr,	"Keeping the old system table\n");
+		goto fail;
+	}
+	if(systable_save_config(new)) {
+		if(new->savefile_path != NULL) {
+			fprintf(stderr, "System table version %d saved to %s\n", result->version, new->savefile_path);
+		}
+	} else {
+		fprintf(stderr, "Could not save system table to %s: %s\n", new->savefile_path,
+				systable_err_text(&new->err));
+	}
+	new->available = true;
+	Systable_lock();
+	struct _systable *old = st->current;
+	st->current = new;
+	_systable_destroy(old);
+	Systable_unlock();
+	return;
+fail:
+	_systable_destroy(new);
+}
+
+static void *systable_persist_thread(void *ctx) {
+	ASSERT(ctx);
+	systable *st = ctx;
+	struct systable_persist_job *job = NULL;
+	while(true) {
+		job = g_async_queue_pop(st->persist_queue);
+		if(job->result == NULL) {
+			XFREE(job);
+			break;
+		}
+		systable_persist(st, job->result);
+		systable_decoding_result_destroy(job->result);
+		XFREE(job);
+	}
+	debug_print(D_MISC, "Exiting\n");
+	return NULL;
+}
+
 static bool systable_validate(struct _systable *st) {
 	ASSERT(st);
 
@@ -743,6 +853,19 @@ static void systable_decoding_result_destroy(void *data) {
 	XFREE(result);
 }
 
+static struct systable_decoding_result *systable_decoding_result_copy(struct systable_decoding_result const *result) {
+	ASSERT(result);
+	NEW(struct systable_decoding_result, copy);
+	copy->version = result->version;
+	copy->err = result->err;
+	for(la_list *l = result->gs_list; l != NULL; l = l->next) {
+		NEW(struct systable_gs_data, gs_data);
+		memcpy(gs_data, l->data, sizeof(struct systable_gs_data));
+		copy->gs_list = la_list_append(copy->gs_list, gs_data);
+	}
+	return copy;
+}
+
 la_type_descriptor proto_DEF_systable_decoding_result = {
 	.format_text = systable_decoding_result_format_text,
 	.destroy = systable_decoding_result_destroy
@@ -764,7 +887,7 @@ static bool systable_is_newer(int32_t v_old, int32_t v_new) {
 		v_new + SYSTABLE_VERSION_MAX - v_old < (SYSTABLE_VERSION_MAX + 1) >> 1;
 }
 
-static bool systable_generate_config(config_t *cfg, struct systable_decoding_result *result) {
+static bool systable_generate_config(config_t *cfg, struct systable_decoding_result const *result) {
 	ASSERT(result);
 	ASSERT(!result->err);
 	ASSERT(cfg);
@@ -871,13 +994,27 @@ static bool systable_save_config(struct _systable *st) {
 	if(st->savefile_path == NULL) {      // Save file path was not specified - this is not an error
 		goto success;
 	}
-	if(config_write_file(&st->cfg, st->savefile_path) == CONFIG_TRUE) {
-		goto success;
-	} else {
+	// Write to a temporary file first and rename it afterwards, so that
+	// a crash or a full disk never leaves a truncated savefile behind
+	size_t len = strlen(st->savefile_path) + sizeof(".tmp");
+	char *tmp_path = XCALLOC(len, sizeof(char));
+	snprintf(tmp_path, len, "%s.tmp", st->savefile_path);
+	if(config_write_file(&st->cfg, tmp_path) != CONFIG_TRUE) {
 		st->err.code = ST_ERR_LIBCONFIG;
 		st->err.cfg = &st->cfg;
+		remove(tmp_path);
+		XFREE(tmp_path);
+		return false;
+	}
+	if(rename(tmp_path, st->savefile_path) != 0) {
+		debug_print(D_MISC, "rename(%s, %s) failed: %s\n", tmp_path, st->savefile_path, strerror(errno));
+		st->err.code = ST_ERR_SAVEFILE_RENAME;
+		st->err.type = SYSTABLE_ERR_IO;
+		remove(tmp_path);
+		XFREE(tmp_path);
 		return false;
 	}
+	XFREE(tmp_path);
 success:
 	st->err.code = ST_ERR_OK;
 	return true;
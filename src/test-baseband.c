@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>                  // fprintf, snprintf
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>                 // memcmp, memset
+#include <unistd.h>                 // read, write, close, usleep
+#include <complex.h>
+#include <sys/socket.h>             // socket, bind, listen, accept, connect, getsockname
+#include <netinet/in.h>             // struct sockaddr_in
+#include <arpa/inet.h>              // htonl, htons, ntohs
+#include "globals.h"                // do_exit
+#include "util.h"                   // XCALLOC, XFREE, octet_string_new
+#include "pdu.h"                    // hfdl_pdu_metadata_create, hfdl_pdu_decoder_init
+#include "baseband.h"
+
+// Loopback test of the front-end <-> worker message framing.
+// Each side is tested against a peer which speaks the protocol
+// directly over a socket on the loopback interface.
+
+#define TEST_FREQ 8927000
+#define TEST_SAMPLE_CNT 540
+#define TEST_SAMPLE_CLOCK 123456789ULL
+#define WAIT_STEP_US 10000
+#define WAIT_STEPS 500
+
+static int32_t Failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		Failures++; \
+	} \
+} while(0)
+
+static bool read_full(int32_t fd, void *buf, size_t len) {
+	uint8_t *ptr = buf;
+	while(len > 0) {
+		ssize_t ret = read(fd, ptr, len);
+		if(ret <= 0) {
+			return false;
+		}
+		ptr += ret;
+		len -= (size_t)ret;
+	}
+	return true;
+}
+
+static bool write_full(int32_t fd, void const *buf, size_t len) {
+	return write(fd, buf, len) == (ssize_t)len;
+}
+
+// Returns a listening socket on a free port of the loopback interface
+static int32_t listen_loopback(uint16_t *port) {
+	int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		.sin_port = 0
+	};
+	socklen_t addr_len = sizeof(addr);
+	if(fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0 ||
+			getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+		perror("listen_loopback");
+		return -1;
+	}
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+static int32_t connect_loopback(uint16_t port) {
+	int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		.sin_port = htons(port)
+	};
+	if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		if(fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+static void samples_fill(float complex *samples) {
+	for(int32_t i = 0; i < TEST_SAMPLE_CNT; i++) {
+		samples[i] = CMPLXF((float)i, -(float)i / 2.0f);
+	}
+}
+
+// Worker: subscription, sample blocks and frames sent back to the front-end
+static void test_worker(void) {
+	uint16_t port = 0;
+	int32_t listen_fd = listen_loopback(&port);
+	CHECK(listen_fd >= 0);
+	if(listen_fd < 0) {
+		return;
+	}
+	char address[32];
+	snprintf(address, sizeof(address), "127.0.0.1:%u", port);
+	bb_client c = bb_client_connect(address);
+	CHECK(c != NULL);
+	if(c == NULL) {
+		close(listen_fd);
+		return;
+	}
+	int32_t fd = accept(listen_fd, NULL, NULL);
+	CHECK(fd >= 0);
+
+	bb_feed f = bb_client_subscribe(c, TEST_FREQ);
+	CHECK(f != NULL);
+	struct bb_msg_hdr hdr;
+	CHECK(read_full(fd, &hdr, sizeof(hdr)));
+	CHECK(hdr.magic == BB_MSG_MAGIC);
+	CHECK(hdr.type == BB_MSG_SUBSCRIBE);
+	CHECK(hdr.freq == TEST_FREQ);
+	CHECK(hdr.len == 0);
+	CHECK(bb_client_start(c) == 0);
+
+	float complex samples[TEST_SAMPLE_CNT];
+	samples_fill(samples);
+	hdr = (struct bb_msg_hdr){
+		.magic = BB_MSG_MAGIC,
+		.type = BB_MSG_SAMPLES,
+		.freq = TEST_FREQ,
+		.len = sizeof(samples),
+		.sample_cnt = TEST_SAMPLE_CLOCK
+	};
+	CHECK(write_full(fd, &hdr, sizeof(hdr)));
+	CHECK(write_full(fd, samples, sizeof(samples)));
+	struct bb_block *b = bb_feed_pop(f);
+	CHECK(b != NULL);
+	if(b != NULL) {
+		CHECK(b->sample_cnt == TEST_SAMPLE_CLOCK);
+		CHECK(b->len == TEST_SAMPLE_CNT);
+		CHECK(b->len == TEST_SAMPLE_CNT && memcmp(b->samples, samples, sizeof(samples)) == 0);
+		XFREE(b);
+	}
+
+	uint8_t data[] = { 0xde, 0xad, 0xbe, 0xef, 0x01, 0x02, 0x03 };
+	struct metadata *m = hfdl_pdu_metadata_create();
+	struct hfdl_pdu_metadata *hm = container_of(m, struct hfdl_pdu_metadata, metadata);
+	hm->version = 1;
+	hm->freq = TEST_FREQ;
+	hm->freq_err_hz = 1.5f;
+	hm->rssi = -60.0f;
+	hm->noise_floor = -80.0f;
+	hm->bit_rate = 1800;
+	hm->slot = 'D';
+	m->rx_timestamp.tv_sec = 1600000000;
+	m->rx_timestamp.tv_usec = 250000;
+	uint8_t *copy = XCALLOC(sizeof(data), sizeof(uint8_t));
+	memcpy(copy, data, sizeof(data));
+	bb_feed_send_pdu(f, m, octet_string_new(copy, sizeof(data)));
+
+	CHECK(read_full(fd, &hdr, sizeof(hdr)));
+	CHECK(hdr.magic == BB_MSG_MAGIC);
+	CHECK(hdr.type == BB_MSG_FRAME);
+	CHECK(hdr.freq == TEST_FREQ);
+	CHECK(hdr.len == sizeof(struct bb_frame_info) + sizeof(data));
+	if(hdr.len == sizeof(struct bb_frame_info) + sizeof(data)) {
+		struct bb_frame_info info;
+		uint8_t rcvd[sizeof(data)];
+		CHECK(read_full(fd, &info, sizeof(info)));
+		CHECK(read_full(fd, rcvd, sizeof(rcvd)));
+		CHECK(info.tv_sec == 1600000000);
+		CHECK(info.tv_usec == 250000);
+		CHECK(info.freq_err_hz == 1.5f);
+		CHECK(info.rssi == -60.0f);
+		CHECK(info.noise_floor == -80.0f);
+		CHECK(info.bit_rate == 1800);
+		CHECK(info.version == 1);
+		CHECK(info.slot == 'D');
+		CHECK(memcmp(rcvd, data, sizeof(data)) == 0);
+	}
+
+	// Front-end going away must wake up the channel
+	close(fd);
+	CHECK(bb_feed_pop(f) == NULL);
+	for(int32_t i = 0; i < WAIT_STEPS && bb_client_is_running(c); i++) {
+		usleep(WAIT_STEP_US);
+	}
+	CHECK(bb_client_is_running(c) == false);
+	bb_client_destroy(c);
+	close(listen_fd);
+	// Set by the client thread when the connection is lost
+	do_exit = 0;
+}
+
+// Front-end: subscription and sample blocks sent to the worker
+static void test_front_end(void) {
+	// Find a free port
+	uint16_t port = 0;
+	int32_t tmp_fd = listen_loopback(&port);
+	CHECK(tmp_fd >= 0);
+	if(tmp_fd < 0) {
+		return;
+	}
+	close(tmp_fd);
+	char port_str[8];
+	snprintf(port_str, sizeof(port_str), "%u", port);
+	bb_server s = bb_server_create(port_str);
+	CHECK(s != NULL);
+	if(s == NULL) {
+		return;
+	}
+	int32_t fd = connect_loopback(port);
+	CHECK(fd >= 0);
+
+	float complex samples[TEST_SAMPLE_CNT];
+	samples_fill(samples);
+	// Nobody has subscribed yet
+	CHECK(bb_server_send(s, TEST_FREQ, TEST_SAMPLE_CLOCK, samples, TEST_SAMPLE_CNT) == false);
+	struct bb_msg_hdr hdr = {
+		.magic = BB_MSG_MAGIC,
+		.type = BB_MSG_SUBSCRIBE,
+		.freq = TEST_FREQ
+	};
+	CHECK(write_full(fd, &hdr, sizeof(hdr)));
+	bool subscribed = false;
+	for(int32_t i = 0; i < WAIT_STEPS && !subscribed; i++) {
+		usleep(WAIT_STEP_US);
+		subscribed = bb_server_send(s, TEST_FREQ, TEST_SAMPLE_CLOCK, samples, TEST_SAMPLE_CNT);
+	}
+	CHECK(subscribed);
+	if(subscribed) {
+		float complex rcvd[TEST_SAMPLE_CNT];
+		CHECK(read_full(fd, &hdr, sizeof(hdr)));
+		CHECK(hdr.magic == BB_MSG_MAGIC);
+		CHECK(hdr.type == BB_MSG_SAMPLES);
+		CHECK(hdr.freq == TEST_FREQ);
+		CHECK(hdr.sample_cnt == TEST_SAMPLE_CLOCK);
+		CHECK(hdr.len == sizeof(rcvd));
+		CHECK(hdr.len == sizeof(rcvd) && read_full(fd, rcvd, sizeof(rcvd)) &&
+				memcmp(rcvd, samples, sizeof(samples)) == 0);
+	}
+	close(fd);
+	do_exit = 1;
+	bb_server_destroy(s);
+}
+
+int32_t main(void) {
+	// Frames received by the front-end are queued for the PDU decoder
+	hfdl_pdu_decoder_init();
+	test_worker();
+	test_front_end();
+	if(Failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", Failures);
+		return 1;
+	}
+	fprintf(stderr, "All checks passed\n");
+	return 0;
+}
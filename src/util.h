@@ -91,6 +91,7 @@
 #define UNUSED(x) (void)(x)
 #define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
 #define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
 #define EOL(x) la_vstring_append_sprintf((x), "%s", "\n")
 #define HZ_TO_KHZ(f) ((f) / 1000.0)
 
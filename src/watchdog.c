@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>                  // fprintf
+#include <unistd.h>                 // sleep, usleep
+#include <stdatomic.h>              // atomic_*
+#include <pthread.h>                // pthread_t
+#include <libacars/list.h>          // la_list
+#include "block.h"                  // block_*
+#include "globals.h"                // do_exit
+#include "util.h"                   // NEW, ASSERT, XFREE, start_thread
+#include "watchdog.h"
+
+struct watchdog {
+	struct block **blocks;      // owned by the caller; entries are replaced on respawn
+	size_t block_cnt;
+	int32_t timeout;
+	watchdog_respawn_fun respawn;
+	watchdog_destroy_fun destroy;
+	la_list *retired;           // detached blocks, freed when their threads exit
+	pthread_t thread;
+	_Atomic bool stop;
+	_Atomic bool running;
+};
+
+static void *watchdog_thread(void *ctx) {
+	ASSERT(ctx != NULL);
+	struct watchdog *wd = ctx;
+	while(!atomic_load(&wd->stop) && do_exit == 0) {
+		sleep(1);
+		for(size_t i = 0; i < wd->block_cnt; i++) {
+			struct block *stalled = wd->blocks[i];
+			if(block_detach_if_stalled(stalled, wd->timeout) == false) {
+				continue;
+			}
+			// The producer and the other consumers are now waiting for
+			// the stalled block at the barrier. The new instance starts
+			// with a barrier wait, so it joins them in the right phase.
+			struct block *block = wd->respawn(stalled);
+			if(block == NULL || block_start(block) != 1) {
+				fprintf(stderr, "Could not restart a stalled block, exiting\n");
+				do_exit = 1;
+				break;
+			}
+			wd->blocks[i] = block;
+			wd->retired = la_list_append(wd->retired, stalled);
+		}
+	}
+	atomic_store(&wd->running, false);
+	return NULL;
+}
+
+watchdog watchdog_create(int32_t timeout, size_t block_cnt, struct block *blocks[block_cnt],
+		watchdog_respawn_fun respawn, watchdog_destroy_fun destroy) {
+	ASSERT(timeout > 0);
+	ASSERT(blocks != NULL);
+	ASSERT(respawn != NULL);
+	ASSERT(destroy != NULL);
+	NEW(struct watchdog, wd);
+	wd->blocks = blocks;
+	wd->block_cnt = block_cnt;
+	wd->timeout = timeout;
+	wd->respawn = respawn;
+	wd->destroy = destroy;
+	atomic_init(&wd->stop, false);
+	atomic_init(&wd->running, true);
+	if(start_thread(&wd->thread, watchdog_thread, wd) != 0) {
+		XFREE(wd);
+		return NULL;
+	}
+	return wd;
+}
+
+// Waits for the watchdog thread to exit. The block array is not
+// modified after this function returns.
+void watchdog_stop(watchdog wd) {
+	if(wd == NULL) {
+		return;
+	}
+	atomic_store(&wd->stop, true);
+	while(atomic_load(&wd->running)) {
+		usleep(100000);
+	}
+}
+
+void watchdog_destroy(watchdog wd) {
+	if(wd == NULL) {
+		return;
+	}
+	watchdog_stop(wd);
+	for(la_list *l = wd->retired; l != NULL; l = la_list_next(l)) {
+		struct block *block = l->data;
+		// Blocks which are still stuck can't be freed safely
+		if(!block_is_running(block)) {
+			wd->destroy(block);
+		}
+	}
+	la_list_free(wd->retired);
+	XFREE(wd);
+}
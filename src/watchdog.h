@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>                 // size_t
+#include "block.h"                  // struct block
+
+// Watches consumers of a one2many connection. A consumer which has been
+// busy with the same buffer for too long would block the producer and all
+// other consumers forever, so it gets detached and replaced with a new
+// instance created by the respawn callback.
+
+#define WATCHDOG_TIMEOUT_DEFAULT 30     // seconds
+
+typedef struct watchdog *watchdog;
+typedef struct block *(*watchdog_respawn_fun)(struct block *stalled);
+typedef void (*watchdog_destroy_fun)(struct block *block);
+
+watchdog watchdog_create(int32_t timeout, size_t block_cnt, struct block *blocks[block_cnt],
+		watchdog_respawn_fun respawn, watchdog_destroy_fun destroy);
+void watchdog_stop(watchdog wd);
+void watchdog_destroy(watchdog wd);